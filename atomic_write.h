@@ -0,0 +1,413 @@
+#ifndef ATOMIC_WRITE_H
+#define ATOMIC_WRITE_H
+
+// syncfs、copy_file_range、mkostemp需要，本头文件须在其他系统头文件之前包含
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/*
+ * 原子替换文件：写同目录临时文件 -> 数据落盘 -> rename覆盖目标 -> fsync目录
+ * 读者要么看到旧文件、要么看到完整的新文件；掉电后也不会出现空文件或半个文件。
+ * 临时文件优先用O_TMPFILE创建（提交前没有名字，进程崩溃不会遗留垃圾文件），
+ * 提交时linkat出名字再rename；文件系统不支持时退回mkstemp。
+ * 目标已存在时沿用其权限位。
+ *
+ * 组提交（aw_group）：多个线程并发提交时，第一个到达者成为leader，取走队列中
+ * 全部待提交文件，依次rename、每个目录只fsync一次，然后唤醒这一批的所有提交者；
+ * leader忙时到达的提交者排队进入下一批。并发越高，每次提交分摊的fsync越少。
+ * 数据落盘屏障二选一（aw_group_init的参数）：
+ *   - 各提交者入队前自己fdatasync：并发的fdatasync在ext4/xfs上会合并进同一次
+ *     日志提交，不能放到leader里串行做；
+ *   - leader对每个文件系统做一次syncfs：会把同一文件系统上其他进程的脏数据一并
+ *     刷盘，繁忙的文件系统上不一定划算。
+ */
+
+typedef struct aw_temp {
+    int fd;
+    int anonymous;                    // O_TMPFILE创建，尚未linkat出名字
+    dev_t dev;
+    char path[PATH_MAX];              // 目标文件
+    char tmp[PATH_MAX + 32];          // 临时文件名（anonymous时在提交时生成）
+    // 组提交使用
+    struct aw_temp *next;
+    int done;
+    int err;
+} aw_temp;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    aw_temp *head, **tail;
+    int flushing;                     // 有leader正在提交
+    int use_syncfs;
+    // 统计
+    uint64_t commits;
+    uint64_t batches;
+    uint64_t barriers;                // syncfs/fdatasync次数
+    uint64_t dir_syncs;
+} aw_group;
+
+static inline int aw_write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;         // 被信号中断则重试
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 取路径所在目录
+static inline void aw_dirname(const char *path, char *dir, size_t size) {
+    const char *slash = strrchr(path, '/');
+    if (!slash)
+        snprintf(dir, size, ".");
+    else if (slash == path)
+        snprintf(dir, size, "/");
+    else
+        snprintf(dir, size, "%.*s", (int)(slash - path), path);
+}
+
+static inline int aw_fsync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    int ret = fsync(fd);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return ret;
+}
+
+// named非0时不用O_TMPFILE，临时文件一开始就有名字（t->tmp）
+static inline int aw_temp_create(aw_temp *t, const char *path, mode_t mode, int named) {
+    memset(t, 0, sizeof(*t));
+    if (strlen(path) + 8 > sizeof(t->path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(t->path, path);
+    struct stat st;
+    if (stat(path, &st) == 0)
+        mode = st.st_mode & 07777;
+
+    char dir[PATH_MAX];
+    aw_dirname(path, dir, sizeof(dir));
+#ifdef O_TMPFILE
+    t->fd = named ? -1 : open(dir, O_TMPFILE | O_WRONLY | O_CLOEXEC, mode);
+    if (t->fd != -1) {
+        t->anonymous = 1;
+    } else if (!named && errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL) {
+        return -1;
+    } else
+#endif
+    {
+        snprintf(t->tmp, sizeof(t->tmp), "%s.XXXXXX", path);
+        if ((t->fd = mkostemp(t->tmp, O_CLOEXEC)) == -1)
+            return -1;
+    }
+    // O_TMPFILE的mode受umask影响，mkstemp固定为0600，统一显式设置
+    if (fchmod(t->fd, mode) == -1 || fstat(t->fd, &st) == -1) {
+        int saved = errno;
+        close(t->fd);
+        if (!t->anonymous)
+            unlink(t->tmp);
+        errno = saved;
+        return -1;
+    }
+    t->dev = st.st_dev;
+    return 0;
+}
+
+/**
+ * 在目标文件所在目录创建临时文件，调用者随后向t->fd写入新内容
+ * @param mode  目标不存在时新文件的权限
+ * @return 成功返回0，失败返回-1并设置errno
+ */
+static inline int aw_temp_open(aw_temp *t, const char *path, mode_t mode) {
+    return aw_temp_create(t, path, mode, 0);
+}
+
+/**
+ * 同aw_temp_open，但临时文件有名字（t->tmp），供只能按路径打开文件的库使用
+ * （如sqlite）；通过其他fd写入的内容同样由提交时对t->fd的fdatasync落盘
+ */
+static inline int aw_temp_open_named(aw_temp *t, const char *path, mode_t mode) {
+    return aw_temp_create(t, path, mode, 1);
+}
+
+// 放弃临时文件
+static inline void aw_temp_abort(aw_temp *t) {
+    if (t->fd != -1)
+        close(t->fd);
+    if (!t->anonymous && t->tmp[0])
+        unlink(t->tmp);
+    t->fd = -1;
+}
+
+// 内容已落盘后：给匿名临时文件起名字并rename覆盖目标（不fsync目录）
+static inline int aw_temp_publish(aw_temp *t) {
+    if (t->anonymous) {
+        static unsigned seq;
+        char proc[64];
+        snprintf(proc, sizeof(proc), "/proc/self/fd/%d", t->fd);
+        for (int i = 0;; i++) {
+            snprintf(t->tmp, sizeof(t->tmp), "%s.%ld.%u", t->path, (long)getpid(),
+                     __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED));
+            if (linkat(AT_FDCWD, proc, AT_FDCWD, t->tmp, AT_SYMLINK_FOLLOW) == 0)
+                break;
+            if (errno != EEXIST || i == 16) {
+                t->tmp[0] = '\0';
+                return -1;
+            }
+        }
+        t->anonymous = 0;
+    }
+    if (rename(t->tmp, t->path) == -1)
+        return -1;
+    t->tmp[0] = '\0';
+    return 0;
+}
+
+/**
+ * 单独提交：fdatasync、rename、fsync目录，临时文件随之关闭
+ * @return 成功返回0，失败返回-1并设置errno
+ *         （只有目录fsync失败时目标已被替换，但不保证掉电后仍在）
+ */
+static inline int aw_temp_commit(aw_temp *t) {
+    char dir[PATH_MAX];
+    aw_dirname(t->path, dir, sizeof(dir));
+    if (fdatasync(t->fd) == -1 || aw_temp_publish(t) == -1) {
+        int saved = errno;
+        aw_temp_abort(t);
+        errno = saved;
+        return -1;
+    }
+    close(t->fd);
+    t->fd = -1;
+    return aw_fsync_dir(dir);
+}
+
+/* ---------------- 组提交 ---------------- */
+
+static inline void aw_group_init(aw_group *g, int use_syncfs) {
+    memset(g, 0, sizeof(*g));
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->cond, NULL);
+    g->tail = &g->head;
+    g->use_syncfs = use_syncfs;
+}
+
+static inline void aw_group_destroy(aw_group *g) {
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->cond);
+}
+
+// leader在锁外提交一批；各项的结果写入err
+static inline void aw_group_flush(aw_group *g, aw_temp *batch) {
+    // 1. 落盘屏障：每个文件系统一次syncfs（fdatasync模式下提交者已各自完成）
+    uint64_t barriers = 0, dir_syncs = 0;
+    for (aw_temp *t = batch; t && g->use_syncfs; t = t->next) {
+        int seen = 0;
+        for (aw_temp *p = batch; p != t && !seen; p = p->next)
+            seen = p->dev == t->dev;
+        if (seen)
+            continue;
+        barriers++;
+        if (syncfs(t->fd) == -1) {
+            // 该文件系统上本批的文件都无法确认已落盘
+            for (aw_temp *p = t; p; p = p->next)
+                if (p->dev == t->dev)
+                    p->err = errno;
+        }
+    }
+
+    // 2. 按提交顺序rename（同一目标在一批中出现多次时后者生效）
+    for (aw_temp *t = batch; t; t = t->next) {
+        if (t->err || aw_temp_publish(t) == -1) {
+            if (!t->err)
+                t->err = errno;
+            aw_temp_abort(t);
+            continue;
+        }
+        close(t->fd);
+        t->fd = -1;
+    }
+
+    // 3. 每个目录fsync一次
+    char dir[PATH_MAX], prev[PATH_MAX];
+    for (aw_temp *t = batch; t; t = t->next) {
+        if (t->err)
+            continue;
+        aw_dirname(t->path, dir, sizeof(dir));
+        int seen = 0;
+        for (aw_temp *p = batch; p != t && !seen; p = p->next) {
+            if (p->err)
+                continue;
+            aw_dirname(p->path, prev, sizeof(prev));
+            seen = strcmp(prev, dir) == 0;
+        }
+        if (seen)
+            continue;
+        dir_syncs++;
+        if (aw_fsync_dir(dir) == -1) {
+            int err = errno;
+            for (aw_temp *p = t; p; p = p->next) {
+                aw_dirname(p->path, prev, sizeof(prev));
+                if (!p->err && strcmp(prev, dir) == 0)
+                    p->err = err;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&g->lock);
+    g->barriers += barriers;
+    g->dir_syncs += dir_syncs;
+    pthread_mutex_unlock(&g->lock);
+}
+
+/**
+ * 组提交：与其他线程的并发提交合并落盘，返回时本文件已持久化
+ * @return 成功返回0，失败返回-1并设置errno（含义同aw_temp_commit）
+ */
+static inline int aw_group_commit(aw_group *g, aw_temp *t) {
+    t->next = NULL;
+    t->done = 0;
+    t->err = 0;
+    if (!g->use_syncfs && fdatasync(t->fd) == -1)
+        t->err = errno;               // 仍入队，由leader统一清理
+    pthread_mutex_lock(&g->lock);
+    if (!g->use_syncfs)
+        g->barriers++;
+    *g->tail = t;
+    g->tail = &t->next;
+    while (!t->done) {
+        if (g->flushing) {
+            pthread_cond_wait(&g->cond, &g->lock);
+            continue;
+        }
+        // 成为leader：取走整个队列（包括自己）
+        aw_temp *batch = g->head;
+        g->head = NULL;
+        g->tail = &g->head;
+        g->flushing = 1;
+        pthread_mutex_unlock(&g->lock);
+
+        aw_group_flush(g, batch);
+
+        pthread_mutex_lock(&g->lock);
+        for (aw_temp *p = batch; p; p = p->next) {
+            g->commits++;
+            p->done = 1;
+        }
+        g->batches++;
+        g->flushing = 0;
+        pthread_cond_broadcast(&g->cond);
+    }
+    pthread_mutex_unlock(&g->lock);
+    if (t->err) {
+        errno = t->err;
+        return -1;
+    }
+    return 0;
+}
+
+/* ---------------- 便捷接口 ---------------- */
+
+// g为NULL时单独提交
+static inline int aw_commit(aw_group *g, aw_temp *t) {
+    return g ? aw_group_commit(g, t) : aw_temp_commit(t);
+}
+
+/**
+ * 原子地把data写为path的全部内容
+ * @param g     组提交上下文，NULL为单独提交
+ * @param mode  目标不存在时新文件的权限
+ * @return 成功返回0，失败返回-1并设置errno
+ */
+static inline int aw_write_file(aw_group *g, const char *path, const void *data, size_t len,
+                                mode_t mode) {
+    aw_temp t;
+    if (aw_temp_open(&t, path, mode) == -1)
+        return -1;
+    if (aw_write_all(t.fd, data, len) == -1) {
+        int saved = errno;
+        aw_temp_abort(&t);
+        errno = saved;
+        return -1;
+    }
+    return aw_commit(g, &t);
+}
+
+/**
+ * 原子地用src的内容替换dst
+ * 用copy_file_range在内核内复制（支持reflink的文件系统上不复制数据块），
+ * 跨文件系统等不支持的情况退回read/write
+ * @return 成功返回0，失败返回-1并设置errno
+ */
+static inline int aw_copy_file(aw_group *g, const char *src, const char *dst) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in == -1)
+        return -1;
+    struct stat st;
+    aw_temp t;
+    if (fstat(in, &st) == -1 || aw_temp_open(&t, dst, st.st_mode & 07777) == -1) {
+        int saved = errno;
+        close(in);
+        errno = saved;
+        return -1;
+    }
+
+    int ret = 0, fallback = 0;
+    for (;;) {
+        ssize_t n;
+        if (!fallback) {
+            n = copy_file_range(in, NULL, t.fd, NULL, 1 << 30, 0);
+            if (n == -1 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                            errno == EOPNOTSUPP)) {
+                fallback = 1;
+                continue;
+            }
+        } else {
+            char buf[64 * 1024];
+            n = read(in, buf, sizeof(buf));
+            if (n > 0 && aw_write_all(t.fd, buf, n) == -1)
+                n = -1;
+        }
+        if (n == 0)
+            break;
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            ret = -1;
+            break;
+        }
+    }
+    int saved = errno;
+    close(in);
+    if (ret == -1) {
+        aw_temp_abort(&t);
+        errno = saved;
+        return -1;
+    }
+    return aw_commit(g, &t);
+}
+
+#endif
@@ -0,0 +1,384 @@
+#ifndef AUDIT_ASSEMBLER_H
+#define AUDIT_ASSEMBLER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/netlink.h>
+#include <linux/audit.h>
+
+/*
+ * 审计事件组装器
+ * 一个审计事件由多条记录组成（SYSCALL、EXECVE、CWD、PATH、PROCTITLE...），
+ * 各记录正文以 "audit(<秒>.<毫秒>:<serial>): " 开头，serial相同即属于同一事件。
+ * 组装器遍历recv缓冲区中的全部nlmsghdr，按serial放入开放寻址哈希表，
+ * 收到AUDIT_EOE或超时后把整个事件交给回调。
+ * 内存硬上限：同时组装的事件数与正文总字节数均有上限，超限时最早的事件被提前输出（evicted）。
+ */
+#define AA_MAX_RECORDS  64            // 单个事件最多保留的记录数
+
+// 以下类型定义在libaudit.h中，内核uapi头文件没有
+#ifndef AUDIT_USER_AUTH
+#define AUDIT_USER_AUTH         1100
+#define AUDIT_USER_ACCT         1101
+#define AUDIT_USER_START        1105
+#define AUDIT_USER_END          1106
+#define AUDIT_CRED_ACQ          1103
+#define AUDIT_CRED_DISP         1104
+#define AUDIT_USER_LOGIN        1112
+#endif
+#ifndef AUDIT_FIRST_EVENT
+#define AUDIT_FIRST_EVENT       1300  // 内核系统调用事件记录起始
+#endif
+#define AA_NIL          UINT32_MAX
+
+enum aa_reason {
+    AA_COMPLETE,                      // 收到EOE或单条记录事件
+    AA_TIMEOUT,                       // 超时仍未收到EOE
+    AA_EVICTED,                       // 超出内存上限被提前输出
+    AA_FLUSHED,                       // 退出时输出
+};
+
+typedef struct {
+    uint16_t type;
+    uint16_t len;                     // 正文长度（不含'\0'）
+    uint32_t off;                     // 正文在事件text中的偏移
+} aa_record;
+
+typedef struct {
+    uint64_t serial;
+    uint64_t sec;                     // 事件时间（内核记录的墙上时间）
+    uint32_t msec;
+    uint32_t nrecords;
+    uint32_t dropped;                 // 超出AA_MAX_RECORDS的记录数
+    uint32_t bytes, cap;
+    char *text;                       // 各记录正文拼接，每条以'\0'结尾
+    uint64_t first_ns;                // 首条记录到达时间（单调时钟）
+    uint32_t prev, next;              // 按到达顺序的双向链表，用于超时与淘汰
+    aa_record rec[AA_MAX_RECORDS];
+} aa_event;
+
+typedef void (*aa_emit_fn)(const aa_event *ev, enum aa_reason reason, void *arg);
+
+typedef struct {
+    uint64_t serial;
+    uint32_t idx;                     // 事件池下标，AA_NIL表示空槽
+} aa_slot;
+
+typedef struct {
+    uint64_t records;                 // 解析的记录数
+    uint64_t events;                  // 输出的事件数
+    uint64_t timeouts;
+    uint64_t evicted;
+    uint64_t dropped_records;         // 单事件记录数超限而丢弃
+    uint64_t malformed;               // 无法解析的消息
+    uint64_t orphan_eoe;              // 找不到对应事件的EOE（事件已超时或被淘汰）
+} aa_stats;
+
+typedef struct {
+    aa_slot *slots;
+    uint32_t mask;
+    aa_event *pool;                   // 事件池，下标稳定，不随哈希表删除移动
+    uint32_t *free_list;
+    uint32_t nfree, max_events;
+    uint32_t head, tail;              // 最早/最新的事件
+    size_t bytes, max_bytes;          // 组装中事件正文的总字节数及上限
+    uint64_t timeout_ns;
+    aa_emit_fn emit;
+    void *arg;
+    aa_stats stats;
+} aa_assembler;
+
+// 常见记录类型的名称
+static inline const char *aa_type_name(uint16_t type) {
+    switch (type) {
+    case AUDIT_SYSCALL:     return "SYSCALL";
+    case AUDIT_PATH:        return "PATH";
+    case AUDIT_IPC:         return "IPC";
+    case AUDIT_SOCKETCALL:  return "SOCKETCALL";
+    case AUDIT_CONFIG_CHANGE: return "CONFIG_CHANGE";
+    case AUDIT_SOCKADDR:    return "SOCKADDR";
+    case AUDIT_CWD:         return "CWD";
+    case AUDIT_EXECVE:      return "EXECVE";
+    case AUDIT_EOE:         return "EOE";
+    case AUDIT_PROCTITLE:   return "PROCTITLE";
+    case AUDIT_AVC:         return "AVC";
+    case AUDIT_USER:        return "USER";
+    case AUDIT_LOGIN:       return "LOGIN";
+    case AUDIT_USER_AUTH:   return "USER_AUTH";
+    case AUDIT_USER_ACCT:   return "USER_ACCT";
+    case AUDIT_USER_START:  return "USER_START";
+    case AUDIT_USER_END:    return "USER_END";
+    case AUDIT_CRED_ACQ:    return "CRED_ACQ";
+    case AUDIT_CRED_DISP:   return "CRED_DISP";
+    case AUDIT_USER_LOGIN:  return "USER_LOGIN";
+    case AUDIT_ANOM_ABEND:  return "ANOM_ABEND";
+    default:                return NULL;
+    }
+}
+
+// 不会跟随EOE的单条记录事件（用户态消息、守护进程消息、1700起的异常/完整性事件等）
+static inline int aa_is_standalone(uint16_t type) {
+    return type < AUDIT_FIRST_EVENT || type >= AUDIT_FIRST_KERN_ANOM_MSG;
+}
+
+/**
+ * 初始化组装器
+ * @param max_events  同时组装中的事件数上限
+ * @param max_bytes   组装中事件正文的总字节上限
+ * @param timeout_ns  未收到EOE时的最长等待时间
+ * @return 成功返回0，内存不足返回-1
+ */
+static inline int aa_init(aa_assembler *aa, uint32_t max_events, size_t max_bytes,
+                          uint64_t timeout_ns, aa_emit_fn emit, void *arg) {
+    memset(aa, 0, sizeof(*aa));
+    uint32_t cap = 16;
+    while (cap < max_events * 2)          // 装载率不超过1/2
+        cap <<= 1;
+    aa->slots = malloc(cap * sizeof(aa_slot));
+    aa->pool = calloc(max_events, sizeof(aa_event));
+    aa->free_list = malloc(max_events * sizeof(uint32_t));
+    if (!aa->slots || !aa->pool || !aa->free_list) {
+        free(aa->slots);
+        free(aa->pool);
+        free(aa->free_list);
+        return -1;
+    }
+    for (uint32_t i = 0; i < cap; i++)
+        aa->slots[i].idx = AA_NIL;
+    for (uint32_t i = 0; i < max_events; i++)
+        aa->free_list[i] = max_events - 1 - i;
+    aa->mask = cap - 1;
+    aa->nfree = aa->max_events = max_events;
+    aa->head = aa->tail = AA_NIL;
+    aa->max_bytes = max_bytes;
+    aa->timeout_ns = timeout_ns;
+    aa->emit = emit;
+    aa->arg = arg;
+    return 0;
+}
+
+static inline void aa_destroy(aa_assembler *aa) {
+    for (uint32_t i = 0; i < aa->max_events; i++)
+        free(aa->pool[i].text);
+    free(aa->slots);
+    free(aa->pool);
+    free(aa->free_list);
+    memset(aa, 0, sizeof(*aa));
+}
+
+static inline uint32_t aa_hash(uint64_t serial, uint32_t mask) {
+    return (uint32_t)((serial * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+// 查找serial所在槽位，不存在时返回应插入的空槽
+static inline uint32_t aa_probe(const aa_assembler *aa, uint64_t serial) {
+    uint32_t i = aa_hash(serial, aa->mask);
+    while (aa->slots[i].idx != AA_NIL && aa->slots[i].serial != serial)
+        i = (i + 1) & aa->mask;
+    return i;
+}
+
+// 删除槽位，后移删除法保持探测链连续
+static inline void aa_slot_remove(aa_assembler *aa, uint32_t i) {
+    aa->slots[i].idx = AA_NIL;
+    for (uint32_t j = (i + 1) & aa->mask; aa->slots[j].idx != AA_NIL; j = (j + 1) & aa->mask) {
+        uint32_t home = aa_hash(aa->slots[j].serial, aa->mask);
+        if (((j - home) & aa->mask) >= ((j - i) & aa->mask)) {
+            aa->slots[i] = aa->slots[j];
+            aa->slots[j].idx = AA_NIL;
+            i = j;
+        }
+    }
+}
+
+// 输出事件并归还到池中（保留text缓冲区供复用）
+static inline void aa_finish(aa_assembler *aa, uint32_t idx, enum aa_reason reason) {
+    aa_event *ev = &aa->pool[idx];
+    aa->emit(ev, reason, aa->arg);
+    aa->stats.events++;
+    if (reason == AA_TIMEOUT)
+        aa->stats.timeouts++;
+    else if (reason == AA_EVICTED)
+        aa->stats.evicted++;
+
+    aa_slot_remove(aa, aa_probe(aa, ev->serial));
+    if (ev->prev != AA_NIL)
+        aa->pool[ev->prev].next = ev->next;
+    else
+        aa->head = ev->next;
+    if (ev->next != AA_NIL)
+        aa->pool[ev->next].prev = ev->prev;
+    else
+        aa->tail = ev->prev;
+
+    aa->bytes -= ev->bytes;
+    // 偶发的超大事件不长期占用内存
+    if (ev->cap > 64 * 1024) {
+        free(ev->text);
+        ev->text = NULL;
+        ev->cap = 0;
+    }
+    aa->free_list[aa->nfree++] = idx;
+}
+
+// 解析 "audit(1700000000.123:4567): "，返回正文起始位置，格式不符返回NULL
+static inline const char *aa_parse_stamp(const char *p, const char *end, uint64_t *sec,
+                                         uint32_t *msec, uint64_t *serial) {
+    if (end - p < 6 || memcmp(p, "audit(", 6) != 0)
+        return NULL;
+    p += 6;
+    uint64_t v[3] = {0};
+    const char seps[3] = { '.', ':', ')' };
+    for (int i = 0; i < 3; i++) {
+        const char *start = p;
+        while (p < end && *p >= '0' && *p <= '9')
+            v[i] = v[i] * 10 + (*p++ - '0');
+        if (p == start || p >= end || *p != seps[i])
+            return NULL;
+        p++;
+    }
+    if (p < end && *p == ':')
+        p++;
+    if (p < end && *p == ' ')
+        p++;
+    *sec = v[0];
+    *msec = (uint32_t)v[1];
+    *serial = v[2];
+    return p;
+}
+
+/**
+ * 处理一条审计记录（netlink消息的负载）
+ * @param now_ns  当前单调时钟，用于超时判断
+ */
+static inline void aa_feed_record(aa_assembler *aa, uint16_t type, const char *data,
+                                  size_t len, uint64_t now_ns) {
+    uint64_t sec, serial;
+    uint32_t msec;
+    // 负载通常以'\0'结尾，计入长度的'\0'去掉
+    const char *end = data + (memchr(data, '\0', len) ? strnlen(data, len) : len);
+    const char *body = aa_parse_stamp(data, end, &sec, &msec, &serial);
+    if (!body) {
+        aa->stats.malformed++;
+        return;
+    }
+    aa->stats.records++;
+
+    uint32_t slot = aa_probe(aa, serial);
+    uint32_t idx = aa->slots[slot].idx;
+    if (type == AUDIT_EOE) {
+        if (idx == AA_NIL)
+            aa->stats.orphan_eoe++;
+        else
+            aa_finish(aa, idx, AA_COMPLETE);
+        return;
+    }
+
+    size_t blen = end - body;
+    if (blen > UINT16_MAX)
+        blen = UINT16_MAX;
+
+    if (idx == AA_NIL) {
+        // 新事件：先按上限淘汰最早的事件
+        while (aa->head != AA_NIL &&
+               (aa->nfree == 0 || aa->bytes + blen + 1 > aa->max_bytes))
+            aa_finish(aa, aa->head, AA_EVICTED);
+        if (aa->nfree == 0)
+            return;
+        idx = aa->free_list[--aa->nfree];
+        slot = aa_probe(aa, serial);      // 淘汰可能移动了槽位
+        aa->slots[slot].serial = serial;
+        aa->slots[slot].idx = idx;
+
+        aa_event *ev = &aa->pool[idx];
+        ev->serial = serial;
+        ev->sec = sec;
+        ev->msec = msec;
+        ev->nrecords = ev->dropped = ev->bytes = 0;
+        ev->first_ns = now_ns;
+        ev->next = AA_NIL;
+        ev->prev = aa->tail;
+        if (aa->tail != AA_NIL)
+            aa->pool[aa->tail].next = idx;
+        else
+            aa->head = idx;
+        aa->tail = idx;
+    } else {
+        // 已有事件追加记录：淘汰其他事件腾出空间，淘汰不到自身
+        while (aa->head != AA_NIL && aa->head != idx &&
+               aa->bytes + blen + 1 > aa->max_bytes)
+            aa_finish(aa, aa->head, AA_EVICTED);
+    }
+
+    aa_event *ev = &aa->pool[idx];
+    if (ev->nrecords >= AA_MAX_RECORDS || aa->bytes + blen + 1 > aa->max_bytes) {
+        ev->dropped++;
+        aa->stats.dropped_records++;
+    } else {
+        if (ev->bytes + blen + 1 > ev->cap) {
+            uint32_t cap = ev->cap ? ev->cap : 1024;
+            while (cap < ev->bytes + blen + 1)
+                cap *= 2;
+            char *text = realloc(ev->text, cap);
+            if (!text) {
+                ev->dropped++;
+                aa->stats.dropped_records++;
+                goto done;
+            }
+            ev->text = text;
+            ev->cap = cap;
+        }
+        aa_record *r = &ev->rec[ev->nrecords++];
+        r->type = type;
+        r->len = blen;
+        r->off = ev->bytes;
+        memcpy(ev->text + ev->bytes, body, blen);
+        ev->text[ev->bytes + blen] = '\0';
+        ev->bytes += blen + 1;
+        aa->bytes += blen + 1;
+    }
+
+done:
+    // 单条记录事件不会有EOE，直接输出（同serial已有其他记录时照常等待EOE）
+    if (aa_is_standalone(type) && ev->nrecords + ev->dropped == 1)
+        aa_finish(aa, idx, AA_COMPLETE);
+}
+
+/**
+ * 遍历recv缓冲区中的全部netlink消息
+ * 单条消息格式错误只跳过该缓冲区的剩余部分，不影响后续接收
+ */
+static inline void aa_feed_buffer(aa_assembler *aa, const void *buf, size_t len,
+                                  uint64_t now_ns) {
+    const struct nlmsghdr *nlh = buf;
+    int remain = (int)len;
+    for (; NLMSG_OK(nlh, remain); nlh = NLMSG_NEXT(nlh, remain)) {
+        if (nlh->nlmsg_type == NLMSG_NOOP || nlh->nlmsg_type == NLMSG_DONE ||
+            nlh->nlmsg_type == NLMSG_ERROR)
+            continue;
+        aa_feed_record(aa, nlh->nlmsg_type, NLMSG_DATA(nlh),
+                       nlh->nlmsg_len - NLMSG_HDRLEN, now_ns);
+    }
+    if (remain > 0)
+        aa->stats.malformed++;
+}
+
+// 输出超时的事件；按到达顺序链表从最早的开始，遇到未超时的即停止
+static inline void aa_expire(aa_assembler *aa, uint64_t now_ns) {
+    while (aa->head != AA_NIL && aa->pool[aa->head].first_ns + aa->timeout_ns <= now_ns)
+        aa_finish(aa, aa->head, AA_TIMEOUT);
+}
+
+// 最早的超时时间，没有组装中的事件返回UINT64_MAX
+static inline uint64_t aa_next_deadline(const aa_assembler *aa) {
+    return aa->head == AA_NIL ? UINT64_MAX : aa->pool[aa->head].first_ns + aa->timeout_ns;
+}
+
+// 输出全部组装中的事件（退出时调用）
+static inline void aa_flush(aa_assembler *aa) {
+    while (aa->head != AA_NIL)
+        aa_finish(aa, aa->head, AA_FLUSHED);
+}
+
+#endif // AUDIT_ASSEMBLER_H
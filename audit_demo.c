@@ -1,24 +1,563 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <linux/netlink.h>
 #include <linux/audit.h>
 
+#include "audit_assembler.h"
+#include "audit_log.h"
+#include "audit_tokenizer.h"
+#include "spsc_ring.h"
+
 //#define NETLINK_AUDIT 21  // 或通过 sys/socket.h 中的定义
 //通过NetLink做日志审计
-// Netlink 消息缓冲区大小
-#define BUFFER_SIZE 4096
+/*
+ * 三级流水线，各级之间用SPSC环传递指针，不加锁：
+ *   接收线程：recvmmsg批量收到池化的缓冲区  --buf_full-->  解析线程
+ *   解析线程：组装事件并格式化到输出块      --chunk_full--> 写出线程
+ *   写出线程：write到标准输出，或 -w 时追加到分段二进制日志（audit_log.h）
+ * 用完的缓冲区/输出块经反向的环归还。某一级变慢时反压逐级向前传递，
+ * 各级的等待计数指出瓶颈所在；主线程定期打印计数并查询内核AUDIT_GET的lost。
+ */
+// Netlink 消息缓冲区大小（单条审计消息上限MAX_AUDIT_MESSAGE_LENGTH）
+#define BUFFER_SIZE 16384
+#define RECV_BATCH          64            // 单次recvmmsg最多接收的消息数
+#define DEFAULT_POOL        4096          // 接收缓冲区池大小（2的幂）
+#define CHUNK_SIZE          (64 * 1024)   // 输出块大小
+#define CHUNK_COUNT         64            // 输出块数量（2的幂）
+#define DEFAULT_RCVBUF      (16 * 1024 * 1024)
+#define DEFAULT_TIMEOUT_MS  2000          // 等待EOE的最长时间
+#define DEFAULT_MAX_EVENTS  8192          // 同时组装中的事件数上限
+#define DEFAULT_MAX_MB      16            // 组装中事件正文的内存上限
+#define DEFAULT_STATS_SEC   10            // 统计打印间隔
+#define STAGE_POLL_MS       200           // 各线程检查退出标志的间隔
+#define DEFAULT_SEG_MB      64            // 二进制日志单段大小上限
+#define DEFAULT_SEG_SEC     3600          // 单段最长写入时间，到期封段
+
+#define STAT_ADD(x, n) __atomic_add_fetch(&(x), (n), __ATOMIC_RELAXED)
+#define STAT_GET(x)    __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+typedef struct {
+    uint32_t len;
+    char data[BUFFER_SIZE];
+} RecvBuf;
+
+typedef struct {
+    size_t len;
+    char data[CHUNK_SIZE];
+} OutChunk;
+
+// 各级计数，只由所属线程写入，主线程读取
+static struct {
+    // 接收
+    uint64_t msgs, batches, bytes_in;
+    uint64_t pool_waits;          // 缓冲区池耗尽（解析跟不上）
+    uint64_t overflows;           // ENOBUFS：内核侧已丢弃
+    uint64_t truncated;
+    // 解析（组装器统计的快照）
+    uint64_t records, events, timeouts, evicted, malformed, dropped_records;
+    uint64_t chunk_waits;         // 输出块耗尽（写出跟不上）
+    // 写出
+    uint64_t chunks, bytes_out, write_errors;
+    uint64_t sealed, deleted, recovered;  // 二进制日志段
+} st;
+
+static volatile sig_atomic_t running = 1;
+
+static struct {
+    int sock;
+    spsc_ring buf_full, buf_free;         // 接收 <-> 解析
+    spsc_ring chunk_full, chunk_free;     // 解析 <-> 写出
+    RecvBuf *bufs;
+    OutChunk *chunks;
+    OutChunk *cur;                        // 解析线程正在填充的输出块
+    aa_assembler aa;
+    int recv_done, parse_done;            // 上一级已退出（原子读写）
+    al_writer *log;                       // -w：写二进制日志而不是文本
+    int interpret;                        // -i：分词后输出，解码十六进制值
+    at_dict names;                        // 字段名驻留表（解析线程）
+    at_record tok;
+} pl;
+
+static void sigint_handler(int sig) {
+    running = 0;
+}
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ---------------- 接收线程 ---------------- */
+
+static void *recv_main(void *arg) {
+    static struct mmsghdr msgs[RECV_BATCH];
+    static struct iovec iov[RECV_BATCH];
+    RecvBuf *batch[RECV_BATCH];
+    int have = 0;
+
+    while (running) {
+        // 从池中取空闲缓冲区补满本批；池空说明解析跟不上，等待归还
+        while (have < RECV_BATCH) {
+            RecvBuf *b = spsc_pop(&pl.buf_free);
+            if (!b) {
+                if (have)
+                    break;
+                STAT_ADD(st.pool_waits, 1);
+                if (!(b = spsc_pop_wait(&pl.buf_free, STAGE_POLL_MS)))
+                    break;
+            }
+            batch[have++] = b;
+        }
+        if (have == 0)
+            continue;
+
+        struct pollfd pfd = { .fd = pl.sock, .events = POLLIN };
+        if (poll(&pfd, 1, STAGE_POLL_MS) <= 0)
+            continue;
+        for (int i = 0; i < have; i++) {
+            iov[i] = (struct iovec){ batch[i]->data, BUFFER_SIZE };
+            msgs[i].msg_hdr = (struct msghdr){ .msg_iov = &iov[i], .msg_iovlen = 1 };
+        }
+        int n = recvmmsg(pl.sock, msgs, have, MSG_DONTWAIT, NULL);
+        if (n == -1) {
+            if (errno == ENOBUFS) {
+                STAT_ADD(st.overflows, 1);
+                continue;
+            }
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            perror("recvmmsg");
+            break;
+        }
+
+        STAT_ADD(st.batches, 1);
+        STAT_ADD(st.msgs, n);
+        for (int i = 0; i < n; i++) {
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+                STAT_ADD(st.truncated, 1);
+            batch[i]->len = msgs[i].msg_len;
+            STAT_ADD(st.bytes_in, msgs[i].msg_len);
+            // 环容量不小于池大小，不会满
+            spsc_push(&pl.buf_full, batch[i]);
+        }
+        // 未用到的缓冲区留到下一批
+        memmove(batch, batch + n, (have - n) * sizeof(batch[0]));
+        have -= n;
+    }
+
+    __atomic_store_n(&pl.recv_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* ---------------- 解析线程 ---------------- */
+
+// 当前输出块交给写出线程
+static void chunk_submit(void) {
+    if (!pl.cur || pl.cur->len == 0)
+        return;
+    // 环容量等于块数量，不会满
+    spsc_push(&pl.chunk_full, pl.cur);
+    pl.cur = NULL;
+}
+
+// 保证当前输出块至少有need字节空间；没有空闲块时等待写出线程归还
+static char *chunk_reserve(size_t need) {
+    if (pl.cur && CHUNK_SIZE - pl.cur->len >= need)
+        return pl.cur->data + pl.cur->len;
+    chunk_submit();
+    if (!(pl.cur = spsc_pop(&pl.chunk_free))) {
+        STAT_ADD(st.chunk_waits, 1);
+        while (!(pl.cur = spsc_pop_wait(&pl.chunk_free, STAGE_POLL_MS)))
+            ;
+    }
+    pl.cur->len = 0;
+    return pl.cur->data;
+}
+
+#define out_printf(need, ...) do { \
+        char *p_ = chunk_reserve(need); \
+        int n_ = snprintf(p_, CHUNK_SIZE - pl.cur->len, __VA_ARGS__); \
+        pl.cur->len += n_ < (int)(CHUNK_SIZE - pl.cur->len) ? n_ : 0; \
+    } while (0)
+
+// 原样输出记录正文，只把十六进制编码的值替换为解码后的带引号字符串，
+// NUL（proctitle的参数分隔）显示为空格，其他控制字符显示为'?'
+static void print_fields(const at_record *r) {
+    size_t done = 0;
+    out_printf(2, " ");
+    for (uint32_t i = 0; i <= r->nfields; i++) {
+        const at_field *f = i < r->nfields ? &r->f[i] : NULL;
+        if (f && !at_is_hex(r, f))
+            continue;
+        size_t upto = f ? f->val_off : r->len;
+        out_printf(upto - done + 1, "%.*s", (int)(upto - done), r->text + done);
+        if (!f)
+            break;
+        size_t len = f->val_len / 2;
+        if (len > CHUNK_SIZE / 2)
+            len = CHUNK_SIZE / 2;
+        char *p = chunk_reserve(len + 2);
+        p[0] = '"';
+        at_value(r, f, p + 1, len);
+        for (size_t j = 1; j <= len; j++) {
+            if (p[j] == '\0')
+                p[j] = ' ';
+            else if ((unsigned char)p[j] < 0x20 || p[j] == 0x7f)
+                p[j] = '?';
+        }
+        p[len + 1] = '"';
+        pl.cur->len += len + 2;
+        done = f->val_off + f->val_len;
+    }
+}
+
+// 把一个完整的审计事件格式化到输出块
+static void print_event(const aa_event *ev, enum aa_reason reason, void *arg) {
+    static const char *const reasons[] = { "", " [timeout]", " [evicted]", " [flushed]" };
+    out_printf(128, "Audit Event %llu.%03u:%llu records=%u%s%s\n",
+               (unsigned long long)ev->sec, ev->msec, (unsigned long long)ev->serial,
+               ev->nrecords, ev->dropped ? " (truncated)" : "", reasons[reason]);
+    for (uint32_t i = 0; i < ev->nrecords; i++) {
+        const aa_record *r = &ev->rec[i];
+        const char *name = aa_type_name(r->type);
+        if (pl.interpret) {
+            if (name)
+                out_printf(32, "  %-10s", name);
+            else
+                out_printf(32, "  type=%-5u", r->type);
+            at_tokenize(&pl.tok, &pl.names, r->type, ev->text + r->off, r->len);
+            print_fields(&pl.tok);
+            out_printf(2, "\n");
+        } else if (name)
+            out_printf(r->len + 32, "  %-10s %.*s\n", name, r->len, ev->text + r->off);
+        else
+            out_printf(r->len + 32, "  type=%-5u %.*s\n", r->type, r->len, ev->text + r->off);
+    }
+}
+
+// -w模式：把事件编码为二进制写入输出块，超出一个块的事件截掉末尾的记录
+static void encode_event(const aa_event *ev, enum aa_reason reason, void *arg) {
+    size_t need = sizeof(al_event) + ev->nrecords * sizeof(al_rec) + ev->bytes + 8;
+    if (need > CHUNK_SIZE)
+        need = CHUNK_SIZE;
+    char *p = chunk_reserve(need);
+    pl.cur->len += al_encode(ev, reason, p, CHUNK_SIZE - pl.cur->len);
+}
+
+static void publish_parse_stats(void) {
+    const aa_stats *s = &pl.aa.stats;
+    __atomic_store_n(&st.records, s->records, __ATOMIC_RELAXED);
+    __atomic_store_n(&st.events, s->events, __ATOMIC_RELAXED);
+    __atomic_store_n(&st.timeouts, s->timeouts, __ATOMIC_RELAXED);
+    __atomic_store_n(&st.evicted, s->evicted, __ATOMIC_RELAXED);
+    __atomic_store_n(&st.malformed, s->malformed, __ATOMIC_RELAXED);
+    __atomic_store_n(&st.dropped_records, s->dropped_records, __ATOMIC_RELAXED);
+}
+
+static void *parse_main(void *arg) {
+    for (;;) {
+        RecvBuf *b = spsc_pop(&pl.buf_full);
+        if (!b) {
+            // 空闲时把未满的输出块交出去，避免输出延迟
+            chunk_submit();
+            publish_parse_stats();
+            if (__atomic_load_n(&pl.recv_done, __ATOMIC_ACQUIRE) && spsc_count(&pl.buf_full) == 0)
+                break;
+            // 等待新数据，但不晚于最早的组装中事件超时
+            uint64_t deadline = aa_next_deadline(&pl.aa), now = mono_ns();
+            int wait_ms = STAGE_POLL_MS;
+            if (deadline != UINT64_MAX) {
+                uint64_t left = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+                if (left < (uint64_t)wait_ms)
+                    wait_ms = (int)left;
+            }
+            b = spsc_pop_wait(&pl.buf_full, wait_ms);
+        }
+        if (b) {
+            aa_feed_buffer(&pl.aa, b->data, b->len, mono_ns());
+            spsc_push(&pl.buf_free, b);
+        }
+        aa_expire(&pl.aa, mono_ns());
+    }
 
-int main() {
-    struct sockaddr_nl src_addr, dest_addr;
-    struct nlmsghdr *nlh = NULL;
+    aa_flush(&pl.aa);
+    chunk_submit();
+    publish_parse_stats();
+    __atomic_store_n(&pl.parse_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* ---------------- 写出线程 ---------------- */
+
+static void publish_log_stats(void) {
+    __atomic_store_n(&st.sealed, pl.log->sealed, __ATOMIC_RELAXED);
+    __atomic_store_n(&st.deleted, pl.log->deleted, __ATOMIC_RELAXED);
+    __atomic_store_n(&st.recovered, pl.log->recovered, __ATOMIC_RELAXED);
+}
+
+static void *write_main(void *arg) {
+    for (;;) {
+        OutChunk *c = spsc_pop_wait(&pl.chunk_full, STAGE_POLL_MS);
+        if (!c) {
+            if (__atomic_load_n(&pl.parse_done, __ATOMIC_ACQUIRE) && spsc_count(&pl.chunk_full) == 0)
+                break;
+            // 空闲时检查段是否到期
+            if (pl.log) {
+                al_tick(pl.log);
+                publish_log_stats();
+            }
+            continue;
+        }
+        if (pl.log) {
+            if (al_append(pl.log, c->data, c->len) == -1)
+                STAT_ADD(st.write_errors, 1);
+            al_tick(pl.log);
+            publish_log_stats();
+        } else {
+            for (size_t off = 0; off < c->len;) {
+                ssize_t n = write(STDOUT_FILENO, c->data + off, c->len - off);
+                if (n == -1) {
+                    if (errno == EINTR)
+                        continue;
+                    STAT_ADD(st.write_errors, 1);
+                    break;
+                }
+                off += n;
+            }
+        }
+        STAT_ADD(st.chunks, 1);
+        STAT_ADD(st.bytes_out, c->len);
+        spsc_push(&pl.chunk_free, c);
+    }
+
+    if (pl.log) {
+        al_writer_close(pl.log);
+        publish_log_stats();
+    }
+    return NULL;
+}
+
+/* ---------------- 内核状态 ---------------- */
+
+// 查询内核审计状态（AUDIT_GET），需要CAP_AUDIT_CONTROL
+static int audit_get_status(int fd, struct audit_status *out) {
+    static uint32_t seq;
+    struct nlmsghdr req = {
+        .nlmsg_len = NLMSG_LENGTH(0),
+        .nlmsg_type = AUDIT_GET,
+        .nlmsg_flags = NLM_F_REQUEST,
+        .nlmsg_seq = ++seq,
+    };
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    if (sendto(fd, &req, req.nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) == -1)
+        return -1;
+
+    char buf[1024];
+    for (;;) {
+        ssize_t len = recv(fd, buf, sizeof(buf), 0);
+        if (len == -1)
+            return -1;
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_seq != seq)
+                continue;
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *err = NLMSG_DATA(nlh);
+                errno = -err->error;
+                return -1;
+            }
+            if (nlh->nlmsg_type == AUDIT_GET) {
+                memset(out, 0, sizeof(*out));
+                size_t n = nlh->nlmsg_len - NLMSG_HDRLEN;
+                memcpy(out, NLMSG_DATA(nlh), n < sizeof(*out) ? n : sizeof(*out));
+                return 0;
+            }
+        }
+    }
+}
+
+static void print_stats(int status_fd) {
+    fprintf(stderr, "[STATS] recv: msgs=%llu batches=%llu bytes=%llu pool_waits=%llu "
+            "overflows=%llu truncated=%llu\n",
+            (unsigned long long)STAT_GET(st.msgs), (unsigned long long)STAT_GET(st.batches),
+            (unsigned long long)STAT_GET(st.bytes_in), (unsigned long long)STAT_GET(st.pool_waits),
+            (unsigned long long)STAT_GET(st.overflows), (unsigned long long)STAT_GET(st.truncated));
+    fprintf(stderr, "[STATS] parse: records=%llu events=%llu timeouts=%llu evicted=%llu "
+            "dropped_records=%llu malformed=%llu chunk_waits=%llu queued=%u\n",
+            (unsigned long long)STAT_GET(st.records), (unsigned long long)STAT_GET(st.events),
+            (unsigned long long)STAT_GET(st.timeouts), (unsigned long long)STAT_GET(st.evicted),
+            (unsigned long long)STAT_GET(st.dropped_records),
+            (unsigned long long)STAT_GET(st.malformed),
+            (unsigned long long)STAT_GET(st.chunk_waits), spsc_count(&pl.buf_full));
+    fprintf(stderr, "[STATS] write: chunks=%llu bytes=%llu errors=%llu queued=%u\n",
+            (unsigned long long)STAT_GET(st.chunks), (unsigned long long)STAT_GET(st.bytes_out),
+            (unsigned long long)STAT_GET(st.write_errors), spsc_count(&pl.chunk_full));
+    if (pl.log)
+        fprintf(stderr, "[STATS] log: sealed=%llu deleted=%llu recovered=%llu\n",
+                (unsigned long long)STAT_GET(st.sealed), (unsigned long long)STAT_GET(st.deleted),
+                (unsigned long long)STAT_GET(st.recovered));
+
+    struct audit_status status;
+    if (status_fd >= 0 && audit_get_status(status_fd, &status) == 0)
+        fprintf(stderr, "[STATS] kernel: lost=%u backlog=%u backlog_limit=%u rate_limit=%u\n",
+                status.lost, status.backlog, status.backlog_limit, status.rate_limit);
+    else
+        fprintf(stderr, "[STATS] kernel: AUDIT_GET unavailable (%s)\n", strerror(errno));
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-t timeout_ms] [-e max_events] [-m max_mb] [-p pool] [-b rcvbuf] [-s sec] [-i]\n"
+            "          [-w dir [-S seg_mb] [-A seg_sec] [-R retain_mb] [-K retain_hours]]\n"
+            "  -t  等待EOE的超时时间（默认%dms）\n"
+            "  -e  同时组装中的事件数上限（默认%d）\n"
+            "  -m  组装中事件的内存上限（默认%dMB）\n"
+            "  -p  接收缓冲区池大小，2的幂（默认%d）\n"
+            "  -b  socket接收缓冲区字节数（默认%d）\n"
+            "  -s  统计打印间隔秒数，0为只在退出时打印（默认%d）\n"
+            "  -i  按字段分词输出，解码十六进制编码的值（如proctitle、含空格的exe）\n"
+            "  -w  事件写入该目录下的分段二进制日志（用audit_query查询），不再输出文本\n"
+            "  -S  单段大小上限（默认%dMB）\n"
+            "  -A  单段最长写入时间，到期封段（默认%d秒）\n"
+            "  -R  保留的日志总量上限，超出删除最旧的段（默认不限，MB）\n"
+            "  -K  段的最长保留时间（默认不限，小时）\n",
+            prog, DEFAULT_TIMEOUT_MS, DEFAULT_MAX_EVENTS, DEFAULT_MAX_MB, DEFAULT_POOL,
+            DEFAULT_RCVBUF, DEFAULT_STATS_SEC, DEFAULT_SEG_MB, DEFAULT_SEG_SEC);
+}
+
+#ifdef NL_REPLAY
+/*
+ * 回放入口（见nl_replay.c）：解析线程的循环体在调用方线程执行，
+ * interpret为1时同 -i 分词输出；写满的输出块直接回收，代替写出线程
+ */
+int audit_replay_init(int interpret) {
+    pl.interpret = interpret;
+    if (aa_init(&pl.aa, DEFAULT_MAX_EVENTS, (size_t)DEFAULT_MAX_MB << 20,
+                (uint64_t)DEFAULT_TIMEOUT_MS * 1000000ULL, print_event, NULL) == -1 ||
+        spsc_init(&pl.chunk_full, CHUNK_COUNT) == -1 ||
+        spsc_init(&pl.chunk_free, CHUNK_COUNT) == -1 ||
+        !(pl.chunks = malloc(CHUNK_COUNT * sizeof(OutChunk))))
+        return -1;
+    for (int i = 0; i < CHUNK_COUNT; i++)
+        spsc_push(&pl.chunk_free, &pl.chunks[i]);
+    at_dict_init(&pl.names);
+    at_select_impl(0);
+    return 0;
+}
+
+static void audit_replay_recycle(void) {
+    OutChunk *c;
+    while ((c = spsc_pop(&pl.chunk_full)))
+        spsc_push(&pl.chunk_free, c);
+}
+
+// 返回数据报中的消息数
+int audit_replay_feed(const void *buf, size_t len, uint64_t now_ns) {
+    const struct nlmsghdr *nlh = buf;
+    int remain = (int)len, n = 0;
+    for (; NLMSG_OK(nlh, remain); nlh = NLMSG_NEXT(nlh, remain))
+        n++;
+    aa_feed_buffer(&pl.aa, buf, len, now_ns);
+    aa_expire(&pl.aa, now_ns);
+    audit_replay_recycle();
+    return n;
+}
+
+void audit_replay_fini(void) {
+    aa_flush(&pl.aa);
+    audit_replay_recycle();
+    aa_destroy(&pl.aa);
+    at_dict_free(&pl.names);
+    spsc_destroy(&pl.chunk_full);
+    spsc_destroy(&pl.chunk_free);
+    free(pl.chunks);
+    pl.chunks = pl.cur = NULL;
+}
+
+#define main audit_demo_main
+#endif
+
+int main(int argc, char **argv) {
+    struct sockaddr_nl src_addr;
     int sock_fd;
-    char buffer[BUFFER_SIZE];
+    int timeout_ms = DEFAULT_TIMEOUT_MS;
+    int max_events = DEFAULT_MAX_EVENTS;
+    int max_mb = DEFAULT_MAX_MB;
+    int pool = DEFAULT_POOL;
+    int rcvbuf = DEFAULT_RCVBUF;
+    int stats_sec = DEFAULT_STATS_SEC;
+    const char *log_dir = NULL;
+    long seg_mb = DEFAULT_SEG_MB, seg_sec = DEFAULT_SEG_SEC, retain_mb = 0, retain_hours = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:e:m:p:b:s:iw:S:A:R:K:")) != -1) {
+        switch (opt) {
+        case 't': timeout_ms = atoi(optarg); break;
+        case 'e': max_events = atoi(optarg); break;
+        case 'm': max_mb = atoi(optarg); break;
+        case 'p': pool = atoi(optarg); break;
+        case 'b': rcvbuf = atoi(optarg); break;
+        case 's': stats_sec = atoi(optarg); break;
+        case 'i': pl.interpret = 1; break;
+        case 'w': log_dir = optarg; break;
+        case 'S': seg_mb = atol(optarg); break;
+        case 'A': seg_sec = atol(optarg); break;
+        case 'R': retain_mb = atol(optarg); break;
+        case 'K': retain_hours = atol(optarg); break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (timeout_ms <= 0 || max_events <= 0 || max_mb <= 0 || stats_sec < 0 ||
+        pool < RECV_BATCH || (pool & (pool - 1)) != 0 || seg_mb <= 0 || seg_sec < 0 ||
+        retain_mb < 0 || retain_hours < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (aa_init(&pl.aa, max_events, (size_t)max_mb << 20,
+                (uint64_t)timeout_ms * 1000000ULL, log_dir ? encode_event : print_event,
+                NULL) == -1 ||
+        spsc_init(&pl.buf_full, pool) == -1 || spsc_init(&pl.buf_free, pool) == -1 ||
+        spsc_init(&pl.chunk_full, CHUNK_COUNT) == -1 ||
+        spsc_init(&pl.chunk_free, CHUNK_COUNT) == -1 ||
+        !(pl.bufs = malloc((size_t)pool * sizeof(RecvBuf))) ||
+        !(pl.chunks = malloc(CHUNK_COUNT * sizeof(OutChunk)))) {
+        perror("Failed to allocate pipeline");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < pool; i++)
+        spsc_push(&pl.buf_free, &pl.bufs[i]);
+    // 分词器的查找表与SIMD实现在启动线程前选定
+    at_dict_init(&pl.names);
+    at_select_impl(0);
+    // 打开日志时恢复上次崩溃遗留的.open段
+    static al_writer log;
+    if (log_dir) {
+        if (al_writer_open(&log, log_dir, (uint64_t)seg_mb << 20, seg_sec,
+                           (uint64_t)retain_mb << 20, (uint64_t)retain_hours * 3600) == -1) {
+            perror(log_dir);
+            return EXIT_FAILURE;
+        }
+        pl.log = &log;
+        publish_log_stats();
+    }
+    for (int i = 0; i < CHUNK_COUNT; i++)
+        spsc_push(&pl.chunk_free, &pl.chunks[i]);
 
     // 1. 创建 Netlink 套接字
-    sock_fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_AUDIT);
+    sock_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_AUDIT);
     if (sock_fd == -1) {
         perror("socket");
         exit(EXIT_FAILURE);
@@ -28,44 +567,64 @@ int main() {
     memset(&src_addr, 0, sizeof(src_addr));
     src_addr.nl_family = AF_NETLINK;
     src_addr.nl_pid = getpid();  // 用户空间进程的 PID
-    src_addr.nl_groups = 1;  // 订阅审计日志组
+    src_addr.nl_groups = AUDIT_NLGRP_READLOG;  // 订阅审计日志组（只读多播）
 
     if (bind(sock_fd, (struct sockaddr *)&src_addr, sizeof(src_addr)) == -1) {
         perror("bind");
         close(sock_fd);
         exit(EXIT_FAILURE);
     }
+    // 特权进程用SO_RCVBUFFORCE突破rmem_max
+    if (setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1)
+        setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    pl.sock = sock_fd;
 
-    printf("Listening for audit events...\n");
+    // 查询内核lost计数用的单播socket，1秒内无应答视为不可用
+    int status_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_AUDIT);
+    struct timeval tv = { 1, 0 };
+    if (status_fd >= 0)
+        setsockopt(status_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
-    // 3. 循环接收审计日志
-    while (1) {
-        int len;
-        // 接收 Netlink 消息
-        len = recv(sock_fd, buffer, BUFFER_SIZE, 0);
-        if (len == -1) {
-            perror("recv");
-            break;
+    // 3. 启动流水线，工作线程屏蔽信号，由主线程处理退出
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    pthread_t threads[3];
+    void *(*stages[3])(void *) = { write_main, parse_main, recv_main };
+    for (int i = 0; i < 3; i++) {
+        if (pthread_create(&threads[i], NULL, stages[i], NULL) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
         }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
 
-        // 解析消息头
-        nlh = (struct nlmsghdr *)buffer;
+    struct sigaction sa = { .sa_handler = sigint_handler };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    fprintf(stderr, "Listening for audit events...\n");
 
-        // 检查消息是否完整
-        if (!NLMSG_OK(nlh, len)) {
-            fprintf(stderr, "Invalid Netlink message\n");
-            break;
-        }
-
-        // 打印审计日志内容
-        if (nlh->nlmsg_type == AUDIT_EOE || nlh->nlmsg_type == AUDIT_PATH) {
-            // 从消息体中提取日志字符串
-            char *log = NLMSG_DATA(nlh);
-            printf("Audit Event: %s\n", log);
+    // 主线程定期打印各级计数
+    uint64_t next_stats = mono_ns() + (uint64_t)stats_sec * 1000000000ULL;
+    while (running) {
+        sleep(1);                         // 被信号打断后立即检查退出标志
+        if (stats_sec && mono_ns() >= next_stats) {
+            print_stats(status_fd);
+            next_stats += (uint64_t)stats_sec * 1000000000ULL;
         }
     }
 
-    // 4. 关闭套接字
+    // 4. 按流水线顺序退出：接收停止后，解析与写出把剩余数据处理完
+    for (int i = 2; i >= 0; i--)
+        pthread_join(threads[i], NULL);
+    print_stats(status_fd);
+
+    aa_destroy(&pl.aa);
+    at_dict_free(&pl.names);
     close(sock_fd);
+    if (status_fd >= 0)
+        close(status_fd);
     return 0;
 }
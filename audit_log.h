@@ -0,0 +1,692 @@
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "audit_assembler.h"
+#include "audit_tokenizer.h"
+
+/*
+ * 分段、只追加的二进制审计日志
+ * 目录下每个段文件 audit-<创建时间ms>.seg，写入中的段带 .open 后缀：
+ *   [al_seg_header][事件][事件]...[al_block索引数组][al_footer]
+ * 事件按写入顺序每AL_BLOCK_BYTES字节划为一个块，每块一条稀疏索引（zone map）：
+ *   时间范围、记录类型位图、uid/auid/exe的128位布隆过滤器。
+ * 查询时先按段尾索引跳过不可能命中的块，只解码候选块中的事件。
+ * 封段：写索引与尾部、fsync、rename去掉.open、fsync目录——已封段的文件总是完整的；
+ * 崩溃后重启时扫描.open段，截掉校验失败的尾部，重建索引后封段。
+ * 保留策略：按总字节数或段的年龄删除最旧的段。
+ */
+#define AL_MAGIC        "NLALOG01"
+#define AL_IDX_MAGIC    "NLAIDX01"
+#define AL_VERSION      1
+#define AL_BLOCK_BYTES  (64 * 1024)
+#define AL_OPEN_SUFFIX  ".open"
+
+// 事件头中的字段存在标志
+#define AL_HAS_UID      0x01
+#define AL_HAS_AUID     0x02
+#define AL_HAS_EXE      0x04
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t created_ms;              // 段创建时间（墙上时间）
+    uint8_t reserved[40];
+} al_seg_header;                      // 64字节
+
+typedef struct {
+    uint32_t len;                     // 事件总长度（含头部，8字节对齐）
+    uint32_t crc;                     // 头部crc字段之后全部字节的CRC32
+    uint64_t ts_ms;                   // 事件时间（内核记录的墙上时间）
+    uint64_t serial;
+    uint64_t exe_hash;
+    uint64_t type_mask;               // 所含记录类型的位图（type & 63）
+    uint32_t uid, auid;
+    uint16_t nrecords;
+    uint8_t reason;                   // enum aa_reason
+    uint8_t flags;                    // AL_HAS_*
+    uint32_t reserved;
+    // 其后：nrecords个 {uint16 type, uint16 len}，再是各记录正文
+} al_event;                           // 56字节
+
+typedef struct {
+    uint16_t type;
+    uint16_t len;
+} al_rec;
+
+typedef struct {
+    uint64_t offset;                  // 块内第一个事件的文件偏移
+    uint32_t bytes;
+    uint32_t nevents;
+    uint64_t ts_min, ts_max;
+    uint64_t type_mask;
+    uint64_t uid_bloom[2];
+    uint64_t auid_bloom[2];
+    uint64_t exe_bloom[2];
+} al_block;
+
+typedef struct {
+    uint64_t index_off;
+    uint64_t nevents;
+    uint64_t ts_min, ts_max;
+    uint32_t nblocks;
+    uint32_t crc;                     // 索引数组的CRC32
+    char magic[8];                    // 最后写入，作为封段完成的标志
+} al_footer;
+
+/* ---------------- 公共工具 ---------------- */
+
+static inline uint32_t al_crc32(const void *data, size_t len) {
+    static uint32_t table[256];
+    static int ready;
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        ready = 1;
+    }
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++)
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+static inline uint64_t al_hash(const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static inline uint64_t al_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// 128位布隆过滤器，每个值置2位
+static inline void al_bloom_add(uint64_t bloom[2], uint64_t v) {
+    uint64_t h = al_mix(v);
+    bloom[(h >> 6) & 1] |= 1ULL << (h & 63);
+    bloom[(h >> 13) & 1] |= 1ULL << ((h >> 7) & 63);
+}
+
+static inline int al_bloom_test(const uint64_t bloom[2], uint64_t v) {
+    uint64_t h = al_mix(v);
+    return (bloom[(h >> 6) & 1] >> (h & 63) & 1) &&
+           (bloom[(h >> 13) & 1] >> ((h >> 7) & 63) & 1);
+}
+
+static inline uint64_t al_type_bit(uint16_t type) {
+    return 1ULL << (type & 63);
+}
+
+static inline uint64_t al_wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline const al_rec *al_event_recs(const al_event *ev) {
+    return (const al_rec *)(ev + 1);
+}
+
+// 第一条记录正文的位置
+static inline const char *al_event_text(const al_event *ev) {
+    return (const char *)(al_event_recs(ev) + ev->nrecords);
+}
+
+// 校验[p, end)处的事件，返回事件指针，无效（截断/损坏）返回NULL
+static inline const al_event *al_event_check(const uint8_t *p, const uint8_t *end) {
+    if ((size_t)(end - p) < sizeof(al_event))
+        return NULL;
+    const al_event *ev = (const al_event *)p;
+    if (ev->len < sizeof(al_event) || ev->len % 8 || ev->len > (size_t)(end - p) ||
+        sizeof(al_event) + ev->nrecords * sizeof(al_rec) > ev->len)
+        return NULL;
+    if (al_crc32(p + 8, ev->len - 8) != ev->crc)
+        return NULL;
+    return ev;
+}
+
+/* ---------------- 事件编码（解析线程） ---------------- */
+
+/**
+ * 把组装好的事件编码为二进制，写入out
+ * @return 编码后的字节数；空间不足时截掉末尾的记录，连头部都放不下返回0
+ */
+static inline size_t al_encode(const aa_event *ev, enum aa_reason reason, void *out, size_t cap) {
+    al_event *h = out;
+    size_t n = ev->nrecords;
+    size_t size;
+    for (;;) {
+        size = sizeof(al_event) + n * sizeof(al_rec);
+        for (size_t i = 0; i < n; i++)
+            size += ev->rec[i].len;
+        size = (size + 7) & ~(size_t)7;
+        if (size <= cap)
+            break;
+        if (n == 0)
+            return 0;
+        n--;
+    }
+
+    memset(h, 0, sizeof(*h));
+    h->len = size;
+    h->ts_ms = ev->sec * 1000 + ev->msec;
+    h->serial = ev->serial;
+    h->nrecords = n;
+    h->reason = reason;
+
+    al_rec *recs = (al_rec *)(h + 1);
+    char *text = (char *)(recs + n);
+    at_record tok;
+    char exe[PATH_MAX];
+    for (size_t i = 0; i < n; i++) {
+        const aa_record *r = &ev->rec[i];
+        const char *body = ev->text + r->off;
+        recs[i].type = r->type;
+        recs[i].len = r->len;
+        memcpy(text, body, r->len);
+        text += r->len;
+        h->type_mask |= al_type_bit(r->type);
+
+        // 索引字段取第一条包含它们的记录（通常是SYSCALL或USER_*的msg内）
+        if ((h->flags & (AL_HAS_UID | AL_HAS_AUID | AL_HAS_EXE)) ==
+            (AL_HAS_UID | AL_HAS_AUID | AL_HAS_EXE))
+            continue;
+        at_tokenize(&tok, NULL, r->type, body, r->len);
+        if (!(h->flags & AL_HAS_UID) && at_get_u32(&tok, AT_UID, &h->uid))
+            h->flags |= AL_HAS_UID;
+        if (!(h->flags & AL_HAS_AUID) && at_get_u32(&tok, AT_AUID, &h->auid))
+            h->flags |= AL_HAS_AUID;
+        const at_field *f;
+        if (!(h->flags & AL_HAS_EXE) && (f = at_get(&tok, AT_EXE))) {
+            size_t len = at_value(&tok, f, exe, sizeof(exe));
+            h->exe_hash = al_hash(exe, len < sizeof(exe) ? len : sizeof(exe));
+            h->flags |= AL_HAS_EXE;
+        }
+    }
+    memset(text, 0, (char *)out + size - text);
+    h->crc = al_crc32((uint8_t *)out + 8, size - 8);
+    return size;
+}
+
+/* ---------------- 写端 ---------------- */
+
+typedef struct {
+    char dir[PATH_MAX - 64];          // 留出段文件名的长度
+    char path[PATH_MAX];              // 当前.open段
+    int fd;
+    uint64_t size;
+    uint64_t opened_ns;               // 当前段打开时间（单调时钟）
+    al_block *blocks;
+    uint32_t nblocks, cap;
+    al_block cur;                     // 正在累积的块
+    uint64_t nevents, ts_min, ts_max;
+    // 策略
+    uint64_t seg_bytes;               // 段大小上限
+    uint64_t seg_age_ns;              // 段最长写入时间，到期即封段
+    uint64_t retain_bytes;            // 全部已封段的总字节上限，0为不限
+    uint64_t retain_sec;              // 已封段的最长保留时间，0为不限
+    // 统计
+    uint64_t sealed, deleted, recovered, errors;
+} al_writer;
+
+static inline uint64_t al_mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int al_fsync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    int ret = fsync(fd);
+    close(fd);
+    return ret;
+}
+
+static inline int al_write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static inline void al_block_reset(al_block *b, uint64_t offset) {
+    memset(b, 0, sizeof(*b));
+    b->offset = offset;
+    b->ts_min = UINT64_MAX;
+}
+
+static inline int al_block_push(al_writer *w) {
+    if (w->cur.nevents == 0)
+        return 0;
+    if (w->nblocks == w->cap) {
+        uint32_t cap = w->cap ? w->cap * 2 : 256;
+        al_block *b = realloc(w->blocks, cap * sizeof(al_block));
+        if (!b)
+            return -1;
+        w->blocks = b;
+        w->cap = cap;
+    }
+    w->blocks[w->nblocks++] = w->cur;
+    return 0;
+}
+
+// 把事件计入索引（事件已位于文件offset处）
+static inline int al_index_event(al_writer *w, const al_event *ev, uint64_t offset) {
+    if (w->cur.nevents && w->cur.bytes + ev->len > AL_BLOCK_BYTES) {
+        if (al_block_push(w) == -1)
+            return -1;
+        al_block_reset(&w->cur, offset);
+    }
+    al_block *b = &w->cur;
+    if (b->nevents == 0)
+        b->offset = offset;
+    b->bytes += ev->len;
+    b->nevents++;
+    if (ev->ts_ms < b->ts_min) b->ts_min = ev->ts_ms;
+    if (ev->ts_ms > b->ts_max) b->ts_max = ev->ts_ms;
+    b->type_mask |= ev->type_mask;
+    if (ev->flags & AL_HAS_UID)
+        al_bloom_add(b->uid_bloom, ev->uid);
+    if (ev->flags & AL_HAS_AUID)
+        al_bloom_add(b->auid_bloom, ev->auid);
+    if (ev->flags & AL_HAS_EXE)
+        al_bloom_add(b->exe_bloom, ev->exe_hash);
+
+    w->nevents++;
+    if (ev->ts_ms < w->ts_min) w->ts_min = ev->ts_ms;
+    if (ev->ts_ms > w->ts_max) w->ts_max = ev->ts_ms;
+    return 0;
+}
+
+static inline void al_reset_index(al_writer *w) {
+    w->nblocks = 0;
+    w->nevents = 0;
+    w->ts_min = UINT64_MAX;
+    w->ts_max = 0;
+    al_block_reset(&w->cur, sizeof(al_seg_header));
+}
+
+// 封段：写索引和尾部、fsync、去掉.open后缀；空段直接删除
+static inline int al_seal(al_writer *w) {
+    if (w->fd == -1)
+        return 0;
+    int ret = 0;
+    if (w->nevents == 0) {
+        close(w->fd);
+        unlink(w->path);
+        w->fd = -1;
+        return 0;
+    }
+
+    if (al_block_push(w) == -1)
+        ret = -1;
+    al_footer f = {
+        .index_off = w->size,
+        .nevents = w->nevents,
+        .ts_min = w->ts_min,
+        .ts_max = w->ts_max,
+        .nblocks = w->nblocks,
+        .crc = al_crc32(w->blocks, w->nblocks * sizeof(al_block)),
+    };
+    memcpy(f.magic, AL_IDX_MAGIC, sizeof(f.magic));
+    char sealed[PATH_MAX];
+    snprintf(sealed, sizeof(sealed), "%.*s", (int)(strlen(w->path) - strlen(AL_OPEN_SUFFIX)),
+             w->path);
+
+    if (ret == -1 ||
+        pwrite(w->fd, w->blocks, w->nblocks * sizeof(al_block), w->size) !=
+            (ssize_t)(w->nblocks * sizeof(al_block)) ||
+        pwrite(w->fd, &f, sizeof(f), w->size + w->nblocks * sizeof(al_block)) != sizeof(f) ||
+        fsync(w->fd) == -1 || rename(w->path, sealed) == -1 || al_fsync_dir(w->dir) == -1) {
+        w->errors++;
+        ret = -1;
+    } else {
+        w->sealed++;
+    }
+    close(w->fd);
+    w->fd = -1;
+    al_reset_index(w);
+    return ret;
+}
+
+static inline int al_open_segment(al_writer *w) {
+    // 段名取创建时间，同一毫秒内换段时顺延，保证按名称排序即按时间排序
+    uint64_t ms = al_wall_ms();
+    struct stat sb;
+    do {
+        snprintf(w->path, sizeof(w->path), "%s/audit-%020llu.seg", w->dir,
+                 (unsigned long long)ms++);
+        if (stat(w->path, &sb) == 0) {            // 已有同名的封段
+            w->fd = -1;
+            errno = EEXIST;
+            continue;
+        }
+        strcat(w->path, AL_OPEN_SUFFIX);
+        w->fd = open(w->path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0640);
+    } while (w->fd == -1 && errno == EEXIST);
+    if (w->fd == -1)
+        return -1;
+    al_seg_header h = { .version = AL_VERSION, .header_size = sizeof(h),
+                        .created_ms = al_wall_ms() };
+    memcpy(h.magic, AL_MAGIC, sizeof(h.magic));
+    if (al_write_all(w->fd, &h, sizeof(h)) == -1) {
+        close(w->fd);
+        unlink(w->path);
+        w->fd = -1;
+        return -1;
+    }
+    w->size = sizeof(h);
+    w->opened_ns = al_mono_ns();
+    al_reset_index(w);
+    return 0;
+}
+
+// 崩溃恢复：扫描.open段，保留校验通过的前缀并封段
+static inline int al_recover(al_writer *w, const char *path) {
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    uint64_t valid = 0;
+    al_reset_index(w);
+    if ((size_t)sb.st_size >= sizeof(al_seg_header)) {
+        uint8_t *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            if (memcmp(map, AL_MAGIC, 8) == 0) {
+                const uint8_t *end = map + sb.st_size;
+                const uint8_t *p = map + sizeof(al_seg_header);
+                const al_event *ev;
+                while ((ev = al_event_check(p, end))) {
+                    al_index_event(w, ev, p - map);
+                    p += ev->len;
+                }
+                valid = p - map;
+            }
+            munmap(map, sb.st_size);
+        }
+    }
+
+    snprintf(w->path, sizeof(w->path), "%s", path);
+    w->fd = fd;
+    w->size = valid;
+    if (valid && ftruncate(fd, valid) == -1) {
+        w->errors++;
+        close(fd);
+        w->fd = -1;
+        return -1;
+    }
+    w->recovered++;
+    return al_seal(w);
+}
+
+static inline int al_name_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * 列出目录中的段文件（按名称即时间排序）
+ * @param open_too  是否包含写入中的.open段
+ * @return 段文件名数组（调用方逐个free后free数组），失败返回NULL
+ */
+static inline char **al_list_segments(const char *dir, int open_too, int *count) {
+    DIR *d = opendir(dir);
+    if (!d)
+        return NULL;
+    char **names = NULL;
+    int n = 0, cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        size_t len = strlen(de->d_name);
+        int is_open = len > 10 && strcmp(de->d_name + len - 9, ".seg" AL_OPEN_SUFFIX) == 0;
+        int is_sealed = len > 4 && strcmp(de->d_name + len - 4, ".seg") == 0;
+        if (strncmp(de->d_name, "audit-", 6) != 0 || !(is_sealed || (open_too && is_open)))
+            continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **p = realloc(names, cap * sizeof(char *));
+            if (!p)
+                break;
+            names = p;
+        }
+        names[n++] = strdup(de->d_name);
+    }
+    closedir(d);
+    if (n)
+        qsort(names, n, sizeof(char *), al_name_cmp);
+    *count = n;
+    return names ? names : calloc(1, sizeof(char *));
+}
+
+static inline void al_free_list(char **names, int n) {
+    for (int i = 0; i < n; i++)
+        free(names[i]);
+    free(names);
+}
+
+// 保留策略：从最旧的段开始删除，直到总量与年龄都在限制内
+static inline void al_retention(al_writer *w) {
+    if (!w->retain_bytes && !w->retain_sec)
+        return;
+    int n;
+    char **names = al_list_segments(w->dir, 0, &n);
+    if (!names)
+        return;
+
+    char path[PATH_MAX];
+    uint64_t total = 0;
+    uint64_t *sizes = calloc(n ? n : 1, sizeof(uint64_t));
+    time_t *mtimes = calloc(n ? n : 1, sizeof(time_t));
+    for (int i = 0; i < n; i++) {
+        struct stat sb;
+        snprintf(path, sizeof(path), "%s/%s", w->dir, names[i]);
+        if (sizes && mtimes && stat(path, &sb) == 0) {
+            sizes[i] = sb.st_size;
+            mtimes[i] = sb.st_mtime;
+            total += sb.st_size;
+        }
+    }
+    time_t now = time(NULL);
+    for (int i = 0; sizes && mtimes && i < n; i++) {
+        int too_big = w->retain_bytes && total > w->retain_bytes;
+        int too_old = w->retain_sec && (uint64_t)(now - mtimes[i]) > w->retain_sec;
+        if (!too_big && !too_old)
+            break;
+        snprintf(path, sizeof(path), "%s/%s", w->dir, names[i]);
+        if (unlink(path) == 0) {
+            total -= sizes[i];
+            w->deleted++;
+        }
+    }
+    free(sizes);
+    free(mtimes);
+    al_free_list(names, n);
+}
+
+/**
+ * 打开写端：恢复崩溃残留的.open段，再新建一个段
+ * @return 成功返回0，失败返回-1
+ */
+static inline int al_writer_open(al_writer *w, const char *dir, uint64_t seg_bytes,
+                                 uint64_t seg_age_sec, uint64_t retain_bytes,
+                                 uint64_t retain_sec) {
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    if (strlen(dir) >= sizeof(w->dir)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    snprintf(w->dir, sizeof(w->dir), "%s", dir);
+    w->seg_bytes = seg_bytes;
+    w->seg_age_ns = seg_age_sec * 1000000000ULL;
+    w->retain_bytes = retain_bytes;
+    w->retain_sec = retain_sec;
+    if (mkdir(dir, 0750) == -1 && errno != EEXIST)
+        return -1;
+
+    int n;
+    char **names = al_list_segments(dir, 1, &n);
+    if (!names)
+        return -1;
+    char path[PATH_MAX];
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(names[i]);
+        if (len > strlen(AL_OPEN_SUFFIX) &&
+            strcmp(names[i] + len - strlen(AL_OPEN_SUFFIX), AL_OPEN_SUFFIX) == 0) {
+            snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+            al_recover(w, path);
+        }
+    }
+    al_free_list(names, n);
+    al_retention(w);
+    return al_open_segment(w);
+}
+
+/**
+ * 追加一段连续编码的事件（al_encode的输出），必要时在事件边界换段
+ * @return 成功返回0，写入失败返回-1
+ */
+static inline int al_append(al_writer *w, const void *data, size_t len) {
+    const uint8_t *p = data, *end = p + len;
+    while (p < end) {
+        if (w->fd == -1 && al_open_segment(w) == -1) {
+            w->errors++;
+            return -1;
+        }
+        // 取本段能容纳的最长事件序列，一次write写入
+        const uint8_t *run = p;
+        uint64_t off = w->size;
+        while (p < end) {
+            const al_event *ev = (const al_event *)p;
+            if (w->nevents && off + ev->len > w->seg_bytes)
+                break;
+            al_index_event(w, ev, off);
+            off += ev->len;
+            p += ev->len;
+        }
+        if (p > run) {
+            if (al_write_all(w->fd, run, p - run) == -1) {
+                w->errors++;
+                return -1;
+            }
+            w->size = off;
+        }
+        if (p < end) {
+            al_seal(w);
+            al_retention(w);
+        }
+    }
+    return 0;
+}
+
+// 定期调用：段写入时间到期则封段
+static inline void al_tick(al_writer *w) {
+    if (w->fd != -1 && w->nevents && w->seg_age_ns &&
+        al_mono_ns() - w->opened_ns >= w->seg_age_ns) {
+        al_seal(w);
+        al_retention(w);
+    }
+}
+
+static inline void al_writer_close(al_writer *w) {
+    al_seal(w);
+    free(w->blocks);
+    w->blocks = NULL;
+}
+
+/* ---------------- 读端 ---------------- */
+
+typedef struct {
+    uint8_t *map;
+    size_t size;
+    int sealed;                       // 1: 有完整索引；0: 写入中的段，只能顺序扫描
+    const al_footer *footer;
+    const al_block *blocks;
+    const uint8_t *data_end;          // 事件区结束位置
+} al_segment;
+
+static inline int al_segment_open(al_segment *s, const char *path) {
+    memset(s, 0, sizeof(*s));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || (size_t)sb.st_size < sizeof(al_seg_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    s->map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s->map == MAP_FAILED)
+        return -1;
+    s->size = sb.st_size;
+    if (memcmp(s->map, AL_MAGIC, 8) != 0) {
+        munmap(s->map, s->size);
+        errno = EINVAL;
+        return -1;
+    }
+    madvise(s->map, s->size, MADV_RANDOM);
+    s->data_end = s->map + s->size;
+
+    if (s->size >= sizeof(al_seg_header) + sizeof(al_footer)) {
+        const al_footer *f = (const al_footer *)(s->map + s->size - sizeof(al_footer));
+        size_t idx_bytes = (size_t)f->nblocks * sizeof(al_block);
+        if (memcmp(f->magic, AL_IDX_MAGIC, 8) == 0 && f->index_off >= sizeof(al_seg_header) &&
+            f->index_off + idx_bytes + sizeof(al_footer) == s->size &&
+            al_crc32(s->map + f->index_off, idx_bytes) == f->crc) {
+            s->sealed = 1;
+            s->footer = f;
+            s->blocks = (const al_block *)(s->map + f->index_off);
+            s->data_end = s->map + f->index_off;
+        }
+    }
+    return 0;
+}
+
+static inline void al_segment_close(al_segment *s) {
+    if (s->map)
+        munmap(s->map, s->size);
+    memset(s, 0, sizeof(*s));
+}
+
+#endif // AUDIT_LOG_H
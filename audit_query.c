@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "audit_log.h"
+
+// 查询audit_demo -w 写入的二进制审计日志，如：最近1小时uid 1001的EXECVE
+//   audit_query -d /var/log/nlaudit -T EXECVE -u 1001 -s 3600
+
+typedef struct {
+    uint64_t from_ms, to_ms;
+    int type;                     // -1为不限
+    int has_uid, has_auid, has_exe;
+    uint32_t uid, auid;
+    uint64_t exe_hash;
+} Query;
+
+// 扫描计数：用于确认查询是在跳块而不是全量扫描
+static struct {
+    uint64_t segments, segments_skipped;
+    uint64_t blocks, blocks_skipped;
+    uint64_t events, matched;
+} qs;
+
+// 块的稀疏索引能否排除本查询
+static int block_may_match(const Query *q, const al_block *b) {
+    if (b->ts_max < q->from_ms || b->ts_min > q->to_ms)
+        return 0;
+    if (q->type >= 0 && !(b->type_mask & al_type_bit(q->type)))
+        return 0;
+    if (q->has_uid && !al_bloom_test(b->uid_bloom, q->uid))
+        return 0;
+    if (q->has_auid && !al_bloom_test(b->auid_bloom, q->auid))
+        return 0;
+    if (q->has_exe && !al_bloom_test(b->exe_bloom, q->exe_hash))
+        return 0;
+    return 1;
+}
+
+static int event_match(const Query *q, const al_event *ev) {
+    if (ev->ts_ms < q->from_ms || ev->ts_ms > q->to_ms)
+        return 0;
+    if (q->has_uid && (!(ev->flags & AL_HAS_UID) || ev->uid != q->uid))
+        return 0;
+    if (q->has_auid && (!(ev->flags & AL_HAS_AUID) || ev->auid != q->auid))
+        return 0;
+    if (q->has_exe && (!(ev->flags & AL_HAS_EXE) || ev->exe_hash != q->exe_hash))
+        return 0;
+    if (q->type >= 0) {
+        if (!(ev->type_mask & al_type_bit(q->type)))
+            return 0;
+        const al_rec *recs = al_event_recs(ev);
+        for (uint32_t i = 0; i < ev->nrecords; i++)
+            if (recs[i].type == q->type)
+                return 1;
+        return 0;
+    }
+    return 1;
+}
+
+// 与audit_demo的文本输出格式一致
+static void print_event(const al_event *ev) {
+    static const char *const reasons[] = { "", " [timeout]", " [evicted]", " [flushed]" };
+    printf("Audit Event %llu.%03u:%llu records=%u%s\n",
+           (unsigned long long)(ev->ts_ms / 1000), (unsigned)(ev->ts_ms % 1000),
+           (unsigned long long)ev->serial, ev->nrecords,
+           ev->reason < 4 ? reasons[ev->reason] : "");
+    const al_rec *recs = al_event_recs(ev);
+    const char *text = al_event_text(ev);
+    for (uint32_t i = 0; i < ev->nrecords; i++) {
+        const char *name = aa_type_name(recs[i].type);
+        if (name)
+            printf("  %-10s %.*s\n", name, recs[i].len, text);
+        else
+            printf("  type=%-5u %.*s\n", recs[i].type, recs[i].len, text);
+        text += recs[i].len;
+    }
+}
+
+// 遍历[p, end)中的事件；check为1时逐条校验（写入中的段可能有半条事件）
+static int scan_events(const Query *q, const uint8_t *p, const uint8_t *end, int check,
+                       int count_only, uint64_t limit) {
+    while (p < end) {
+        const al_event *ev;
+        if (check) {
+            if (!(ev = al_event_check(p, end)))
+                break;
+        } else {
+            ev = (const al_event *)p;
+            if ((size_t)(end - p) < sizeof(al_event) || ev->len < sizeof(al_event) ||
+                ev->len > (size_t)(end - p))
+                break;
+        }
+        p += ev->len;
+        qs.events++;
+        if (!event_match(q, ev))
+            continue;
+        qs.matched++;
+        if (!count_only)
+            print_event(ev);
+        if (limit && qs.matched >= limit)
+            return 1;
+    }
+    return 0;
+}
+
+static int query_segment(const Query *q, const char *path, int count_only, uint64_t limit) {
+    al_segment seg;
+    if (al_segment_open(&seg, path) == -1) {
+        perror(path);
+        return 0;
+    }
+    qs.segments++;
+    int done = 0;
+    if (!seg.sealed) {
+        // 写入中的段没有索引，顺序扫描（大小受段上限约束）
+        done = scan_events(q, seg.map + sizeof(al_seg_header), seg.data_end, 1,
+                           count_only, limit);
+    } else if (seg.footer->ts_max < q->from_ms || seg.footer->ts_min > q->to_ms) {
+        qs.segments_skipped++;
+    } else {
+        for (uint32_t i = 0; i < seg.footer->nblocks && !done; i++) {
+            const al_block *b = &seg.blocks[i];
+            qs.blocks++;
+            if (!block_may_match(q, b) || b->offset + b->bytes > seg.footer->index_off) {
+                qs.blocks_skipped++;
+                continue;
+            }
+            done = scan_events(q, seg.map + b->offset, seg.map + b->offset + b->bytes, 0,
+                               count_only, limit);
+        }
+    }
+    al_segment_close(&seg);
+    return done;
+}
+
+// 记录类型：名称（EXECVE）或数字
+static int parse_type(const char *s) {
+    char *endp;
+    long v = strtol(s, &endp, 10);
+    if (*endp == '\0' && v > 0 && v < 65536)
+        return (int)v;
+    for (int t = 1000; t < 3000; t++) {
+        const char *name = aa_type_name(t);
+        if (name && strcasecmp(name, s) == 0)
+            return t;
+    }
+    return -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s -d <dir> [-s seconds | -f from -t to] [-T type] [-u uid] [-a auid]\n"
+            "          [-e exe] [-n limit] [-c] [-v]\n"
+            "  -d  audit_demo -w 指定的日志目录\n"
+            "  -s  只查最近若干秒\n"
+            "  -f  起始时间（Unix秒）\n"
+            "  -t  结束时间（Unix秒）\n"
+            "  -T  包含该类型记录的事件，名称（EXECVE）或数字\n"
+            "  -u  uid\n"
+            "  -a  auid（登录uid）\n"
+            "  -e  可执行文件路径\n"
+            "  -n  最多输出的事件数\n"
+            "  -c  只输出匹配数\n"
+            "  -v  打印扫描/跳过的段与块数\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    const char *dir = NULL;
+    Query q = { .from_ms = 0, .to_ms = UINT64_MAX, .type = -1 };
+    uint64_t since = 0, limit = 0;
+    int count_only = 0, verbose = 0, opt;
+
+    while ((opt = getopt(argc, argv, "d:s:f:t:T:u:a:e:n:cv")) != -1) {
+        switch (opt) {
+        case 'd': dir = optarg; break;
+        case 's': since = strtoull(optarg, NULL, 10); break;
+        case 'f': q.from_ms = strtoull(optarg, NULL, 10) * 1000; break;
+        case 't': q.to_ms = strtoull(optarg, NULL, 10) * 1000 + 999; break;
+        case 'u': q.uid = strtoul(optarg, NULL, 10); q.has_uid = 1; break;
+        case 'a': q.auid = strtoul(optarg, NULL, 10); q.has_auid = 1; break;
+        case 'e':
+            q.exe_hash = al_hash(optarg, strlen(optarg));
+            q.has_exe = 1;
+            break;
+        case 'n': limit = strtoull(optarg, NULL, 10); break;
+        case 'c': count_only = 1; break;
+        case 'v': verbose = 1; break;
+        case 'T':
+            if ((q.type = parse_type(optarg)) < 0) {
+                fprintf(stderr, "Unknown record type: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!dir || q.from_ms > q.to_ms) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (since) {
+        uint64_t now = al_wall_ms();
+        q.from_ms = now > since * 1000 ? now - since * 1000 : 0;
+    }
+
+    int n;
+    char **names = al_list_segments(dir, 1, &n);
+    if (!names) {
+        perror(dir);
+        return EXIT_FAILURE;
+    }
+    char path[PATH_MAX];
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        if (query_segment(&q, path, count_only, limit))
+            break;
+    }
+    al_free_list(names, n);
+
+    if (count_only)
+        printf("%llu\n", (unsigned long long)qs.matched);
+    if (verbose)
+        fprintf(stderr, "[STATS] segments=%llu skipped=%llu blocks=%llu skipped=%llu "
+                "events_scanned=%llu matched=%llu\n",
+                (unsigned long long)qs.segments, (unsigned long long)qs.segments_skipped,
+                (unsigned long long)qs.blocks, (unsigned long long)qs.blocks_skipped,
+                (unsigned long long)qs.events, (unsigned long long)qs.matched);
+    return EXIT_SUCCESS;
+}
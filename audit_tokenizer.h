@@ -0,0 +1,447 @@
+#ifndef AUDIT_TOKENIZER_H
+#define AUDIT_TOKENIZER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <linux/audit.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AT_HAVE_X86 1
+#endif
+
+/*
+ * 审计记录 key=value 分词
+ * 每64字节为一个窗口，用SIMD（AVX2/SSE2，其他平台为标量）一次算出空格、'='、
+ * 双引号、单引号的位置位图，状态机按当前状态选择位图、用ctz直接跳到下一个结构字符，
+ * 正文每个字节只被分类一次。
+ * msg='...' 的单引号值会展开，内部的字段带AT_NESTED标志跟在msg之后。
+ * 字段名驻留为整数ID：常用字段为编译期常量（AT_UID等），其余由at_dict动态分配，
+ * 下游按ID比较而不是字符串比较。
+ * 十六进制编码的值（审计对含空格等字符的不可信字符串的编码）只标记，用at_value按需解码。
+ */
+#define AT_MAX_FIELDS   128
+#define AT_MAX_NAMES    1024          // at_dict可驻留的字段名总数
+#define AT_ID_NONE      0xFFFF        // 未驻留（at_dict已满或未提供）
+
+// 字段标志
+#define AT_DQUOTED      0x01          // "..."
+#define AT_SQUOTED      0x02          // '...'（其内字段已展开）
+#define AT_HEX          0x04          // 不带引号且属于可能编码的字段，at_value时尝试解码
+#define AT_NESTED       0x08          // 位于msg='...'之内
+
+enum at_id {
+    AT_ARCH, AT_SYSCALL, AT_SUCCESS, AT_EXIT, AT_A0, AT_A1, AT_A2, AT_A3, AT_ITEMS,
+    AT_PPID, AT_PID, AT_AUID, AT_UID, AT_GID, AT_EUID, AT_SUID, AT_FSUID, AT_EGID,
+    AT_SGID, AT_FSGID, AT_TTY, AT_SES, AT_COMM, AT_EXE, AT_SUBJ, AT_KEY, AT_ARGC,
+    AT_ITEM, AT_NAME, AT_INODE, AT_DEV, AT_MODE, AT_OUID, AT_OGID, AT_RDEV,
+    AT_NAMETYPE, AT_CWD, AT_PROCTITLE, AT_MSG, AT_OP, AT_RES, AT_ACCT, AT_HOSTNAME,
+    AT_ADDR, AT_TERMINAL, AT_SADDR, AT_OBJ, AT_FAMILY, AT_SPORT, AT_DPORT,
+    AT_NKNOWN
+};
+
+static const char *const at_known_names[AT_NKNOWN] = {
+    "arch", "syscall", "success", "exit", "a0", "a1", "a2", "a3", "items",
+    "ppid", "pid", "auid", "uid", "gid", "euid", "suid", "fsuid", "egid",
+    "sgid", "fsgid", "tty", "ses", "comm", "exe", "subj", "key", "argc",
+    "item", "name", "inode", "dev", "mode", "ouid", "ogid", "rdev",
+    "nametype", "cwd", "proctitle", "msg", "op", "res", "acct", "hostname",
+    "addr", "terminal", "saddr", "obj", "family", "sport", "dport",
+};
+
+// 内核以audit_log_untrustedstring输出的字段：带引号或整体十六进制编码
+static inline int at_known_encoded(int id) {
+    return id == AT_COMM || id == AT_EXE || id == AT_KEY || id == AT_NAME ||
+           id == AT_CWD || id == AT_PROCTITLE || id == AT_ACCT;
+}
+
+typedef struct {
+    uint32_t name_off;
+    uint32_t val_off, val_len;        // 不含引号
+    uint16_t id;
+    uint8_t name_len;
+    uint8_t flags;
+} at_field;
+
+typedef struct {
+    const char *text;
+    size_t len;
+    uint16_t type;                    // 记录类型，决定EXECVE的aN是否可能编码
+    uint32_t nfields;
+    uint32_t dropped;                 // 超出AT_MAX_FIELDS的字段数
+    uint8_t first[AT_NKNOWN];         // 常用字段首次出现的下标，0xFF为不存在
+    at_field f[AT_MAX_FIELDS];
+} at_record;
+
+// 动态驻留表：常用字段之外的名称（开放寻址，只由一个线程使用）
+typedef struct {
+    uint32_t count;
+    uint16_t slots[AT_MAX_NAMES * 2]; // 名称下标+1，0为空
+    uint8_t lens[AT_MAX_NAMES];
+    char *names[AT_MAX_NAMES];
+} at_dict;
+
+/* ---------------- 字段名驻留 ---------------- */
+
+#define AT_KEYTAB_SIZE 128
+static int8_t at_keytab[AT_KEYTAB_SIZE];
+static uint8_t at_known_lens[AT_NKNOWN];
+static int at_keytab_ready;
+
+static inline uint32_t at_name_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+// 常用字段的查找表；多线程使用前应先在主线程调用一次
+static inline void at_keytab_init(void) {
+    memset(at_keytab, -1, sizeof(at_keytab));
+    for (int i = 0; i < AT_NKNOWN; i++) {
+        at_known_lens[i] = strlen(at_known_names[i]);
+        uint32_t h = at_name_hash(at_known_names[i], at_known_lens[i]);
+        while (at_keytab[h & (AT_KEYTAB_SIZE - 1)] >= 0)
+            h++;
+        at_keytab[h & (AT_KEYTAB_SIZE - 1)] = i;
+    }
+    at_keytab_ready = 1;
+}
+
+static inline int at_known_id(const char *s, size_t len, uint32_t h) {
+    for (;; h++) {
+        int id = at_keytab[h & (AT_KEYTAB_SIZE - 1)];
+        if (id < 0)
+            return -1;
+        if (at_known_lens[id] == len && memcmp(at_known_names[id], s, len) == 0)
+            return id;
+    }
+}
+
+static inline void at_dict_init(at_dict *d) {
+    memset(d, 0, sizeof(*d));
+    if (!at_keytab_ready)
+        at_keytab_init();
+}
+
+static inline void at_dict_free(at_dict *d) {
+    for (uint32_t i = 0; i < d->count; i++)
+        free(d->names[i]);
+    d->count = 0;
+}
+
+/**
+ * 字段名驻留为整数ID：常用字段返回enum at_id，其余从AT_NKNOWN起分配
+ * @param d  可为NULL，此时非常用字段返回AT_ID_NONE
+ */
+static inline uint16_t at_intern(at_dict *d, const char *s, size_t len) {
+    if (len > 255)
+        return AT_ID_NONE;
+    uint32_t h = at_name_hash(s, len);
+    int id = at_known_id(s, len, h);
+    if (id >= 0)
+        return id;
+    if (!d)
+        return AT_ID_NONE;
+    for (uint32_t i = h;; i++) {
+        uint16_t *slot = &d->slots[i & (AT_MAX_NAMES * 2 - 1)];
+        if (*slot == 0) {
+            if (d->count >= AT_MAX_NAMES || !(d->names[d->count] = malloc(len + 1)))
+                return AT_ID_NONE;
+            memcpy(d->names[d->count], s, len);
+            d->names[d->count][len] = '\0';
+            d->lens[d->count] = len;
+            *slot = ++d->count;
+            return AT_NKNOWN + *slot - 1;
+        }
+        if (d->lens[*slot - 1] == len && memcmp(d->names[*slot - 1], s, len) == 0)
+            return AT_NKNOWN + *slot - 1;
+    }
+}
+
+static inline const char *at_id_name(const at_dict *d, uint16_t id) {
+    if (id < AT_NKNOWN)
+        return at_known_names[id];
+    if (d && id != AT_ID_NONE && id - AT_NKNOWN < (int)d->count)
+        return d->names[id - AT_NKNOWN];
+    return NULL;
+}
+
+/* ---------------- 结构字符位图 ---------------- */
+
+#define AT_SEL_SPACE    1
+#define AT_SEL_EQ       2
+#define AT_SEL_DQ       4
+#define AT_SEL_SQ       8
+
+typedef struct {
+    uint64_t space, eq, dq, sq;
+} at_masks;
+
+static inline void at_classify_scalar(const char *p, size_t n, at_masks *m) {
+    m->space = m->eq = m->dq = m->sq = 0;
+    for (size_t i = 0; i < n; i++) {
+        switch (p[i]) {
+        case ' ':  m->space |= 1ULL << i; break;
+        case '=':  m->eq |= 1ULL << i; break;
+        case '"':  m->dq |= 1ULL << i; break;
+        case '\'': m->sq |= 1ULL << i; break;
+        }
+    }
+}
+
+#ifdef AT_HAVE_X86
+__attribute__((target("sse2")))
+static inline void at_classify_sse2(const char *p, at_masks *m) {
+    const __m128i sp = _mm_set1_epi8(' '), eq = _mm_set1_epi8('=');
+    const __m128i dq = _mm_set1_epi8('"'), sq = _mm_set1_epi8('\'');
+    m->space = m->eq = m->dq = m->sq = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+        m->space |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, sp)) << (16 * i);
+        m->eq |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, eq)) << (16 * i);
+        m->dq |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dq)) << (16 * i);
+        m->sq |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, sq)) << (16 * i);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void at_classify_avx2(const char *p, at_masks *m) {
+    const __m256i sp = _mm256_set1_epi8(' '), eq = _mm256_set1_epi8('=');
+    const __m256i dq = _mm256_set1_epi8('"'), sq = _mm256_set1_epi8('\'');
+    __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+#define AT_MASK64(c) ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, c)) | \
+                      (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, c)) << 32)
+    m->space = AT_MASK64(sp);
+    m->eq = AT_MASK64(eq);
+    m->dq = AT_MASK64(dq);
+    m->sq = AT_MASK64(sq);
+#undef AT_MASK64
+}
+#endif
+
+// 整窗口（64字节）分类函数，首次使用时按CPU选择；at_select_impl(1)强制标量，用于对比
+typedef void (*at_classify_fn)(const char *p, at_masks *m);
+
+static inline void at_classify_scalar64(const char *p, at_masks *m) {
+    at_classify_scalar(p, 64, m);
+}
+
+static at_classify_fn at_classify64;
+
+static inline void at_select_impl(int force_scalar) {
+    at_classify64 = at_classify_scalar64;
+#ifdef AT_HAVE_X86
+    if (!force_scalar) {
+        __builtin_cpu_init();
+        at_classify64 = __builtin_cpu_supports("avx2") ? at_classify_avx2 : at_classify_sse2;
+    }
+#endif
+}
+
+typedef struct {
+    const char *text;
+    size_t len;
+    size_t base;                      // 当前窗口起点
+    at_masks m;
+} at_scan;
+
+static inline void at_scan_load(at_scan *s, size_t base) {
+    s->base = base;
+    if (s->len - base >= 64)
+        at_classify64(s->text + base, &s->m);
+    else
+        at_classify_scalar(s->text + base, s->len - base, &s->m);
+}
+
+// from处起第一个属于sel所选类别的字符位置，没有则返回len
+static inline size_t at_next(at_scan *s, unsigned sel, size_t from) {
+    while (from < s->len) {
+        size_t base = from & ~(size_t)63;
+        if (base != s->base)
+            at_scan_load(s, base);
+        uint64_t bits = (sel & AT_SEL_SPACE ? s->m.space : 0) |
+                        (sel & AT_SEL_EQ ? s->m.eq : 0) |
+                        (sel & AT_SEL_DQ ? s->m.dq : 0) |
+                        (sel & AT_SEL_SQ ? s->m.sq : 0);
+        bits &= ~0ULL << (from - base);
+        if (bits)
+            return base + __builtin_ctzll(bits);
+        from = base + 64;
+    }
+    return s->len;
+}
+
+/* ---------------- 分词 ---------------- */
+
+// EXECVE记录的参数a0、a1...（及a1[0]分片）都可能编码
+static inline int at_execve_arg(const char *s, size_t len) {
+    if (len < 2 || s[0] != 'a' || s[1] < '0' || s[1] > '9')
+        return 0;
+    for (size_t i = 2; i < len; i++)
+        if (!((s[i] >= '0' && s[i] <= '9') || s[i] == '[' || s[i] == ']'))
+            return 0;
+    return 1;
+}
+
+static inline void at_add(at_record *r, at_dict *d, size_t name, size_t name_len,
+                          size_t val, size_t val_len, uint8_t flags) {
+    if (name_len == 0 || name_len > 255)
+        return;
+    if (r->nfields >= AT_MAX_FIELDS) {
+        r->dropped++;
+        return;
+    }
+    const char *s = r->text + name;
+    at_field *f = &r->f[r->nfields];
+    f->name_off = name;
+    f->name_len = name_len;
+    f->val_off = val;
+    f->val_len = val_len;
+    f->id = at_intern(d, s, name_len);
+    if (!(flags & (AT_DQUOTED | AT_SQUOTED)) &&
+        ((f->id < AT_NKNOWN && at_known_encoded(f->id)) ||
+         (r->type == AUDIT_EXECVE && at_execve_arg(s, name_len))))
+        flags |= AT_HEX;
+    f->flags = flags;
+    if (f->id < AT_NKNOWN && r->first[f->id] == 0xFF)
+        r->first[f->id] = r->nfields;
+    r->nfields++;
+}
+
+/**
+ * 把一条记录正文切分为字段（不复制正文，字段以偏移引用text）
+ * @param d     驻留非常用字段名，可为NULL
+ * @param type  记录类型
+ * @return 字段数
+ */
+static inline uint32_t at_tokenize(at_record *r, at_dict *d, uint16_t type,
+                                   const char *text, size_t len) {
+    if (!at_classify64)
+        at_select_impl(0);
+    if (!at_keytab_ready)
+        at_keytab_init();
+    r->text = text;
+    r->len = len;
+    r->type = type;
+    r->nfields = r->dropped = 0;
+    memset(r->first, 0xFF, sizeof(r->first));
+
+    at_scan s = { .text = text, .len = len, .base = SIZE_MAX };
+    size_t pos = 0;
+    size_t nest_end = SIZE_MAX;           // 所在msg='...'的结束引号位置
+    while (pos < len) {
+        // 到达（或因引号不配对越过）msg的结束引号则回到外层
+        if (pos >= nest_end) {
+            pos += pos == nest_end;
+            nest_end = SIZE_MAX;
+            continue;
+        }
+        if (text[pos] == ' ') {
+            pos++;
+            continue;
+        }
+        unsigned stop = AT_SEL_SPACE | (nest_end != SIZE_MAX ? AT_SEL_SQ : 0);
+        size_t key = pos;
+        size_t eq = at_next(&s, stop | AT_SEL_EQ, pos);
+        if (eq >= len || text[eq] != '=') {
+            pos = eq > pos ? eq : pos + 1;    // 没有'='的词（如AVC的"denied"）
+            continue;
+        }
+        uint8_t flags = nest_end != SIZE_MAX ? AT_NESTED : 0;
+        size_t v = eq + 1, vend;
+        if (v < len && text[v] == '"') {
+            vend = at_next(&s, AT_SEL_DQ, v + 1);
+            at_add(r, d, key, eq - key, v + 1, vend - v - 1, flags | AT_DQUOTED);
+            pos = vend < len ? vend + 1 : len;
+        } else if (v < len && text[v] == '\'' && nest_end == SIZE_MAX) {
+            vend = at_next(&s, AT_SEL_SQ, v + 1);
+            at_add(r, d, key, eq - key, v + 1, vend - v - 1, flags | AT_SQUOTED);
+            nest_end = vend;
+            pos = v + 1;                  // 展开引号内的字段
+        } else {
+            vend = at_next(&s, stop, v);
+            at_add(r, d, key, eq - key, v, vend - v, flags);
+            pos = vend;
+        }
+    }
+    return r->nfields;
+}
+
+/* ---------------- 取值 ---------------- */
+
+// 字段id的第一次出现；常用字段O(1)
+static inline const at_field *at_get(const at_record *r, uint16_t id) {
+    if (id < AT_NKNOWN)
+        return r->first[id] == 0xFF ? NULL : &r->f[r->first[id]];
+    for (uint32_t i = 0; i < r->nfields; i++)
+        if (r->f[i].id == id)
+            return &r->f[i];
+    return NULL;
+}
+
+static inline const char *at_raw(const at_record *r, const at_field *f) {
+    return r->text + f->val_off;
+}
+
+static inline const char *at_name(const at_record *r, const at_field *f) {
+    return r->text + f->name_off;
+}
+
+static inline int at_hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// 带AT_HEX标志的值是否确为十六进制编码（偶数长度、全为大写十六进制数字）
+static inline int at_is_hex(const at_record *r, const at_field *f) {
+    if (!(f->flags & AT_HEX) || f->val_len < 2 || f->val_len % 2)
+        return 0;
+    const char *p = at_raw(r, f);
+    for (uint32_t i = 0; i < f->val_len; i++)
+        if (at_hex_digit(p[i]) < 0)
+            return 0;
+    return 1;
+}
+
+/**
+ * 取字段值，十六进制编码的值在此解码；结果不以'\0'结尾
+ * @return 值的完整长度（可能大于cap，此时只写入cap字节）
+ */
+static inline size_t at_value(const at_record *r, const at_field *f, char *buf, size_t cap) {
+    const char *p = at_raw(r, f);
+    if (!at_is_hex(r, f)) {
+        memcpy(buf, p, f->val_len < cap ? f->val_len : cap);
+        return f->val_len;
+    }
+    size_t n = f->val_len / 2;
+    for (size_t i = 0; i < n && i < cap; i++)
+        buf[i] = at_hex_digit(p[2 * i]) << 4 | at_hex_digit(p[2 * i + 1]);
+    return n;
+}
+
+// 十进制无符号整数字段
+static inline int at_get_u32(const at_record *r, uint16_t id, uint32_t *out) {
+    const at_field *f = at_get(r, id);
+    if (!f || f->val_len == 0 || f->val_len > 10)
+        return 0;
+    const char *p = at_raw(r, f);
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < f->val_len; i++) {
+        if (p[i] < '0' || p[i] > '9')
+            return 0;
+        v = v * 10 + (p[i] - '0');
+    }
+    if (v > UINT32_MAX)
+        return 0;
+    *out = (uint32_t)v;
+    return 1;
+}
+
+#endif // AUDIT_TOKENIZER_H
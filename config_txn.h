@@ -0,0 +1,476 @@
+#ifndef CONFIG_TXN_H
+#define CONFIG_TXN_H
+
+#include "atomic_write.h"
+
+#include <dirent.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/file.h>
+
+/*
+ * 多文件原子事务：一组配置文件（如interfaces、resolv.conf、keepalived.conf）
+ * 要么全部换成新内容，要么全部保持原样，掉电/崩溃后也是如此。
+ *
+ *   ct_begin -> ct_stage × N -> ct_commit（或ct_abort）
+ *
+ * ct_stage 把新内容写进目标同目录的临时文件 <path>.ct-<事务id>（内容与现有文件
+ * 相同则跳过）。ct_commit：
+ *   1. 在日志目录写意图日志 <id>.journal（状态P + 全部 目标/临时文件 对）；
+ *      屏障：每个文件系统一次syncfs，目标目录与日志目录各fsync一次
+ *   2. 日志状态改写为C并fdatasync —— 提交点
+ *   3. 逐个rename临时文件覆盖目标；每个目标目录fsync一次
+ *   4. 删除日志
+ * 无论多少个文件，fsync轮次固定（1、2、3各一轮），不随文件数增长。
+ *
+ * 启动时ct_recover扫描日志目录：状态C的日志重做第3步（rename幂等，已不存在的
+ * 临时文件跳过）；状态P或校验失败的日志说明提交点之前中断，删除其临时文件，
+ * 目标保持原样。日志本身不完整（第1步屏障之前崩溃）时无从得知临时文件名，
+ * 只删除日志；这类残留的临时文件以 .ct- 结尾，可按名字清理。
+ *
+ * 第3步rename失败（ct_commit返回-2）时状态C的日志保留。ct_begin先重做目录中
+ * 全部状态C的日志，仍有未完成的就拒绝开始新事务（EBUSY）：否则新事务写过的
+ * 目标会在之后的恢复中被旧日志里的临时文件覆盖回去。
+ *
+ * 事务从ct_begin到ct_commit/ct_abort持有日志目录上的排他flock，同一目录上的
+ * 事务因此串行执行。ct_recover也要取这把锁；锁被占用说明有进程正在事务中，
+ * 状态P与无法解析的日志可能正是它的（后者可能还在写），只完成状态C的日志。
+ */
+#define CT_MAGIC        "CTXN0001"
+#define CT_SUFFIX       ".journal"
+#define CT_STATE_PREP   0x50          // 'P'
+#define CT_STATE_COMMIT 0x43          // 'C'
+#define CT_MAX_FILES    256
+#define CT_ID_LEN       32
+#define CT_TMP_MAX      (PATH_MAX + 4 + CT_ID_LEN)    // <path>.ct-<id>
+
+typedef struct {
+    char magic[8];
+    uint32_t state;                   // 提交点时原地改写，4字节写在扇区内是原子的
+    uint32_t count;
+    uint32_t bytes;                   // 头部之后的条目字节数
+    uint32_t crc;                     // 条目的CRC32
+} ct_journal_header;
+// 其后count个条目：uint16 path_len, uint16 tmp_len, path, tmp
+
+typedef struct {
+    char path[PATH_MAX];
+    char tmp[CT_TMP_MAX];
+    int fd;
+    dev_t dev;
+} ct_entry;
+
+typedef struct {
+    char dir[PATH_MAX - 64];          // 日志目录
+    char id[CT_ID_LEN];
+    ct_entry *files;
+    int count;
+    int lock_fd;                      // 日志目录的flock，事务结束时释放
+} ct_txn;
+
+static inline uint32_t ct_crc32(const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static inline int ct_settle(const char *journal_dir, int committed_only, int *redone,
+                            int *rolledback);
+
+/**
+ * 对日志目录加排他flock
+ * @param nonblock  已被占用时不等待，返回-1且errno为EWOULDBLOCK
+ * @return 持有锁的fd，关闭即释放；失败返回-1并设置errno
+ */
+static inline int ct_lock(const char *journal_dir, int nonblock) {
+    int fd = open(journal_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    while (flock(fd, LOCK_EX | (nonblock ? LOCK_NB : 0)) == -1) {
+        if (errno == EINTR)
+            continue;
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+static inline void ct_unlock(ct_txn *txn) {
+    if (txn->lock_fd != -1) {
+        close(txn->lock_fd);
+        txn->lock_fd = -1;
+    }
+}
+
+/**
+ * 开始事务；等待同一日志目录上的其他事务结束，再完成其中已提交但未完成的事务
+ * @param journal_dir  日志目录（不存在则创建），应与目标文件在同一台机器的持久存储上
+ * @return 成功返回0，失败返回-1并设置errno（仍有已提交的事务无法完成时为EBUSY）
+ */
+static inline int ct_begin(ct_txn *txn, const char *journal_dir) {
+    memset(txn, 0, sizeof(*txn));
+    txn->lock_fd = -1;
+    if (strlen(journal_dir) >= sizeof(txn->dir)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (mkdir(journal_dir, 0700) == -1 && errno != EEXIST)
+        return -1;
+    if ((txn->lock_fd = ct_lock(journal_dir, 0)) == -1)
+        return -1;
+    int pending = ct_settle(journal_dir, 1, NULL, NULL);
+    if (pending != 0) {
+        ct_unlock(txn);
+        if (pending > 0)
+            errno = EBUSY;
+        return -1;
+    }
+    strcpy(txn->dir, journal_dir);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    snprintf(txn->id, sizeof(txn->id), "%llx%05lx",
+             (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec, (long)getpid() & 0xFFFFF);
+    txn->files = calloc(CT_MAX_FILES, sizeof(ct_entry));
+    if (!txn->files) {
+        ct_unlock(txn);
+        return -1;
+    }
+    return 0;
+}
+
+// 现有文件内容是否与data相同
+static inline int ct_same_content(const char *path, const void *data, size_t len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return 0;
+    struct stat st;
+    int same = fstat(fd, &st) == 0 && (size_t)st.st_size == len;
+    char buf[16 * 1024];
+    for (size_t off = 0; same && off < len;) {
+        ssize_t n = read(fd, buf, len - off < sizeof(buf) ? len - off : sizeof(buf));
+        if (n <= 0 || memcmp(buf, (const char *)data + off, n) != 0)
+            same = 0;
+        else
+            off += n;
+    }
+    close(fd);
+    return same;
+}
+
+/**
+ * 暂存一个文件的新内容；同一事务中重复暂存同一路径时以最后一次为准
+ * @param mode  目标不存在时新文件的权限
+ * @return 已暂存返回1，内容未变跳过返回0，失败返回-1并设置errno
+ */
+static inline int ct_stage(ct_txn *txn, const char *path, const void *data, size_t len,
+                           mode_t mode) {
+    ct_entry *e = NULL;
+    for (int i = 0; i < txn->count && !e; i++)
+        if (strcmp(txn->files[i].path, path) == 0)
+            e = &txn->files[i];
+    if (ct_same_content(path, data, len)) {
+        if (e) {
+            // 之前暂存过不同内容，撤掉
+            close(e->fd);
+            unlink(e->tmp);
+            *e = txn->files[--txn->count];
+        }
+        return 0;
+    }
+    if (!e) {
+        if (txn->count == CT_MAX_FILES || strlen(path) >= sizeof(e->path)) {
+            errno = txn->count == CT_MAX_FILES ? E2BIG : ENAMETOOLONG;
+            return -1;
+        }
+        struct stat st;
+        if (stat(path, &st) == 0)
+            mode = st.st_mode & 07777;
+        e = &txn->files[txn->count];
+        strcpy(e->path, path);
+        snprintf(e->tmp, sizeof(e->tmp), "%s.ct-%s", path, txn->id);
+        e->fd = open(e->tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+        if (e->fd == -1)
+            return -1;
+        if (fchmod(e->fd, mode) == -1 || fstat(e->fd, &st) == -1) {
+            int saved = errno;
+            close(e->fd);
+            unlink(e->tmp);
+            errno = saved;
+            return -1;
+        }
+        e->dev = st.st_dev;
+        txn->count++;
+    } else if (ftruncate(e->fd, 0) == -1 || lseek(e->fd, 0, SEEK_SET) == -1) {
+        return -1;
+    }
+    if (aw_write_all(e->fd, data, len) == -1)
+        return -1;
+    return 1;
+}
+
+// 放弃事务，删除全部临时文件
+static inline void ct_abort(ct_txn *txn) {
+    for (int i = 0; i < txn->count; i++) {
+        if (txn->files[i].fd != -1)
+            close(txn->files[i].fd);
+        unlink(txn->files[i].tmp);
+    }
+    free(txn->files);
+    txn->files = NULL;
+    txn->count = 0;
+    ct_unlock(txn);
+}
+
+// 事务涉及的每个目标目录fsync一次
+static inline int ct_sync_dirs(const ct_txn *txn) {
+    char dir[PATH_MAX], prev[PATH_MAX];
+    int ret = 0;
+    for (int i = 0; i < txn->count; i++) {
+        aw_dirname(txn->files[i].path, dir, sizeof(dir));
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) {
+            aw_dirname(txn->files[j].path, prev, sizeof(prev));
+            seen = strcmp(prev, dir) == 0;
+        }
+        if (!seen && aw_fsync_dir(dir) == -1)
+            ret = -1;
+    }
+    return ret;
+}
+
+static inline void ct_journal_path(const char *dir, const char *id, char *out, size_t size) {
+    snprintf(out, size, "%s/%s%s", dir, id, CT_SUFFIX);
+}
+
+/**
+ * 提交事务；无论成功与否事务都结束
+ * @return 成功返回0（没有暂存任何文件也算成功）
+ *         提交点之前失败返回-1，目标全部保持原样；
+ *         提交点之后失败返回-2，已提交，日志保留，由下次ct_begin或ct_recover完成
+ *         剩余的rename；完成之前不能开始新事务
+ */
+static inline int ct_commit(ct_txn *txn) {
+    if (txn->count == 0) {
+        ct_abort(txn);
+        return 0;
+    }
+
+    // 1. 意图日志（状态P），与临时文件一起过屏障
+    size_t bytes = 0;
+    for (int i = 0; i < txn->count; i++)
+        bytes += 4 + strlen(txn->files[i].path) + strlen(txn->files[i].tmp);
+    char *buf = malloc(sizeof(ct_journal_header) + bytes);
+    if (!buf) {
+        ct_abort(txn);
+        return -1;
+    }
+    ct_journal_header *h = (ct_journal_header *)buf;
+    char *p = buf + sizeof(*h);
+    for (int i = 0; i < txn->count; i++) {
+        uint16_t pl = strlen(txn->files[i].path), tl = strlen(txn->files[i].tmp);
+        memcpy(p, &pl, 2);
+        memcpy(p + 2, &tl, 2);
+        memcpy(p + 4, txn->files[i].path, pl);
+        memcpy(p + 4 + pl, txn->files[i].tmp, tl);
+        p += 4 + pl + tl;
+    }
+    memcpy(h->magic, CT_MAGIC, 8);
+    h->state = CT_STATE_PREP;
+    h->count = txn->count;
+    h->bytes = bytes;
+    h->crc = ct_crc32(buf + sizeof(*h), bytes);
+
+    char jpath[PATH_MAX];
+    ct_journal_path(txn->dir, txn->id, jpath, sizeof(jpath));
+    int jfd = open(jpath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    int ok = jfd != -1 && aw_write_all(jfd, buf, sizeof(*h) + bytes) == 0;
+    free(buf);
+
+    // 屏障：每个文件系统一次syncfs（临时文件内容与日志），再fsync各目录（名字）
+    struct stat st;
+    dev_t jdev = ok && fstat(jfd, &st) == 0 ? st.st_dev : 0;
+    for (int i = 0; ok && i < txn->count; i++) {
+        int seen = txn->files[i].dev == jdev;
+        for (int j = 0; j < i && !seen; j++)
+            seen = txn->files[j].dev == txn->files[i].dev;
+        if (!seen && syncfs(txn->files[i].fd) == -1)
+            ok = 0;
+    }
+    ok = ok && syncfs(jfd) == 0 && aw_fsync_dir(txn->dir) == 0 &&
+         ct_sync_dirs(txn) == 0;
+
+    // 2. 提交点
+    uint32_t state = CT_STATE_COMMIT;
+    ok = ok && pwrite(jfd, &state, sizeof(state), offsetof(ct_journal_header, state)) ==
+                   (ssize_t)sizeof(state) && fdatasync(jfd) == 0;
+    if (!ok) {
+        int saved = errno;
+        if (jfd != -1) {
+            close(jfd);
+            unlink(jpath);
+        }
+        ct_abort(txn);
+        errno = saved;
+        return -1;
+    }
+    close(jfd);
+
+    // 3. rename覆盖目标，fsync目标目录
+    int ret = 0;
+    for (int i = 0; i < txn->count; i++) {
+        close(txn->files[i].fd);
+        txn->files[i].fd = -1;
+        if (rename(txn->files[i].tmp, txn->files[i].path) == -1)
+            ret = -2;
+    }
+    if (ct_sync_dirs(txn) == -1)
+        ret = -2;
+
+    // 4. 事务完成，日志不再需要；rename失败时保留，不得在新事务之后重做
+    if (ret == 0)
+        unlink(jpath);
+    free(txn->files);
+    txn->files = NULL;
+    txn->count = 0;
+    ct_unlock(txn);
+    return ret;
+}
+
+/**
+ * 处理一个日志：状态C则完成rename，否则删除临时文件
+ * @param committed_only  只处理状态C的日志，其余原样保留
+ * @return 重做完成返回1，重做时有rename失败返回2（日志应保留），回滚返回0，
+ *         日志无法解析（或committed_only时未提交）返回-1
+ */
+static inline int ct_recover_one(const char *jpath, int committed_only) {
+    int fd = open(jpath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    struct stat st;
+    char *buf = NULL;
+    ct_journal_header h;
+    int ok = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(h) &&
+             (buf = malloc(st.st_size)) && read(fd, buf, st.st_size) == st.st_size;
+    close(fd);
+    if (ok) {
+        memcpy(&h, buf, sizeof(h));
+        ok = memcmp(h.magic, CT_MAGIC, 8) == 0 && (off_t)h.bytes == st.st_size - (off_t)sizeof(h) &&
+             ct_crc32(buf + sizeof(h), h.bytes) == h.crc;
+    }
+    if (!ok) {
+        free(buf);
+        return -1;
+    }
+
+    // 条目只有在CRC正确时才使用
+    int redo = h.state == CT_STATE_COMMIT, failed = 0;
+    if (committed_only && !redo) {
+        free(buf);
+        return -1;
+    }
+    char path[PATH_MAX], tmp[CT_TMP_MAX], dir[PATH_MAX];
+    const char *p = buf + sizeof(h), *end = buf + st.st_size;
+    for (uint32_t i = 0; i < h.count && p + 4 <= end; i++) {
+        uint16_t pl, tl;
+        memcpy(&pl, p, 2);
+        memcpy(&tl, p + 2, 2);
+        if (p + 4 + pl + tl > end || pl >= sizeof(path) || tl >= sizeof(tmp))
+            break;
+        snprintf(path, sizeof(path), "%.*s", pl, p + 4);
+        snprintf(tmp, sizeof(tmp), "%.*s", tl, p + 4 + pl);
+        p += 4 + pl + tl;
+        if (redo) {
+            // 临时文件已不存在说明之前已rename过
+            if (rename(tmp, path) == 0) {
+                aw_dirname(path, dir, sizeof(dir));
+                if (aw_fsync_dir(dir) == -1)
+                    failed = 1;
+            } else if (errno != ENOENT) {
+                failed = 1;
+            }
+        } else {
+            unlink(tmp);
+        }
+    }
+    free(buf);
+    return failed ? 2 : redo;
+}
+
+/**
+ * 扫描日志目录，完成已提交的事务；committed_only为0时还回滚未提交的事务
+ * 调用者须持有日志目录锁，或（锁被占用时）只处理已提交的事务
+ * @return 仍未完成（日志保留）的已提交事务数，日志目录无法读取返回-1
+ */
+static inline int ct_settle(const char *journal_dir, int committed_only, int *redone,
+                            int *rolledback) {
+    int r = 0, b = 0, pending = 0;
+    DIR *d = opendir(journal_dir);
+    if (!d) {
+        if (errno != ENOENT)
+            return -1;
+    } else {
+        struct dirent *de;
+        char jpath[PATH_MAX];
+        size_t sl = strlen(CT_SUFFIX);
+        while ((de = readdir(d))) {
+            size_t n = strlen(de->d_name);
+            if (n <= sl || strcmp(de->d_name + n - sl, CT_SUFFIX) != 0)
+                continue;
+            snprintf(jpath, sizeof(jpath), "%s/%s", journal_dir, de->d_name);
+            int ret = ct_recover_one(jpath, committed_only);
+            if (ret == 2) {
+                pending++;
+                continue;
+            }
+            if (ret == -1 && committed_only)
+                continue;
+            if (ret == 1)
+                r++;
+            else
+                b++;
+            unlink(jpath);
+        }
+        closedir(d);
+        if (r + b)
+            aw_fsync_dir(journal_dir);
+    }
+    if (redone)
+        *redone = r;
+    if (rolledback)
+        *rolledback = b;
+    return pending;
+}
+
+/**
+ * 启动时调用：完成或回滚上次崩溃时未完成的事务
+ * 另一进程正在事务中（日志目录锁被占用）时只完成已提交的事务，不回滚
+ * @param redone      完成的事务数（可为NULL）
+ * @param rolledback  回滚的事务数（可为NULL）
+ * @return 成功返回0；日志目录无法读取，或仍有已提交的事务无法完成（errno为EBUSY，
+ *         日志保留待下次重试）返回-1
+ */
+static inline int ct_recover(const char *journal_dir, int *redone, int *rolledback) {
+    int committed_only = 0;
+    int fd = ct_lock(journal_dir, 1);
+    if (fd == -1) {
+        if (errno == EWOULDBLOCK)
+            committed_only = 1;
+        else if (errno != ENOENT)
+            return -1;
+    }
+    int pending = ct_settle(journal_dir, committed_only, redone, rolledback);
+    if (fd != -1)
+        close(fd);
+    if (pending > 0)
+        errno = EBUSY;
+    return pending == 0 ? 0 : -1;
+}
+
+#endif
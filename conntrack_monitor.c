@@ -0,0 +1,1007 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <endian.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+
+/*
+ * conntrack流监控：订阅NETLINK_NETFILTER的NEW/DESTROY事件，维护按5元组索引的流表，
+ * 周期性输出流量最大的源地址（talker）与各流的字节/包增量。
+ *   - 接收：事件socket用recvmmsg批量接收（-n 个 -b 字节的缓冲区），SO_RCVBUFFORCE
+ *     加大内核缓冲（-r）。ENOBUFS表示内核已丢弃事件，计数并触发一次全量dump重同步。
+ *   - 流表：流记录在一块固定上限（-m）的arena里（MAP_NORESERVE，按使用量占内存），
+ *     空闲记录串成链表复用；索引是开放寻址哈希表，槽位存哈希值与记录下标，
+ *     删除用后移法，不留墓碑。表满时新流只计数，内存不会无限增长。
+ *   - 计数器：事件只在DESTROY带最终计数；存活的流靠每周期一次的CT_GET dump刷新
+ *     （需要 net.netfilter.nf_conntrack_acct=1，-x 关闭周期dump只统计已结束的流）。
+ *     dump走另一个非阻塞socket，与事件在同一个epoll里交替接收，dump期间事件照常处理。
+ *     dump结束时，dump开始前就存在却没出现在dump里的流视为丢失了DESTROY，一并结束。
+ *   - 输出：每周期dump完成后（-x 时在定时器到期时）扫描一遍arena，计算增量、
+ *     汇总talker、选出前N，已结束的流在这次报告后释放。
+ * 流的键是原方向5元组加zone；talker按原方向源地址汇总。
+ */
+#define DEFAULT_INTERVAL_MS 1000
+#define DEFAULT_TOP         10
+#define DEFAULT_MAX_FLOWS   (512 * 1024)        // arena容量（流数）
+#define DEFAULT_RCVBUF      (64 * 1024 * 1024)  // 事件socket内核接收缓冲区
+#define DEFAULT_BATCH       256                 // 单次recvmmsg的消息数
+#define DEFAULT_BUF_SIZE    2048                // 单条事件一般200~400字节
+#define DUMP_BUF_SIZE       (64 * 1024)
+#define NL_ROUNDS           8                   // 每轮epoll事件socket最多接收的批数
+#define EVENT_MIN_TRUESIZE  256                 // 单条事件在接收队列中至少占用的字节
+#define DUMP_ROUNDS         16                  // 每轮epoll dump socket最多recv的次数
+#define TALKER_INIT_CAP     4096
+#define NSEC_PER_SEC        1000000000ULL
+#define FLOW_NIL            UINT32_MAX
+
+enum { FLOW_FREE, FLOW_LIVE, FLOW_CLOSED };
+enum { EV_EVENTS, EV_DUMP, EV_SIGNAL, EV_TIMER };
+
+typedef struct {
+    uint8_t src[16], dst[16];
+    uint16_t sport, dport;       // ICMP为id与type<<8|code
+    uint16_t zone;
+    uint8_t family, proto;
+} FlowKey;
+
+typedef struct {
+    FlowKey key;
+    uint32_t id;                 // 内核conntrack ID
+    uint8_t state;               // FLOW_FREE / FLOW_LIVE / FLOW_CLOSED
+    uint32_t seen_gen;           // 最近一次出现在dump中的轮次
+    uint32_t next_free;          // 空闲链表
+    uint64_t born_ns;            // 进入流表的时刻；dump补进来的记为该dump开始时刻
+    uint64_t bytes[2], pkts[2];  // 最新累计值，[0]原方向 [1]应答方向
+    uint64_t rep_bytes[2], rep_pkts[2];  // 上次报告时的累计值
+} Flow;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t idx;                // 记录下标+1，0表示空槽
+} Slot;
+
+typedef struct {
+    Flow *flows;                 // arena
+    uint32_t max_flows, high;    // 容量；曾经用到的最高下标
+    uint32_t free_head;
+    uint32_t live;               // 索引中的流数
+    Slot *slots;
+    size_t cap;                  // 索引槽位数（2的幂，不小于2*max_flows）
+    uint32_t gen;                // dump轮次
+} FlowTable;
+
+typedef struct {
+    uint8_t addr[16];
+    uint8_t family;
+    uint32_t flows;
+    uint64_t bytes, pkts;
+} Talker;
+
+typedef struct {
+    Talker *slots;
+    size_t cap, count, max_cap;
+} TalkerTable;
+
+// 解析出的一条conntrack消息
+typedef struct {
+    FlowKey key;
+    uint32_t id;
+    int has_counters;
+    uint64_t bytes[2], pkts[2];
+} CtMsg;
+
+typedef struct {
+    double key;
+    FlowKey k;
+    uint64_t bytes, pkts;
+    int closed;
+} TopFlow;
+
+typedef struct {
+    double key;
+    const Talker *t;
+} TopTalker;
+
+static struct {
+    uint64_t events, batches, news, destroys, unknown_destroys, reused;
+    uint64_t enobufs, truncated, table_full, malformed;
+    uint64_t dumps, dumped, pruned, resyncs;
+    uint64_t interval_news, interval_destroys;
+    uint64_t max_dump_ns;
+} st;
+
+/* ---------------- 流表 ---------------- */
+
+static inline uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline uint32_t flow_hash(const FlowKey *k) {
+    uint64_t w[5];
+    memcpy(w, k, sizeof(w));
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 5; i++) {
+        h ^= w[i];
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    return (uint32_t)h;
+}
+
+static int flow_table_init(FlowTable *ft, uint32_t max_flows) {
+    ft->max_flows = max_flows;
+    ft->cap = 1;
+    while (ft->cap < (size_t)max_flows * 2)
+        ft->cap *= 2;
+    // 都是按需缺页的匿名映射：上限固定，实际占用随流数增长
+    ft->flows = mmap(NULL, (size_t)max_flows * sizeof(Flow), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    ft->slots = mmap(NULL, ft->cap * sizeof(Slot), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ft->flows == MAP_FAILED || ft->slots == MAP_FAILED)
+        return -1;
+    ft->free_head = FLOW_NIL;
+    return 0;
+}
+
+// 查找槽位：命中返回该槽，否则返回可插入的空槽
+static Slot *flow_probe(const FlowTable *ft, const FlowKey *k, uint32_t hash) {
+    size_t mask = ft->cap - 1, i = hash & mask;
+    for (;; i = (i + 1) & mask) {
+        Slot *s = &ft->slots[i];
+        if (s->idx == 0 ||
+            (s->hash == hash && memcmp(&ft->flows[s->idx - 1].key, k, sizeof(*k)) == 0))
+            return s;
+    }
+}
+
+static Flow *flow_find(const FlowTable *ft, const FlowKey *k) {
+    Slot *s = flow_probe(ft, k, flow_hash(k));
+    return s->idx ? &ft->flows[s->idx - 1] : NULL;
+}
+
+// 查找或插入；*created返回是否新建，arena满返回NULL
+static Flow *flow_get(FlowTable *ft, const FlowKey *k, int *created) {
+    uint32_t hash = flow_hash(k);
+    Slot *s = flow_probe(ft, k, hash);
+    *created = 0;
+    if (s->idx)
+        return &ft->flows[s->idx - 1];
+
+    uint32_t idx;
+    if (ft->free_head != FLOW_NIL) {
+        idx = ft->free_head;
+        ft->free_head = ft->flows[idx].next_free;
+    } else if (ft->high < ft->max_flows) {
+        idx = ft->high++;
+    } else {
+        return NULL;
+    }
+    Flow *f = &ft->flows[idx];
+    memset(f, 0, sizeof(*f));
+    f->key = *k;
+    f->state = FLOW_LIVE;
+    s->hash = hash;
+    s->idx = idx + 1;
+    ft->live++;
+    *created = 1;
+    return f;
+}
+
+// 从索引删除（后移法，同sock_traffic），记录留在arena里等报告后释放
+static void flow_unindex(FlowTable *ft, const Flow *f) {
+    size_t mask = ft->cap - 1;
+    uint32_t idx = (uint32_t)(f - ft->flows) + 1, hash = flow_hash(&f->key);
+    size_t i = hash & mask, j;
+    while (ft->slots[i].idx != idx)
+        i = (i + 1) & mask;
+    for (j = i;;) {
+        j = (j + 1) & mask;
+        if (!ft->slots[j].idx)
+            break;
+        size_t k = ft->slots[j].hash & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        ft->slots[i] = ft->slots[j];
+        i = j;
+    }
+    ft->slots[i].idx = 0;
+    ft->live--;
+}
+
+static void flow_free(FlowTable *ft, Flow *f) {
+    f->state = FLOW_FREE;
+    f->next_free = ft->free_head;
+    ft->free_head = (uint32_t)(f - ft->flows);
+}
+
+/* ---------------- 消息解析 ---------------- */
+
+#define NLA_OK(a, len) ((len) >= (int)NLA_HDRLEN && (a)->nla_len >= NLA_HDRLEN && \
+                        (a)->nla_len <= (len))
+#define NLA_NEXT(a, len) ((len) -= NLA_ALIGN((a)->nla_len), \
+                          (struct nlattr *)((char *)(a) + NLA_ALIGN((a)->nla_len)))
+#define NLA_DATA(a) ((void *)((char *)(a) + NLA_HDRLEN))
+#define NLA_PAYLOAD(a) ((int)(a)->nla_len - NLA_HDRLEN)
+#define NLA_TYPE(a) ((a)->nla_type & NLA_TYPE_MASK)
+
+static inline uint16_t nla_be16(const struct nlattr *a) {
+    uint16_t v;
+    memcpy(&v, NLA_DATA(a), sizeof(v));
+    return ntohs(v);
+}
+
+static inline uint32_t nla_be32(const struct nlattr *a) {
+    uint32_t v;
+    memcpy(&v, NLA_DATA(a), sizeof(v));
+    return ntohl(v);
+}
+
+static inline uint64_t nla_be64(const struct nlattr *a) {
+    uint64_t v;
+    memcpy(&v, NLA_DATA(a), sizeof(v));
+    return be64toh(v);
+}
+
+// CTA_TUPLE_ORIG：地址、协议与端口，返回0表示地址和协议都齐了
+static int parse_tuple(const struct nlattr *tuple, FlowKey *k) {
+    int have = 0, len = NLA_PAYLOAD(tuple);
+    for (const struct nlattr *a = NLA_DATA(tuple); NLA_OK(a, len); a = NLA_NEXT(a, len)) {
+        int len2 = NLA_PAYLOAD(a);
+        const struct nlattr *b = NLA_DATA(a);
+        switch (NLA_TYPE(a)) {
+        case CTA_TUPLE_IP:
+            for (; NLA_OK(b, len2); b = NLA_NEXT(b, len2)) {
+                int t = NLA_TYPE(b), plen = NLA_PAYLOAD(b);
+                if ((t == CTA_IP_V4_SRC || t == CTA_IP_V4_DST) && plen == 4)
+                    memcpy(t == CTA_IP_V4_SRC ? k->src : k->dst, NLA_DATA(b), 4);
+                else if ((t == CTA_IP_V6_SRC || t == CTA_IP_V6_DST) && plen == 16)
+                    memcpy(t == CTA_IP_V6_SRC ? k->src : k->dst, NLA_DATA(b), 16);
+                else
+                    continue;
+                have |= 1;
+            }
+            break;
+        case CTA_TUPLE_PROTO:
+            for (; NLA_OK(b, len2); b = NLA_NEXT(b, len2)) {
+                switch (NLA_TYPE(b)) {
+                case CTA_PROTO_NUM:
+                    k->proto = *(const uint8_t *)NLA_DATA(b);
+                    have |= 2;
+                    break;
+                case CTA_PROTO_SRC_PORT:
+                case CTA_PROTO_ICMP_ID:
+                case CTA_PROTO_ICMPV6_ID:
+                    k->sport = nla_be16(b);
+                    break;
+                case CTA_PROTO_DST_PORT:
+                    k->dport = nla_be16(b);
+                    break;
+                case CTA_PROTO_ICMP_TYPE:
+                case CTA_PROTO_ICMPV6_TYPE:
+                    k->dport |= *(const uint8_t *)NLA_DATA(b) << 8;
+                    break;
+                case CTA_PROTO_ICMP_CODE:
+                case CTA_PROTO_ICMPV6_CODE:
+                    k->dport |= *(const uint8_t *)NLA_DATA(b);
+                    break;
+                }
+            }
+            break;
+        case CTA_TUPLE_ZONE:
+            k->zone = nla_be16(a);
+            break;
+        }
+    }
+    return have == 3 ? 0 : -1;
+}
+
+static void parse_counters(const struct nlattr *nest, uint64_t *bytes, uint64_t *pkts) {
+    int len = NLA_PAYLOAD(nest);
+    for (const struct nlattr *a = NLA_DATA(nest); NLA_OK(a, len); a = NLA_NEXT(a, len)) {
+        switch (NLA_TYPE(a)) {
+        case CTA_COUNTERS_BYTES:   *bytes = nla_be64(a); break;
+        case CTA_COUNTERS_PACKETS: *pkts = nla_be64(a); break;
+        case CTA_COUNTERS32_BYTES:   *bytes = nla_be32(a); break;
+        case CTA_COUNTERS32_PACKETS: *pkts = nla_be32(a); break;
+        }
+    }
+}
+
+static int ct_parse(const struct nlmsghdr *nlh, CtMsg *m) {
+    const struct nfgenmsg *nfg = NLMSG_DATA(nlh);
+    int len = (int)nlh->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(sizeof(*nfg)));
+    if (len < 0)
+        return -1;
+    memset(m, 0, sizeof(*m));
+    m->key.family = nfg->nfgen_family;
+    int have_tuple = 0;
+    const struct nlattr *a = (const struct nlattr *)((const char *)nfg + NLMSG_ALIGN(sizeof(*nfg)));
+    for (; NLA_OK(a, len); a = NLA_NEXT(a, len)) {
+        switch (NLA_TYPE(a)) {
+        case CTA_TUPLE_ORIG:
+            have_tuple = parse_tuple(a, &m->key) == 0;
+            break;
+        case CTA_COUNTERS_ORIG:
+            parse_counters(a, &m->bytes[0], &m->pkts[0]);
+            m->has_counters = 1;
+            break;
+        case CTA_COUNTERS_REPLY:
+            parse_counters(a, &m->bytes[1], &m->pkts[1]);
+            m->has_counters = 1;
+            break;
+        case CTA_ID:
+            m->id = nla_be32(a);
+            break;
+        case CTA_ZONE:
+            m->key.zone = nla_be16(a);
+            break;
+        }
+    }
+    return have_tuple ? 0 : -1;
+}
+
+static void flow_set_counters(Flow *f, const CtMsg *m) {
+    memcpy(f->bytes, m->bytes, sizeof(f->bytes));
+    memcpy(f->pkts, m->pkts, sizeof(f->pkts));
+}
+
+/*
+ * 表中的流换了conntrack ID：旧连接的DESTROY丢失后同一元组又建了新连接
+ * （同sock_traffic的cookie检查）。旧连接的计数不能与新连接相减，清零重新起算
+ */
+static int flow_reused(Flow *f, const CtMsg *m) {
+    if (!f->id || !m->id || f->id == m->id)
+        return 0;
+    memset(f->bytes, 0, sizeof(f->bytes));
+    memset(f->pkts, 0, sizeof(f->pkts));
+    memset(f->rep_bytes, 0, sizeof(f->rep_bytes));
+    memset(f->rep_pkts, 0, sizeof(f->rep_pkts));
+    st.reused++;
+    return 1;
+}
+
+/* ---------------- 事件与dump ---------------- */
+
+static void handle_event(FlowTable *ft, const struct nlmsghdr *nlh, uint64_t now) {
+    if (NFNL_SUBSYS_ID(nlh->nlmsg_type) != NFNL_SUBSYS_CTNETLINK)
+        return;
+    CtMsg m;
+    if (ct_parse(nlh, &m) == -1) {
+        st.malformed++;
+        return;
+    }
+    int created;
+    Flow *f;
+    switch (NFNL_MSG_TYPE(nlh->nlmsg_type)) {
+    case IPCTNL_MSG_CT_NEW:
+        st.news++;
+        st.interval_news++;
+        if (!(f = flow_get(ft, &m.key, &created))) {
+            st.table_full++;
+            return;
+        }
+        if (created || flow_reused(f, &m)) {
+            // 新流从0起算，建立时已有的字节也计入第一个周期
+            f->born_ns = now;
+            if (m.has_counters)
+                flow_set_counters(f, &m);
+        }
+        f->id = m.id;
+        break;
+    case IPCTNL_MSG_CT_DELETE:
+        st.destroys++;
+        st.interval_destroys++;
+        if (!(f = flow_find(ft, &m.key))) {
+            st.unknown_destroys++;    // NEW在启动前、丢失或表满时未跟踪
+            return;
+        }
+        if (m.has_counters)
+            flow_set_counters(f, &m);
+        flow_unindex(ft, f);
+        f->state = FLOW_CLOSED;
+        break;
+    }
+}
+
+// dump中的一条流：刷新计数器；不在表中的按dump开始时刻补入，基线取当前值不产生增量
+static void handle_dumped(FlowTable *ft, const struct nlmsghdr *nlh, uint64_t dump_start) {
+    CtMsg m;
+    if (ct_parse(nlh, &m) == -1) {
+        st.malformed++;
+        return;
+    }
+    st.dumped++;
+    int created;
+    Flow *f = flow_get(ft, &m.key, &created);
+    if (!f) {
+        st.table_full++;
+        return;
+    }
+    if (created || flow_reused(f, &m)) {
+        f->born_ns = dump_start;
+        memcpy(f->rep_bytes, m.bytes, sizeof(f->rep_bytes));
+        memcpy(f->rep_pkts, m.pkts, sizeof(f->rep_pkts));
+    }
+    if (m.has_counters)
+        flow_set_counters(f, &m);
+    f->id = m.id;
+    f->seen_gen = ft->gen;
+}
+
+/*
+ * dump开始前就存在、却没出现在dump里的流，其DESTROY事件已丢失。
+ * 调用前要先收完事件socket里已排队的事件：dump走完时已删除的流，
+ * DESTROY可能还在队列里没处理，先清剪会丢掉它带的最终计数
+ */
+static void dump_prune(FlowTable *ft, uint64_t dump_start) {
+    for (uint32_t i = 0; i < ft->high; i++) {
+        Flow *f = &ft->flows[i];
+        if (f->state == FLOW_LIVE && f->seen_gen != ft->gen && f->born_ns < dump_start) {
+            flow_unindex(ft, f);
+            f->state = FLOW_CLOSED;
+            st.pruned++;
+        }
+    }
+}
+
+typedef struct {
+    int fd;
+    int active;
+    uint32_t seq;
+    uint64_t start_ns;
+    int resync;                  // 完成后是否因为ENOBUFS需要再来一次
+    char *buf;
+} DumpState;
+
+static int dump_start(DumpState *d, FlowTable *ft) {
+    struct {
+        struct nlmsghdr nlh;
+        struct nfgenmsg nfg;
+    } req = {
+        .nlh = {
+            .nlmsg_len = sizeof(req),
+            .nlmsg_type = (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_GET,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+            .nlmsg_seq = ++d->seq,
+        },
+        .nfg = { .nfgen_family = AF_UNSPEC, .version = NFNETLINK_V0 },
+    };
+    d->start_ns = mono_ns();
+    if (send(d->fd, &req, sizeof(req), 0) == -1) {
+        perror("conntrack dump");
+        return -1;
+    }
+    d->active = 1;
+    ft->gen++;
+    return 0;
+}
+
+// 接收一部分dump应答；返回1表示dump已结束
+static int dump_drain(DumpState *d, FlowTable *ft) {
+    for (int round = 0; round < DUMP_ROUNDS; round++) {
+        ssize_t n = recv(d->fd, d->buf, DUMP_BUF_SIZE, MSG_DONTWAIT);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EINTR)
+                return 0;
+            // dump期间丢了应答（ENOBUFS）或其他错误：放弃本轮，下周期重来
+            fprintf(stderr, "conntrack dump: %s\n", strerror(errno));
+            d->active = 0;
+            d->resync = 1;
+            return 0;
+        }
+        struct nlmsghdr *nlh = (struct nlmsghdr *)d->buf;
+        int remain = (int)n;
+        for (; NLMSG_OK(nlh, remain); nlh = NLMSG_NEXT(nlh, remain)) {
+            if (nlh->nlmsg_seq != d->seq)
+                continue;
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                d->active = 0;
+                st.dumps++;
+                return 1;
+            }
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *err = NLMSG_DATA(nlh);
+                fprintf(stderr, "conntrack dump: %s\n", strerror(-err->error));
+                d->active = 0;
+                return 0;
+            }
+            handle_dumped(ft, nlh, d->start_ns);
+        }
+    }
+    return 0;
+}
+
+/* ---------------- 报告 ---------------- */
+
+static inline size_t talker_hash(const uint8_t *addr) {
+    uint64_t a, b;
+    memcpy(&a, addr, 8);
+    memcpy(&b, addr + 8, 8);
+    return (size_t)(((a ^ (b * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL) >> 32);
+}
+
+static Talker *talker_probe(Talker *slots, size_t cap, const uint8_t *addr, uint8_t family) {
+    size_t i = talker_hash(addr) & (cap - 1);
+    while (slots[i].family != 0 &&
+           (slots[i].family != family || memcmp(slots[i].addr, addr, 16) != 0))
+        i = (i + 1) & (cap - 1);
+    return &slots[i];
+}
+
+// 负载因子超过1/2时扩容，容量上限与流表索引相同
+static void talker_add(TalkerTable *tt, const FlowKey *k, uint64_t bytes, uint64_t pkts) {
+    Talker *t = talker_probe(tt->slots, tt->cap, k->src, k->family);
+    if (!t->family) {
+        if ((tt->count + 1) * 2 > tt->cap && tt->cap < tt->max_cap) {
+            size_t new_cap = tt->cap * 2;
+            Talker *slots = calloc(new_cap, sizeof(*slots));
+            if (slots) {
+                for (size_t i = 0; i < tt->cap; i++)
+                    if (tt->slots[i].family)
+                        *talker_probe(slots, new_cap, tt->slots[i].addr,
+                                      tt->slots[i].family) = tt->slots[i];
+                free(tt->slots);
+                tt->slots = slots;
+                tt->cap = new_cap;
+            }
+            t = talker_probe(tt->slots, tt->cap, k->src, k->family);
+        }
+        memcpy(t->addr, k->src, 16);
+        t->family = k->family;
+        tt->count++;
+    }
+    t->flows++;
+    t->bytes += bytes;
+    t->pkts += pkts;
+}
+
+static void top_flow_push(TopFlow *top, int *n, int max, const TopFlow *item) {
+    if (*n == max && item->key <= top[*n - 1].key)
+        return;
+    int i = *n < max ? (*n)++ : *n - 1;
+    while (i > 0 && top[i - 1].key < item->key) {
+        top[i] = top[i - 1];
+        i--;
+    }
+    top[i] = *item;
+}
+
+static void top_talker_push(TopTalker *top, int *n, int max, double key, const Talker *t) {
+    if (*n == max && key <= top[*n - 1].key)
+        return;
+    int i = *n < max ? (*n)++ : *n - 1;
+    while (i > 0 && top[i - 1].key < key) {
+        top[i] = top[i - 1];
+        i--;
+    }
+    top[i].key = key;
+    top[i].t = t;
+}
+
+static const char *proto_name(uint8_t proto, char *buf, size_t size) {
+    switch (proto) {
+    case IPPROTO_TCP:    return "tcp";
+    case IPPROTO_UDP:    return "udp";
+    case IPPROTO_ICMP:   return "icmp";
+    case IPPROTO_ICMPV6: return "icmp6";
+    case IPPROTO_SCTP:   return "sctp";
+    case IPPROTO_GRE:    return "gre";
+    }
+    snprintf(buf, size, "%u", proto);
+    return buf;
+}
+
+static void format_endpoint(char *out, size_t size, int family, const uint8_t *addr,
+                            uint16_t port, int with_port) {
+    char ip[INET6_ADDRSTRLEN] = "?";
+    if (family == AF_INET || family == AF_INET6)
+        inet_ntop(family, addr, ip, sizeof(ip));
+    if (!with_port)
+        snprintf(out, size, "%s", ip);
+    else
+        snprintf(out, size, family == AF_INET6 ? "[%s]:%u" : "%s:%u", ip, port);
+}
+
+/*
+ * 扫描arena：计算各流自上次报告以来的增量，汇总talker并选出前N；
+ * 已结束的流报告后释放。arena只扫到曾用过的最高下标
+ */
+static void report(FlowTable *ft, TalkerTable *tt, TopFlow *top_flows, TopTalker *top_talkers,
+                   int ntop, double dt, int quiet) {
+    int nflows = 0, ntalkers = 0;
+    uint64_t total_bytes = 0, total_pkts = 0, closed = 0;
+    memset(tt->slots, 0, tt->cap * sizeof(*tt->slots));
+    tt->count = 0;
+    for (uint32_t i = 0; i < ft->high; i++) {
+        Flow *f = &ft->flows[i];
+        if (f->state == FLOW_FREE)
+            continue;
+        uint64_t bytes = 0, pkts = 0;
+        for (int d = 0; d < 2; d++) {
+            bytes += f->bytes[d] > f->rep_bytes[d] ? f->bytes[d] - f->rep_bytes[d] : 0;
+            pkts += f->pkts[d] > f->rep_pkts[d] ? f->pkts[d] - f->rep_pkts[d] : 0;
+        }
+        if (bytes || pkts) {
+            total_bytes += bytes;
+            total_pkts += pkts;
+            if (!quiet) {
+                talker_add(tt, &f->key, bytes, pkts);
+                TopFlow item = { .key = (double)bytes, .k = f->key, .bytes = bytes,
+                                 .pkts = pkts, .closed = f->state == FLOW_CLOSED };
+                top_flow_push(top_flows, &nflows, ntop, &item);
+            }
+        }
+        memcpy(f->rep_bytes, f->bytes, sizeof(f->rep_bytes));
+        memcpy(f->rep_pkts, f->pkts, sizeof(f->rep_pkts));
+        if (f->state == FLOW_CLOSED) {
+            flow_free(ft, f);
+            closed++;
+        }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    printf("[%ld.%03ld] flows=%u new=%llu destroyed=%llu bytes=%llu pkts=%llu (%.2f KB/s) "
+           "enobufs=%llu table_full=%llu\n", (long)now.tv_sec, now.tv_nsec / 1000000, ft->live,
+           (unsigned long long)st.interval_news, (unsigned long long)st.interval_destroys,
+           (unsigned long long)total_bytes, (unsigned long long)total_pkts,
+           dt > 0 ? total_bytes / dt / 1024 : 0.0, (unsigned long long)st.enobufs,
+           (unsigned long long)st.table_full);
+    st.interval_news = st.interval_destroys = 0;
+    if (quiet) {
+        fflush(stdout);
+        return;
+    }
+
+    for (size_t i = 0; i < tt->cap; i++)
+        if (tt->slots[i].family)
+            top_talker_push(top_talkers, &ntalkers, ntop, (double)tt->slots[i].bytes,
+                            &tt->slots[i]);
+    char a[64], b[64], p[8];
+    if (ntalkers) {
+        printf("  %-40s %7s %14s %10s %12s\n", "TALKER", "FLOWS", "BYTES", "PKTS", "KB/s");
+        for (int i = 0; i < ntalkers; i++) {
+            const Talker *t = top_talkers[i].t;
+            format_endpoint(a, sizeof(a), t->family, t->addr, 0, 0);
+            printf("  %-40s %7u %14llu %10llu %12.2f\n", a, t->flows,
+                   (unsigned long long)t->bytes, (unsigned long long)t->pkts,
+                   dt > 0 ? t->bytes / dt / 1024 : 0.0);
+        }
+    }
+    if (nflows) {
+        printf("  %-5s %-64s %14s %10s\n", "PROTO", "FLOW", "BYTES", "PKTS");
+        for (int i = 0; i < nflows; i++) {
+            const TopFlow *t = &top_flows[i];
+            char flow[160];
+            format_endpoint(a, sizeof(a), t->k.family, t->k.src, t->k.sport, 1);
+            format_endpoint(b, sizeof(b), t->k.family, t->k.dst, t->k.dport, 1);
+            snprintf(flow, sizeof(flow), "%s -> %s%s", a, b, t->closed ? " [closed]" : "");
+            printf("  %-5s %-64s %14llu %10llu\n", proto_name(t->k.proto, p, sizeof(p)), flow,
+                   (unsigned long long)t->bytes, (unsigned long long)t->pkts);
+        }
+    }
+    if (ntalkers || nflows)
+        printf("--------------------------------\n");
+    fflush(stdout);
+}
+
+/* ---------------- 主循环 ---------------- */
+
+static struct {
+    char *mem;
+    size_t buf_size;
+    int count;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+} pool;
+
+static int pool_init(size_t buf_size, int count) {
+    pool.buf_size = buf_size;
+    pool.count = count;
+    pool.mem = malloc(buf_size * count);
+    pool.msgs = calloc(count, sizeof(*pool.msgs));
+    pool.iov = calloc(count, sizeof(*pool.iov));
+    if (!pool.mem || !pool.msgs || !pool.iov)
+        return -1;
+    for (int i = 0; i < count; i++)
+        pool.iov[i] = (struct iovec){ pool.mem + (size_t)i * buf_size, buf_size };
+    return 0;
+}
+
+enum { DRAIN_LOST = 1, DRAIN_EMPTY = 2 };
+
+// 收至多rounds批事件并同步处理；返回DRAIN_LOST（发生了ENOBUFS）与DRAIN_EMPTY（已收空）
+static int events_drain(int fd, FlowTable *ft, int rounds) {
+    int ret = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < pool.count; i++)
+            pool.msgs[i].msg_hdr = (struct msghdr){ .msg_iov = &pool.iov[i], .msg_iovlen = 1 };
+        int n = recvmmsg(fd, pool.msgs, pool.count, MSG_DONTWAIT, NULL);
+        if (n == -1) {
+            if (errno == ENOBUFS) {
+                st.enobufs++;         // 内核已丢弃事件，继续收
+                ret |= DRAIN_LOST;
+                continue;
+            }
+            if (errno != EAGAIN && errno != EINTR)
+                fprintf(stderr, "conntrack events: %s\n", strerror(errno));
+            return ret | DRAIN_EMPTY;
+        }
+        st.batches++;
+        uint64_t now = mono_ns();
+        for (int i = 0; i < n; i++) {
+            if (pool.msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                st.truncated++;
+                continue;
+            }
+            struct nlmsghdr *nlh = pool.iov[i].iov_base;
+            int remain = (int)pool.msgs[i].msg_len;
+            for (; NLMSG_OK(nlh, remain); nlh = NLMSG_NEXT(nlh, remain)) {
+                st.events++;
+                handle_event(ft, nlh, now);
+            }
+        }
+        if (n < pool.count)
+            return ret | DRAIN_EMPTY;
+    }
+    return ret;
+}
+
+static int nf_open(unsigned groups, int rcvbuf) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_NETFILTER);
+    if (fd == -1)
+        return -1;
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = groups };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    // 特权进程用SO_RCVBUFFORCE突破rmem_max
+    if (rcvbuf && setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    return fd;
+}
+
+static void print_stats(const FlowTable *ft, uint64_t wakeups) {
+    fprintf(stderr, "[STATS] events=%llu batches=%llu wakeups=%llu new=%llu destroy=%llu "
+            "unknown_destroy=%llu reused=%llu malformed=%llu truncated=%llu\n",
+            (unsigned long long)st.events, (unsigned long long)st.batches,
+            (unsigned long long)wakeups, (unsigned long long)st.news,
+            (unsigned long long)st.destroys, (unsigned long long)st.unknown_destroys,
+            (unsigned long long)st.reused, (unsigned long long)st.malformed, (unsigned long long)st.truncated);
+    fprintf(stderr, "[STATS] enobufs=%llu resyncs=%llu table_full=%llu dumps=%llu dumped=%llu "
+            "pruned=%llu max_dump=%.1fms\n",
+            (unsigned long long)st.enobufs, (unsigned long long)st.resyncs,
+            (unsigned long long)st.table_full, (unsigned long long)st.dumps,
+            (unsigned long long)st.dumped, (unsigned long long)st.pruned, st.max_dump_ns / 1e6);
+    fprintf(stderr, "[STATS] flows=%u arena=%u/%u (%.1fMB used of %.1fMB) index=%zu slots\n",
+            ft->live, ft->high, ft->max_flows, (double)ft->high * sizeof(Flow) / 1048576,
+            (double)ft->max_flows * sizeof(Flow) / 1048576, ft->cap);
+}
+
+static int acct_enabled(void) {
+    FILE *f = fopen("/proc/sys/net/netfilter/nf_conntrack_acct", "r");
+    int v = -1;
+    if (f) {
+        if (fscanf(f, "%d", &v) != 1)
+            v = -1;
+        fclose(f);
+    }
+    return v;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-i ms] [-n top] [-m max_flows] [-r rcvbuf] [-B batch] [-b bytes]\n"
+            "          [-x] [-c count] [-q]\n"
+            "  -i  报告间隔（毫秒，默认%d）\n"
+            "  -n  列出增量最大的talker/流数（默认%d）\n"
+            "  -m  流表容量，超出的新流只计数（默认%d，每条%zu字节）\n"
+            "  -r  事件socket内核接收缓冲区（默认%d）\n"
+            "  -B  单次recvmmsg接收的事件数（默认%d）\n"
+            "  -b  单个接收缓冲区大小（默认%d）\n"
+            "  -x  不做周期dump，只统计已结束流的最终计数（事件量极大时减轻负载；丢事件后仍会重同步）\n"
+            "  -c  报告多少次后退出\n"
+            "  -q  只打印每周期的汇总行\n",
+            prog, DEFAULT_INTERVAL_MS, DEFAULT_TOP, DEFAULT_MAX_FLOWS, sizeof(Flow),
+            DEFAULT_RCVBUF, DEFAULT_BATCH, DEFAULT_BUF_SIZE);
+}
+
+int main(int argc, char **argv) {
+    long interval_ms = DEFAULT_INTERVAL_MS, max_flows = DEFAULT_MAX_FLOWS;
+    int ntop = DEFAULT_TOP, rcvbuf = DEFAULT_RCVBUF, batch = DEFAULT_BATCH;
+    int buf_size = DEFAULT_BUF_SIZE, no_dump = 0, quiet = 0;
+    long long count = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:n:m:r:B:b:xc:q")) != -1) {
+        switch (opt) {
+        case 'i': interval_ms = strtol(optarg, NULL, 10); break;
+        case 'n': ntop = atoi(optarg); break;
+        case 'm': max_flows = strtol(optarg, NULL, 10); break;
+        case 'r': rcvbuf = atoi(optarg); break;
+        case 'B': batch = atoi(optarg); break;
+        case 'b': buf_size = atoi(optarg); break;
+        case 'x': no_dump = 1; break;
+        case 'c': count = strtoll(optarg, NULL, 10); break;
+        case 'q': quiet = 1; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (interval_ms <= 0 || ntop <= 0 || max_flows <= 0 || max_flows >= FLOW_NIL / 2 ||
+        rcvbuf < 0 || batch <= 0 || buf_size < 256 || count < 0 || optind != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FlowTable ft = {0};
+    TalkerTable tt = { .cap = TALKER_INIT_CAP };
+    DumpState dump = { .fd = -1 };
+    if (flow_table_init(&ft, (uint32_t)max_flows) == -1 || pool_init(buf_size, batch) == -1 ||
+        !(tt.slots = calloc(tt.cap, sizeof(*tt.slots))) ||
+        !(dump.buf = malloc(DUMP_BUF_SIZE))) {
+        perror("Failed to allocate flow table");
+        return EXIT_FAILURE;
+    }
+    tt.max_cap = ft.cap > TALKER_INIT_CAP ? ft.cap : TALKER_INIT_CAP;
+    TopFlow *top_flows = calloc(ntop, sizeof(*top_flows));
+    TopTalker *top_talkers = calloc(ntop, sizeof(*top_talkers));
+    if (!top_flows || !top_talkers) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    int efd = nf_open((1 << (NFNLGRP_CONNTRACK_NEW - 1)) | (1 << (NFNLGRP_CONNTRACK_DESTROY - 1)),
+                      rcvbuf);
+    if (efd == -1) {
+        perror("conntrack events (need CAP_NET_ADMIN)");
+        return EXIT_FAILURE;
+    }
+    // -x 时也保留dump socket：启动基线与ENOBUFS后的重同步都靠它
+    if ((dump.fd = nf_open(0, 0)) == -1) {
+        perror("conntrack dump socket");
+        return EXIT_FAILURE;
+    }
+    if (acct_enabled() == 0)
+        fprintf(stderr, "Warning: nf_conntrack_acct=0, flows carry no byte/packet counters "
+                "(sysctl -w net.netfilter.nf_conntrack_acct=1)\n");
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec its = {
+        .it_value    = { interval_ms / 1000, (interval_ms % 1000) * 1000000L },
+        .it_interval = { interval_ms / 1000, (interval_ms % 1000) * 1000000L },
+    };
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (sfd == -1 || tfd == -1 || ep == -1 || timerfd_settime(tfd, 0, &its, NULL) == -1) {
+        perror("signalfd/timerfd/epoll");
+        return EXIT_FAILURE;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = EV_EVENTS };
+    epoll_ctl(ep, EPOLL_CTL_ADD, efd, &ev);
+    ev.data.u32 = EV_SIGNAL;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev);
+    ev.data.u32 = EV_TIMER;
+    epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev);
+    ev.data.u32 = EV_DUMP;
+    epoll_ctl(ep, EPOLL_CTL_ADD, dump.fd, &ev);
+    // 启动时先dump一次，已有的流作为基线
+    dump_start(&dump, &ft);
+    fprintf(stderr, "Listening for conntrack events...\n");
+
+    int prune_rounds = rcvbuf / (EVENT_MIN_TRUESIZE * batch) + NL_ROUNDS;
+    uint64_t wakeups = 0, reports = 0, last_report = mono_ns();
+    int running = 1, report_pending = 0;
+    while (running && (!count || (long long)reports < count)) {
+        struct epoll_event events[4];
+        int n = epoll_wait(ep, events, 4, -1);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        wakeups++;
+        for (int i = 0; i < n; i++) {
+            switch (events[i].data.u32) {
+            case EV_EVENTS:
+                // 丢了事件：流表与内核不一致，dump一次补齐NEW、清掉丢了DESTROY的流
+                if (events_drain(efd, &ft, NL_ROUNDS) & DRAIN_LOST) {
+                    dump.resync = 1;
+                    st.resyncs++;
+                }
+                break;
+            case EV_DUMP:
+                if (dump.active && dump_drain(&dump, &ft)) {
+                    // DONE之前排队的事件最多一整个接收缓冲区；持续过载时收不空，
+                    // 收够这么多也照样清剪，免得流表只增不减
+                    if (events_drain(efd, &ft, prune_rounds) & DRAIN_LOST) {
+                        dump.resync = 1;
+                        st.resyncs++;
+                    }
+                    dump_prune(&ft, dump.start_ns);
+                    uint64_t took = mono_ns() - dump.start_ns;
+                    if (took > st.max_dump_ns)
+                        st.max_dump_ns = took;
+                }
+                break;
+            case EV_SIGNAL: {
+                struct signalfd_siginfo si;
+                while (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGUSR1)
+                        print_stats(&ft, wakeups);
+                    else
+                        running = 0;
+                }
+                break;
+            }
+            case EV_TIMER: {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+                    break;
+                report_pending = 1;
+                // 上一轮dump还没结束时不叠加，本周期直接用已有的计数器
+                if (!no_dump && !dump.active)
+                    dump_start(&dump, &ft);
+                break;
+            }
+            }
+        }
+        // 报告等本周期的dump结束，计数器是最新的
+        if (report_pending && !dump.active) {
+            uint64_t now = mono_ns();
+            report(&ft, &tt, top_flows, top_talkers, ntop,
+                   (double)(now - last_report) / NSEC_PER_SEC, quiet);
+            last_report = now;
+            report_pending = 0;
+            reports++;
+        }
+        if (dump.resync && !dump.active) {
+            dump.resync = 0;
+            dump_start(&dump, &ft);
+        }
+    }
+
+    print_stats(&ft, wakeups);
+    close(efd);
+    close(dump.fd);
+    close(sfd);
+    close(tfd);
+    close(ep);
+    munmap(ft.flows, (size_t)ft.max_flows * sizeof(Flow));
+    munmap(ft.slots, ft.cap * sizeof(Slot));
+    free(tt.slots);
+    free(top_flows);
+    free(top_talkers);
+    free(pool.mem);
+    free(pool.msgs);
+    free(pool.iov);
+    free(dump.buf);
+    return 0;
+}
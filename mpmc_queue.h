@@ -0,0 +1,89 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * 有界无锁多生产者多消费者队列（Dmitry Vyukov的环形数组算法）
+ * 每个单元带序号：seq == pos 表示可写，seq == pos + 1 表示可读；
+ * 生产者/消费者各自CAS推进位置，不需要锁，满/空时立即返回失败由调用方决定等待策略。
+ * 容量必须为2的幂。
+ */
+typedef struct {
+    size_t seq;
+    void *data;
+} mpmc_cell;
+
+typedef struct {
+    mpmc_cell *cells;
+    size_t mask;
+    // 生产者、消费者位置各占一个缓存行，避免互相伪共享
+    size_t enqueue_pos __attribute__((aligned(64)));
+    size_t dequeue_pos __attribute__((aligned(64)));
+} mpmc_queue;
+
+static inline int mpmc_init(mpmc_queue *q, size_t capacity) {
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+        return -1;
+    q->cells = malloc(capacity * sizeof(mpmc_cell));
+    if (!q->cells)
+        return -1;
+    for (size_t i = 0; i < capacity; i++)
+        __atomic_store_n(&q->cells[i].seq, i, __ATOMIC_RELAXED);
+    q->mask = capacity - 1;
+    __atomic_store_n(&q->enqueue_pos, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->dequeue_pos, 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static inline void mpmc_destroy(mpmc_queue *q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+// 入队，队列满返回-1
+static inline int mpmc_push(mpmc_queue *q, void *data) {
+    size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        mpmc_cell *cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->data = data;
+                __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (dif < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// 出队，队列空返回NULL
+static inline void *mpmc_pop(mpmc_queue *q) {
+    size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        mpmc_cell *cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                void *data = cell->data;
+                __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+                return data;
+            }
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+#endif // MPMC_QUEUE_H
@@ -1,3 +1,5 @@
+#include "config_txn.h"
+
 #include <netlink/netlink.h>
 #include <netlink/route/link.h>
 #include <netlink/route/addr.h>
@@ -5,9 +7,22 @@
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/netlink.h>
 
 // 依赖第三方工具 apt install -y libnl-3-dev libnl-route-3-dev libnl-genl-3-dev
 static struct nl_cache *link_cache = NULL;
+static struct nl_cache *addr_cache = NULL;
+static struct nl_cache_mngr *cache_mngr = NULL;
+static struct nl_sock *cache_sock = NULL;       // cache manager接收通知的socket
 
 #include <netlink/netlink.h>
 #include <netlink/route/link.h>
@@ -17,120 +32,313 @@ static struct nl_cache *link_cache = NULL;
 #include <stdlib.h>
 #include <string.h>
 
+/* ---------------- 接口缓存 ---------------- */
+
+/*
+ * link_cache/addr_cache由cache manager维护：启动时dump一次，之后靠
+ * RTNLGRP_LINK、RTNLGRP_IPV4_IFADDR、RTNLGRP_IPV6_IFADDR通知增量更新，
+ * 启动后新建的接口（如容器的veth）无需重新dump即可使用。
+ * 链路变化回调同步维护 ifname -> ifindex 哈希索引（开放寻址，线性探测）。
+ * 通知溢出（ENOBUFS）时才整表重新dump。
+ */
+#define CACHE_RCVBUF (4 * 1024 * 1024)
+
+typedef struct {
+    int ifindex;                      // 0为空槽
+    char name[IFNAMSIZ];
+} IfEntry;
+
+static struct {
+    IfEntry *slots;
+    uint32_t mask, count;
+} ifindex_by_name;
+
+static uint32_t ifname_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    while (*name)
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    return h;
+}
+
+static IfEntry *ifname_slot(const char *name) {
+    for (uint32_t i = ifname_hash(name);; i++) {
+        IfEntry *e = &ifindex_by_name.slots[i & ifindex_by_name.mask];
+        if (e->ifindex == 0 || strcmp(e->name, name) == 0)
+            return e;
+    }
+}
+
+static void ifname_remove(const char *name) {
+    IfEntry *e = ifname_slot(name);
+    if (e->ifindex == 0)
+        return;
+    ifindex_by_name.count--;
+    // 后移删除：把探测链上后续的条目挪到空位，保持查找不断链
+    uint32_t mask = ifindex_by_name.mask;
+    uint32_t hole = e - ifindex_by_name.slots;
+    for (uint32_t i = (hole + 1) & mask;; i = (i + 1) & mask) {
+        IfEntry *n = &ifindex_by_name.slots[i];
+        if (n->ifindex == 0)
+            break;
+        uint32_t home = ifname_hash(n->name) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            ifindex_by_name.slots[hole] = *n;
+            hole = i;
+        }
+    }
+    ifindex_by_name.slots[hole].ifindex = 0;
+}
+
+static int ifname_insert(const char *name, int ifindex) {
+    if ((ifindex_by_name.count + 1) * 4 > (ifindex_by_name.mask + 1) * 3) {
+        uint32_t cap = ifindex_by_name.slots ? (ifindex_by_name.mask + 1) * 2 : 256;
+        IfEntry *old = ifindex_by_name.slots;
+        uint32_t old_cap = old ? ifindex_by_name.mask + 1 : 0;
+        IfEntry *slots = calloc(cap, sizeof(IfEntry));
+        if (!slots)
+            return -1;
+        ifindex_by_name.slots = slots;
+        ifindex_by_name.mask = cap - 1;
+        for (uint32_t i = 0; i < old_cap; i++)
+            if (old[i].ifindex)
+                *ifname_slot(old[i].name) = old[i];
+        free(old);
+    }
+    IfEntry *e = ifname_slot(name);
+    if (e->ifindex == 0)
+        ifindex_by_name.count++;
+    e->ifindex = ifindex;
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    return 0;
+}
+
+// 接口名解析为ifindex，O(1)；不存在返回0
+static int link_ifindex(const char *ifname) {
+    if (!ifindex_by_name.slots || strlen(ifname) >= IFNAMSIZ)
+        return 0;
+    return ifname_slot(ifname)->ifindex;
+}
+
+// 链路变化：old/new分别为变化前后的对象（新增时old为NULL，删除时new为NULL）
+static void link_changed(struct nl_cache *cache, struct nl_object *old_obj,
+                         struct nl_object *new_obj, uint64_t diff, int action, void *arg) {
+    const char *name;
+    if (old_obj && (name = rtnl_link_get_name((struct rtnl_link *)old_obj)))
+        ifname_remove(name);
+    if (new_obj && action != NL_ACT_DEL &&
+        (name = rtnl_link_get_name((struct rtnl_link *)new_obj)))
+        ifname_insert(name, rtnl_link_get_ifindex((struct rtnl_link *)new_obj));
+}
+
+static void index_link(struct nl_object *obj, void *arg) {
+    struct rtnl_link *link = (struct rtnl_link *)obj;
+    if (rtnl_link_get_name(link))
+        ifname_insert(rtnl_link_get_name(link), rtnl_link_get_ifindex(link));
+}
+
+static void rebuild_ifindex(void) {
+    free(ifindex_by_name.slots);
+    memset(&ifindex_by_name, 0, sizeof(ifindex_by_name));
+    nl_cache_foreach(link_cache, index_link, NULL);
+}
+
 /**
- * 添加IP地址、子网掩码、默认网关并配置DNS
- * @param sk         Netlink套接字
- * @param ifname     接口名（如eth0）
- * @param ip_cidr    IP地址/CIDR（如192.168.1.10/24）
- * @param gateway    默认网关（如192.168.1.1，NULL表示不配置）
- * @param dns_servers DNS服务器数组（如{"8.8.8.8", "1.1.1.1"}）
- * @param dns_count  DNS服务器数量
+ * 建立由通知维护的链路/地址缓存（启动时唯一一次全量dump）
  * @return 成功返回0，失败返回-1
  */
-static int configure_network(
-    struct nl_sock *sk, 
-    const char *ifname,
-    const char *ip_cidr,
-    const char *gateway,
-    const char **dns_servers,
-    int dns_count
-) {
-    // 获取接口对象
-    struct rtnl_link *link = rtnl_link_get_by_name(link_cache, ifname);
-    if (!link) {
-        fprintf(stderr, "接口 %s 不存在\n", ifname);
+static int cache_init(void) {
+    struct nl_sock *msk = cache_sock = nl_socket_alloc();
+    int ret;
+    if (!msk)
+        return -1;
+    if ((ret = nl_cache_mngr_alloc(msk, NETLINK_ROUTE, NL_AUTO_PROVIDE, &cache_mngr)) < 0 ||
+        (ret = rtnl_link_alloc_cache_flags(NULL, AF_UNSPEC, &link_cache, 0)) < 0 ||
+        (ret = nl_cache_mngr_add_cache_v2(cache_mngr, link_cache, link_changed, NULL)) < 0 ||
+        (ret = nl_cache_mngr_add(cache_mngr, "route/addr", NULL, NULL, &addr_cache)) < 0) {
+        fprintf(stderr, "初始化接口缓存失败: %s\n", nl_geterror(ret));
         return -1;
     }
+    // 突发大量接口变化（批量创建容器）时避免通知溢出
+    nl_socket_set_buffer_size(msk, CACHE_RCVBUF, 0);
+    rebuild_ifindex();
+    return 0;
+}
 
-    //======== 1. 配置IP地址和子网掩码 ========
-    struct rtnl_addr *addr = rtnl_addr_alloc();
-    struct nl_addr *local_addr;
+static void cache_free(void) {
+    // 托管的缓存随manager一起释放
+    if (cache_mngr)
+        nl_cache_mngr_free(cache_mngr);
+    if (cache_sock)
+        nl_socket_free(cache_sock);
+    free(ifindex_by_name.slots);
+}
 
-    // 解析IP/CIDR（自动提取子网掩码）
-    int ret = nl_addr_parse(ip_cidr, AF_INET, &local_addr);
+/**
+ * 处理已到达的通知，使缓存反映当前内核状态；执行每条命令前调用
+ * @param sk  通知溢出时用于重新dump的socket
+ */
+static void cache_sync(struct nl_sock *sk) {
+    int ret;
+    while ((ret = nl_cache_mngr_poll(cache_mngr, 0)) > 0)
+        ;
     if (ret < 0) {
-        fprintf(stderr, "无效的IP地址格式: %s\n", ip_cidr);
-        goto cleanup_link;
+        // 通知丢失，缓存可能已与内核不一致，只能整表重建
+        fprintf(stderr, "接口通知丢失（%s），重新同步缓存\n", nl_geterror(ret));
+        nl_cache_refill(sk, link_cache);
+        nl_cache_refill(sk, addr_cache);
+        rebuild_ifindex();
     }
+}
 
-    // 设置地址属性
-    rtnl_addr_set_local(addr, local_addr);
-    rtnl_addr_set_link(addr, link);
-    rtnl_addr_set_prefixlen(addr, nl_addr_get_prefixlen(local_addr)); // 显式设置子网掩码
-
-    // 提交到内核
-    if ((ret = rtnl_addr_add(sk, addr, 0)) < 0) {
-        fprintf(stderr, "添加IP地址失败: %s\n", nl_geterror(ret));
-        goto cleanup_addr;
-    }
-
-    //======== 2. 配置默认网关 ========
-    if (gateway) {
-        struct rtnl_route *route = rtnl_route_alloc();
-        struct nl_addr *dst_addr, *gw_addr;
-
-        // 目标网络：0.0.0.0/0
-        nl_addr_parse("0.0.0.0/0", AF_INET, &dst_addr);
-        rtnl_route_set_dst(route, dst_addr);
-
-        // 下一跳网关
-        nl_addr_parse(gateway, AF_INET, &gw_addr);
-        struct rtnl_nexthop *nh = rtnl_route_nh_alloc();
-        rtnl_route_nh_set_gateway(nh, gw_addr);
-        rtnl_route_nh_set_ifindex(nh, rtnl_link_get_ifindex(link)); // 绑定出口接口
-        rtnl_route_add_nexthop(route, nh);
-
-        // 提交路由
-        if ((ret = rtnl_route_add(sk, route, 0)) < 0) {
-            fprintf(stderr, "添加默认网关失败: %s\n", nl_geterror(ret));
-            goto cleanup_route;
-        }
-
-        // 释放资源
-cleanup_route:
-        rtnl_route_put(route);
-        nl_addr_put(dst_addr);
-        nl_addr_put(gw_addr);
-        rtnl_route_nh_free(nh);
-        if (ret < 0) goto cleanup_addr;
+/**
+ * 设置默认网关（替换已有的同族默认路由）
+ * @param gw      网关地址（IPv4或IPv6）
+ * @param ifname  出口接口
+ * @return 成功返回0，失败返回libnl错误码
+ */
+static int set_default_gateway(struct nl_sock *sk, const char *gw, const char *ifname) {
+    int ifindex = link_ifindex(ifname);
+    if (!ifindex) {
+        fprintf(stderr, "接口 %s 不存在\n", ifname);
+        return -1;
     }
+    struct nl_addr *gateway, *dst;
+    int ret = nl_addr_parse(gw, AF_UNSPEC, &gateway);
+    if (ret < 0) {
+        fprintf(stderr, "无效的网关地址: %s\n", gw);
+        return ret;
+    }
+    int family = nl_addr_get_family(gateway);
+    nl_addr_parse(family == AF_INET6 ? "::/0" : "0.0.0.0/0", family, &dst);
 
-    //======== 3. 配置DNS服务器 ========
-    if (dns_servers && dns_count > 0) {
-        FILE *fp = fopen("/etc/resolv.conf", "a"); // 追加模式
-        if (!fp) {
-            perror("无法配置DNS（需要root权限）");
-            ret = -1;
-            goto cleanup_addr;
-        }
+    // 设置路由属性
+    struct rtnl_route *route = rtnl_route_alloc();
+    rtnl_route_set_family(route, family);
+    rtnl_route_set_type(route, RTN_UNICAST);
+    rtnl_route_set_scope(route, RT_SCOPE_UNIVERSE);
+    rtnl_route_set_table(route, RT_TABLE_MAIN);
+    rtnl_route_set_protocol(route, RTPROT_STATIC);
+    rtnl_route_set_dst(route, dst);
+
+    // 下一跳：网关与出口设备（nexthop归route所有，随route释放）
+    struct rtnl_nexthop *nh = rtnl_route_nh_alloc();
+    rtnl_route_nh_set_gateway(nh, gateway);
+    rtnl_route_nh_set_ifindex(nh, ifindex);
+    rtnl_route_add_nexthop(route, nh);
+
+    ret = rtnl_route_add(sk, route, NLM_F_REPLACE);
+
+    // 释放资源
+    nl_addr_put(gateway);
+    nl_addr_put(dst);
+    rtnl_route_put(route);
+    return ret;
+}
+
+#define RESOLV_CONF "/etc/resolv.conf"
+#define NETCFG_TXN_DIR "/var/lib/netcfg"    // 配置文件事务的意图日志
+
+/**
+ * 把resolv.conf的nameserver行替换为servers，其余行（search/options等）保持原样
+ * 内容不变时不写；需要写时暂存到事务中，由调用者与其他配置文件一起提交
+ * @param txn  NULL时只比较不暂存
+ * @return 需要修改返回1，无需修改返回0，失败返回-1
+ */
+static int write_resolv_conf(ct_txn *txn, const char **servers, int count) {
+    // 符号链接（如systemd-resolved）写到其目标所在目录
+    char path[PATH_MAX];
+    if (!realpath(RESOLV_CONF, path))
+        snprintf(path, sizeof(path), "%s", RESOLV_CONF);
 
-        // 写入DNS服务器
-        for (int i = 0; i < dns_count; i++) {
-            fprintf(fp, "nameserver %s\n", dns_servers[i]);
+    char *old = NULL, *new = NULL;
+    size_t old_len = 0, new_len = 0;
+    FILE *in = fopen(path, "r");
+    if (in) {
+        fseek(in, 0, SEEK_END);
+        long n = ftell(in);
+        rewind(in);
+        if (n > 0 && (old = malloc(n + 1)))
+            old_len = fread(old, 1, n, in);
+        fclose(in);
+    }
+    FILE *out = open_memstream(&new, &new_len);
+    if (!out) {
+        free(old);
+        return -1;
+    }
+    // nameserver放在原来第一条nameserver的位置，没有则放在末尾
+    int placed = 0;
+    for (size_t off = 0; off < old_len;) {
+        char *nl = memchr(old + off, '\n', old_len - off);
+        size_t len = nl ? (size_t)(nl - (old + off)) : old_len - off;
+        const char *line = old + off;
+        if (len >= 10 && strncmp(line, "nameserver", 10) == 0 &&
+            (line[10] == ' ' || line[10] == '\t')) {
+            for (int i = 0; !placed && i < count; i++)
+                fprintf(out, "nameserver %s\n", servers[i]);
+            placed = 1;
+        } else {
+            fprintf(out, "%.*s\n", (int)len, line);
         }
+        off += len + 1;
+    }
+    for (int i = 0; !placed && i < count; i++)
+        fprintf(out, "nameserver %s\n", servers[i]);
+    fclose(out);
 
-        fclose(fp);
+    int ret = 0;
+    if (new_len != old_len || (new_len && memcmp(new, old, new_len) != 0))
+        ret = 1;
+    if (ret && txn && ct_stage(txn, path, new, new_len, 0644) == -1) {
+        perror("无法配置DNS");
+        ret = -1;
     }
+    free(old);
+    free(new);
+    return ret;
+}
 
-    //======== 清理资源 ========
-cleanup_addr:
-    nl_addr_put(local_addr);
-    rtnl_addr_put(addr);
-cleanup_link:
-    rtnl_link_put(link);
+/**
+ * 在一个事务中更新配置文件（目前是resolv.conf；需要同时生效的其他配置文件
+ * 也应暂存到同一事务），崩溃后由启动时的ct_recover完成或回滚
+ * @param dry_run  只比较不写入
+ * @return 已修改（或需要修改）返回1，无需修改返回0，失败返回-1
+ */
+static int update_config_files(const char **servers, int count, int dry_run) {
+    if (dry_run)
+        return write_resolv_conf(NULL, servers, count);
+    ct_txn txn;
+    if (ct_begin(&txn, NETCFG_TXN_DIR) == -1) {
+        if (errno == EBUSY)
+            fprintf(stderr, "%s: 上次已提交的配置文件事务仍无法完成\n", NETCFG_TXN_DIR);
+        else
+            perror(NETCFG_TXN_DIR);
+        return -1;
+    }
+    int ret = write_resolv_conf(&txn, servers, count);
+    if (ret < 0) {
+        ct_abort(&txn);
+        return -1;
+    }
+    int err = ct_commit(&txn);
+    if (err == -1) {
+        perror("配置文件提交失败（需要root权限）");
+        return -1;
+    }
+    if (err == -2)
+        fprintf(stderr, "配置文件已提交但未全部落盘，下次启动时完成\n");
     return ret;
 }
 
 // 添加IP地址
 static int add_ip_address(struct nl_sock *sk, const char *ifname, 
                          const char *ip_cidr) {
-    struct rtnl_link *link = rtnl_link_get_by_name(link_cache, ifname);
-    if (!link) {
+    int ifindex = link_ifindex(ifname);
+    if (!ifindex) {
         fprintf(stderr, "接口 %s 不存在\n", ifname);
         return -1;
     }
 
-    struct rtnl_addr *addr = rtnl_addr_alloc();
     struct nl_addr *local_addr;
     
     // 解析IP/CIDR
@@ -140,12 +348,13 @@ static int add_ip_address(struct nl_sock *sk, const char *ifname,
         return -1;
     }
     
+    struct rtnl_addr *addr = rtnl_addr_alloc();
     rtnl_addr_set_local(addr, local_addr);
-    rtnl_addr_set_link(addr, link);
+    rtnl_addr_set_ifindex(addr, ifindex);
     
     ret = rtnl_addr_add(sk, addr, 0);
     nl_addr_put(local_addr);
-    rtnl_link_put(link);
+    rtnl_addr_put(addr);
     
     return ret;
 }
@@ -153,56 +362,945 @@ static int add_ip_address(struct nl_sock *sk, const char *ifname,
 // 删除IP地址
 static int del_ip_address(struct nl_sock *sk, const char *ifname, 
                          const char *ip) {
-    struct rtnl_addr *addr = rtnl_addr_alloc();
+    int ifindex = link_ifindex(ifname);
+    if (!ifindex) {
+        fprintf(stderr, "接口 %s 不存在\n", ifname);
+        return -1;
+    }
+
     struct nl_addr *local_addr;
+    if (nl_addr_parse(ip, AF_UNSPEC, &local_addr) < 0) {
+        fprintf(stderr, "无效的IP地址格式: %s\n", ip);
+        return -1;
+    }
     
-    nl_addr_parse(ip, AF_UNSPEC, &local_addr);
+    struct rtnl_addr *addr = rtnl_addr_alloc();
     rtnl_addr_set_local(addr, local_addr);
-    
-    struct rtnl_link *link = rtnl_link_get_by_name(link_cache, ifname);
-    rtnl_addr_set_link(addr, link);
+    rtnl_addr_set_ifindex(addr, ifindex);
     
     int ret = rtnl_addr_delete(sk, addr, 0);
     nl_addr_put(local_addr);
-    rtnl_link_put(link);
+    rtnl_addr_put(addr);
     
     return ret;
 }
 
-// 正确设置网关的代码
-// static int set_default_gateway(struct nl_sock *sk, const char *gw, const char *ifname) {
-//     struct rtnl_route *route = rtnl_route_alloc();
-//     struct rtnl_nexthop *nh = rtnl_route_nexthop_alloc();
-    
-//     // 设置路由属性
-//     rtnl_route_set_family(route, AF_INET);
-//     rtnl_route_set_type(route, RTN_UNICAST);
-//     rtnl_route_set_scope(route, RT_SCOPE_UNIVERSE);
-//     rtnl_route_set_table(route, RT_TABLE_MAIN);
-    
-//     // 设置网关地址
-//     struct nl_addr *gateway;
-//     nl_addr_parse(gw, AF_INET, &gateway);
-//     rtnl_route_nexthop_set_gateway(nh, gateway);
-    
-//     // 设置出口设备
-//     struct rtnl_link *link = rtnl_link_get_by_name(link_cache, ifname);
-//     rtnl_route_nexthop_set_ifindex(nh, rtnl_link_get_ifindex(link));
-    
-//     // 添加下一跳
-//     rtnl_route_add_nexthop(route, nh);
-    
-//     int ret = rtnl_route_add(sk, route, 0);
-    
-//     // 释放资源
-//     rtnl_link_put(link);
-//     nl_addr_put(gateway);
-//     rtnl_route_nexthop_put(nh);
-//     rtnl_route_put(route);
-    
-//     return ret;
-// }
 
+/* ---------------- 批量模式（-f） ---------------- */
+
+/*
+ * 批量文件每行一条命令，语法同交互模式，# 开头为注释：
+ *   add ip eth0 10.0.0.2/24
+ *   del ip eth0 10.0.0.3/24
+ *   add route 10.1.0.0/16 via 10.0.0.1 dev eth0 [metric 100] [table 100]
+ *   del route default via 10.0.0.1
+ * 全部请求在同一个socket上流水线发送：多条消息打包进一次send，每条带独立的
+ * 序号并要求ACK，在途请求数受窗口限制，ACK按序号异步归位到各行。
+ * -r 时任一行失败即停止发送，并按相反顺序撤销已成功的操作。
+ */
+#define BATCH_WINDOW    256           // 最多在途（未收到ACK）的请求数
+#define BATCH_SNDBUF    (64 * 1024)   // 单次send打包的字节数上限
+#define BATCH_RCVBUF    (4 * 1024 * 1024)
+#define BATCH_MAX_LINE  512
+
+// ADD/DEL成对排列，op ^ 1 即为逆操作
+enum { OP_ADD_ADDR, OP_DEL_ADDR, OP_ADD_ROUTE, OP_DEL_ROUTE };
+
+typedef struct {
+    int line;
+    int type;
+    char *text;                       // 原始命令，出错时打印
+    struct nl_object *obj;            // rtnl_addr 或 rtnl_route
+    int done;                         // 已收到ACK
+    int err;                          // ACK中的错误码（负的errno）
+    char errmsg[128];                 // 内核的扩展错误信息（NETLINK_EXT_ACK）
+} BatchOp;
+
+static struct nl_object *batch_parse_addr(char **argv, int argc, const char **err) {
+    if (argc != 4) {
+        *err = "usage: add|del ip <ifname> <ip/cidr>";
+        return NULL;
+    }
+    int ifindex = link_ifindex(argv[2]);
+    if (ifindex <= 0) {
+        *err = "no such interface";
+        return NULL;
+    }
+    struct nl_addr *local;
+    if (nl_addr_parse(argv[3], AF_UNSPEC, &local) < 0) {
+        *err = "invalid address";
+        return NULL;
+    }
+    struct rtnl_addr *addr = rtnl_addr_alloc();
+    rtnl_addr_set_local(addr, local);
+    rtnl_addr_set_prefixlen(addr, nl_addr_get_prefixlen(local));
+    rtnl_addr_set_ifindex(addr, ifindex);
+    nl_addr_put(local);
+    return (struct nl_object *)addr;
+}
+
+static struct nl_object *batch_parse_route(char **argv, int argc, const char **err) {
+    if (argc < 3) {
+        *err = "usage: add|del route <dst|default> [via gw] [dev ifname] [metric n] [table n]";
+        return NULL;
+    }
+    struct nl_addr *dst = NULL, *gw = NULL;
+    int ifindex = 0;
+    long metric = -1, table = RT_TABLE_MAIN;
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            *err = "missing value";
+            goto fail;
+        }
+        if (strcmp(argv[i], "via") == 0) {
+            if (gw || nl_addr_parse(argv[i + 1], AF_UNSPEC, &gw) < 0) {
+                *err = "invalid gateway";
+                goto fail;
+            }
+        } else if (strcmp(argv[i], "dev") == 0) {
+            if ((ifindex = link_ifindex(argv[i + 1])) <= 0) {
+                *err = "no such interface";
+                goto fail;
+            }
+        } else if (strcmp(argv[i], "metric") == 0) {
+            metric = strtol(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "table") == 0) {
+            table = strtol(argv[i + 1], NULL, 10);
+        } else {
+            *err = "unknown route option";
+            goto fail;
+        }
+    }
+    if (!gw && !ifindex) {
+        *err = "route needs via or dev";
+        goto fail;
+    }
+    int family = gw ? nl_addr_get_family(gw) : AF_INET;
+    if (strcmp(argv[2], "default") == 0) {
+        nl_addr_parse(family == AF_INET6 ? "::/0" : "0.0.0.0/0", family, &dst);
+    } else if (nl_addr_parse(argv[2], family, &dst) < 0) {
+        *err = "invalid destination";
+        goto fail;
+    }
+
+    struct rtnl_route *route = rtnl_route_alloc();
+    rtnl_route_set_family(route, family);
+    rtnl_route_set_dst(route, dst);
+    rtnl_route_set_table(route, table);
+    rtnl_route_set_protocol(route, RTPROT_STATIC);
+    rtnl_route_set_scope(route, gw ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK);
+    if (metric >= 0)
+        rtnl_route_set_priority(route, metric);
+    struct rtnl_nexthop *nh = rtnl_route_nh_alloc();
+    if (gw)
+        rtnl_route_nh_set_gateway(nh, gw);
+    if (ifindex)
+        rtnl_route_nh_set_ifindex(nh, ifindex);
+    rtnl_route_add_nexthop(route, nh);
+    nl_addr_put(dst);
+    if (gw)
+        nl_addr_put(gw);
+    return (struct nl_object *)route;
+
+fail:
+    if (dst)
+        nl_addr_put(dst);
+    if (gw)
+        nl_addr_put(gw);
+    return NULL;
+}
+
+static int batch_push(BatchOp **ops, int *n, int *cap, const BatchOp *op) {
+    if (*n == *cap) {
+        int c = *cap ? *cap * 2 : 64;
+        BatchOp *p = realloc(*ops, c * sizeof(BatchOp));
+        if (!p) {
+            perror("realloc");
+            return -1;
+        }
+        *ops = p;
+        *cap = c;
+    }
+    (*ops)[(*n)++] = *op;
+    return 0;
+}
+
+static void batch_free(BatchOp *ops, int n) {
+    for (int i = 0; i < n; i++) {
+        nl_object_put(ops[i].obj);
+        free(ops[i].text);
+    }
+    free(ops);
+}
+
+// 读取并解析整个批量文件；任何一行有语法错误都不发送
+static BatchOp *batch_load(const char *path, int *count) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+    BatchOp *ops = NULL;
+    int n = 0, cap = 0, lineno = 0, bad = 0;
+    char buf[BATCH_MAX_LINE];
+    while (fgets(buf, sizeof(buf), fp)) {
+        lineno++;
+        buf[strcspn(buf, "\r\n")] = '\0';
+        char *text = buf + strspn(buf, " \t");
+        if (*text == '\0' || *text == '#')
+            continue;
+        char copy[BATCH_MAX_LINE], *argv[16];
+        int argc = 0;
+        strcpy(copy, text);
+        for (char *tok = strtok(copy, " \t"); tok && argc < 16; tok = strtok(NULL, " \t"))
+            argv[argc++] = tok;
+
+        const char *err = "unknown command";
+        struct nl_object *obj = NULL;
+        int type = -1;
+        if (argc >= 2 && (strcmp(argv[0], "add") == 0 || strcmp(argv[0], "del") == 0)) {
+            int del = argv[0][0] == 'd';
+            if (strcmp(argv[1], "ip") == 0) {
+                type = del ? OP_DEL_ADDR : OP_ADD_ADDR;
+                obj = batch_parse_addr(argv, argc, &err);
+            } else if (strcmp(argv[1], "route") == 0) {
+                type = del ? OP_DEL_ROUTE : OP_ADD_ROUTE;
+                obj = batch_parse_route(argv, argc, &err);
+            }
+        }
+        if (!obj) {
+            fprintf(stderr, "%s:%d: %s: %s\n", path, lineno, text, err);
+            bad++;
+            continue;
+        }
+        BatchOp op = { .line = lineno, .type = type, .text = strdup(text), .obj = obj };
+        if (batch_push(&ops, &n, &cap, &op) == -1) {
+            nl_object_put(obj);
+            free(op.text);
+            bad++;
+            break;
+        }
+    }
+    fclose(fp);
+    if (bad) {
+        batch_free(ops, n);
+        return NULL;
+    }
+    *count = n;
+    return ops ? ops : calloc(1, sizeof(BatchOp));
+}
+
+static struct nl_msg *batch_build(const BatchOp *op, int inverse) {
+    struct nl_msg *msg = NULL;
+    int ret = -1;
+    switch (inverse ? op->type ^ 1 : op->type) {
+    case OP_ADD_ADDR:
+        ret = rtnl_addr_build_add_request((struct rtnl_addr *)op->obj,
+                                          NLM_F_CREATE | NLM_F_EXCL, &msg);
+        break;
+    case OP_DEL_ADDR:
+        ret = rtnl_addr_build_delete_request((struct rtnl_addr *)op->obj, 0, &msg);
+        break;
+    case OP_ADD_ROUTE:
+        ret = rtnl_route_build_add_request((struct rtnl_route *)op->obj,
+                                           NLM_F_CREATE | NLM_F_EXCL, &msg);
+        break;
+    case OP_DEL_ROUTE:
+        ret = rtnl_route_build_del_request((struct rtnl_route *)op->obj, 0, &msg);
+        break;
+    }
+    return ret < 0 ? NULL : msg;
+}
+
+// 从ACK中取内核的扩展错误信息
+static void batch_extack(const struct nlmsghdr *nlh, char *out, size_t cap) {
+    const struct nlmsgerr *e = NLMSG_DATA(nlh);
+    if (!(nlh->nlmsg_flags & NLM_F_ACK_TLVS))
+        return;
+    size_t off = NLMSG_HDRLEN + sizeof(*e);
+    if (!(nlh->nlmsg_flags & NLM_F_CAPPED))
+        off += NLMSG_ALIGN(e->msg.nlmsg_len) - NLMSG_HDRLEN;
+    while (off + NLA_HDRLEN <= nlh->nlmsg_len) {
+        const struct nlattr *a = (const struct nlattr *)((const char *)nlh + off);
+        if (a->nla_len < NLA_HDRLEN || off + a->nla_len > nlh->nlmsg_len)
+            break;
+        if ((a->nla_type & NLA_TYPE_MASK) == NLMSGERR_ATTR_MSG) {
+            snprintf(out, cap, "%.*s", (int)(a->nla_len - NLA_HDRLEN),
+                     (const char *)a + NLA_HDRLEN);
+            return;
+        }
+        off += NLA_ALIGN(a->nla_len);
+    }
+}
+
+/**
+ * 流水线执行一组操作
+ * @param inverse        发送各操作的逆操作（回滚）
+ * @param stop_on_error  出现失败后不再发送新请求（在途的仍等待ACK）
+ * @return 失败的操作数；socket出错返回-1
+ */
+static int batch_run(int fd, BatchOp **list, int n, int inverse, int stop_on_error) {
+    static uint32_t next_seq;
+    static char sndbuf[BATCH_SNDBUF];
+    static char rcvbuf[64 * 1024];
+    if (next_seq == 0)
+        next_seq = (uint32_t)time(NULL);
+    uint32_t base = next_seq;
+    next_seq += n;
+    int sent = 0, inflight = 0, failed = 0;
+
+    while (inflight > 0 || (sent < n && !(stop_on_error && failed))) {
+        // 1. 窗口内尽量多地打包请求，一次send发出
+        size_t len = 0;
+        while (sent < n && inflight < BATCH_WINDOW && !(stop_on_error && failed)) {
+            BatchOp *op = list[sent];
+            struct nl_msg *msg = batch_build(op, inverse);
+            if (!msg) {
+                op->done = 1;
+                op->err = -ENOMEM;
+                failed++;
+                sent++;
+                continue;
+            }
+            struct nlmsghdr *h = nlmsg_hdr(msg);
+            if (len + NLMSG_ALIGN(h->nlmsg_len) > sizeof(sndbuf)) {
+                nlmsg_free(msg);
+                if (len)
+                    break;
+                op->done = 1;               // 空缓冲区也放不下：单独失败，避免原地重试
+                op->err = -EMSGSIZE;
+                failed++;
+                sent++;
+                continue;
+            }
+            h->nlmsg_seq = base + sent;
+            h->nlmsg_pid = 0;
+            h->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+            memcpy(sndbuf + len, h, h->nlmsg_len);
+            len += NLMSG_ALIGN(h->nlmsg_len);
+            nlmsg_free(msg);
+            op->done = 0;
+            sent++;
+            inflight++;
+        }
+        if (len && send(fd, sndbuf, len, 0) == -1) {
+            perror("send");
+            return -1;
+        }
+        if (inflight == 0)
+            continue;
+
+        // 2. 收ACK，按序号归位
+        ssize_t r = recv(fd, rcvbuf, sizeof(rcvbuf), 0);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("recv");               // ENOBUFS：ACK丢失，无法确认结果
+            return -1;
+        }
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)rcvbuf; NLMSG_OK(nlh, r);
+             nlh = NLMSG_NEXT(nlh, r)) {
+            uint32_t i = nlh->nlmsg_seq - base;
+            if (nlh->nlmsg_type != NLMSG_ERROR || i >= (uint32_t)sent || list[i]->done)
+                continue;
+            const struct nlmsgerr *e = NLMSG_DATA(nlh);
+            BatchOp *op = list[i];
+            op->done = 1;
+            op->err = e->error;
+            op->errmsg[0] = '\0';
+            inflight--;
+            if (e->error) {
+                failed++;
+                batch_extack(nlh, op->errmsg, sizeof(op->errmsg));
+            }
+        }
+    }
+    return failed;
+}
+
+static void batch_report(const char *path, const BatchOp *op, const char *what) {
+    char where[16] = "";
+    if (op->line > 0)
+        snprintf(where, sizeof(where), "%d:", op->line);
+    fprintf(stderr, "%s:%s %s%s: %s%s%s\n", path, where, what, op->text,
+            op->done ? strerror(-op->err) : "not applied",
+            op->errmsg[0] ? ": " : "", op->errmsg);
+}
+
+// 批量模式的socket选项：ACK不带原请求、带内核扩展错误信息，加大接收缓冲
+static int batch_socket(struct nl_sock *sk) {
+    int fd = nl_socket_get_fd(sk), one = 1, rcvbuf = BATCH_RCVBUF;
+    setsockopt(fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+    setsockopt(fd, SOL_NETLINK, NETLINK_EXT_ACK, &one, sizeof(one));
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    return fd;
+}
+
+/**
+ * 流水线发送一组操作并报告结果
+ * @param path      出错时报告用的文件名
+ * @param rollback  任一操作失败时撤销已成功的操作
+ * @return 全部成功返回0，否则返回-1
+ */
+static int batch_apply(struct nl_sock *sk, const char *path, BatchOp *ops, int n, int rollback) {
+    int fd = batch_socket(sk);
+
+    BatchOp **list = malloc((n ? n : 1) * sizeof(BatchOp *));
+    if (!list) {
+        perror("malloc");
+        return -1;
+    }
+    for (int i = 0; i < n; i++)
+        list[i] = &ops[i];
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int failed = batch_run(fd, list, n, 0, rollback);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int ok = 0, undone = 0;
+    for (int i = 0; i < n; i++) {
+        if (ops[i].done && ops[i].err == 0)
+            ok++;
+        else if (ops[i].done || !rollback)
+            batch_report(path, &ops[i], "");
+    }
+
+    // 回滚：已成功的操作按相反顺序执行逆操作
+    if (failed && rollback && ok) {
+        int m = 0;
+        for (int i = n - 1; i >= 0; i--)
+            if (ops[i].done && ops[i].err == 0)
+                list[m++] = &ops[i];
+        int bad = batch_run(fd, list, m, 1, 0);
+        for (int i = 0; i < m; i++) {
+            if (list[i]->done && list[i]->err == 0)
+                undone++;
+            else
+                batch_report(path, list[i], "rollback failed: ");
+        }
+        if (bad)
+            fprintf(stderr, "回滚未完成，%d项需手工处理\n", m - undone);
+    }
+
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "[STATS] ops=%d ok=%d failed=%d rolled_back=%d elapsed=%.3fs rate=%.0f ops/s\n",
+            n, ok, n - ok, undone, sec, sec > 0 ? n / sec : 0.0);
+    free(list);
+    return failed == 0 ? 0 : -1;
+}
+
+// 执行批量文件
+static int run_batch(struct nl_sock *sk, const char *path, int rollback) {
+    int n;
+    BatchOp *ops = batch_load(path, &n);
+    if (!ops)
+        return -1;
+    int ret = batch_apply(sk, path, ops, n, rollback);
+    batch_free(ops, n);
+    return ret;
+}
+
+/* ---------------- 吞吐基准（-B） ---------------- */
+
+/*
+ * 在临时网络命名空间（main中unshare）的lo上添加再删除count个/32地址，
+ * 分别走交互路径（每条命令cache_sync + 一次同步rtnl_addr_add/delete往返）
+ * 与批量路径（batch_run流水线），报告ops/s。命名空间随进程退出销毁。
+ */
+#define BENCH_MAX_OPS   (1 << 20)
+
+static double bench_elapsed(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static void bench_addr(int i, char *buf, size_t cap) {
+    snprintf(buf, cap, "10.%d.%d.%d/32", (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF);
+}
+
+// 交互路径：与主循环处理 add ip / del ip 命令相同
+static int bench_interactive(struct nl_sock *sk, int count, int del, double *sec) {
+    char ip[32];
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < count; i++) {
+        bench_addr(i, ip, sizeof(ip));
+        cache_sync(sk);
+        int ret = del ? del_ip_address(sk, "lo", ip) : add_ip_address(sk, "lo", ip);
+        if (ret < 0) {
+            fprintf(stderr, "%s ip lo %s: %s\n", del ? "del" : "add", ip, nl_geterror(ret));
+            return -1;
+        }
+    }
+    *sec = bench_elapsed(&t0);
+    return 0;
+}
+
+// 批量路径：解析在计时之外（同 -f 读文件的开销），只计发送与收ACK
+static int bench_batch(struct nl_sock *sk, BatchOp *ops, int count, int del, double *sec) {
+    BatchOp **list = malloc(count * sizeof(BatchOp *));
+    if (!list) {
+        perror("malloc");
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+        list[i] = &ops[i];
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int failed = batch_run(batch_socket(sk), list, count, del, 0);
+    *sec = bench_elapsed(&t0);
+    for (int i = 0; i < count && failed; i++)
+        if (!ops[i].done || ops[i].err) {
+            batch_report("bench", &ops[i], del ? "undo " : "");
+            break;
+        }
+    free(list);
+    return failed == 0 ? 0 : -1;
+}
+
+static int run_bench(struct nl_sock *sk, int count) {
+    // 新命名空间里的lo是DOWN的，地址照样可以加，不需要先UP
+    if (!link_ifindex("lo")) {
+        fprintf(stderr, "接口 lo 不存在\n");
+        return -1;
+    }
+    BatchOp *ops = calloc(count, sizeof(BatchOp));
+    if (!ops) {
+        perror("calloc");
+        return -1;
+    }
+    int n, ret = -1;
+    for (n = 0; n < count; n++) {
+        char ip[32], *argv[4] = { "add", "ip", "lo", ip };
+        const char *err;
+        bench_addr(n, ip, sizeof(ip));
+        ops[n] = (BatchOp){ .line = n + 1, .type = OP_ADD_ADDR, .text = strdup(ip) };
+        if (!(ops[n].obj = batch_parse_addr(argv, 4, &err))) {
+            fprintf(stderr, "%s: %s\n", ip, err);
+            goto out;
+        }
+    }
+
+    double t[4];
+    if (bench_interactive(sk, count, 0, &t[0]) == -1 ||
+        bench_interactive(sk, count, 1, &t[1]) == -1 ||
+        bench_batch(sk, ops, count, 0, &t[2]) == -1 ||
+        bench_batch(sk, ops, count, 1, &t[3]) == -1)   // 逆操作即删除
+        goto out;
+    printf("interactive: add %d in %.3fs (%.0f ops/s), del in %.3fs (%.0f ops/s)\n",
+           count, t[0], count / t[0], t[1], count / t[1]);
+    printf("batch:       add %d in %.3fs (%.0f ops/s), del in %.3fs (%.0f ops/s)\n",
+           count, t[2], count / t[2], t[3], count / t[3]);
+    printf("speedup:     add %.2fx, del %.2fx\n", t[0] / t[2], t[1] / t[3]);
+    ret = 0;
+out:
+    batch_free(ops, n);
+    return ret;
+}
+
+/* ---------------- 期望状态（-s） ---------------- */
+
+/*
+ * 状态文件声明接口应有的地址与路由、默认网关和DNS，# 开头为注释：
+ *   interface eth0
+ *       address 10.0.0.2/24
+ *       route 10.1.0.0/16 via 10.0.0.1 [metric 100] [table 100]
+ *   gateway 10.0.0.1 [dev eth0]
+ *   dns 8.8.8.8
+ * 与内核当前状态做差，只发送必要的增删（仍走批量模式的流水线与回滚）。
+ * 归本工具管理、不在文件中即删除的对象：
+ *   - 声明接口上scope global的永久地址（DHCP/SLAAC等有租期的地址不动）
+ *   - main表中出口为声明接口的RTPROT_STATIC路由
+ *   - 声明了网关的地址族在main表中的全部默认路由
+ * 已收敛的主机只有dump，没有任何写操作（resolv.conf内容相同也不重写）。
+ */
+#define STATE_MAX_IFACES  64
+#define STATE_MAX_DNS     8
+
+typedef struct {
+    BatchOp *want;                    // 期望存在的地址与路由（OP_ADD_*）
+    int nwant, cap;
+    int ifindex[STATE_MAX_IFACES];    // 声明的接口
+    int nif;
+    unsigned gw_families;             // 声明了网关的地址族：1为IPv4，2为IPv6
+    char dns[STATE_MAX_DNS][INET6_ADDRSTRLEN];
+    int ndns;
+} DesiredState;
+
+static unsigned family_bit(int family) {
+    return family == AF_INET6 ? 2 : family == AF_INET ? 1 : 0;
+}
+
+static int state_has_if(const DesiredState *st, int ifindex) {
+    for (int i = 0; i < st->nif; i++)
+        if (st->ifindex[i] == ifindex)
+            return 1;
+    return 0;
+}
+
+// 读取状态文件；地址与路由复用批量模式的解析（拼出等价的add命令）
+static int state_load(const char *path, DesiredState *st) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    char buf[BATCH_MAX_LINE], ifname[IFNAMSIZ] = "";
+    int lineno = 0, bad = 0;
+    while (fgets(buf, sizeof(buf), fp)) {
+        lineno++;
+        buf[strcspn(buf, "\r\n#")] = '\0';
+        char *tok[16];
+        int ntok = 0;
+        for (char *t = strtok(buf, " \t"); t && ntok < 16; t = strtok(NULL, " \t"))
+            tok[ntok++] = t;
+        if (ntok == 0)
+            continue;
+
+        const char *err = NULL;
+        char *argv[20];
+        int argc = 0, type = -1;
+        struct nl_object *obj = NULL;
+        if (strcmp(tok[0], "interface") == 0 && ntok == 2) {
+            int ifindex = link_ifindex(tok[1]);
+            if (!ifindex)
+                err = "no such interface";
+            else if (st->nif == STATE_MAX_IFACES)
+                err = "too many interfaces";
+            else if (!state_has_if(st, ifindex))
+                st->ifindex[st->nif++] = ifindex;
+            snprintf(ifname, sizeof(ifname), "%s", tok[1]);
+        } else if (strcmp(tok[0], "address") == 0 && ntok == 2) {
+            char *a[4] = { "add", "ip", ifname, tok[1] };
+            if (!ifname[0])
+                err = "address outside interface";
+            else if ((obj = batch_parse_addr(a, 4, &err)))
+                type = OP_ADD_ADDR;
+        } else if (strcmp(tok[0], "route") == 0 && ntok >= 2) {
+            argv[argc++] = "add";
+            argv[argc++] = "route";
+            for (int i = 1; i < ntok; i++)
+                argv[argc++] = tok[i];
+            argv[argc++] = "dev";
+            argv[argc++] = ifname;
+            if (!ifname[0])
+                err = "route outside interface";
+            else if ((obj = batch_parse_route(argv, argc, &err)))
+                type = OP_ADD_ROUTE;
+        } else if (strcmp(tok[0], "gateway") == 0 && (ntok == 2 || ntok == 4)) {
+            // 未写dev时取所在interface段的接口（若有）
+            char *a[7] = { "add", "route", "default", "via", tok[1], "dev", ifname };
+            argc = ntok == 4 || ifname[0] ? 7 : 5;
+            if (ntok == 4)
+                a[6] = tok[3];
+            if (ntok == 4 && strcmp(tok[2], "dev") != 0)
+                err = "usage: gateway <gw> [dev ifname]";
+            else if ((obj = batch_parse_route(a, argc, &err))) {
+                type = OP_ADD_ROUTE;
+                st->gw_families |= family_bit(rtnl_route_get_family((struct rtnl_route *)obj));
+            }
+        } else if (strcmp(tok[0], "dns") == 0 && ntok == 2) {
+            unsigned char tmp[sizeof(struct in6_addr)];
+            if (inet_pton(AF_INET, tok[1], tmp) != 1 && inet_pton(AF_INET6, tok[1], tmp) != 1)
+                err = "invalid dns server";
+            else if (st->ndns == STATE_MAX_DNS)
+                err = "too many dns servers";
+            else
+                snprintf(st->dns[st->ndns++], INET6_ADDRSTRLEN, "%s", tok[1]);
+        } else {
+            err = "unknown statement";
+        }
+        if (err) {
+            fprintf(stderr, "%s:%d: %s: %s\n", path, lineno, tok[0], err);
+            bad++;
+            continue;
+        }
+        if (obj) {
+            BatchOp op = { .line = lineno, .type = type, .obj = obj };
+            if (batch_push(&st->want, &st->nwant, &st->cap, &op) == -1) {
+                nl_object_put(obj);
+                bad++;
+                break;
+            }
+        }
+    }
+    fclose(fp);
+    return bad ? -1 : 0;
+}
+
+static int addr_bytes_equal(struct nl_addr *a, struct nl_addr *b) {
+    if (!a || !b)
+        return a == b;
+    return nl_addr_get_family(a) == nl_addr_get_family(b) &&
+           nl_addr_get_len(a) == nl_addr_get_len(b) &&
+           memcmp(nl_addr_get_binary_addr(a), nl_addr_get_binary_addr(b), nl_addr_get_len(a)) == 0;
+}
+
+static int addr_equal(struct rtnl_addr *a, struct rtnl_addr *b) {
+    return rtnl_addr_get_ifindex(a) == rtnl_addr_get_ifindex(b) &&
+           rtnl_addr_get_prefixlen(a) == rtnl_addr_get_prefixlen(b) &&
+           addr_bytes_equal(rtnl_addr_get_local(a), rtnl_addr_get_local(b));
+}
+
+// 内核中的路由have是否满足期望的路由want（want未指定出口时不比较出口）
+static int route_equal(struct rtnl_route *have, struct rtnl_route *want) {
+    int family = rtnl_route_get_family(want);
+    uint32_t prio = rtnl_route_get_priority(want);
+    if (family == AF_INET6 && prio == 0)
+        prio = 1024;                  // 内核给未指定metric的IPv6路由的默认值
+    if (rtnl_route_get_family(have) != family ||
+        rtnl_route_get_table(have) != rtnl_route_get_table(want) ||
+        rtnl_route_get_priority(have) != prio ||
+        rtnl_route_get_type(have) != RTN_UNICAST ||
+        rtnl_route_get_nnexthops(have) != 1)
+        return 0;
+    struct nl_addr *hd = rtnl_route_get_dst(have), *wd = rtnl_route_get_dst(want);
+    int hplen = hd ? (int)nl_addr_get_prefixlen(hd) : 0;
+    if (hplen != (int)nl_addr_get_prefixlen(wd) || (hplen && nl_addr_cmp_prefix(hd, wd) != 0))
+        return 0;
+    struct rtnl_nexthop *hn = rtnl_route_nexthop_n(have, 0), *wn = rtnl_route_nexthop_n(want, 0);
+    int wif = rtnl_route_nh_get_ifindex(wn);
+    return addr_bytes_equal(rtnl_route_nh_get_gateway(hn), rtnl_route_nh_get_gateway(wn)) &&
+           (wif == 0 || wif == rtnl_route_nh_get_ifindex(hn));
+}
+
+// 地址是否归本工具管理
+static int addr_owned(const DesiredState *st, struct rtnl_addr *a) {
+    return state_has_if(st, rtnl_addr_get_ifindex(a)) &&
+           rtnl_addr_get_scope(a) == RT_SCOPE_UNIVERSE &&
+           (rtnl_addr_get_flags(a) & IFA_F_PERMANENT);
+}
+
+// 路由是否归本工具管理
+static int route_owned(const DesiredState *st, struct rtnl_route *r) {
+    if (rtnl_route_get_table(r) != RT_TABLE_MAIN || rtnl_route_get_type(r) != RTN_UNICAST)
+        return 0;
+    struct nl_addr *dst = rtnl_route_get_dst(r);
+    if ((!dst || nl_addr_get_prefixlen(dst) == 0) &&
+        (st->gw_families & family_bit(rtnl_route_get_family(r))))
+        return 1;
+    if (rtnl_route_get_protocol(r) != RTPROT_STATIC || rtnl_route_get_nnexthops(r) == 0)
+        return 0;
+    return state_has_if(st, rtnl_route_nh_get_ifindex(rtnl_route_nexthop_n(r, 0)));
+}
+
+// 按批量文件的语法生成操作描述，用于打印计划和报告错误
+static char *op_text(int type, struct nl_object *obj) {
+    char ifname[IFNAMSIZ], a[INET6_ADDRSTRLEN + 8], b[INET6_ADDRSTRLEN + 8], text[256];
+    const char *verb = type == OP_ADD_ADDR || type == OP_ADD_ROUTE ? "add" : "del";
+    if (type == OP_ADD_ADDR || type == OP_DEL_ADDR) {
+        struct rtnl_addr *addr = (struct rtnl_addr *)obj;
+        if (!rtnl_link_i2name(link_cache, rtnl_addr_get_ifindex(addr), ifname, sizeof(ifname)))
+            snprintf(ifname, sizeof(ifname), "%d", rtnl_addr_get_ifindex(addr));
+        nl_addr2str(rtnl_addr_get_local(addr), a, sizeof(a));
+        snprintf(text, sizeof(text), "%s ip %s %s/%u", verb, ifname, strtok(a, "/"),
+                 rtnl_addr_get_prefixlen(addr));
+        return strdup(text);
+    }
+
+    struct rtnl_route *route = (struct rtnl_route *)obj;
+    struct nl_addr *dst = rtnl_route_get_dst(route);
+    if (!dst || nl_addr_get_prefixlen(dst) == 0)
+        strcpy(a, "default");
+    else
+        nl_addr2str(dst, a, sizeof(a));
+    char via[INET6_ADDRSTRLEN + 8] = "", dev[IFNAMSIZ + 8] = "", extra[48] = "";
+    if (rtnl_route_get_nnexthops(route) > 0) {
+        struct rtnl_nexthop *nh = rtnl_route_nexthop_n(route, 0);
+        if (rtnl_route_nh_get_gateway(nh))
+            snprintf(via, sizeof(via), " via %s",
+                     nl_addr2str(rtnl_route_nh_get_gateway(nh), b, sizeof(b)));
+        if (rtnl_link_i2name(link_cache, rtnl_route_nh_get_ifindex(nh), ifname, sizeof(ifname)))
+            snprintf(dev, sizeof(dev), " dev %s", ifname);
+    }
+    if (rtnl_route_get_priority(route))
+        snprintf(extra, sizeof(extra), " metric %u", rtnl_route_get_priority(route));
+    if (rtnl_route_get_table(route) != RT_TABLE_MAIN)
+        snprintf(extra + strlen(extra), sizeof(extra) - strlen(extra), " table %u",
+                 rtnl_route_get_table(route));
+    snprintf(text, sizeof(text), "%s route %s%s%s%s", verb, a, via, dev, extra);
+    return strdup(text);
+}
+
+static int plan_push(BatchOp **plan, int *n, int *cap, int line, int type, struct nl_object *obj) {
+    BatchOp op = { .line = line, .type = type, .obj = obj, .text = op_text(type, obj) };
+    if (!op.text || batch_push(plan, n, cap, &op) == -1) {
+        free(op.text);
+        return -1;
+    }
+    nl_object_get(obj);
+    return 0;
+}
+
+// 期望中有而cache中没有的地址（type为OP_ADD_ADDR）或路由（OP_ADD_ROUTE）加入计划
+static int plan_missing(const DesiredState *st, int type, struct nl_cache *cache,
+                        BatchOp **plan, int *n, int *cap) {
+    for (int i = 0; i < st->nwant; i++) {
+        if (st->want[i].type != type)
+            continue;
+        int have = 0;
+        for (struct nl_object *o = nl_cache_get_first(cache); o && !have; o = nl_cache_get_next(o))
+            have = type == OP_ADD_ADDR
+                       ? addr_equal((struct rtnl_addr *)o, (struct rtnl_addr *)st->want[i].obj)
+                       : route_equal((struct rtnl_route *)o, (struct rtnl_route *)st->want[i].obj);
+        if (!have && plan_push(plan, n, cap, st->want[i].line, type, st->want[i].obj) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * 把主机收敛到状态文件描述的状态
+ * 顺序：删路由、删地址、加地址、加路由（同一socket上内核按序处理）
+ * @param dry_run   只打印需要执行的操作
+ * @param rollback  任一操作失败时撤销已成功的操作
+ * @return 成功（或已收敛）返回0，否则返回-1
+ */
+static int reconcile(struct nl_sock *sk, const char *path, int dry_run, int rollback) {
+    DesiredState st = { 0 };
+    struct nl_cache *route_cache = NULL;
+    BatchOp *plan = NULL;
+    int n = 0, cap = 0, ret = -1, dns = 0;
+
+    if (state_load(path, &st) == -1)
+        goto out;
+    int err = rtnl_route_alloc_cache(sk, AF_UNSPEC, 0, &route_cache);
+    if (err < 0) {
+        fprintf(stderr, "获取路由表失败: %s\n", nl_geterror(err));
+        goto out;
+    }
+
+    // 1. 多余的路由
+    for (struct nl_object *o = nl_cache_get_first(route_cache); o; o = nl_cache_get_next(o)) {
+        struct rtnl_route *r = (struct rtnl_route *)o;
+        if (!route_owned(&st, r))
+            continue;
+        int keep = 0;
+        for (int i = 0; i < st.nwant && !keep; i++)
+            keep = st.want[i].type == OP_ADD_ROUTE &&
+                   route_equal(r, (struct rtnl_route *)st.want[i].obj);
+        if (!keep && plan_push(&plan, &n, &cap, 0, OP_DEL_ROUTE, o) == -1)
+            goto out;
+    }
+    // 2. 多余的地址
+    for (struct nl_object *o = nl_cache_get_first(addr_cache); o; o = nl_cache_get_next(o)) {
+        struct rtnl_addr *a = (struct rtnl_addr *)o;
+        if (!addr_owned(&st, a))
+            continue;
+        int keep = 0;
+        for (int i = 0; i < st.nwant && !keep; i++)
+            keep = st.want[i].type == OP_ADD_ADDR &&
+                   addr_equal(a, (struct rtnl_addr *)st.want[i].obj);
+        if (!keep && plan_push(&plan, &n, &cap, 0, OP_DEL_ADDR, o) == -1)
+            goto out;
+    }
+    int deleted_addr = 0;
+    for (int i = 0; i < n; i++)
+        deleted_addr |= plan[i].type == OP_DEL_ADDR;
+    // 3. 缺少的地址，4. 缺少的路由
+    if (plan_missing(&st, OP_ADD_ADDR, addr_cache, &plan, &n, &cap) == -1 ||
+        plan_missing(&st, OP_ADD_ROUTE, route_cache, &plan, &n, &cap) == -1)
+        goto out;
+
+    for (int i = 0; i < n; i++)
+        printf("%s\n", plan[i].text);
+    if (st.ndns) {
+        const char *servers[STATE_MAX_DNS];
+        for (int i = 0; i < st.ndns; i++)
+            servers[i] = st.dns[i];
+        if ((dns = update_config_files(servers, st.ndns, dry_run)) == 1)
+            printf("%s nameserver", dry_run ? "rewrite" : "rewrote");
+        for (int i = 0; dns == 1 && i < st.ndns; i++)
+            printf(" %s%s", servers[i], i + 1 == st.ndns ? "\n" : "");
+    }
+
+    fflush(stdout);
+    ret = dns < 0 ? -1 : 0;
+    if (n == 0 && dns == 0)
+        printf("已收敛\n");
+    else if (n > 0 && !dry_run && batch_apply(sk, path, plan, n, rollback) == -1)
+        ret = -1;
+
+    // 删除地址时内核会连带删除经由该网段的路由（如默认路由），重新dump补齐
+    if (ret == 0 && !dry_run && deleted_addr && nl_cache_refill(sk, route_cache) == 0) {
+        int first = n;
+        if (plan_missing(&st, OP_ADD_ROUTE, route_cache, &plan, &n, &cap) == -1)
+            ret = -1;
+        for (int i = first; i < n; i++)
+            printf("%s\n", plan[i].text);
+        fflush(stdout);
+        if (n > first && batch_apply(sk, path, plan + first, n - first, rollback) == -1)
+            ret = -1;
+    }
+    fprintf(stderr, "[STATS] addresses=%d routes=%d changes=%d dns=%s%s\n",
+            nl_cache_nitems(addr_cache), nl_cache_nitems(route_cache), n,
+            dns == 1 ? "changed" : dns == 0 ? "unchanged" : "failed", dry_run ? " (dry run)" : "");
+
+out:
+    batch_free(plan, n);
+    batch_free(st.want, st.nwant);
+    if (route_cache)
+        nl_cache_free(route_cache);
+    return ret;
+}
+
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP 0x10000          // linux/if.h，与net/if.h不能同时包含
+#endif
+
+static void print_addr(struct nl_object *obj, void *arg) {
+    char buf[INET6_ADDRSTRLEN + 8];
+    struct rtnl_addr *addr = (struct rtnl_addr *)obj;
+    printf("    %s %s\n", rtnl_addr_get_family(addr) == AF_INET6 ? "inet6" : "inet",
+           nl_addr2str(rtnl_addr_get_local(addr), buf, sizeof(buf)));
+}
+
+static void print_link(struct nl_object *obj, void *arg) {
+    struct rtnl_link *link = (struct rtnl_link *)obj;
+    const char *only = arg;
+    if (only && strcmp(rtnl_link_get_name(link), only) != 0)
+        return;
+    unsigned flags = rtnl_link_get_flags(link);
+    printf("%d: %s <%s%s> mtu %u\n", rtnl_link_get_ifindex(link), rtnl_link_get_name(link),
+           flags & IFF_UP ? "UP" : "DOWN", flags & IFF_LOWER_UP ? ",LOWER_UP" : "",
+           rtnl_link_get_mtu(link));
+    struct rtnl_addr *filter = rtnl_addr_alloc();
+    rtnl_addr_set_ifindex(filter, rtnl_link_get_ifindex(link));
+    nl_cache_foreach_filter(addr_cache, (struct nl_object *)filter, print_addr, NULL);
+    rtnl_addr_put(filter);
+}
+
+// 显示接口信息，数据来自通知维护的缓存，不再向内核dump
+static void show_links(const char *ifname) {
+    if (ifname && !link_ifindex(ifname)) {
+        fprintf(stderr, "接口 %s 不存在\n", ifname);
+        return;
+    }
+    nl_cache_foreach(link_cache, print_link, (void *)ifname);
+}
+
+/**
+ * 读取一行命令；终端输入时等待期间继续处理接口通知
+ * @return 成功返回0，输入结束返回-1
+ */
+static int read_command(char *cmd, size_t size) {
+    if (isatty(STDIN_FILENO)) {
+        struct pollfd pfd[2] = {
+            { .fd = STDIN_FILENO, .events = POLLIN },
+            { .fd = nl_cache_mngr_get_fd(cache_mngr), .events = POLLIN },
+        };
+        while (!(pfd[0].revents & (POLLIN | POLLHUP))) {
+            if (poll(pfd, 2, -1) == -1 && errno != EINTR)
+                break;
+            if (pfd[1].revents)
+                nl_cache_mngr_data_ready(cache_mngr);
+        }
+    }
+    return fgets(cmd, size, stdin) ? 0 : -1;
+}
 
 // 命令行帮助
 static void print_help() {
@@ -210,29 +1308,91 @@ static void print_help() {
     puts("  show [ifname]            - 显示接口信息");
     puts("  add ip <ifname> <ip/cidr> - 添加IP地址");
     puts("  del ip <ifname> <ip>      - 删除IP地址");
-    //puts("  route add default via <gw> dev <ifname> - 添加默认路由");
+    puts("  route add default via <gw> dev <ifname> - 设置默认路由");
     puts("  exit                     - 退出程序");
 }
 
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s              交互模式\n"
+            "       %s -f <file> [-r] 批量执行文件中的命令\n"
+            "       %s -s <file> [-n] [-r] 收敛到文件描述的期望状态\n"
+            "       %s -B <count>         在临时网络命名空间中比较交互与批量路径的ops/s\n"
+            "  -r  任一命令失败时撤销已执行的命令\n"
+            "  -n  只打印需要执行的变更\n",
+            prog, prog, prog, prog);
+}
+
 // 主交互循环
-int main() {
+int main(int argc, char **argv) {
+    const char *batch_file = NULL, *state_file = NULL;
+    int rollback = 0, dry_run = 0, bench = 0, opt;
+    while ((opt = getopt(argc, argv, "f:s:nrB:")) != -1) {
+        switch (opt) {
+        case 'B': bench = atoi(optarg); break;
+        case 'f': batch_file = optarg; break;
+        case 's': state_file = optarg; break;
+        case 'n': dry_run = 1; break;
+        case 'r': rollback = 1; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (bench < 0 || bench > BENCH_MAX_OPS) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    // 基准在临时网络命名空间里进行，必须在打开任何netlink socket之前切换
+    if (bench && unshare(CLONE_NEWNET) == -1) {
+        perror("unshare(CLONE_NEWNET)（需要root权限）");
+        return EXIT_FAILURE;
+    }
+
+    // 上次崩溃时未完成的配置文件事务：已过提交点的完成，否则回滚；-n与-B不写配置文件
+    int redone, rolledback;
+    if (!dry_run && !bench) {
+        if (ct_recover(NETCFG_TXN_DIR, &redone, &rolledback) == 0) {
+            if (redone + rolledback > 0)
+                fprintf(stderr, "恢复配置文件事务: 完成%d个，回滚%d个\n", redone, rolledback);
+        } else if (errno == EBUSY) {
+            fprintf(stderr, "%s: 已提交的配置文件事务仍无法完成，日志保留\n", NETCFG_TXN_DIR);
+        }
+    }
+
     // 初始化netlink socket
     struct nl_sock *sk = nl_socket_alloc();
     // 连接到路由套接字
     nl_connect(sk, NETLINK_ROUTE);
-    // 获取接口缓存
-    rtnl_link_alloc_cache(sk, AF_UNSPEC, &link_cache);
+    // 获取由通知维护的接口缓存
+    if (cache_init() == -1) {
+        cache_free();
+        nl_socket_free(sk);
+        return EXIT_FAILURE;
+    }
+
+    if (batch_file || state_file || bench) {
+        int ret = bench ? run_bench(sk, bench)
+                : batch_file ? run_batch(sk, batch_file, rollback)
+                             : reconcile(sk, state_file, dry_run, rollback);
+        cache_free();
+        nl_socket_free(sk);
+        return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     char cmd[256];
     while (1) {
         printf("netcfg> ");
-        fgets(cmd, sizeof(cmd), stdin);
+        fflush(stdout);
+        if (read_command(cmd, sizeof(cmd)) == -1)
+            break;
+        cache_sync(sk);
         
         // 解析命令
-        char *argv[6];
+        char *argv[8];
         int argc = 0;
         char *token = strtok(cmd, " \n");
-        while (token && argc < 5) {
+        while (token && argc < 8) {
             argv[argc++] = token;
             token = strtok(NULL, " \n");
         }
@@ -242,7 +1402,7 @@ int main() {
         if (strcmp(argv[0], "exit") == 0) {
             break;
         } else if (strcmp(argv[0], "show") == 0) {
-            // 显示接口信息的实现（参考之前demo）
+            show_links(argc > 1 ? argv[1] : NULL);
         } else if (strcmp(argv[0], "add") == 0 && argc >=4) {
             if (strcmp(argv[1], "ip") == 0) {
                 if (add_ip_address(sk, argv[2], argv[3]) == 0) {
@@ -255,21 +1415,22 @@ int main() {
                     printf("成功删除地址: %s\n", argv[3]);
                 }
             }
-        // } else if (strcmp(argv[0], "route") == 0 && argc >=6) {
-        //     if (strcmp(argv[1], "add") == 0 && 
-        //         strcmp(argv[2], "default") == 0 &&
-        //         strcmp(argv[3], "via") == 0 &&
-        //         strcmp(argv[5], "dev") == 0) {
-        //         if (set_default_gateway(sk, argv[4], argv[6]) == 0) {
-        //             printf("默认网关已设置: %s\n", argv[4]);
-        //         }
-        //     }
+        } else if (strcmp(argv[0], "route") == 0 && argc >= 7 &&
+                   strcmp(argv[1], "add") == 0 &&
+                   strcmp(argv[2], "default") == 0 &&
+                   strcmp(argv[3], "via") == 0 &&
+                   strcmp(argv[5], "dev") == 0) {
+            int ret = set_default_gateway(sk, argv[4], argv[6]);
+            if (ret == 0)
+                printf("默认网关已设置: %s\n", argv[4]);
+            else
+                fprintf(stderr, "设置默认网关失败: %s\n", nl_geterror(ret));
         } else {
             print_help();
         }
     }
 
-    nl_cache_free(link_cache);
+    cache_free();
     nl_socket_free(sk);
     return 0;
 }
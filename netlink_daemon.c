@@ -0,0 +1,755 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/audit.h>
+
+#include "uevent_parser.h"
+#include "uevent_filter.h"
+#include "audit_assembler.h"
+
+/*
+ * 统一的netlink守护进程：一个epoll循环同时持有NETLINK_ROUTE、NETLINK_KOBJECT_UEVENT、
+ * NETLINK_AUDIT三个非阻塞socket，取代分别运行的netlink_traffic/uevent_monitor/audit_demo。
+ *   - 接收：所有socket共用一个接收缓冲区池（-b 单个大小、-n 个数），就绪时用recvmmsg
+ *     一次收满一批；每个socket每轮最多收NL_ROUNDS批，其余留给水平触发的下一轮，
+ *     一个协议的突发不会饿死其他协议。处理是同步的，一批处理完缓冲区即可复用。
+ *   - 处理：每个协议一个Handler（setup/handle/tick/stop），格式化后调用emit()。
+ *   - 输出：emit()只格式化一次，分发给全部Sink（-o 可多次指定）；文本/JSON输出缓冲，
+ *     每轮epoll结束统一flush，一次唤醒只有一次write。
+ *   - 信号用signalfd、定时用timerfd，都在同一个epoll里，没有异步信号处理。
+ * 缓冲区大小、接收批量、socket接收缓冲区都只在这里调。
+ */
+#define DEFAULT_BUF_SIZE    16384     // 单条消息上限：审计记录约9K，uevent 8K
+#define DEFAULT_BATCH       64        // 缓冲区池大小 = 单次recvmmsg的消息数
+#define DEFAULT_RCVBUF      (16 * 1024 * 1024)
+#define DEFAULT_TICK_MS     200       // 审计事件超时检查
+#define NL_ROUNDS           4         // 每个socket每轮最多接收的批数
+#define MAX_SINKS           8
+#define SINK_BUF_SIZE       (64 * 1024)
+#define LINE_MAX_LEN        (64 * 1024)
+#define IFNAME_CACHE        1024      // ifindex小于此值的网卡名缓存
+#define AUDIT_TIMEOUT_MS    2000
+#define AUDIT_MAX_EVENTS    4096
+#define AUDIT_MAX_MB        8
+
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP        0x10000   // linux/if.h，与net/if.h冲突不能同时包含
+#endif
+
+/* ---------------- 输出层 ---------------- */
+
+typedef struct {
+    const char *source;               // "route" / "uevent" / "audit"
+    struct timespec ts;               // 墙上时间
+    const char *text;                 // 格式化好的正文（可含换行）
+    size_t len;
+} Record;
+
+typedef struct Sink {
+    const char *name;
+    int (*open)(struct Sink *s, const char *arg);
+    void (*write)(struct Sink *s, const Record *r);
+    void (*flush)(struct Sink *s);
+    int fd;
+    struct sockaddr_un addr;          // unix数据报目标
+    char *buf;
+    size_t len;
+    // 统计
+    uint64_t records, bytes, writes, drops, errors;
+} Sink;
+
+static Sink sinks[MAX_SINKS];
+static int nsinks;
+
+static void sink_flush_buf(Sink *s) {
+    for (size_t off = 0; off < s->len;) {
+        ssize_t n = write(s->fd, s->buf + off, s->len - off);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            s->errors++;
+            break;
+        }
+        off += n;
+    }
+    if (s->len)
+        s->writes++;
+    s->bytes += s->len;
+    s->len = 0;
+}
+
+// 保证缓冲区至少有need字节空间；单条超过缓冲区的记录截断
+static char *sink_reserve(Sink *s, size_t *need) {
+    if (*need > SINK_BUF_SIZE)
+        *need = SINK_BUF_SIZE;
+    if (SINK_BUF_SIZE - s->len < *need)
+        sink_flush_buf(s);
+    return s->buf + s->len;
+}
+
+// "-"为标准输出，否则追加写文件
+static int sink_open_file(Sink *s, const char *arg) {
+    s->fd = strcmp(arg, "-") == 0 ? STDOUT_FILENO
+                                  : open(arg, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (s->fd == -1) {
+        perror(arg);
+        return -1;
+    }
+    if (!(s->buf = malloc(SINK_BUF_SIZE))) {
+        perror("malloc");
+        return -1;
+    }
+    return 0;
+}
+
+// 文本：时间 来源 正文
+static void sink_text_write(Sink *s, const Record *r) {
+    struct tm tm;
+    localtime_r(&r->ts.tv_sec, &tm);
+    size_t need = r->len + 48;
+    char *p = sink_reserve(s, &need);
+    size_t n = strftime(p, need, "%F %T", &tm);
+    n += snprintf(p + n, need - n, ".%03ld %-6s ", r->ts.tv_nsec / 1000000, r->source);
+    size_t body = r->len < need - n - 1 ? r->len : need - n - 1;
+    memcpy(p + n, r->text, body);
+    p[n + body] = '\n';
+    s->len += n + body + 1;
+}
+
+// JSON Lines：{"ts":秒.纳秒,"source":...,"text":...}
+static void sink_json_write(Sink *s, const Record *r) {
+    size_t need = r->len * 6 + 80;    // 最坏情况每个字节转义为\u00XX
+    char *p = sink_reserve(s, &need);
+    size_t n = snprintf(p, need, "{\"ts\":%lld.%09ld,\"source\":\"%s\",\"text\":\"",
+                        (long long)r->ts.tv_sec, r->ts.tv_nsec, r->source);
+    for (size_t i = 0; i < r->len && n + 8 < need; i++) {
+        unsigned char c = r->text[i];
+        if (c == '"' || c == '\\') {
+            p[n++] = '\\';
+            p[n++] = c;
+        } else if (c == '\n') {
+            p[n++] = '\\';
+            p[n++] = 'n';
+        } else if (c < 0x20) {
+            n += snprintf(p + n, need - n, "\\u%04x", c);
+        } else {
+            p[n++] = c;
+        }
+    }
+    memcpy(p + n, "\"}\n", 3);
+    s->len += n + 3;
+}
+
+static void sink_file_flush(Sink *s) {
+    sink_flush_buf(s);
+}
+
+// unix数据报：每条记录一个数据报，对端不收时丢弃计数，不阻塞主循环
+static int sink_unix_open(Sink *s, const char *arg) {
+    if (strlen(arg) >= sizeof(s->addr.sun_path)) {
+        fprintf(stderr, "%s: path too long\n", arg);
+        return -1;
+    }
+    s->addr.sun_family = AF_UNIX;
+    strcpy(s->addr.sun_path, arg);
+    s->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    return 0;
+}
+
+static void sink_unix_write(Sink *s, const Record *r) {
+    char hdr[32];
+    int hlen = snprintf(hdr, sizeof(hdr), "%s ", r->source);
+    struct iovec iov[2] = { { hdr, hlen }, { (void *)r->text, r->len } };
+    struct msghdr msg = { .msg_name = &s->addr, .msg_namelen = sizeof(s->addr),
+                          .msg_iov = iov, .msg_iovlen = 2 };
+    if (sendmsg(s->fd, &msg, MSG_DONTWAIT) == -1) {
+        if (errno == EAGAIN || errno == ECONNREFUSED || errno == ENOENT)
+            s->drops++;
+        else
+            s->errors++;
+        return;
+    }
+    s->writes++;
+    s->bytes += hlen + r->len;
+}
+
+static void sink_unix_flush(Sink *s) {
+}
+
+static const Sink sink_types[] = {
+    { .name = "text", .open = sink_open_file, .write = sink_text_write, .flush = sink_file_flush },
+    { .name = "json", .open = sink_open_file, .write = sink_json_write, .flush = sink_file_flush },
+    { .name = "unix", .open = sink_unix_open, .write = sink_unix_write, .flush = sink_unix_flush },
+};
+
+// -o type:arg
+static int sink_add(const char *spec) {
+    const char *colon = strchr(spec, ':');
+    if (!colon || nsinks == MAX_SINKS)
+        return -1;
+    for (size_t i = 0; i < sizeof(sink_types) / sizeof(sink_types[0]); i++) {
+        if (strlen(sink_types[i].name) != (size_t)(colon - spec) ||
+            strncmp(sink_types[i].name, spec, colon - spec) != 0)
+            continue;
+        Sink *s = &sinks[nsinks];
+        *s = sink_types[i];
+        if (s->open(s, colon + 1) == -1)
+            return -1;
+        nsinks++;
+        return 0;
+    }
+    return -1;
+}
+
+static char line[LINE_MAX_LEN];
+
+// 分发给所有输出
+static void emit_raw(const char *source, const char *text, size_t len) {
+    Record r = { .source = source, .text = text, .len = len };
+    clock_gettime(CLOCK_REALTIME, &r.ts);
+    for (int i = 0; i < nsinks; i++) {
+        sinks[i].records++;
+        sinks[i].write(&sinks[i], &r);
+    }
+}
+
+// 格式化一次，分发给所有输出
+static void emit(const char *source, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n >= 0)
+        emit_raw(source, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+}
+
+static void sinks_flush(void) {
+    for (int i = 0; i < nsinks; i++)
+        sinks[i].flush(&sinks[i]);
+}
+
+/* ---------------- 协议处理 ---------------- */
+
+typedef struct Handler {
+    const char *name;
+    int protocol;
+    unsigned groups;
+    int (*setup)(struct Handler *h);
+    void (*handle)(struct Handler *h, const char *buf, size_t len);
+    void (*tick)(struct Handler *h, uint64_t now_ns);
+    void (*stop)(struct Handler *h);
+    int enabled;
+    int fd;
+    // 统计
+    uint64_t msgs, bytes, batches, overruns, truncated, events;
+} Handler;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ---- NETLINK_ROUTE：网卡、地址、路由变化 ---- */
+
+static char ifnames[IFNAME_CACHE][IF_NAMESIZE];
+
+static const char *ifname(int index, char *buf) {
+    if (index > 0 && index < IFNAME_CACHE && ifnames[index][0])
+        return ifnames[index];
+    if (!if_indextoname(index, buf))
+        snprintf(buf, IF_NAMESIZE, "if%d", index);
+    return buf;
+}
+
+static void parse_rtattr(struct rtattr **tb, int max, struct rtattr *rta, int len) {
+    memset(tb, 0, sizeof(struct rtattr *) * (max + 1));
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+        if (rta->rta_type <= max)
+            tb[rta->rta_type] = rta;
+}
+
+static const char *operstate_name(int state) {
+    static const char *const names[] = { "unknown", "notpresent", "down", "lowerlayerdown",
+                                         "testing", "dormant", "up" };
+    return state >= 0 && state < (int)(sizeof(names) / sizeof(names[0])) ? names[state] : "?";
+}
+
+static void route_link(Handler *h, const struct nlmsghdr *nlh) {
+    struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    struct rtattr *tb[IFLA_MAX + 1];
+    parse_rtattr(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(nlh));
+    const char *name = tb[IFLA_IFNAME] ? RTA_DATA(tb[IFLA_IFNAME]) : "?";
+    int del = nlh->nlmsg_type == RTM_DELLINK;
+    if (ifi->ifi_index > 0 && ifi->ifi_index < IFNAME_CACHE) {
+        if (del)
+            ifnames[ifi->ifi_index][0] = '\0';
+        else if (tb[IFLA_IFNAME])
+            snprintf(ifnames[ifi->ifi_index], IF_NAMESIZE, "%s", name);
+    }
+    int oper = tb[IFLA_OPERSTATE] ? *(uint8_t *)RTA_DATA(tb[IFLA_OPERSTATE]) : -1;
+    unsigned mtu = tb[IFLA_MTU] ? *(uint32_t *)RTA_DATA(tb[IFLA_MTU]) : 0;
+    emit(h->name, "link %s %s index=%d %s%s oper=%s mtu=%u", del ? "del" : "new", name,
+         ifi->ifi_index, ifi->ifi_flags & IFF_UP ? "UP" : "DOWN",
+         ifi->ifi_flags & IFF_LOWER_UP ? ",LOWER_UP" : "", operstate_name(oper), mtu);
+}
+
+static void route_addr(Handler *h, const struct nlmsghdr *nlh) {
+    struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+    struct rtattr *tb[IFA_MAX + 1];
+    parse_rtattr(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(nlh));
+    struct rtattr *a = tb[IFA_LOCAL] ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+    char addr[INET6_ADDRSTRLEN] = "?", namebuf[IF_NAMESIZE];
+    if (a)
+        inet_ntop(ifa->ifa_family, RTA_DATA(a), addr, sizeof(addr));
+    emit(h->name, "addr %s %s/%u dev %s", nlh->nlmsg_type == RTM_DELADDR ? "del" : "new", addr,
+         ifa->ifa_prefixlen, ifname(ifa->ifa_index, namebuf));
+}
+
+static void route_route(Handler *h, const struct nlmsghdr *nlh) {
+    struct rtmsg *rtm = NLMSG_DATA(nlh);
+    if (rtm->rtm_flags & RTM_F_CLONED)
+        return;                       // 路由缓存项
+    struct rtattr *tb[RTA_MAX + 1];
+    parse_rtattr(tb, RTA_MAX, RTM_RTA(rtm), RTM_PAYLOAD(nlh));
+    char dst[INET6_ADDRSTRLEN] = "default", gw[INET6_ADDRSTRLEN + 8] = "", dev[IF_NAMESIZE + 8] = "";
+    char namebuf[IF_NAMESIZE];
+    if (tb[RTA_DST])
+        inet_ntop(rtm->rtm_family, RTA_DATA(tb[RTA_DST]), dst, sizeof(dst));
+    if (tb[RTA_GATEWAY]) {
+        char a[INET6_ADDRSTRLEN];
+        inet_ntop(rtm->rtm_family, RTA_DATA(tb[RTA_GATEWAY]), a, sizeof(a));
+        snprintf(gw, sizeof(gw), " via %s", a);
+    }
+    if (tb[RTA_OIF])
+        snprintf(dev, sizeof(dev), " dev %s", ifname(*(int *)RTA_DATA(tb[RTA_OIF]), namebuf));
+    unsigned table = tb[RTA_TABLE] ? *(uint32_t *)RTA_DATA(tb[RTA_TABLE]) : rtm->rtm_table;
+    unsigned metric = tb[RTA_PRIORITY] ? *(uint32_t *)RTA_DATA(tb[RTA_PRIORITY]) : 0;
+    emit(h->name, "route %s %s/%u%s%s table %u metric %u proto %u",
+         nlh->nlmsg_type == RTM_DELROUTE ? "del" : "new", dst, rtm->rtm_dst_len, gw, dev,
+         table, metric, rtm->rtm_protocol);
+}
+
+static void route_handle(Handler *h, const char *buf, size_t len) {
+    int rest = len;
+    for (const struct nlmsghdr *nlh = (const void *)buf; NLMSG_OK(nlh, rest);
+         nlh = NLMSG_NEXT(nlh, rest)) {
+        h->events++;
+        switch (nlh->nlmsg_type) {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            route_link(h, nlh);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            route_addr(h, nlh);
+            break;
+        case RTM_NEWROUTE:
+        case RTM_DELROUTE:
+            route_route(h, nlh);
+            break;
+        default:
+            h->events--;
+        }
+    }
+}
+
+/* ---- NETLINK_KOBJECT_UEVENT：设备热插拔 ---- */
+
+static uf_spec uevent_filter;
+
+static int uevent_setup(Handler *h) {
+    // 内核里先按子系统/动作过滤，不匹配的事件不会唤醒进程
+    if (uf_attach(h->fd, &uevent_filter) == -1) {
+        perror("uevent filter");
+        return -1;
+    }
+    return 0;
+}
+
+static void uevent_handle(Handler *h, const char *buf, size_t len) {
+    static ue_event ev;
+    if (ue_parse(&ev, buf, len) == -1)
+        return;
+    ue_str action = ue_action(&ev), devpath = ue_devpath(&ev);
+    ue_str subsystem = ue_get(&ev, UE_SUBSYSTEM), seq = ue_get(&ev, UE_SEQNUM);
+    ue_str devname = ue_get(&ev, UE_DEVNAME);
+    // BPF放行的非常规消息在用户态再过滤一次
+    if (!uf_match(&uevent_filter, action.ptr, action.len, subsystem.ptr, subsystem.len))
+        return;
+    h->events++;
+    emit(h->name, "%.*s %.*s subsystem=%.*s seq=%.*s%s%.*s", (int)action.len, action.ptr,
+         (int)devpath.len, devpath.ptr, (int)subsystem.len, subsystem.ptr, (int)seq.len, seq.ptr,
+         devname.ptr ? " devname=" : "", (int)devname.len, devname.ptr);
+}
+
+/* ---- NETLINK_AUDIT：按serial组装后输出完整事件 ---- */
+
+static aa_assembler audit_aa;
+
+static void audit_emit(const aa_event *ev, enum aa_reason reason, void *arg) {
+    static const char *const reasons[] = { "", " [timeout]", " [evicted]", " [flushed]" };
+    Handler *h = arg;
+    size_t n = snprintf(line, sizeof(line), "event %llu.%03u:%llu records=%u%s%s",
+                        (unsigned long long)ev->sec, ev->msec, (unsigned long long)ev->serial,
+                        ev->nrecords, ev->dropped ? " (truncated)" : "", reasons[reason]);
+    for (uint32_t i = 0; i < ev->nrecords && n < sizeof(line); i++) {
+        const aa_record *r = &ev->rec[i];
+        const char *name = aa_type_name(r->type);
+        if (name)
+            n += snprintf(line + n, sizeof(line) - n, "\n  %-10s %.*s", name, r->len,
+                          ev->text + r->off);
+        else
+            n += snprintf(line + n, sizeof(line) - n, "\n  type=%-5u %.*s", r->type, r->len,
+                          ev->text + r->off);
+    }
+    h->events++;
+    emit_raw(h->name, line, n < sizeof(line) ? n : sizeof(line) - 1);
+}
+
+static int audit_setup(Handler *h) {
+    if (aa_init(&audit_aa, AUDIT_MAX_EVENTS, (size_t)AUDIT_MAX_MB << 20,
+                (uint64_t)AUDIT_TIMEOUT_MS * 1000000, audit_emit, h) == -1) {
+        perror("aa_init");
+        return -1;
+    }
+    return 0;
+}
+
+static void audit_handle(Handler *h, const char *buf, size_t len) {
+    aa_feed_buffer(&audit_aa, buf, len, mono_ns());
+}
+
+static void audit_tick(Handler *h, uint64_t now_ns) {
+    aa_expire(&audit_aa, now_ns);
+}
+
+static void audit_stop(Handler *h) {
+    aa_flush(&audit_aa);
+    aa_destroy(&audit_aa);
+}
+
+static Handler handlers[] = {
+    { .name = "route", .protocol = NETLINK_ROUTE,
+      .groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+                RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE,
+      .handle = route_handle, .enabled = 1, .fd = -1 },
+    { .name = "uevent", .protocol = NETLINK_KOBJECT_UEVENT, .groups = 1,
+      .setup = uevent_setup, .handle = uevent_handle, .enabled = 1, .fd = -1 },
+    { .name = "audit", .protocol = NETLINK_AUDIT, .groups = AUDIT_NLGRP_READLOG,
+      .setup = audit_setup, .handle = audit_handle, .tick = audit_tick, .stop = audit_stop,
+      .enabled = 1, .fd = -1 },
+};
+#define NHANDLERS ((int)(sizeof(handlers) / sizeof(handlers[0])))
+
+/* ---------------- 接收 ---------------- */
+
+// 所有socket共用的接收缓冲区池
+static struct {
+    char *mem;
+    size_t buf_size;
+    int count;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+} pool;
+
+static int pool_init(size_t buf_size, int count) {
+    pool.buf_size = buf_size;
+    pool.count = count;
+    pool.mem = malloc(buf_size * count);
+    pool.msgs = calloc(count, sizeof(*pool.msgs));
+    pool.iov = calloc(count, sizeof(*pool.iov));
+    if (!pool.mem || !pool.msgs || !pool.iov)
+        return -1;
+    for (int i = 0; i < count; i++)
+        pool.iov[i] = (struct iovec){ pool.mem + (size_t)i * buf_size, buf_size };
+    return 0;
+}
+
+// 创建并绑定socket；特权进程用SO_RCVBUFFORCE突破rmem_max
+static int handler_open(Handler *h, int rcvbuf) {
+    h->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, h->protocol);
+    if (h->fd == -1) {
+        fprintf(stderr, "%s: socket: %s\n", h->name, strerror(errno));
+        return -1;
+    }
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = h->groups };
+    if (bind(h->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "%s: bind: %s\n", h->name, strerror(errno));
+        goto fail;
+    }
+    if (setsockopt(h->fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1)
+        setsockopt(h->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (h->setup && h->setup(h) == -1)
+        goto fail;
+    return 0;
+fail:
+    close(h->fd);
+    h->fd = -1;
+    return -1;
+}
+
+// 收若干批并同步处理；返回-1表示socket出错
+static int handler_drain(Handler *h) {
+    for (int round = 0; round < NL_ROUNDS; round++) {
+        for (int i = 0; i < pool.count; i++)
+            pool.msgs[i].msg_hdr = (struct msghdr){ .msg_iov = &pool.iov[i], .msg_iovlen = 1 };
+        int n = recvmmsg(h->fd, pool.msgs, pool.count, MSG_DONTWAIT, NULL);
+        if (n == -1) {
+            if (errno == ENOBUFS) {
+                h->overruns++;        // 内核已丢弃消息，继续收
+                continue;
+            }
+            if (errno == EAGAIN || errno == EINTR)
+                return 0;
+            fprintf(stderr, "%s: recvmmsg: %s\n", h->name, strerror(errno));
+            return -1;
+        }
+        h->batches++;
+        for (int i = 0; i < n; i++) {
+            if (pool.msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                h->truncated++;
+                continue;
+            }
+            h->msgs++;
+            h->bytes += pool.msgs[i].msg_len;
+            h->handle(h, pool.iov[i].iov_base, pool.msgs[i].msg_len);
+        }
+        if (n < pool.count)
+            return 0;                 // 已收空
+    }
+    return 0;
+}
+
+static void print_stats(uint64_t wakeups) {
+    uint64_t msgs = 0;
+    for (int i = 0; i < NHANDLERS; i++) {
+        const Handler *h = &handlers[i];
+        if (h->fd == -1)
+            continue;
+        msgs += h->msgs;
+        fprintf(stderr, "[STATS] %-6s msgs=%llu bytes=%llu batches=%llu events=%llu "
+                "overruns=%llu truncated=%llu\n", h->name,
+                (unsigned long long)h->msgs, (unsigned long long)h->bytes,
+                (unsigned long long)h->batches, (unsigned long long)h->events,
+                (unsigned long long)h->overruns, (unsigned long long)h->truncated);
+    }
+    for (int i = 0; i < nsinks; i++) {
+        const Sink *s = &sinks[i];
+        fprintf(stderr, "[STATS] sink %s records=%llu bytes=%llu writes=%llu drops=%llu "
+                "errors=%llu\n", s->name,
+                (unsigned long long)s->records, (unsigned long long)s->bytes,
+                (unsigned long long)s->writes, (unsigned long long)s->drops,
+                (unsigned long long)s->errors);
+    }
+    fprintf(stderr, "[STATS] loop wakeups=%llu msgs/wakeup=%.1f pool=%dx%zu\n",
+            (unsigned long long)wakeups, wakeups ? (double)msgs / wakeups : 0.0,
+            pool.count, pool.buf_size);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-p route,uevent,audit] [-o type:arg]... [-b bytes] [-n count]\n"
+            "          [-r rcvbuf] [-s subsystems] [-a actions] [-S sec]\n"
+            "  -p  启用的协议（默认全部；某个协议无权限时跳过）\n"
+            "  -o  输出，可多次指定（默认text:-）：\n"
+            "        text:<file|->   文本行\n"
+            "        json:<file|->   JSON Lines\n"
+            "        unix:<path>     每条记录一个unix数据报，对端不收时丢弃\n"
+            "  -b  接收缓冲区大小（默认%d）\n"
+            "  -n  接收缓冲区个数，即单次recvmmsg的消息数（默认%d）\n"
+            "  -r  每个socket的内核接收缓冲区（默认%d）\n"
+            "  -s  uevent只接收这些子系统（逗号分隔，内核BPF过滤）\n"
+            "  -a  uevent只接收这些动作（逗号分隔）\n"
+            "  -S  每隔多少秒打印统计（默认只在退出和SIGUSR1时打印）\n",
+            prog, DEFAULT_BUF_SIZE, DEFAULT_BATCH, DEFAULT_RCVBUF);
+}
+
+// 逗号分隔的列表追加到白名单
+static int add_names(const char **list, int *n, char *arg) {
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        if (*n >= UF_MAX_ITEMS || strlen(tok) > UF_MAX_NAME)
+            return -1;
+        list[(*n)++] = tok;
+    }
+    return 0;
+}
+
+static int enable_protocols(char *arg) {
+    for (int i = 0; i < NHANDLERS; i++)
+        handlers[i].enabled = 0;
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        int found = 0;
+        for (int i = 0; i < NHANDLERS; i++) {
+            if (strcmp(handlers[i].name, tok) == 0)
+                handlers[i].enabled = found = 1;
+        }
+        if (!found) {
+            fprintf(stderr, "unknown protocol: %s\n", tok);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    size_t buf_size = DEFAULT_BUF_SIZE;
+    int batch = DEFAULT_BATCH, rcvbuf = DEFAULT_RCVBUF, stats_sec = 0, opt;
+    while ((opt = getopt(argc, argv, "p:o:b:n:r:s:a:S:")) != -1) {
+        switch (opt) {
+        case 'p':
+            if (enable_protocols(optarg) == -1)
+                return EXIT_FAILURE;
+            break;
+        case 'o':
+            if (sink_add(optarg) == -1) {
+                fprintf(stderr, "bad output: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b': buf_size = strtoul(optarg, NULL, 0); break;
+        case 'n': batch = atoi(optarg); break;
+        case 'r': rcvbuf = atoi(optarg); break;
+        case 's':
+        case 'a':
+            if (add_names(opt == 's' ? uevent_filter.subsystems : uevent_filter.actions,
+                          opt == 's' ? &uevent_filter.nsubsystems : &uevent_filter.nactions,
+                          optarg) == -1) {
+                fprintf(stderr, "Too many or too long names\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'S': stats_sec = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc || buf_size < 4096 || batch < 1 || stats_sec < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (nsinks == 0 && sink_add("text:-") == -1)
+        return EXIT_FAILURE;
+    if (pool_init(buf_size, batch) == -1) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep == -1) {
+        perror("epoll_create1");
+        return EXIT_FAILURE;
+    }
+    int active = 0;
+    for (int i = 0; i < NHANDLERS; i++) {
+        Handler *h = &handlers[i];
+        if (!h->enabled || handler_open(h, rcvbuf) == -1)
+            continue;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+        epoll_ctl(ep, EPOLL_CTL_ADD, h->fd, &ev);
+        active++;
+    }
+    if (!active) {
+        fprintf(stderr, "no protocol available\n");
+        return EXIT_FAILURE;
+    }
+
+    // 信号与定时器也进同一个epoll
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec its = { { 0, DEFAULT_TICK_MS * 1000000L }, { 0, DEFAULT_TICK_MS * 1000000L } };
+    if (sfd == -1 || tfd == -1 || timerfd_settime(tfd, 0, &its, NULL) == -1) {
+        perror("signalfd/timerfd");
+        return EXIT_FAILURE;
+    }
+    struct epoll_event sev = { .events = EPOLLIN, .data.u32 = NHANDLERS };
+    struct epoll_event tev = { .events = EPOLLIN, .data.u32 = NHANDLERS + 1 };
+    epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &sev);
+    epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &tev);
+
+    uint64_t wakeups = 0, next_stats = stats_sec ? mono_ns() + stats_sec * 1000000000ULL : 0;
+    int running = 1;
+    while (running) {
+        struct epoll_event events[NHANDLERS + 2];
+        int n = epoll_wait(ep, events, NHANDLERS + 2, -1);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        wakeups++;
+        for (int i = 0; i < n; i++) {
+            uint32_t id = events[i].data.u32;
+            if (id < (uint32_t)NHANDLERS) {
+                Handler *h = &handlers[id];
+                if (handler_drain(h) == -1) {
+                    epoll_ctl(ep, EPOLL_CTL_DEL, h->fd, NULL);
+                    if (--active == 0)
+                        running = 0;
+                }
+            } else if (id == (uint32_t)NHANDLERS) {
+                struct signalfd_siginfo si;
+                while (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGUSR1)
+                        print_stats(wakeups);
+                    else
+                        running = 0;
+                }
+            } else {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+                    continue;
+                uint64_t now = mono_ns();
+                for (int j = 0; j < NHANDLERS; j++)
+                    if (handlers[j].fd != -1 && handlers[j].tick)
+                        handlers[j].tick(&handlers[j], now);
+                if (next_stats && now >= next_stats) {
+                    print_stats(wakeups);
+                    next_stats = now + stats_sec * 1000000000ULL;
+                }
+            }
+        }
+        sinks_flush();
+    }
+
+    for (int i = 0; i < NHANDLERS; i++) {
+        if (handlers[i].fd == -1)
+            continue;
+        if (handlers[i].stop)
+            handlers[i].stop(&handlers[i]);
+        close(handlers[i].fd);
+    }
+    sinks_flush();
+    print_stats(wakeups);
+    return EXIT_SUCCESS;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,78 +6,291 @@
 #include <signal.h>
 #include <time.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <linux/if_link.h>
 #include <linux/rtnetlink.h>
 #include <netlink/netlink.h>
 #include <netlink/msg.h>
+#include <netlink/attr.h>
 #include <netlink/route/link.h>
 
+#include "traffic_history.h"
+#include "traffic_shm.h"
+
 // 通过NetLink做网卡流量统计
-#define INTERVAL_SEC 1  // 统计间隔（秒）
+#define DEFAULT_INTERVAL_MS 1000  // 默认统计间隔（毫秒）
+#define SCHED_REPORT_SEC    10    // 调度抖动/丢拍统计输出间隔（秒）
+#define NSEC_PER_SEC        1000000000ULL
+#define DEFAULT_HISTORY_CAP (1U << 20)  // 历史文件原始采样环默认容量（条）
+#define DEFAULT_SHM_SLOTS   4096       // 共享内存默认槽位数（可发布的网卡数）
+#define IFTABLE_INIT_CAP 64       // 网卡哈希表初始槽位数（必须为2的幂）
+#define NL_MSG_BUF_SIZE  32768    // 单次recv缓冲区，dump大量网卡时减少系统调用
+#define METRICS_MAX_CLIENTS 16    // 指标端点最大并发连接数
+#define METRICS_REQ_MAX     2048  // HTTP请求头最大长度
+#define METRICS_TIMEOUT_NS  (5 * NSEC_PER_SEC)
+#define HTTP_HDR_RESERVE    256   // 响应缓冲区为HTTP头预留的空间
+
+// epoll事件来源标识
+enum { EV_TIMER, EV_LISTEN, EV_CLIENT };
 
 typedef struct {
+    int ifindex;                 // 网卡索引，0表示空槽
     char ifname[IF_NAMESIZE];    // 网卡名称
-    uint64_t last_rx_bytes;      // 上次接收字节数
-    uint64_t last_tx_bytes;      // 上次发送字节数
-    time_t last_update;          // 上次更新时间戳
+    int matched;                 // 名称过滤结果缓存（改名时重新计算）
+    unsigned seen_gen;           // 最近一次出现在dump中的轮次
+    struct rtnl_link_stats64 last; // 上次采样的完整计数器
+    uint64_t last_ns;            // 上次采样的单调时钟时间（纳秒），0表示尚未采样
+    double rx_bps, tx_bps;       // 最近一次计算的速率（B/s）
+    double rx_pps, tx_pps;       // 最近一次计算的速率（包/秒）
+    th_accum roll[TH_NROLLUPS];  // 历史文件各级汇总累加器
+    int shm_slot;                // 共享内存槽位，-1表示未发布
 } TrafficContext;
 
+// 网卡选择方式
+typedef enum {
+    MATCH_ONE,    // 单个网卡：按名称直接请求，不做dump
+    MATCH_ALL,    // 全部网卡
+    MATCH_GLOB,   // 通配符，如 "veth*"
+    MATCH_REGEX   // 扩展正则，如 "^(eth|ens)[0-9]+$"
+} MatchMode;
+
+// 以ifindex为键的开放寻址哈希表，一次dump内查找/插入均为O(1)
+typedef struct {
+    MatchMode mode;
+    const char *pattern;
+    regex_t regex;
+    TrafficContext *slots;
+    size_t cap;                  // 槽位数（2的幂）
+    size_t count;                // 已占用槽位数
+    size_t seen;                 // 本轮dump中出现的网卡数
+    unsigned gen;                // 当前轮次
+    uint64_t now_ns;             // 本轮采样的单调时钟时间（纳秒）
+    struct timespec now_wall;    // 本轮采样的墙上时间，仅用于显示
+    th_store *hist;              // 历史文件，NULL表示不记录
+    ts_shm *shm;                 // 共享内存发布，NULL表示不发布
+    uint64_t shm_full;           // 槽位耗尽而未能发布的次数
+    int quiet;                   // 不在终端打印速率（仅发布/记录）
+} TrafficTable;
+
+// 定时调度统计：抖动为实际唤醒时刻相对理想时刻的延迟
+typedef struct {
+    uint64_t interval_ns;        // 采样间隔
+    uint64_t start_ns;           // 第0拍的理想时刻
+    uint64_t ticks;              // 理想时间轴上已经过的拍数（含丢拍）
+    uint64_t handled;            // 实际处理的拍数
+    uint64_t missed;             // 因处理过慢而合并掉的拍数
+    uint64_t jitter_sum_ns;
+    uint64_t jitter_max_ns;
+} TickStats;
+
 static volatile sig_atomic_t keep_running = 1;
 
 // 信号处理：优雅退出
-void sigint_handler(int sig) {
+static void sigint_handler(int sig) {
     keep_running = 0;
 }
 
+static inline uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline size_t iftable_hash(int ifindex, size_t cap) {
+    return ((uint32_t)ifindex * 2654435761u) & (cap - 1);
+}
+
+// 线性探测查找槽位：命中返回该槽，否则返回可插入的空槽
+static TrafficContext *iftable_probe(TrafficContext *slots, size_t cap, int ifindex) {
+    size_t i = iftable_hash(ifindex, cap);
+    while (slots[i].ifindex != 0 && slots[i].ifindex != ifindex)
+        i = (i + 1) & (cap - 1);
+    return &slots[i];
+}
+
+// 按新容量重建哈希表；only_seen非0时顺带丢弃本轮未出现（已删除）的网卡
+static int iftable_rehash(TrafficTable *tbl, size_t new_cap, int only_seen) {
+    TrafficContext *slots = calloc(new_cap, sizeof(*slots));
+    if (!slots)
+        return -1;
+
+    size_t count = 0;
+    for (size_t i = 0; i < tbl->cap; i++) {
+        TrafficContext *old = &tbl->slots[i];
+        if (old->ifindex == 0)
+            continue;
+        if (only_seen && old->seen_gen != tbl->gen) {
+            // 网卡已删除，把未满的汇总桶落盘
+            if (tbl->hist)
+                th_flush_all(tbl->hist, old->roll);
+            if (tbl->shm && old->shm_slot >= 0)
+                ts_slot_free(tbl->shm, old->shm_slot);
+            continue;
+        }
+        *iftable_probe(slots, new_cap, old->ifindex) = *old;
+        count++;
+    }
+
+    free(tbl->slots);
+    tbl->slots = slots;
+    tbl->cap = new_cap;
+    tbl->count = count;
+    return 0;
+}
+
+// 查找或插入网卡表项，负载因子超过1/2时扩容
+static TrafficContext *iftable_get(TrafficTable *tbl, int ifindex) {
+    TrafficContext *ctx = iftable_probe(tbl->slots, tbl->cap, ifindex);
+    if (ctx->ifindex != 0)
+        return ctx;
+
+    if ((tbl->count + 1) * 2 > tbl->cap) {
+        if (iftable_rehash(tbl, tbl->cap * 2, 0) < 0)
+            return NULL;
+        ctx = iftable_probe(tbl->slots, tbl->cap, ifindex);
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->ifindex = ifindex;
+    ctx->shm_slot = -1;
+    tbl->count++;
+    return ctx;
+}
+
+// 判断网卡名称是否符合过滤条件
+static int iftable_match(const TrafficTable *tbl, const char *ifname) {
+    switch (tbl->mode) {
+    case MATCH_ONE:
+        return strcmp(ifname, tbl->pattern) == 0;
+    case MATCH_GLOB:
+        return fnmatch(tbl->pattern, ifname, 0) == 0;
+    case MATCH_REGEX:
+        return regexec(&tbl->regex, ifname, 0, NULL, 0) == 0;
+    default:
+        return 1;
+    }
+}
+
 // 解析网卡统计信息（含流量速率计算）
 static int parse_link_stats(struct nl_msg *msg, void *arg) {
-    TrafficContext *ctx = (TrafficContext *)arg;
+    TrafficTable *tbl = (TrafficTable *)arg;
     struct nlmsghdr *nlh = nlmsg_hdr(msg);
-    struct ifinfomsg *ifinfo = NLMSG_DATA(nlh);
     struct nlattr *attrs[IFLA_MAX + 1];
-    
-    nlmsg_parse(nlh, sizeof(struct ifinfomsg), attrs, IFLA_MAX, NULL);
 
-    if (!attrs[IFLA_IFNAME] || !attrs[IFLA_STATS64]) 
+    if (nlh->nlmsg_type != RTM_NEWLINK)
+        return NL_SKIP;
+
+    struct ifinfomsg *ifinfo = NLMSG_DATA(nlh);
+    if (nlmsg_parse(nlh, sizeof(struct ifinfomsg), attrs, IFLA_MAX, NULL) < 0)
+        return NL_SKIP;
+
+    if (!attrs[IFLA_IFNAME] || !attrs[IFLA_STATS64])
         return NL_SKIP;
 
-    // 匹配目标网卡
+    TrafficContext *ctx = iftable_get(tbl, ifinfo->ifi_index);
+    if (!ctx) {
+        fprintf(stderr, "Out of memory\n");
+        return NL_STOP;
+    }
+    ctx->seen_gen = tbl->gen;
+    tbl->seen++;
+
+    // 首次出现或改名时才重新匹配过滤条件
     char *current_ifname = nla_get_string(attrs[IFLA_IFNAME]);
-    if (strcmp(current_ifname, ctx->ifname) != 0)
+    if (strncmp(current_ifname, ctx->ifname, IF_NAMESIZE) != 0) {
+        strncpy(ctx->ifname, current_ifname, IF_NAMESIZE - 1);
+        ctx->ifname[IF_NAMESIZE - 1] = '\0';
+        ctx->matched = iftable_match(tbl, ctx->ifname);
+        ctx->last_ns = 0;
+        // 改名后不再匹配的网卡停止发布
+        if (!ctx->matched && tbl->shm && ctx->shm_slot >= 0) {
+            ts_slot_free(tbl->shm, ctx->shm_slot);
+            ctx->shm_slot = -1;
+        }
+    }
+    if (!ctx->matched)
         return NL_SKIP;
 
     // 获取当前统计值
-    struct rtnl_link_stats64 *stats = nla_data(attrs[IFLA_STATS64]);
-    time_t now = time(NULL);
-    
-    // 计算时间差（处理首次运行）
-    double time_diff = (ctx->last_update == 0) ? 1.0 : 
-                      difftime(now, ctx->last_update);
+    // 旧内核的stats64可能比头文件定义短，缺失字段补0
+    struct rtnl_link_stats64 cur = {0};
+    struct rtnl_link_stats64 *stats = &cur;
+    int stats_len = nla_len(attrs[IFLA_STATS64]);
+    memcpy(&cur, nla_data(attrs[IFLA_STATS64]),
+           stats_len < (int)sizeof(cur) ? stats_len : (int)sizeof(cur));
+    uint64_t now = tbl->now_ns;
+
+    // 计算时间差（单调时钟纳秒精度，不受系统改时影响）
+    double time_diff = (double)(now - ctx->last_ns) / NSEC_PER_SEC;
 
     // 计算速率（B/s）
-    if (ctx->last_update != 0) {
-        uint64_t rx_diff = stats->rx_bytes - ctx->last_rx_bytes;
-        uint64_t tx_diff = stats->tx_bytes - ctx->last_tx_bytes;
-        
-        printf("[%ld] %s:\n", now, ctx->ifname);
-        printf("  RX: %lu B (%.2f KB/s)\n", stats->rx_bytes, rx_diff/time_diff/1024);
-        printf("  TX: %lu B (%.2f KB/s)\n", stats->tx_bytes, tx_diff/time_diff/1024);
-        printf("--------------------------------\n");
+    if (ctx->last_ns != 0 && now > ctx->last_ns) {
+        ctx->rx_bps = (stats->rx_bytes - ctx->last.rx_bytes) / time_diff;
+        ctx->tx_bps = (stats->tx_bytes - ctx->last.tx_bytes) / time_diff;
+        ctx->rx_pps = (stats->rx_packets - ctx->last.rx_packets) / time_diff;
+        ctx->tx_pps = (stats->tx_packets - ctx->last.tx_packets) / time_diff;
+
+        if (!tbl->quiet) {
+            printf("[%ld.%03ld] %s:\n", (long)tbl->now_wall.tv_sec,
+                   tbl->now_wall.tv_nsec / 1000000, ctx->ifname);
+            printf("  RX: %llu B (%.2f KB/s)\n", (unsigned long long)stats->rx_bytes,
+                   ctx->rx_bps/1024);
+            printf("  TX: %llu B (%.2f KB/s)\n", (unsigned long long)stats->tx_bytes,
+                   ctx->tx_bps/1024);
+            printf("--------------------------------\n");
+        }
+    }
+
+    // 发布到共享内存槽位
+    if (tbl->shm) {
+        if (ctx->shm_slot < 0)
+            ctx->shm_slot = ts_slot_alloc(tbl->shm);
+        if (ctx->shm_slot >= 0) {
+            ts_slot *slot = &tbl->shm->slots[ctx->shm_slot];
+            ts_write_begin(slot);
+            slot->ifindex = ctx->ifindex;
+            memcpy(slot->ifname, ctx->ifname, IF_NAMESIZE);
+            slot->ts_ns = now;
+            slot->rx_bps = ctx->rx_bps;
+            slot->tx_bps = ctx->tx_bps;
+            slot->rx_pps = ctx->rx_pps;
+            slot->tx_pps = ctx->tx_pps;
+            slot->stats = *stats;
+            ts_write_end(slot);
+        } else {
+            tbl->shm_full++;
+        }
+    }
+
+    // 写入历史文件：原始样本 + 增量汇总
+    if (tbl->hist) {
+        th_append_sample(tbl->hist, ctx->ifindex, now, stats);
+        if (ctx->last_ns != 0)
+            th_accumulate(tbl->hist, ctx->roll, ctx->ifindex, ctx->last_ns, now,
+                          &ctx->last, stats);
     }
 
     // 更新上下文
-    ctx->last_rx_bytes = stats->rx_bytes;
-    ctx->last_tx_bytes = stats->tx_bytes;
-    ctx->last_update = now;
+    ctx->last = *stats;
+    ctx->last_ns = now;
 
     return NL_OK;
 }
 
-// 周期性获取统计数据
-void fetch_stats(struct nl_sock *sock, TrafficContext *ctx) {
-    struct nl_msg *msg = nlmsg_alloc_simple(RTM_GETLINK, NLM_F_REQUEST);
+// 周期性获取统计数据：单网卡按名称请求，其余模式一次dump取回全部网卡
+void fetch_stats(struct nl_sock *sock, TrafficTable *tbl) {
+    int flags = (tbl->mode == MATCH_ONE) ? NLM_F_REQUEST : NLM_F_REQUEST | NLM_F_DUMP;
+    struct nl_msg *msg = nlmsg_alloc_simple(RTM_GETLINK, flags);
     if (!msg) {
         fprintf(stderr, "Failed to allocate message\n");
         return;
@@ -85,50 +299,701 @@ void fetch_stats(struct nl_sock *sock, TrafficContext *ctx) {
     // 构造请求消息
     struct ifinfomsg ifinfo = {
         .ifi_family = AF_UNSPEC,
-        .ifi_index = if_nametoindex(ctx->ifname)  // 直接指定目标网卡
     };
     nlmsg_append(msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO);
+    // 由内核按名称查找，省去每轮的 if_nametoindex() 系统调用
+    if (tbl->mode == MATCH_ONE)
+        nla_put_string(msg, IFLA_IFNAME, tbl->pattern);
 
-    // 发送请求并处理响应
-    nl_send_auto(sock, msg);
-    nl_socket_modify_cb(sock, NL_CB_MSG_IN, NL_CB_CUSTOM, parse_link_stats, ctx);
-    nl_recvmsgs_default(sock);
+    tbl->gen++;
+    tbl->seen = 0;
+    tbl->now_ns = mono_ns();
+    clock_gettime(CLOCK_REALTIME, &tbl->now_wall);
 
+    // 发送请求并处理响应
+    int err = nl_send_auto(sock, msg);
+    if (err >= 0)
+        err = nl_recvmsgs_default(sock);
+    if (err < 0)
+        fprintf(stderr, "Failed to fetch link stats: %s\n", nl_geterror(err));
     nlmsg_free(msg);
+
+    // 清理已消失的网卡（成功完成dump后才清理，避免误删）
+    if (err >= 0 && tbl->seen < tbl->count)
+        iftable_rehash(tbl, tbl->cap, 1);
+    if (tbl->shm)
+        ts_publish_generation(tbl->shm);
 }
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <interface>\n", argv[0]);
-        return EXIT_FAILURE;
+// 创建按绝对单调时间触发的周期定时器，避免sleep()带来的累积漂移
+static int tick_timer_create(TickStats *ts) {
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd == -1)
+        return -1;
+
+    ts->start_ns = mono_ns() + ts->interval_ns;
+    struct itimerspec its = {
+        .it_value    = { ts->start_ns / NSEC_PER_SEC, ts->start_ns % NSEC_PER_SEC },
+        .it_interval = { ts->interval_ns / NSEC_PER_SEC, ts->interval_ns % NSEC_PER_SEC },
+    };
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+        close(tfd);
+        return -1;
+    }
+    return tfd;
+}
+
+// 消费定时器到期次数并更新抖动/丢拍统计；返回0表示本次唤醒无到期
+static int tick_timer_consume(int tfd, TickStats *ts) {
+    uint64_t expirations;
+    if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return 0;
+
+    uint64_t now = mono_ns();
+    ts->ticks += expirations;
+    ts->missed += expirations - 1;
+    ts->handled++;
+
+    // 本次唤醒对应的理想时刻为最近一次到期点
+    uint64_t expected = ts->start_ns + (ts->ticks - 1) * ts->interval_ns;
+    uint64_t jitter = now > expected ? now - expected : 0;
+    ts->jitter_sum_ns += jitter;
+    if (jitter > ts->jitter_max_ns)
+        ts->jitter_max_ns = jitter;
+    return 1;
+}
+
+static void tick_report(const TickStats *ts) {
+    fprintf(stderr, "[sched] ticks=%llu handled=%llu missed=%llu "
+            "jitter avg=%.1fus max=%.1fus\n",
+            (unsigned long long)ts->ticks, (unsigned long long)ts->handled,
+            (unsigned long long)ts->missed,
+            ts->handled ? ts->jitter_sum_ns / 1000.0 / ts->handled : 0.0,
+            ts->jitter_max_ns / 1000.0);
+}
+
+/* ---------------- Prometheus 指标暴露 ---------------- */
+
+// 响应缓冲区：正文从HTTP_HDR_RESERVE处开始写，渲染完成后把HTTP头紧贴在正文前
+typedef struct {
+    char *buf;
+    size_t cap;                  // 仅在网卡数增长时扩容，稳态下每次请求零堆分配
+    size_t len;                  // 已写入位置（含预留头部）
+    size_t start;                // 完整响应起始偏移
+    int oom;
+} MetricsBuf;
+
+typedef struct {
+    int fd;                      // -1表示空闲
+    size_t req_len;
+    char req[METRICS_REQ_MAX];
+    const char *resp;            // 待发送响应（指向共享缓冲区或静态文本）
+    size_t resp_len;
+    size_t sent;
+    uint64_t accepted_ns;
+    int parked;                  // 本批epoll事件中刚关闭，批次处理完之前不复用
+} MetricsClient;
+
+typedef struct {
+    int listen_fd;
+    MetricsBuf out;
+    unsigned rendered_gen;       // 缓冲区对应的采样轮次
+    int rendered;
+    int senders;                 // 正在发送共享缓冲区的客户端数，>0时不重新渲染
+    uint64_t scrapes;
+    uint64_t rejected;
+    MetricsClient clients[METRICS_MAX_CLIENTS];
+} MetricsServer;
+
+static const char metrics_404[] =
+    "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n"
+    "Content-Length: 10\r\nConnection: close\r\n\r\nNot Found\n";
+
+static int mb_reserve(MetricsBuf *mb, size_t n) {
+    if (mb->len + n <= mb->cap)
+        return 0;
+    size_t cap = mb->cap ? mb->cap : 65536;
+    while (cap < mb->len + n)
+        cap *= 2;
+    char *p = realloc(mb->buf, cap);
+    if (!p) {
+        mb->oom = 1;
+        return -1;
+    }
+    mb->buf = p;
+    mb->cap = cap;
+    return 0;
+}
+
+static inline void mb_put(MetricsBuf *mb, const char *s, size_t n) {
+    if (mb_reserve(mb, n) == 0) {
+        memcpy(mb->buf + mb->len, s, n);
+        mb->len += n;
+    }
+}
+
+#define mb_puts(mb, lit) mb_put((mb), (lit), sizeof(lit) - 1)
+
+static inline void mb_u64(MetricsBuf *mb, uint64_t v) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[sizeof(tmp) - 1 - n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    mb_put(mb, tmp + sizeof(tmp) - n, n);
+}
+
+// 速率保留3位小数即可，整数部分与小数部分分别按整数输出，避免printf开销
+static inline void mb_rate(MetricsBuf *mb, double v) {
+    if (v < 0)
+        v = 0;
+    uint64_t milli = (uint64_t)(v * 1000 + 0.5);
+    mb_u64(mb, milli / 1000);
+    char frac[4] = { '.', '0' + milli / 100 % 10, '0' + milli / 10 % 10, '0' + milli % 10 };
+    mb_put(mb, frac, sizeof(frac));
+}
+
+// 标签值需转义反斜杠与双引号
+static inline void mb_label(MetricsBuf *mb, const char *name) {
+    mb_puts(mb, "{interface=\"");
+    for (const char *p = name; *p; p++) {
+        if (*p == '\\' || *p == '"')
+            mb_puts(mb, "\\");
+        mb_put(mb, p, 1);
+    }
+    mb_puts(mb, "\"} ");
+}
+
+// 每类指标的取值方式：offset为stats64内字段偏移，rate为上下文内速率字段偏移
+typedef struct {
+    const char *name;
+    const char *help;
+    int is_rate;
+    size_t offset;
+} MetricDesc;
+
+#define STAT64(field) offsetof(struct rtnl_link_stats64, field)
+#define CTXRATE(field) offsetof(TrafficContext, field)
+
+static const MetricDesc metric_descs[] = {
+    { "netlink_traffic_receive_bytes_total", "Received bytes.", 0, STAT64(rx_bytes) },
+    { "netlink_traffic_transmit_bytes_total", "Transmitted bytes.", 0, STAT64(tx_bytes) },
+    { "netlink_traffic_receive_packets_total", "Received packets.", 0, STAT64(rx_packets) },
+    { "netlink_traffic_transmit_packets_total", "Transmitted packets.", 0, STAT64(tx_packets) },
+    { "netlink_traffic_receive_errors_total", "Receive errors.", 0, STAT64(rx_errors) },
+    { "netlink_traffic_transmit_errors_total", "Transmit errors.", 0, STAT64(tx_errors) },
+    { "netlink_traffic_receive_dropped_total", "Receive drops.", 0, STAT64(rx_dropped) },
+    { "netlink_traffic_transmit_dropped_total", "Transmit drops.", 0, STAT64(tx_dropped) },
+    { "netlink_traffic_receive_bytes_per_second", "Receive rate over the last interval.", 1, CTXRATE(rx_bps) },
+    { "netlink_traffic_transmit_bytes_per_second", "Transmit rate over the last interval.", 1, CTXRATE(tx_bps) },
+    { "netlink_traffic_receive_packets_per_second", "Receive packet rate over the last interval.", 1, CTXRATE(rx_pps) },
+    { "netlink_traffic_transmit_packets_per_second", "Transmit packet rate over the last interval.", 1, CTXRATE(tx_pps) },
+};
+
+static void metrics_render(MetricsServer *srv, const TrafficTable *tbl, const TickStats *ts) {
+    MetricsBuf *mb = &srv->out;
+    mb->len = HTTP_HDR_RESERVE;
+    mb->oom = 0;
+    mb_reserve(mb, 0);
+
+    // 与下面逐接口输出的条件一致：只计过滤匹配且已有采样的接口
+    uint64_t reported = 0;
+    for (size_t i = 0; i < tbl->cap; i++) {
+        const TrafficContext *ctx = &tbl->slots[i];
+        if (ctx->ifindex != 0 && ctx->matched && ctx->last_ns != 0)
+            reported++;
     }
 
+    for (size_t m = 0; m < sizeof(metric_descs) / sizeof(metric_descs[0]); m++) {
+        const MetricDesc *d = &metric_descs[m];
+        size_t nlen = strlen(d->name);
+        mb_puts(mb, "# HELP ");
+        mb_put(mb, d->name, nlen);
+        mb_puts(mb, " ");
+        mb_put(mb, d->help, strlen(d->help));
+        mb_puts(mb, "\n# TYPE ");
+        mb_put(mb, d->name, nlen);
+        if (d->is_rate)
+            mb_puts(mb, " gauge\n");
+        else
+            mb_puts(mb, " counter\n");
+
+        for (size_t i = 0; i < tbl->cap; i++) {
+            const TrafficContext *ctx = &tbl->slots[i];
+            if (ctx->ifindex == 0 || !ctx->matched || ctx->last_ns == 0)
+                continue;
+            mb_put(mb, d->name, nlen);
+            mb_label(mb, ctx->ifname);
+            if (d->is_rate)
+                mb_rate(mb, *(const double *)((const char *)ctx + d->offset));
+            else
+                mb_u64(mb, *(const uint64_t *)((const char *)&ctx->last + d->offset));
+            mb_puts(mb, "\n");
+        }
+    }
+
+    mb_puts(mb, "# TYPE netlink_traffic_interfaces gauge\nnetlink_traffic_interfaces ");
+    mb_u64(mb, reported);
+    mb_puts(mb, "\n# TYPE netlink_traffic_missed_ticks_total counter\n"
+                "netlink_traffic_missed_ticks_total ");
+    mb_u64(mb, ts->missed);
+    mb_puts(mb, "\n# TYPE netlink_traffic_tick_jitter_max_seconds gauge\n"
+                "netlink_traffic_tick_jitter_max_seconds ");
+    char jitter[32];
+    mb_put(mb, jitter, snprintf(jitter, sizeof(jitter), "%.9f\n", ts->jitter_max_ns / 1e9));
+
+    if (mb->oom) {
+        srv->rendered = 0;
+        return;
+    }
+
+    // HTTP头写入预留区，紧贴正文之前
+    char hdr[HTTP_HDR_RESERVE];
+    int hlen = snprintf(hdr, sizeof(hdr),
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: %zu\r\n"
+                        "Connection: close\r\n\r\n",
+                        mb->len - HTTP_HDR_RESERVE);
+    mb->start = HTTP_HDR_RESERVE - hlen;
+    memcpy(mb->buf + mb->start, hdr, hlen);
+    srv->rendered = 1;
+    srv->rendered_gen = tbl->gen;
+}
+
+// 监听地址：unix:<path>、[host:]port
+static int metrics_listen(const char *spec) {
+    int fd;
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un sun = { .sun_family = AF_UNIX };
+        snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", spec + 5);
+        unlink(sun.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1 || bind(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+            goto fail;
+    } else {
+        char host[256] = "127.0.0.1";
+        const char *port = spec;
+        const char *colon = strrchr(spec, ':');
+        if (colon) {
+            snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+            port = colon + 1;
+        }
+        struct addrinfo hints = { .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE };
+        struct addrinfo *ai;
+        if (getaddrinfo(host[0] ? host : NULL, port, &hints, &ai) != 0)
+            return -1;
+        fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        if (fd != -1)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (fd == -1 || bind(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
+            freeaddrinfo(ai);
+            goto fail;
+        }
+        freeaddrinfo(ai);
+    }
+    if (listen(fd, 64) == -1)
+        goto fail;
+    return fd;
+
+fail:
+    if (fd != -1)
+        close(fd);
+    return -1;
+}
+
+static void metrics_client_close(MetricsServer *srv, MetricsClient *c) {
+    if (c->resp && c->resp != metrics_404)
+        srv->senders--;
+    close(c->fd);
+    c->fd = -1;
+    c->resp = NULL;
+    // 同一批epoll事件里可能还有发给旧连接的事件，立即复用会被新连接误收
+    c->parked = 1;
+}
+
+// 尽量发送，发送完毕关闭连接；返回0表示仍需等待EPOLLOUT
+static int metrics_client_flush(MetricsServer *srv, MetricsClient *c) {
+    while (c->sent < c->resp_len) {
+        ssize_t n = send(c->fd, c->resp + c->sent, c->resp_len - c->sent, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        c->sent += n;
+    }
+    metrics_client_close(srv, c);
+    return 1;
+}
+
+static void metrics_accept(MetricsServer *srv, int epfd) {
+    for (;;) {
+        int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+            return;
+
+        MetricsClient *c = NULL;
+        for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+            if (srv->clients[i].fd == -1 && !srv->clients[i].parked) {
+                c = &srv->clients[i];
+                break;
+            }
+        }
+        if (!c) {
+            srv->rejected++;
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = EV_CLIENT + (c - srv->clients) };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->req_len = 0;
+        c->sent = 0;
+        c->resp = NULL;
+        c->accepted_ns = mono_ns();
+    }
+}
+
+static void metrics_client_event(MetricsServer *srv, MetricsClient *c, int epfd,
+                                 const TrafficTable *tbl, const TickStats *ts) {
+    if (c->resp) {
+        metrics_client_flush(srv, c);
+        return;
+    }
+
+    ssize_t n = recv(c->fd, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len, 0);
+    if (n <= 0) {
+        if (n == -1 && (errno == EAGAIN || errno == EINTR))
+            return;
+        metrics_client_close(srv, c);
+        return;
+    }
+    c->req_len += n;
+    c->req[c->req_len] = '\0';
+    if (!strstr(c->req, "\r\n\r\n") && !strstr(c->req, "\n\n")) {
+        if (c->req_len >= sizeof(c->req) - 1)
+            metrics_client_close(srv, c);
+        return;
+    }
+
+    if (strncmp(c->req, "GET /metrics", 12) == 0 || strncmp(c->req, "GET / ", 6) == 0) {
+        // 有客户端正在发送旧缓冲区时继续复用它，最多落后一个采样周期
+        if (!srv->rendered || (srv->rendered_gen != tbl->gen && srv->senders == 0))
+            metrics_render(srv, tbl, ts);
+        if (!srv->rendered) {
+            metrics_client_close(srv, c);
+            return;
+        }
+        c->resp = srv->out.buf + srv->out.start;
+        c->resp_len = srv->out.len - srv->out.start;
+        srv->senders++;
+        srv->scrapes++;
+    } else {
+        c->resp = metrics_404;
+        c->resp_len = sizeof(metrics_404) - 1;
+    }
+
+    if (!metrics_client_flush(srv, c)) {
+        struct epoll_event ev = { .events = EPOLLOUT, .data.u64 = EV_CLIENT + (c - srv->clients) };
+        epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    }
+}
+
+// 一批epoll事件处理完毕，本批关闭的槽位可以复用
+static void metrics_unpark(MetricsServer *srv) {
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++)
+        srv->clients[i].parked = 0;
+}
+
+// 每个采样周期清理超时的慢客户端，防止占满连接槽
+static void metrics_reap(MetricsServer *srv, uint64_t now) {
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        MetricsClient *c = &srv->clients[i];
+        if (c->fd != -1 && now - c->accepted_ns > METRICS_TIMEOUT_NS)
+            metrics_client_close(srv, c);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-i ms] <interface>\n"
+            "       %s [-i ms] -a             监控全部网卡\n"
+            "       %s [-i ms] -g <glob>      监控名称匹配通配符的网卡，如 'veth*'\n"
+            "       %s [-i ms] -r <regex>     监控名称匹配扩展正则的网卡\n"
+            "  -i ms    采样间隔（毫秒，默认%d）\n"
+            "  -H file  把采样追加到mmap环形历史文件（可用traffic_query查询）\n"
+            "  -N n     历史文件原始采样环容量（条，默认%u）\n"
+            "  -S name  把最新计数器与速率发布到POSIX共享内存（见traffic_shm.h）\n"
+            "  -M n     共享内存槽位数（默认%u）\n"
+            "  -q       不在终端打印速率\n"
+            "  -P addr  以Prometheus文本格式暴露指标：[host:]port 或 unix:<path>\n",
+            prog, prog, prog, prog, DEFAULT_INTERVAL_MS, DEFAULT_HISTORY_CAP,
+            DEFAULT_SHM_SLOTS);
+}
+
+#ifdef NL_REPLAY
+/*
+ * 回放入口（见nl_replay.c）：-DNL_REPLAY 编译时main改名，本文件与nl_replay.c链接
+ * 录制的RTM_NEWLINK数据报按fetch_stats相同的路径逐条交给parse_link_stats
+ */
+static TrafficTable replay_tbl = { .mode = MATCH_ALL, .cap = IFTABLE_INIT_CAP, .quiet = 1 };
+
+int traffic_replay_init(void) {
+    replay_tbl.slots = calloc(replay_tbl.cap, sizeof(*replay_tbl.slots));
+    return replay_tbl.slots ? 0 : -1;
+}
+
+// 一个数据报按一轮采样处理，返回其中的消息数
+int traffic_replay_feed(const void *buf, size_t len, uint64_t now_ns) {
+    struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+    int remain = (int)len, n = 0;
+
+    replay_tbl.gen++;
+    replay_tbl.seen = 0;
+    replay_tbl.now_ns = now_ns;
+    for (; nlmsg_ok(nlh, remain); nlh = nlmsg_next(nlh, &remain), n++) {
+        // nl_recvmsgs对每条消息都分配nl_msg，这里照做以便计入分配次数
+        struct nl_msg *msg = nlmsg_convert(nlh);
+        if (!msg)
+            return -1;
+        parse_link_stats(msg, &replay_tbl);
+        nlmsg_free(msg);
+    }
+    return n;
+}
+
+void traffic_replay_fini(void) {
+    free(replay_tbl.slots);
+    replay_tbl.slots = NULL;
+    replay_tbl.cap = IFTABLE_INIT_CAP;
+    replay_tbl.count = 0;
+}
+
+#define main netlink_traffic_main
+#endif
+
+int main(int argc, char **argv) {
     // 初始化上下文
-    TrafficContext ctx = {
-        .last_rx_bytes = 0,
-        .last_tx_bytes = 0,
-        .last_update = 0
+    TrafficTable tbl = {
+        .mode = MATCH_ONE,
+        .cap = IFTABLE_INIT_CAP,
+    };
+
+    TickStats ticks = {
+        .interval_ns = DEFAULT_INTERVAL_MS * 1000000ULL,
     };
-    strncpy(ctx.ifname, argv[1], IF_NAMESIZE-1);
+
+    const char *hist_path = NULL;
+    uint64_t hist_cap = DEFAULT_HISTORY_CAP;
+    th_store hist;
+    const char *shm_name = NULL;
+    uint32_t shm_slots = DEFAULT_SHM_SLOTS;
+    ts_shm shm;
+    const char *metrics_addr = NULL;
+    MetricsServer metrics = { .listen_fd = -1 };
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++)
+        metrics.clients[i].fd = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "ag:r:i:H:N:S:M:qP:")) != -1) {
+        switch (opt) {
+        case 'P':
+            metrics_addr = optarg;
+            break;
+        case 'q':
+            tbl.quiet = 1;
+            break;
+        case 'S':
+            shm_name = optarg;
+            break;
+        case 'M':
+            shm_slots = strtoul(optarg, NULL, 10);
+            break;
+        case 'H':
+            hist_path = optarg;
+            break;
+        case 'N':
+            hist_cap = strtoull(optarg, NULL, 10);
+            break;
+        case 'i': {
+            long ms = strtol(optarg, NULL, 10);
+            if (ms <= 0) {
+                fprintf(stderr, "Invalid interval: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            ticks.interval_ns = (uint64_t)ms * 1000000ULL;
+            break;
+        }
+        case 'a':
+            tbl.mode = MATCH_ALL;
+            break;
+        case 'g':
+            tbl.mode = MATCH_GLOB;
+            tbl.pattern = optarg;
+            break;
+        case 'r':
+            tbl.mode = MATCH_REGEX;
+            tbl.pattern = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (tbl.mode == MATCH_ONE) {
+        if (optind != argc - 1) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        tbl.pattern = argv[optind];
+    } else if (optind != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (tbl.mode == MATCH_REGEX &&
+        regcomp(&tbl.regex, tbl.pattern, REG_EXTENDED | REG_NOSUB) != 0) {
+        fprintf(stderr, "Invalid regex: %s\n", tbl.pattern);
+        return EXIT_FAILURE;
+    }
+
+    if (hist_path) {
+        if (th_open_writer(&hist, hist_path, hist_cap) == -1) {
+            perror("Failed to open history file");
+            return EXIT_FAILURE;
+        }
+        tbl.hist = &hist;
+    }
+
+    if (shm_name) {
+        if (shm_slots == 0 || ts_create(&shm, shm_name, shm_slots, ticks.interval_ns) == -1) {
+            perror("Failed to create shared memory");
+            return EXIT_FAILURE;
+        }
+        tbl.shm = &shm;
+    }
+
+    tbl.slots = calloc(tbl.cap, sizeof(*tbl.slots));
+    if (!tbl.slots) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
 
     // 创建 Netlink 套接字
     struct nl_sock *sock = nl_socket_alloc();
     if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0) {
         fprintf(stderr, "Failed to initialize socket\n");
         nl_socket_free(sock);
+        free(tbl.slots);
         return EXIT_FAILURE;
     }
+    nl_socket_set_msg_buf_size(sock, NL_MSG_BUF_SIZE);
+    // 应答本身即结果，不再请求ACK，避免残留ACK错位到下一轮
+    nl_socket_disable_auto_ack(sock);
+    nl_socket_modify_cb(sock, NL_CB_VALID, NL_CB_CUSTOM, parse_link_stats, &tbl);
+
+    // 定时器与epoll：按理想时间轴触发，处理耗时不会推迟后续采样点
+    int tfd = tick_timer_create(&ticks);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = EV_TIMER };
+    if (tfd == -1 || epfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) == -1) {
+        perror("Failed to initialize timer");
+        nl_socket_free(sock);
+        free(tbl.slots);
+        return EXIT_FAILURE;
+    }
+
+    if (metrics_addr) {
+        metrics.listen_fd = metrics_listen(metrics_addr);
+        ev.data.u64 = EV_LISTEN;
+        if (metrics.listen_fd == -1 ||
+            epoll_ctl(epfd, EPOLL_CTL_ADD, metrics.listen_fd, &ev) == -1) {
+            perror("Failed to listen for metrics");
+            nl_socket_free(sock);
+            free(tbl.slots);
+            return EXIT_FAILURE;
+        }
+    }
 
     signal(SIGINT, sigint_handler);
 
     // 主循环
+    uint64_t report_every = SCHED_REPORT_SEC * NSEC_PER_SEC / ticks.interval_ns;
+    uint64_t next_report = report_every ? report_every : 1;
     while (keep_running) {
-        fetch_stats(sock, &ctx);
-        sleep(INTERVAL_SEC);
+        struct epoll_event events[METRICS_MAX_CLIENTS + 2];
+        int n = epoll_wait(epfd, events, METRICS_MAX_CLIENTS + 2, -1);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint64_t src = events[i].data.u64;
+            if (src == EV_LISTEN) {
+                metrics_accept(&metrics, epfd);
+            } else if (src >= EV_CLIENT) {
+                // 该槽位已在本批中关闭，事件属于旧连接
+                if (metrics.clients[src - EV_CLIENT].fd == -1)
+                    continue;
+                metrics_client_event(&metrics, &metrics.clients[src - EV_CLIENT], epfd,
+                                     &tbl, &ticks);
+            } else if (tick_timer_consume(tfd, &ticks)) {
+                fetch_stats(sock, &tbl);
+                if (metrics.listen_fd != -1)
+                    metrics_reap(&metrics, mono_ns());
+
+                if (ticks.handled >= next_report) {
+                    tick_report(&ticks);
+                    next_report += report_every ? report_every : 1;
+                }
+            }
+        }
+        if (metrics.listen_fd != -1)
+            metrics_unpark(&metrics);
     }
 
     // 清理资源
+    tick_report(&ticks);
+    if (metrics.listen_fd != -1) {
+        for (int i = 0; i < METRICS_MAX_CLIENTS; i++)
+            if (metrics.clients[i].fd != -1)
+                metrics_client_close(&metrics, &metrics.clients[i]);
+        close(metrics.listen_fd);
+        if (strncmp(metrics_addr, "unix:", 5) == 0)
+            unlink(metrics_addr + 5);
+        free(metrics.out.buf);
+    }
+    close(epfd);
+    close(tfd);
     nl_socket_free(sock);
+    if (tbl.hist) {
+        for (size_t i = 0; i < tbl.cap; i++)
+            if (tbl.slots[i].ifindex)
+                th_flush_all(tbl.hist, tbl.slots[i].roll);
+        th_close(tbl.hist);
+    }
+    if (tbl.shm) {
+        if (tbl.shm_full)
+            fprintf(stderr, "shm slots exhausted %llu times, raise -M\n",
+                    (unsigned long long)tbl.shm_full);
+        ts_destroy(tbl.shm);
+    }
+    free(tbl.slots);
+    if (tbl.mode == MATCH_REGEX)
+        regfree(&tbl.regex);
     printf("\nMonitoring stopped.\n");
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -1,9 +1,17 @@
+#define _GNU_SOURCE
 #include <netlink/netlink.h>
 #include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
 #include <netlink/route/addr.h>
 #include <netlink/route/route.h>
 #include <arpa/inet.h>
 #include <net/if.h>  // 新增关键头文件
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 /*
 * source： https://github.com/thom311/libnl
@@ -15,78 +23,509 @@ iproute2项目，支持ip等命令
 * 1. 设置环境变量 NLCB=debug ./myprogram 将启用调试消息处理程序
 * 2. NLDBG=[0..4] ./myprogram
 */
-// 打印接口的IP地址信息（保持不变）
-// 打印接口的IP地址信息
-void print_addresses(struct rtnl_link *link) {
-    struct nl_sock *sock = nl_socket_alloc();
-    nl_connect(sock, NETLINK_ROUTE);
-    
-    struct nl_cache *addr_cache;
-    rtnl_addr_alloc_cache(sock, &addr_cache);
 
+/*
+ * 网络清单：链路、地址、路由各dump一次（共用一个socket），按ifindex归并。
+ * 归并用ifindex哈希表（开放寻址）：先数出每个接口的地址/路由数，再按前缀和
+ * 把对象指针排进一整块数组（每个接口占连续一段），全程O(链路+地址+路由)，
+ * 不再为每个接口各建一个socket、各dump一次地址表。
+ */
+
+typedef struct {
+    int ifindex;                      // 0为空槽
+    struct rtnl_link *link;
+    int addr_off, naddr;              // 在addrs数组中的区间
+    int route_off, nroute;            // 在routes数组中的区间
+} Iface;
+
+static struct {
+    Iface *slots;
+    unsigned mask;
+    struct rtnl_addr **addrs;
+    struct rtnl_route **routes;
+} inv;
+
+static Iface *iface_find(int ifindex) {
+    if (ifindex <= 0)
+        return NULL;
+    for (unsigned i = (unsigned)ifindex * 2654435761u & inv.mask;; i = (i + 1) & inv.mask) {
+        if (inv.slots[i].ifindex == ifindex)
+            return &inv.slots[i];
+        if (inv.slots[i].ifindex == 0)
+            return NULL;
+    }
+}
+
+static Iface *iface_insert(int ifindex) {
+    unsigned i = (unsigned)ifindex * 2654435761u & inv.mask;
+    while (inv.slots[i].ifindex && inv.slots[i].ifindex != ifindex)
+        i = (i + 1) & inv.mask;
+    inv.slots[i].ifindex = ifindex;
+    return &inv.slots[i];
+}
+
+// 路由归属的接口：第一个下一跳的出口（黑洞等无下一跳的路由不归属任何接口）
+static int route_ifindex(struct rtnl_route *route) {
+    if (rtnl_route_get_nnexthops(route) == 0)
+        return 0;
+    return rtnl_route_nh_get_ifindex(rtnl_route_nexthop_n(route, 0));
+}
+
+/**
+ * 按ifindex归并三张表
+ * @return 成功返回0，内存不足返回-1
+ */
+static int inventory_build(struct nl_cache *links, struct nl_cache *addrs,
+                           struct nl_cache *routes) {
+    unsigned size = 16;
+    while (size < (unsigned)nl_cache_nitems(links) * 2)
+        size <<= 1;
+    inv.mask = size - 1;
+    inv.slots = calloc(size, sizeof(Iface));
+    inv.addrs = malloc((nl_cache_nitems(addrs) + 1) * sizeof(*inv.addrs));
+    inv.routes = malloc((nl_cache_nitems(routes) + 1) * sizeof(*inv.routes));
+    if (!inv.slots || !inv.addrs || !inv.routes)
+        return -1;
+
+    struct nl_object *o;
+    for (o = nl_cache_get_first(links); o; o = nl_cache_get_next(o)) {
+        struct rtnl_link *link = (struct rtnl_link *)o;
+        iface_insert(rtnl_link_get_ifindex(link))->link = link;
+    }
+
+    // 1. 计数
+    Iface *e;
+    for (o = nl_cache_get_first(addrs); o; o = nl_cache_get_next(o))
+        if ((e = iface_find(rtnl_addr_get_ifindex((struct rtnl_addr *)o))))
+            e->naddr++;
+    for (o = nl_cache_get_first(routes); o; o = nl_cache_get_next(o))
+        if ((e = iface_find(route_ifindex((struct rtnl_route *)o))))
+            e->nroute++;
+
+    // 2. 前缀和分配区间
+    int na = 0, nr = 0;
+    for (unsigned i = 0; i < size; i++) {
+        e = &inv.slots[i];
+        e->addr_off = na;
+        e->route_off = nr;
+        na += e->naddr;
+        nr += e->nroute;
+        e->naddr = e->nroute = 0;
+    }
+
+    // 3. 填充（保持dump中的顺序）
+    for (o = nl_cache_get_first(addrs); o; o = nl_cache_get_next(o))
+        if ((e = iface_find(rtnl_addr_get_ifindex((struct rtnl_addr *)o))))
+            inv.addrs[e->addr_off + e->naddr++] = (struct rtnl_addr *)o;
+    for (o = nl_cache_get_first(routes); o; o = nl_cache_get_next(o))
+        if ((e = iface_find(route_ifindex((struct rtnl_route *)o))))
+            inv.routes[e->route_off + e->nroute++] = (struct rtnl_route *)o;
+    return 0;
+}
+
+static void inventory_free(void) {
+    free(inv.slots);
+    free(inv.addrs);
+    free(inv.routes);
+}
+
+/* ---------------- 输出 ---------------- */
+
+enum { OUT_TEXT, OUT_JSON, OUT_COLUMNS };
+
+// 地址转字符串，带前缀长度
+static const char *addr_str(struct rtnl_addr *addr, char *buf, size_t size) {
+    struct nl_addr *local = rtnl_addr_get_local(addr);
+    char ip[INET6_ADDRSTRLEN];
+    if (!local || !inet_ntop(nl_addr_get_family(local), nl_addr_get_binary_addr(local),
+                             ip, sizeof(ip)))
+        snprintf(ip, sizeof(ip), "?");
+    snprintf(buf, size, "%s/%d", ip, rtnl_addr_get_prefixlen(addr));
+    return buf;
+}
+
+// 路由目的地址，前缀长度为0时为default
+static const char *route_dst_str(struct rtnl_route *route, char *buf, size_t size) {
+    struct nl_addr *dst = rtnl_route_get_dst(route);
+    if (!dst || nl_addr_get_prefixlen(dst) == 0)
+        return "default";
+    return nl_addr2str(dst, buf, size);
+}
+
+static const char *route_gw_str(struct rtnl_route *route, char *buf, size_t size) {
+    struct nl_addr *gw = rtnl_route_nh_get_gateway(rtnl_route_nexthop_n(route, 0));
+    return gw ? nl_addr2str(gw, buf, size) : NULL;
+}
+
+// JSON字符串（接口名可以包含引号等任意可见字符）
+static void json_str(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
+
+// 打印接口的IP地址信息
+static void print_addresses(const Iface *e) {
+    char buf[INET6_ADDRSTRLEN + 8];
     printf("IP Addresses:\n");
-    
-    // 遍历所有地址缓存
-    struct rtnl_addr *addr = (struct rtnl_addr*) nl_cache_get_first(addr_cache);
-    for (; addr; addr = (struct rtnl_addr*) nl_cache_get_next(addr)) {
-        if (rtnl_addr_get_ifindex(addr) == rtnl_link_get_ifindex(link)) {
-            struct nl_addr *local = rtnl_addr_get_local(addr);
-            char buf[INET6_ADDRSTRLEN];
-            
-            if (nl_addr_get_family(local) == AF_INET) {
-                inet_ntop(AF_INET, nl_addr_get_binary_addr(local), 
-                         buf, sizeof(buf));
-                printf("  IPv4: %s/%d\n", buf, nl_addr_get_prefixlen(local));
-            } else if (nl_addr_get_family(local) == AF_INET6) {
-                inet_ntop(AF_INET6, nl_addr_get_binary_addr(local), 
-                         buf, sizeof(buf));
-                printf("  IPv6: %s/%d\n", buf, nl_addr_get_prefixlen(local));
+    for (int i = 0; i < e->naddr; i++) {
+        struct rtnl_addr *addr = inv.addrs[e->addr_off + i];
+        printf("  %s: %s\n", rtnl_addr_get_family(addr) == AF_INET6 ? "IPv6" : "IPv4",
+               addr_str(addr, buf, sizeof(buf)));
+    }
+}
+
+// 打印经由该接口的路由
+static void print_routes(const Iface *e) {
+    char dst[INET6_ADDRSTRLEN + 8], gw[INET6_ADDRSTRLEN + 8];
+    if (e->nroute)
+        printf("Routes:\n");
+    for (int i = 0; i < e->nroute; i++) {
+        struct rtnl_route *route = inv.routes[e->route_off + i];
+        const char *via = route_gw_str(route, gw, sizeof(gw));
+        printf("  %s%s%s metric %u table %u\n", route_dst_str(route, dst, sizeof(dst)),
+               via ? " via " : "", via ? via : "", rtnl_route_get_priority(route),
+               rtnl_route_get_table(route));
+    }
+}
+
+static void print_json(const Iface *e, const char *mac, int first) {
+    struct rtnl_link *link = e->link;
+    char buf[INET6_ADDRSTRLEN + 8], gw[INET6_ADDRSTRLEN + 8];
+    printf("%s\n  {\"ifindex\":%d,\"name\":", first ? "" : ",", e->ifindex);
+    json_str(rtnl_link_get_name(link));
+    printf(",\"mac\":");
+    if (mac)
+        json_str(mac);
+    else
+        printf("null");
+    printf(",\"mtu\":%u,\"state\":\"%s\",\"flags\":%u,\"addresses\":[",
+           rtnl_link_get_mtu(link), rtnl_link_get_flags(link) & IFF_UP ? "UP" : "DOWN",
+           rtnl_link_get_flags(link));
+    for (int i = 0; i < e->naddr; i++) {
+        printf("%s", i ? "," : "");
+        json_str(addr_str(inv.addrs[e->addr_off + i], buf, sizeof(buf)));
+    }
+    printf("],\"routes\":[");
+    for (int i = 0; i < e->nroute; i++) {
+        struct rtnl_route *route = inv.routes[e->route_off + i];
+        const char *via = route_gw_str(route, gw, sizeof(gw));
+        printf("%s{\"dst\":", i ? "," : "");
+        json_str(route_dst_str(route, buf, sizeof(buf)));
+        printf(",\"gateway\":");
+        if (via)
+            json_str(via);
+        else
+            printf("null");
+        printf(",\"metric\":%u,\"table\":%u}", rtnl_route_get_priority(route),
+               rtnl_route_get_table(route));
+    }
+    printf("]}");
+}
+
+// 紧凑列格式：每个接口一行，地址以逗号分隔，便于awk/grep
+static void print_columns(const Iface *e, const char *mac) {
+    struct rtnl_link *link = e->link;
+    char buf[INET6_ADDRSTRLEN + 8];
+    printf("%d %s %s %u %s %d ", e->ifindex, rtnl_link_get_name(link), mac ? mac : "-",
+           rtnl_link_get_mtu(link), rtnl_link_get_flags(link) & IFF_UP ? "UP" : "DOWN",
+           e->nroute);
+    for (int i = 0; i < e->naddr; i++)
+        printf("%s%s", i ? "," : "", addr_str(inv.addrs[e->addr_off + i], buf, sizeof(buf)));
+    printf("%s\n", e->naddr ? "" : "-");
+}
+
+static double elapsed_ms(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+/* ---------------- 基准（-B） ---------------- */
+
+/*
+ * 在unshare出的网络命名空间里建count个接口（优先dummy，内核不支持时改用
+ * veth对），每个接口一个/24地址（UP的接口随之有一条前缀路由），然后比较：
+ *   naive  旧实现：dump链路，每个接口新建socket、dump整张地址表再按ifindex过滤
+ *   join   现实现：链路/地址/路由各dump一次，inventory_build按ifindex归并
+ * 两者都不输出，只计采集与归并；每种各跑rounds轮取最快一轮。
+ */
+#define BENCH_ROUNDS    3
+#define BENCH_MAX_LINKS 65000         // 地址10.<hi>.<lo>.1/24，每个接口一个/24
+
+static int bench_add_link(struct nl_sock *sk, int i, int use_veth) {
+    char name[IFNAMSIZ];
+    struct rtnl_link *link = use_veth ? rtnl_link_veth_alloc() : rtnl_link_alloc();
+    if (!link)
+        return -NLE_NOMEM;
+    snprintf(name, sizeof(name), "bench%u", (unsigned)i & 0xFFFF);
+    rtnl_link_set_name(link, name);
+    rtnl_link_set_flags(link, IFF_UP);
+    if (use_veth) {
+        struct rtnl_link *peer = rtnl_link_veth_get_peer(link);
+        snprintf(name, sizeof(name), "bench%u", (unsigned)(i + 1) & 0xFFFF);
+        rtnl_link_set_name(peer, name);   // 内核不接受在对端上置IFF_UP，对端保持DOWN
+        rtnl_link_put(peer);
+    } else {
+        rtnl_link_set_type(link, "dummy");
+    }
+    int err = rtnl_link_add(sk, link, NLM_F_CREATE | NLM_F_EXCL);
+    if (use_veth)
+        rtnl_link_veth_release(link);
+    else
+        rtnl_link_put(link);
+    return err;
+}
+
+static int bench_add_addr(struct nl_sock *sk, int ifindex, int i) {
+    char ip[32];
+    struct nl_addr *local;
+    snprintf(ip, sizeof(ip), "10.%d.%d.1/24", i >> 8 & 0xFF, i & 0xFF);
+    int err = nl_addr_parse(ip, AF_INET, &local);
+    if (err < 0)
+        return err;
+    struct rtnl_addr *addr = rtnl_addr_alloc();
+    rtnl_addr_set_local(addr, local);
+    rtnl_addr_set_ifindex(addr, ifindex);
+    err = rtnl_addr_add(sk, addr, 0);
+    rtnl_addr_put(addr);
+    nl_addr_put(local);
+    return err;
+}
+
+// 建接口并配地址；返回使用的接口类型
+static const char *bench_populate(struct nl_sock *sk, int count) {
+    int use_veth = 0, err;
+    for (int i = 0; i < count; i += use_veth ? 2 : 1) {
+        err = bench_add_link(sk, i, use_veth);
+        if (err == -NLE_OPNOTSUPP && i == 0 && !use_veth) {
+            use_veth = 1;                 // 没有dummy模块
+            err = bench_add_link(sk, i, use_veth);
+        }
+        if (err < 0) {
+            fprintf(stderr, "创建接口bench%d失败: %s\n", i, nl_geterror(err));
+            return NULL;
+        }
+    }
+    struct nl_cache *links;
+    if ((err = rtnl_link_alloc_cache(sk, AF_UNSPEC, &links)) < 0) {
+        fprintf(stderr, "dump失败: %s\n", nl_geterror(err));
+        return NULL;
+    }
+    int i = 0;
+    struct nl_object *o;
+    for (o = nl_cache_get_first(links); o && err >= 0; o = nl_cache_get_next(o))
+        if (strncmp(rtnl_link_get_name((struct rtnl_link *)o), "bench", 5) == 0)
+            err = bench_add_addr(sk, rtnl_link_get_ifindex((struct rtnl_link *)o), i++);
+    nl_cache_free(links);
+    if (err < 0) {
+        fprintf(stderr, "添加地址失败: %s\n", nl_geterror(err));
+        return NULL;
+    }
+    return use_veth ? "veth" : "dummy";
+}
+
+// 旧实现的采集方式：每个接口一个socket、一次完整的地址dump
+static int bench_naive(struct nl_sock *sk, long *found) {
+    struct nl_cache *links;
+    if (rtnl_link_alloc_cache(sk, AF_UNSPEC, &links) < 0)
+        return -1;
+    *found = 0;
+    struct nl_object *o;
+    for (o = nl_cache_get_first(links); o; o = nl_cache_get_next(o)) {
+        int ifindex = rtnl_link_get_ifindex((struct rtnl_link *)o);
+        struct nl_sock *s = nl_socket_alloc();
+        struct nl_cache *addrs;
+        if (!s || nl_connect(s, NETLINK_ROUTE) < 0 || rtnl_addr_alloc_cache(s, &addrs) < 0) {
+            nl_socket_free(s);
+            nl_cache_free(links);
+            return -1;
+        }
+        struct nl_object *a;
+        for (a = nl_cache_get_first(addrs); a; a = nl_cache_get_next(a))
+            *found += rtnl_addr_get_ifindex((struct rtnl_addr *)a) == ifindex;
+        nl_cache_free(addrs);
+        nl_socket_free(s);
+    }
+    nl_cache_free(links);
+    return 0;
+}
+
+static int bench_join(struct nl_sock *sk, long *found) {
+    struct nl_cache *links = NULL, *addrs = NULL, *routes = NULL;
+    int ret = -1;
+    if (rtnl_link_alloc_cache(sk, AF_UNSPEC, &links) < 0 ||
+        rtnl_addr_alloc_cache(sk, &addrs) < 0 ||
+        rtnl_route_alloc_cache(sk, AF_UNSPEC, 0, &routes) < 0 ||
+        inventory_build(links, addrs, routes) == -1)
+        goto out;
+    *found = 0;
+    for (unsigned i = 0; i <= inv.mask; i++)
+        *found += inv.slots[i].naddr;
+    ret = 0;
+out:
+    inventory_free();
+    memset(&inv, 0, sizeof(inv));
+    nl_cache_free(routes);
+    nl_cache_free(addrs);
+    nl_cache_free(links);
+    return ret;
+}
+
+static int run_bench(int count, int rounds) {
+    if (unshare(CLONE_NEWNET) == -1) {
+        perror("unshare(CLONE_NEWNET)（需要root权限）");
+        return EXIT_FAILURE;
+    }
+    struct nl_sock *sk = nl_socket_alloc();
+    nl_connect(sk, NETLINK_ROUTE);
+    nl_socket_set_msg_buf_size(sk, 64 * 1024);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    const char *kind = bench_populate(sk, count);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (!kind) {
+        nl_socket_free(sk);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "[STATS] created %d %s links in %.0fms\n", count, kind,
+            elapsed_ms(&t0, &t1));
+
+    static const char *const names[] = { "naive", "join" };
+    int (*const fns[])(struct nl_sock *, long *) = { bench_naive, bench_join };
+    double best[2] = { 0, 0 };
+    long found[2] = { 0, 0 };
+    for (int k = 0; k < 2; k++) {
+        for (int r = 0; r < rounds; r++) {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            if (fns[k](sk, &found[k]) == -1) {
+                fprintf(stderr, "%s: dump失败\n", names[k]);
+                nl_socket_free(sk);
+                return EXIT_FAILURE;
             }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            double ms = elapsed_ms(&t0, &t1);
+            if (r == 0 || ms < best[k])
+                best[k] = ms;
         }
+        printf("%-5s links=%d addresses=%ld best=%.1fms (of %d)\n", names[k], count + 1,
+               found[k], best[k], rounds);
     }
-    
-    nl_cache_free(addr_cache);
-    nl_socket_free(sock);
+    printf("speedup %.1fx\n", best[0] / best[1]);
+    nl_socket_free(sk);                   // 命名空间及其中的接口随进程退出销毁
+    return found[0] == found[1] ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-j | -c] [-v]\n"
+            "       %s -B <count> [-n rounds]\n"
+            "  -j  JSON输出\n"
+            "  -c  紧凑列输出：ifindex name mac mtu state routes addresses\n"
+            "  -v  打印dump与归并耗时\n"
+            "  -B  基准：在临时网络命名空间中建count个接口，比较逐接口dump与单次dump归并\n"
+            "  -n  基准的轮数，取最快一轮（默认%d）\n",
+            prog, prog, BENCH_ROUNDS);
 }
 
-int main() {
+int main(int argc, char **argv) {
+    int mode = OUT_TEXT, verbose = 0, bench = 0, rounds = BENCH_ROUNDS, opt;
+    while ((opt = getopt(argc, argv, "jcvB:n:")) != -1) {
+        switch (opt) {
+        case 'B': bench = atoi(optarg); break;
+        case 'n': rounds = atoi(optarg); break;
+        case 'j': mode = OUT_JSON; break;
+        case 'c': mode = OUT_COLUMNS; break;
+        case 'v': verbose = 1; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (bench < 0 || bench > BENCH_MAX_LINKS || rounds <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (bench)
+        return run_bench(bench, rounds);
+
+    struct timespec t0, t1, t2, t3;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
     struct nl_sock *sock = nl_socket_alloc();
     nl_connect(sock, NETLINK_ROUTE);
-    
-    struct nl_cache *link_cache;
-    rtnl_link_alloc_cache(sock, AF_UNSPEC, &link_cache);
+    nl_socket_set_msg_buf_size(sock, 64 * 1024);   // 大块接收，减少dump的recv次数
+
+    struct nl_cache *link_cache = NULL, *addr_cache = NULL, *route_cache = NULL;
+    int err;
+    if ((err = rtnl_link_alloc_cache(sock, AF_UNSPEC, &link_cache)) < 0 ||
+        (err = rtnl_addr_alloc_cache(sock, &addr_cache)) < 0 ||
+        (err = rtnl_route_alloc_cache(sock, AF_UNSPEC, 0, &route_cache)) < 0) {
+        fprintf(stderr, "dump失败: %s\n", nl_geterror(err));
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (inventory_build(link_cache, addr_cache, route_cache) == -1) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
 
-    printf("%-10s %-17s %-6s %-18s %s\n", 
-          "Interface", "MAC Address", "MTU", "State", "Flags");
+    // 输出可能有上万行，整块缓冲
+    static char outbuf[256 * 1024];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+    if (mode == OUT_TEXT)
+        printf("%-10s %-17s %-6s %-18s %s\n",
+              "Interface", "MAC Address", "MTU", "State", "Flags");
+    else if (mode == OUT_JSON)
+        printf("[");
 
+    int first = 1;
     struct rtnl_link *link = (struct rtnl_link*) nl_cache_get_first(link_cache);
-    for (; link; link = (struct rtnl_link*) nl_cache_get_next(link)) {
-        const char *name = rtnl_link_get_name(link);
-        int mtu = rtnl_link_get_mtu(link);
-        unsigned flags = rtnl_link_get_flags(link);
+    for (; link; link = (struct rtnl_link*) nl_cache_get_next((struct nl_object *)link)) {
+        const Iface *e = iface_find(rtnl_link_get_ifindex(link));
 
         // 修正后的MAC地址处理
         struct nl_addr *mac = rtnl_link_get_addr(link);
-        char mac_buf[18];
-        const char *mac_str;
-        if (mac) {
-            nl_addr2str(mac, mac_buf, sizeof(mac_buf));
-            mac_str = mac_buf;
+        char mac_buf[64];
+        const char *mac_str = mac ? nl_addr2str(mac, mac_buf, sizeof(mac_buf)) : NULL;
+
+        if (mode == OUT_JSON) {
+            print_json(e, mac_str, first);
+        } else if (mode == OUT_COLUMNS) {
+            print_columns(e, mac_str);
         } else {
-            mac_str = "N/A";
+            unsigned flags = rtnl_link_get_flags(link);
+            // 修正后的状态判断
+            const char *state = (flags & IFF_UP) ? "UP" : "DOWN";
+            printf("%-10s %-17s %-6d %-18s 0x%x\n", rtnl_link_get_name(link),
+                  mac_str ? mac_str : "N/A", rtnl_link_get_mtu(link), state, flags);
+            print_addresses(e);
+            print_routes(e);
+            printf("\n");
         }
-
-        // 修正后的状态判断
-        const char *state = (flags & IFF_UP) ? "UP" : "DOWN";
-        
-        printf("%-10s %-17s %-6d %-18s 0x%x\n", 
-              name, mac_str, mtu, state, flags);
-
-        print_addresses(link);
-        printf("\n");
+        first = 0;
     }
+    if (mode == OUT_JSON)
+        printf("\n]\n");
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &t3);
+
+    if (verbose)
+        fprintf(stderr, "[STATS] links=%d addresses=%d routes=%d dump=%.1fms join=%.1fms "
+                "output=%.1fms\n", nl_cache_nitems(link_cache), nl_cache_nitems(addr_cache),
+                nl_cache_nitems(route_cache), elapsed_ms(&t0, &t1), elapsed_ms(&t1, &t2),
+                elapsed_ms(&t2, &t3));
 
+    inventory_free();
+    nl_cache_free(route_cache);
+    nl_cache_free(addr_cache);
     nl_cache_free(link_cache);
     nl_socket_free(sock);
     return 0;
-}
\ No newline at end of file
+}
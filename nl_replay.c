@@ -0,0 +1,759 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/audit.h>
+#include "audit_assembler.h"
+#include "audit_tokenizer.h"
+
+/*
+ * netlink解析器的录制回放基准：不需要root和真实的内核流量即可测量、比较解析性能。
+ *   - 录制（-w）：打开route/uevent/audit三个socket，原样保存收到的数据报到语料文件；
+ *     route每隔 -i 毫秒主动发一次RTM_GETLINK dump（netlink_traffic的采样请求）。
+ *   - 回放（-r）：语料按协议分组，直接调用各工具自己的解析代码：
+ *       route   netlink_traffic.c 的 parse_link_stats()（经nl_msg，同fetch_stats）
+ *       uevent  uevent_monitor.c 的 parse_uevent()（-q，不打印）
+ *       audit   audit_demo.c 解析线程的循环体（组装 + -i分词格式化到输出块）
+ *     每个协议先预热一遍，再计时回放 -n 遍，报告消息数/秒、ns/消息（各遍的最小值与中位数）、
+ *     每条消息的分配次数（本文件覆盖malloc族计数，libnl内部的分配也计入）。
+ *   - 基线：-o 写出本次结果，-b 与基线比较，ns/消息超过 -t 百分比或分配次数增加即为退化，
+ *     比较用各遍的最小值：共享的构建机上中位数受调度干扰，最小值稳定得多；
+ *     退出码2，可直接用在构建脚本里。
+ *   - 分词（-k）：只取语料中的审计记录正文，比较audit_tokenizer.h的SIMD/标量分词与
+ *     strtok+sscanf的朴素解析，每条记录都取出syscall/pid/uid/comm，报告MB/s与ns/记录。
+ * 被测工具以 -DNL_REPLAY 编译（main改名、导出回放入口），与本文件链接：
+ *   gcc -O2 -DNL_REPLAY -c netlink_traffic.c $(pkg-config --cflags libnl-3.0 libnl-route-3.0)
+ *   gcc -O2 -DNL_REPLAY -c uevent_monitor.c
+ *   gcc -O2 -DNL_REPLAY -c audit_demo.c
+ *   gcc -O2 nl_replay.c netlink_traffic.o uevent_monitor.o audit_demo.o -pthread \
+ *       $(pkg-config --libs libnl-3.0 libnl-route-3.0) -o nl_replay
+ *
+ * 语料文件格式（本机字节序）：8字节魔数，之后是记录序列，
+ * 每条记录为 CorpusRec 头 + len 字节数据报，数据补齐到8字节。
+ * 回放按协议分组，几个语料去掉开头的魔数后可以直接拼接；
+ * 审计多播只投递到初始网络命名空间，录audit不能在 unshare -n 里进行。
+ */
+#define CORPUS_MAGIC        "NLCORP01"
+#define RECV_BUF_SIZE       (64 * 1024)   // dump一次最多约32K
+#define DEFAULT_RCVBUF      (16 * 1024 * 1024)
+#define DEFAULT_DUMP_MS     1000          // 录制时RTM_GETLINK dump的间隔
+#define DEFAULT_PASSES      50            // 计时回放的遍数
+#define DEFAULT_THRESHOLD   10            // 退化阈值（百分比）
+#define ALLOC_EPSILON       0.01          // 分配次数/消息的比较容差
+#define NSEC_PER_SEC        1000000000ULL
+
+typedef struct {
+    uint32_t len;                 // 数据报字节数
+    uint16_t proto;               // NETLINK_ROUTE / NETLINK_KOBJECT_UEVENT / NETLINK_AUDIT
+    uint16_t pad;
+    uint64_t ts_ns;               // 接收时刻（单调时钟）
+} CorpusRec;
+
+/* ---------------- 分配计数 ---------------- */
+
+// 主程序定义的malloc族覆盖glibc的实现，被链接的工具代码与libnl的分配都经过这里
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t alloc_count;
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+/* ---------------- 被测解析器 ---------------- */
+
+// 各工具在 -DNL_REPLAY 下导出的入口，feed返回数据报中的消息数，-1表示出错
+int traffic_replay_init(void);
+int traffic_replay_feed(const void *buf, size_t len, uint64_t now_ns);
+void traffic_replay_fini(void);
+int uevent_replay_init(void);
+int uevent_replay_feed(const void *buf, size_t len, uint64_t now_ns);
+void uevent_replay_fini(void);
+int audit_replay_init(int interpret);
+int audit_replay_feed(const void *buf, size_t len, uint64_t now_ns);
+void audit_replay_fini(void);
+
+static int audit_interpret = 1;
+
+static int audit_init(void) {
+    return audit_replay_init(audit_interpret);
+}
+
+typedef struct {
+    const char *name;
+    int protocol;
+    int enabled;
+    int (*init)(void);
+    int (*feed)(const void *buf, size_t len, uint64_t now_ns);
+    void (*fini)(void);
+    // 回放结果
+    const CorpusRec **recs;
+    size_t nrecs;
+    uint64_t msgs;                // 每遍的消息数
+    double ns_median, ns_min;     // ns/消息
+    double allocs;                // 分配次数/消息
+} Parser;
+
+static Parser parsers[] = {
+    { .name = "route",  .protocol = NETLINK_ROUTE,
+      .init = traffic_replay_init, .feed = traffic_replay_feed, .fini = traffic_replay_fini },
+    { .name = "uevent", .protocol = NETLINK_KOBJECT_UEVENT,
+      .init = uevent_replay_init, .feed = uevent_replay_feed, .fini = uevent_replay_fini },
+    { .name = "audit",  .protocol = NETLINK_AUDIT,
+      .init = audit_init, .feed = audit_replay_feed, .fini = audit_replay_fini },
+};
+#define NPARSERS (sizeof(parsers) / sizeof(parsers[0]))
+
+static volatile sig_atomic_t running = 1;
+
+static void sigint_handler(int sig) {
+    running = 0;
+}
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static Parser *parser_by_proto(int protocol) {
+    for (size_t i = 0; i < NPARSERS; i++)
+        if (parsers[i].protocol == protocol)
+            return &parsers[i];
+    return NULL;
+}
+
+static Parser *parser_by_name(const char *name) {
+    for (size_t i = 0; i < NPARSERS; i++)
+        if (strcmp(parsers[i].name, name) == 0)
+            return &parsers[i];
+    return NULL;
+}
+
+// -p 逗号分隔的协议列表
+static int select_parsers(char *arg) {
+    for (size_t i = 0; i < NPARSERS; i++)
+        parsers[i].enabled = 0;
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        Parser *p = parser_by_name(tok);
+        if (!p)
+            return -1;
+        p->enabled = 1;
+    }
+    return 0;
+}
+
+/* ---------------- 录制 ---------------- */
+
+static int nl_open(int protocol, unsigned groups, int rcvbuf) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, protocol);
+    if (fd == -1)
+        return -1;
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = groups };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    return fd;
+}
+
+// 请求全部网卡的RTM_NEWLINK，应答与链路通知都在同一个socket上收
+static int send_link_dump(int fd, uint32_t seq) {
+    struct {
+        struct nlmsghdr nlh;
+        struct ifinfomsg ifi;
+    } req = {
+        .nlh = {
+            .nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+            .nlmsg_type = RTM_GETLINK,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+            .nlmsg_seq = seq,
+        },
+        .ifi = { .ifi_family = AF_UNSPEC },
+    };
+    return send(fd, &req, req.nlh.nlmsg_len, 0) == -1 ? -1 : 0;
+}
+
+static int write_rec(FILE *out, int protocol, const void *buf, size_t len, uint64_t ts_ns) {
+    static const char zero[8];
+    CorpusRec rec = { .len = (uint32_t)len, .proto = (uint16_t)protocol, .ts_ns = ts_ns };
+    size_t pad = (8 - len % 8) % 8;
+    if (fwrite(&rec, sizeof(rec), 1, out) != 1 || fwrite(buf, 1, len, out) != len ||
+        fwrite(zero, 1, pad, out) != pad)
+        return -1;
+    return 0;
+}
+
+static int run_record(const char *path, int dump_ms, int duration, uint64_t max_recs,
+                      int rcvbuf) {
+    static const unsigned groups[] = { RTMGRP_LINK, 1, AUDIT_NLGRP_READLOG };
+    struct pollfd pfd[NPARSERS];
+    Parser *owner[NPARSERS];
+    uint64_t count[NPARSERS] = {0}, bytes[NPARSERS] = {0};
+    int nfds = 0, route_fd = -1;
+
+    for (size_t i = 0; i < NPARSERS; i++) {
+        if (!parsers[i].enabled)
+            continue;
+        int fd = nl_open(parsers[i].protocol, groups[i], rcvbuf);
+        if (fd == -1) {
+            fprintf(stderr, "Skipping %s: %s\n", parsers[i].name, strerror(errno));
+            continue;
+        }
+        if (parsers[i].protocol == NETLINK_ROUTE)
+            route_fd = fd;
+        owner[nfds] = &parsers[i];
+        pfd[nfds].fd = fd;
+        pfd[nfds++].events = POLLIN;
+    }
+    if (nfds == 0) {
+        fprintf(stderr, "No netlink socket available\n");
+        return -1;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    fwrite(CORPUS_MAGIC, 1, 8, out);
+
+    char *buf = malloc(RECV_BUF_SIZE);
+    if (!buf) {
+        perror("malloc");
+        fclose(out);
+        return -1;
+    }
+    struct sigaction sa = { .sa_handler = sigint_handler };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    fprintf(stderr, "Recording to %s (Ctrl-C to stop)...\n", path);
+
+    uint64_t start = mono_ns(), next_dump = start, total = 0;
+    uint64_t end = duration > 0 ? start + (uint64_t)duration * NSEC_PER_SEC : UINT64_MAX;
+    uint32_t seq = 0;
+    int ret = 0;
+    while (running && total < max_recs) {
+        uint64_t now = mono_ns();
+        if (now >= end)
+            break;
+        if (route_fd >= 0 && now >= next_dump) {
+            if (send_link_dump(route_fd, ++seq) == -1)
+                perror("RTM_GETLINK");
+            next_dump = now + (uint64_t)dump_ms * 1000000ULL;
+        }
+        uint64_t wake = route_fd >= 0 && next_dump < end ? next_dump : end;
+        int timeout = wake == UINT64_MAX ? -1 : (int)((wake - now + 999999) / 1000000);
+        if (poll(pfd, nfds, timeout) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            ret = -1;
+            break;
+        }
+        for (int i = 0; i < nfds && total < max_recs; i++) {
+            if (!(pfd[i].revents & POLLIN))
+                continue;
+            for (;;) {
+                struct sockaddr_nl from;
+                socklen_t alen = sizeof(from);
+                ssize_t n = recvfrom(pfd[i].fd, buf, RECV_BUF_SIZE, 0,
+                                     (struct sockaddr *)&from, &alen);
+                if (n == -1) {
+                    if (errno == ENOBUFS) {
+                        fprintf(stderr, "%s: receive buffer overflow, messages lost\n",
+                                owner[i]->name);
+                        continue;
+                    }
+                    break;
+                }
+                // 只录内核发出的消息（uevent组里还可能有udevd转发的）
+                if (from.nl_pid != 0)
+                    continue;
+                if (write_rec(out, owner[i]->protocol, buf, n, mono_ns()) == -1) {
+                    perror(path);
+                    ret = -1;
+                    goto out;
+                }
+                size_t k = owner[i] - parsers;
+                count[k]++;
+                bytes[k] += n;
+                if (++total >= max_recs)
+                    break;
+            }
+        }
+    }
+
+out:
+    free(buf);
+    if (fclose(out) == EOF && ret == 0) {
+        perror(path);
+        ret = -1;
+    }
+    for (int i = 0; i < nfds; i++)
+        close(pfd[i].fd);
+    for (size_t i = 0; i < NPARSERS; i++)
+        if (parsers[i].enabled)
+            fprintf(stderr, "[STATS] %s: datagrams=%llu bytes=%llu\n", parsers[i].name,
+                    (unsigned long long)count[i], (unsigned long long)bytes[i]);
+    return ret;
+}
+
+/* ---------------- 回放 ---------------- */
+
+// 读入整个语料，按协议建立记录索引；返回映射地址
+static void *load_corpus(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror(path);
+        return NULL;
+    }
+    struct stat stt;
+    if (fstat(fd, &stt) == -1 || stt.st_size < 8) {
+        fprintf(stderr, "%s: not a corpus file\n", path);
+        close(fd);
+        return NULL;
+    }
+    *size = stt.st_size;
+    char *base = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    if (memcmp(base, CORPUS_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: bad magic\n", path);
+        munmap(base, *size);
+        return NULL;
+    }
+
+    // 两遍：先计数再填索引
+    for (int fill = 0; fill < 2; fill++) {
+        size_t off = 8;
+        while (off + sizeof(CorpusRec) <= *size) {
+            const CorpusRec *rec = (const CorpusRec *)(base + off);
+            size_t next = off + sizeof(CorpusRec) + ((rec->len + 7) & ~7U);
+            if (next > *size) {
+                fprintf(stderr, "%s: truncated record at offset %zu, ignoring the rest\n",
+                        path, off);
+                break;
+            }
+            Parser *p = parser_by_proto(rec->proto);
+            if (p) {
+                if (fill)
+                    p->recs[p->nrecs] = rec;
+                p->nrecs++;
+            }
+            off = next;
+        }
+        if (fill)
+            break;
+        for (size_t i = 0; i < NPARSERS; i++) {
+            parsers[i].recs = malloc((parsers[i].nrecs + 1) * sizeof(*parsers[i].recs));
+            if (!parsers[i].recs) {
+                perror("malloc");
+                munmap(base, *size);
+                return NULL;
+            }
+            parsers[i].nrecs = 0;
+        }
+    }
+    return base;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * 回放一遍；offset_ns让时间戳每遍向后平移整个语料的跨度，
+ * 各解析器看到的时间单调递增（速率计算、审计超时都依赖它）
+ */
+static int replay_pass(Parser *p, uint64_t offset_ns, uint64_t *msgs) {
+    *msgs = 0;
+    for (size_t i = 0; i < p->nrecs; i++) {
+        const CorpusRec *rec = p->recs[i];
+        int n = p->feed(rec + 1, rec->len, rec->ts_ns + offset_ns);
+        if (n < 0)
+            return -1;
+        *msgs += n;
+    }
+    return 0;
+}
+
+static int run_parser(Parser *p, int passes) {
+    if (p->init() == -1) {
+        fprintf(stderr, "%s: init failed\n", p->name);
+        return -1;
+    }
+    uint64_t span = p->recs[p->nrecs - 1]->ts_ns - p->recs[0]->ts_ns + NSEC_PER_SEC;
+    double *ns = malloc(passes * sizeof(double));
+    uint64_t allocs = 0;
+    int ret = -1;
+    if (!ns)
+        goto out;
+    // 预热：建好哈希表、字段名驻留表等只在首次出现时分配的状态
+    if (replay_pass(p, 0, &p->msgs) == -1 || p->msgs == 0)
+        goto out;
+    for (int i = 0; i < passes; i++) {
+        uint64_t msgs;
+        uint64_t a0 = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+        uint64_t t0 = mono_ns();
+        if (replay_pass(p, (uint64_t)(i + 1) * span, &msgs) == -1)
+            goto out;
+        uint64_t t1 = mono_ns();
+        allocs += __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - a0;
+        ns[i] = (double)(t1 - t0) / msgs;
+    }
+    qsort(ns, passes, sizeof(double), cmp_double);
+    p->ns_min = ns[0];
+    p->ns_median = ns[passes / 2];
+    p->allocs = (double)allocs / ((double)p->msgs * passes);
+    ret = 0;
+out:
+    if (ret == -1)
+        fprintf(stderr, "%s: replay failed\n", p->name);
+    free(ns);
+    p->fini();
+    return ret;
+}
+
+// 基线文件每行：协议名 ns/消息 分配次数/消息
+static int write_baseline(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    for (size_t i = 0; i < NPARSERS; i++)
+        if (parsers[i].enabled && parsers[i].msgs)
+            fprintf(f, "%s %.2f %.4f\n", parsers[i].name, parsers[i].ns_min,
+                    parsers[i].allocs);
+    if (fclose(f) == EOF) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+// 返回退化项数，-1表示基线不可读
+static int check_baseline(const char *path, int threshold) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char name[32];
+    double base_ns, base_allocs;
+    int regressions = 0;
+    while (fscanf(f, "%31s %lf %lf", name, &base_ns, &base_allocs) == 3) {
+        Parser *p = parser_by_name(name);
+        if (!p || !p->enabled || !p->msgs) {
+            fprintf(stderr, "[BASELINE] %s: not replayed, skipped\n", name);
+            continue;
+        }
+        double limit = base_ns * (100 + threshold) / 100;
+        if (p->ns_min > limit) {
+            printf("[REGRESSION] %s: ns/msg %.1f > %.1f (baseline %.1f +%d%%)\n",
+                   name, p->ns_min, limit, base_ns, threshold);
+            regressions++;
+        }
+        if (p->allocs > base_allocs + ALLOC_EPSILON) {
+            printf("[REGRESSION] %s: allocs/msg %.3f > baseline %.3f\n",
+                   name, p->allocs, base_allocs);
+            regressions++;
+        }
+        if (p->ns_min <= limit && p->allocs <= base_allocs + ALLOC_EPSILON)
+            printf("[BASELINE] %s: ns/msg %.1f vs %.1f (%+.1f%%), allocs/msg %.3f vs %.3f\n",
+                   name, p->ns_min, base_ns, (p->ns_min / base_ns - 1) * 100,
+                   p->allocs, base_allocs);
+    }
+    fclose(f);
+    return regressions;
+}
+
+static int run_replay(const char *path, int passes, const char *baseline_in,
+                      const char *baseline_out, int threshold) {
+    size_t size;
+    void *base = load_corpus(path, &size);
+    if (!base)
+        return EXIT_FAILURE;
+
+    int ret = EXIT_SUCCESS;
+    for (size_t i = 0; i < NPARSERS; i++) {
+        Parser *p = &parsers[i];
+        if (!p->enabled)
+            continue;
+        if (p->nrecs == 0) {
+            fprintf(stderr, "%s: no records in corpus\n", p->name);
+            p->enabled = 0;
+            continue;
+        }
+        if (run_parser(p, passes) == -1) {
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        printf("[REPLAY] %-6s datagrams=%zu msgs=%llu passes=%d ns/msg=%.1f (median %.1f) "
+               "msgs/s=%.0f allocs/msg=%.3f\n",
+               p->name, p->nrecs, (unsigned long long)p->msgs, passes, p->ns_min,
+               p->ns_median, 1e9 / p->ns_min, p->allocs);
+    }
+
+    if (ret == EXIT_SUCCESS && baseline_out && write_baseline(baseline_out) == -1)
+        ret = EXIT_FAILURE;
+    if (ret == EXIT_SUCCESS && baseline_in) {
+        int r = check_baseline(baseline_in, threshold);
+        if (r == -1)
+            ret = EXIT_FAILURE;
+        else if (r > 0)
+            ret = 2;
+    }
+    for (size_t i = 0; i < NPARSERS; i++)
+        free(parsers[i].recs);
+    munmap(base, size);
+    return ret;
+}
+
+/* ---------------- 分词基准 ---------------- */
+
+typedef struct {
+    const char *text;
+    uint32_t len;
+    uint16_t type;
+} TokRec;
+
+// 朴素解析：复制正文，strtok按空格切词，逐个strcmp字段名，数字用sscanf
+static uint64_t tok_naive(const TokRec *r, char *buf) {
+    uint64_t sum = 0;
+    char *save;
+    memcpy(buf, r->text, r->len);
+    buf[r->len] = '\0';
+    for (char *tok = strtok_r(buf, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+        char *eq = strchr(tok, '=');
+        unsigned v;
+        if (!eq)
+            continue;
+        *eq = '\0';
+        if (strcmp(tok, "syscall") == 0 || strcmp(tok, "pid") == 0 ||
+            strcmp(tok, "uid") == 0) {
+            if (sscanf(eq + 1, "%u", &v) == 1)
+                sum += v;
+        } else if (strcmp(tok, "comm") == 0) {
+            sum += strlen(eq + 1);
+        }
+    }
+    return sum;
+}
+
+static uint64_t tok_simd(const TokRec *r, at_record *rec, at_dict *d) {
+    static const uint16_t ids[] = { AT_SYSCALL, AT_PID, AT_UID };
+    uint64_t sum = 0;
+    uint32_t v;
+    at_tokenize(rec, d, r->type, r->text, r->len);
+    for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
+        if (at_get_u32(rec, ids[i], &v))
+            sum += v;
+    const at_field *f = at_get(rec, AT_COMM);
+    if (f)                                // 朴素解析看到的值带引号
+        sum += f->val_len + ((f->flags & AT_DQUOTED) ? 2 : 0);
+    return sum;
+}
+
+// 从语料取出审计记录正文（去掉 "audit(...): " 前缀与结尾的'\0'）
+static size_t collect_audit(const Parser *p, TokRec **out, uint64_t *bytes) {
+    size_t n = 0, cap = 0;
+    *out = NULL;
+    *bytes = 0;
+    for (size_t i = 0; i < p->nrecs; i++) {
+        const struct nlmsghdr *nlh = (const struct nlmsghdr *)(p->recs[i] + 1);
+        int len = p->recs[i]->len;
+        for (; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            const char *data = NLMSG_DATA(nlh);
+            size_t dlen = nlh->nlmsg_len - NLMSG_HDRLEN;
+            const char *end = data + strnlen(data, dlen), *body;
+            uint64_t sec, serial;
+            uint32_t msec;
+            if (!(body = aa_parse_stamp(data, end, &sec, &msec, &serial)) || body == end)
+                continue;
+            if (n == cap) {
+                TokRec *t = realloc(*out, (cap = cap ? cap * 2 : 1024) * sizeof(*t));
+                if (!t) {
+                    perror("realloc");
+                    free(*out);
+                    *out = NULL;
+                    return 0;
+                }
+                *out = t;
+            }
+            (*out)[n++] = (TokRec){ body, (uint32_t)(end - body), nlh->nlmsg_type };
+            *bytes += end - body;
+        }
+    }
+    return n;
+}
+
+static int run_tokenize(const char *path, int passes) {
+    static const char *const names[] = { "strtok", "scalar", "simd" };
+    size_t size;
+    void *base = load_corpus(path, &size);
+    if (!base)
+        return EXIT_FAILURE;
+    TokRec *recs;
+    uint64_t bytes;
+    size_t n = collect_audit(parser_by_proto(NETLINK_AUDIT), &recs, &bytes);
+    int ret = EXIT_FAILURE, dict_ready = 0;
+    char *buf = malloc(RECV_BUF_SIZE);
+    at_record *rec = malloc(sizeof(*rec));
+    at_dict *dict = malloc(sizeof(*dict));
+    if (n == 0) {
+        fprintf(stderr, "%s: no audit records in corpus\n", path);
+        goto out;
+    }
+    if (!buf || !rec || !dict) {
+        perror("malloc");
+        goto out;
+    }
+    at_dict_init(dict);
+    dict_ready = 1;
+
+    uint64_t sums[3];
+    double best[3];
+    for (int impl = 0; impl < 3; impl++) {
+        if (impl > 0)
+            at_select_impl(impl == 1);
+        best[impl] = 0;
+        for (int pass = 0; pass <= passes; pass++) {   // 第0遍为预热
+            uint64_t sum = 0, t0 = mono_ns();
+            for (size_t i = 0; i < n; i++)
+                sum += impl == 0 ? tok_naive(&recs[i], buf) : tok_simd(&recs[i], rec, dict);
+            double ns = (double)(mono_ns() - t0);
+            if (pass > 0 && (best[impl] == 0 || ns < best[impl]))
+                best[impl] = ns;
+            sums[impl] = sum;
+        }
+        printf("[TOKENIZE] %-6s records=%zu bytes=%llu passes=%d MB/s=%.1f ns/record=%.1f "
+               "(%.2fx strtok)\n", names[impl], n, (unsigned long long)bytes, passes,
+               bytes * 1e3 / best[impl], best[impl] / n, best[0] / best[impl]);
+    }
+    // 三种实现取出的值之和应一致；不一致说明语料里有朴素解析切错的引号值
+    if (sums[1] != sums[2] || sums[0] != sums[2])
+        fprintf(stderr, "[STATS] checksum strtok=%llu scalar=%llu simd=%llu\n",
+                (unsigned long long)sums[0], (unsigned long long)sums[1],
+                (unsigned long long)sums[2]);
+    ret = sums[1] == sums[2] ? EXIT_SUCCESS : EXIT_FAILURE;
+out:
+    if (dict_ready)
+        at_dict_free(dict);
+    free(dict);
+    free(rec);
+    free(buf);
+    free(recs);
+    for (size_t i = 0; i < NPARSERS; i++)
+        free(parsers[i].recs);
+    munmap(base, size);
+    return ret;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s -w corpus [-p route,uevent,audit] [-i dump_ms] [-d sec] [-c count]\n"
+            "       %s -r corpus [-p route,uevent,audit] [-n passes] [-R] [-o baseline]\n"
+            "          [-b baseline [-t pct]]\n"
+            "       %s -k corpus [-n passes]\n"
+            "  -w  录制：原样保存收到的netlink数据报（需要root；无权限的协议跳过）\n"
+            "  -i  录制时RTM_GETLINK dump的间隔毫秒（默认%d）\n"
+            "  -d  录制多少秒后退出（默认直到Ctrl-C）\n"
+            "  -c  录满多少条数据报后退出\n"
+            "  -r  回放：把语料交给各工具的解析代码，报告消息数/秒、ns/消息、分配次数/消息\n"
+            "  -p  录制/回放的协议（默认全部）\n"
+            "  -n  计时回放的遍数（默认%d）\n"
+            "  -R  审计按原始文本输出（默认同audit_demo -i，分词并解码十六进制值）\n"
+            "  -o  把本次结果写为基线文件\n"
+            "  -b  与基线比较，退化时退出码为2\n"
+            "  -t  ns/消息允许超出基线的百分比（默认%d；分配次数不允许增加）\n"
+            "  -k  分词基准：语料中审计记录正文的SIMD/标量分词对比strtok+sscanf，报告MB/s\n",
+            prog, prog, prog, DEFAULT_DUMP_MS, DEFAULT_PASSES, DEFAULT_THRESHOLD);
+}
+
+int main(int argc, char **argv) {
+    const char *record_path = NULL, *replay_path = NULL, *tokenize_path = NULL;
+    const char *baseline_in = NULL, *baseline_out = NULL;
+    int dump_ms = DEFAULT_DUMP_MS, duration = 0, passes = DEFAULT_PASSES;
+    int threshold = DEFAULT_THRESHOLD;
+    uint64_t max_recs = UINT64_MAX;
+    int opt;
+
+    for (size_t i = 0; i < NPARSERS; i++)
+        parsers[i].enabled = 1;
+    while ((opt = getopt(argc, argv, "w:r:k:p:i:d:c:n:Ro:b:t:")) != -1) {
+        switch (opt) {
+        case 'w': record_path = optarg; break;
+        case 'r': replay_path = optarg; break;
+        case 'k': tokenize_path = optarg; break;
+        case 'p':
+            if (select_parsers(optarg) == -1) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'i': dump_ms = atoi(optarg); break;
+        case 'd': duration = atoi(optarg); break;
+        case 'c': max_recs = strtoull(optarg, NULL, 10); break;
+        case 'n': passes = atoi(optarg); break;
+        case 'R': audit_interpret = 0; break;
+        case 'o': baseline_out = optarg; break;
+        case 'b': baseline_in = optarg; break;
+        case 't': threshold = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!!record_path + !!replay_path + !!tokenize_path != 1 || dump_ms <= 0 || duration < 0 || passes <= 0 ||
+        threshold < 0 || max_recs == 0 || optind != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (record_path)
+        return run_record(record_path, dump_ms, duration, max_recs, DEFAULT_RCVBUF) == -1 ?
+               EXIT_FAILURE : EXIT_SUCCESS;
+    if (tokenize_path)
+        return run_tokenize(tokenize_path, passes);
+    return run_replay(replay_path, passes, baseline_in, baseline_out, threshold);
+}
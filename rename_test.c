@@ -1,82 +1,147 @@
+#include "atomic_write.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <fcntl.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/stat.h>
-#include <errno.h>
 
 // 针对已经存在的文件内容进行原子操作修订，避免修订过程中异常导致服务无法正常启动
+// 实现见atomic_write.h；-b 对比单独提交与组提交的吞吐和延迟
 #define TARGET_FILE "./interfaces"
-#define TEMPLATE    "./interfaces.XXXXXX"
-
-int main() {
-    // 创建临时文件路径并生成唯一文件名
-    char temp_path[sizeof(TEMPLATE)];
-    strcpy(temp_path, TEMPLATE);
-    int fd = mkstemp(temp_path);
-    if (fd == -1) {
-        perror("mkstemp failed");
+
+typedef struct {
+    aw_group *group;                  // NULL为单独提交
+    const char *dir;
+    int id;
+    int count;
+    double *lat_us;                   // 每次提交的耗时
+    int failed;
+} BenchThread;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// 每个线程反复改写自己的16个小状态文件
+static void *bench_thread(void *arg) {
+    BenchThread *bt = arg;
+    char path[PATH_MAX], content[128];
+    for (int i = 0; i < bt->count; i++) {
+        snprintf(path, sizeof(path), "%s/state-%d-%d", bt->dir, bt->id, i % 16);
+        int len = snprintf(content, sizeof(content), "thread=%d seq=%d\n", bt->id, i);
+        double t0 = now_us();
+        if (aw_write_file(bt->group, path, content, len, 0644) == -1)
+            bt->failed++;
+        bt->lat_us[i] = now_us() - t0;
+    }
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench(const char *name, aw_group *group, const char *dir, int nthreads, int count) {
+    pthread_t tids[nthreads];
+    BenchThread bts[nthreads];
+    double *lat = malloc(sizeof(double) * nthreads * count);
+    if (!lat) {
+        perror("malloc");
         exit(EXIT_FAILURE);
     }
 
-    // 获取原文件属性以保留权限
+    double t0 = now_us();
+    for (int i = 0; i < nthreads; i++) {
+        bts[i] = (BenchThread){ .group = group, .dir = dir, .id = i, .count = count,
+                                .lat_us = lat + (size_t)i * count };
+        pthread_create(&tids[i], NULL, bench_thread, &bts[i]);
+    }
+    int failed = 0;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+        failed += bts[i].failed;
+    }
+    double sec = (now_us() - t0) / 1e6;
+
+    int n = nthreads * count;
+    qsort(lat, n, sizeof(double), cmp_double);
+    printf("%-8s commits=%d failed=%d %.0f commits/s p50=%.0fus p99=%.0fus max=%.0fus",
+           name, n, failed, n / sec, lat[n / 2], lat[(int)(n * 0.99)], lat[n - 1]);
+    if (group)
+        printf(" batches=%llu barriers=%llu dir_syncs=%llu",
+               (unsigned long long)group->batches, (unsigned long long)group->barriers,
+               (unsigned long long)group->dir_syncs);
+    printf("\n");
+    free(lat);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s                  原子改写 " TARGET_FILE "\n"
+            "       %s -b [-d dir] [-t threads] [-n count] [-S]\n"
+            "  -b  基准测试：单独提交与组提交各跑一遍\n"
+            "  -d  测试目录（默认当前目录）\n"
+            "  -t  并发线程数（默认16）\n"
+            "  -n  每线程提交次数（默认200）\n"
+            "  -S  组提交用syncfs作屏障（默认逐个fdatasync）\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv) {
+    const char *dir = ".";
+    int run_bench = 0, nthreads = 16, count = 200, use_syncfs = 0, opt;
+    while ((opt = getopt(argc, argv, "bd:t:n:S")) != -1) {
+        switch (opt) {
+        case 'b': run_bench = 1; break;
+        case 'd': dir = optarg; break;
+        case 't': nthreads = atoi(optarg); break;
+        case 'n': count = atoi(optarg); break;
+        case 'S': use_syncfs = 1; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (run_bench) {
+        if (nthreads < 1 || count < 1) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        aw_group group;
+        aw_group_init(&group, use_syncfs);
+        bench("naive", NULL, dir, nthreads, count);
+        bench("group", &group, dir, nthreads, count);
+        aw_group_destroy(&group);
+        return EXIT_SUCCESS;
+    }
+
+    // 只修订已存在的文件，不新建
     struct stat orig_st;
     if (stat(TARGET_FILE, &orig_st) != 0) {
         perror("stat failed - target file may not exist");
-        close(fd);
-        unlink(temp_path);
-        exit(EXIT_FAILURE);
-    }
-
-    // 设置临时文件权限与原文件一致
-    if (fchmod(fd, orig_st.st_mode) == -1) {
-        perror("fchmod failed");
-        close(fd);
-        unlink(temp_path);
         exit(EXIT_FAILURE);
     }
 
     // 示例配置内容（实际应用中可替换为动态生成的内容）
-    const char *config_content = 
+    const char *config_content =
         "auto eth0\n"
         "iface eth0 inet static\n"
         "address 192.168.1.100\n"
         "netmask 255.255.255.0\n";
 
-    // 循环写入确保所有数据写入临时文件
-    const char *p = config_content;
-    size_t remaining = strlen(config_content);
-    while (remaining > 0) {
-        ssize_t bytes_written = write(fd, p, remaining);
-        if (bytes_written == -1) {
-            if (errno == EINTR) continue; // 被信号中断则重试
-            perror("write failed");
-            close(fd);
-            unlink(temp_path);
-            exit(EXIT_FAILURE);
-        }
-        p += bytes_written;
-        remaining -= bytes_written;
-    }
-
-    // 确保数据刷入磁盘
-    if (fsync(fd) == -1) {
-        perror("fsync failed");
-        close(fd);
-        unlink(temp_path);
-        exit(EXIT_FAILURE);
-    }
-    close(fd); // 关闭文件描述符以便后续重命名操作
-
-    // 原子替换操作
-    if (rename(temp_path, TARGET_FILE) == -1) {
-        perror("rename failed");
-        unlink(temp_path);
+    // 写临时文件、落盘、rename覆盖、fsync目录；目标已存在时保留其权限
+    if (aw_write_file(NULL, TARGET_FILE, config_content, strlen(config_content), 0644) == -1) {
+        perror("atomic write failed");
         exit(EXIT_FAILURE);
     }
 
     printf("Network configuration updated atomically.\n");
     return EXIT_SUCCESS;
 }
-
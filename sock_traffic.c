@@ -0,0 +1,731 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>
+
+/*
+ * 按socket/进程统计流量：netlink_traffic只有网卡总量，这里回答"哪个进程/连接在占带宽"。
+ *   - 采集：每个周期对每个地址族发一次NETLINK_SOCK_DIAG dump（TCP带INET_DIAG_INFO，
+ *     取tcp_info的bytes_received/bytes_acked），流式接收、原地解析，不按socket发系统调用。
+ *   - socket表：以inode为键的开放寻址哈希表（cookie区分inode复用），保存上次的计数器，
+ *     两次dump的差值即速率；本轮dump没出现的socket在汇总时用后移删除就地清除，
+ *     不整表重建。表项数有上限（-m），超出的新socket只计数不跟踪，内存有界。
+ *   - inode->pid：socket表本身就是索引。只有出现未解析的新socket时才扫描/proc/<pid>/fd，
+ *     扫描可跨周期续做，每周期最多readlink -b 次；一整轮扫描下来仍无属主的socket
+ *     （内核socket、属主已退出）标记为无主，不再触发扫描。
+ *   - 进程：按pid汇总socket速率，comm每轮扫描只读一次。
+ * UDP（-u）没有字节计数器可取，只列出socket数与收发队列。
+ * 两次dump之间建立又关闭的连接看不到；两次dump之间新建的连接按计数器从0起算。
+ */
+#define DEFAULT_INTERVAL_MS 1000
+#define DEFAULT_TOP         10
+#define DEFAULT_MAX_SOCKS   (256 * 1024)  // 跟踪的socket数上限
+#define DEFAULT_SCAN_BUDGET 65536         // 每周期最多readlink的fd数
+#define SOCK_INIT_CAP       4096          // socket表初始槽位数（2的幂）
+#define PROC_CAP            65536         // 进程表槽位数（2的幂），最多使用一半
+#define DIAG_BUF_SIZE       65536         // 单次recv缓冲区，dump一次最多约32K
+#define NSEC_PER_SEC        1000000000ULL
+
+// TCP状态（include/net/tcp_states.h，用户态头文件没有）
+enum {
+    ST_ESTABLISHED = 1, ST_SYN_SENT, ST_SYN_RECV, ST_FIN_WAIT1, ST_FIN_WAIT2, ST_TIME_WAIT,
+    ST_CLOSE, ST_CLOSE_WAIT, ST_LAST_ACK, ST_LISTEN, ST_CLOSING, ST_MAX
+};
+static const char *const state_names[ST_MAX] = {
+    "?", "ESTAB", "SYN-SENT", "SYN-RECV", "FIN-WAIT-1", "FIN-WAIT-2", "TIME-WAIT",
+    "UNCONN", "CLOSE-WAIT", "LAST-ACK", "LISTEN", "CLOSING",
+};
+// 监听、TIME-WAIT、半连接没有应用数据，也没有tcp_info，不请求
+#define TCP_STATES ((1U << ST_MAX) - 1 - (1U << ST_LISTEN) - (1U << ST_TIME_WAIT) - \
+                    (1U << ST_SYN_RECV))
+
+typedef struct {
+    uint32_t inode;              // 0表示空槽
+    int32_t pid;                 // 0未解析，-1扫描过仍无属主
+    uint64_t cookie;
+    uint32_t seen_gen;           // 最近一次出现在dump中的轮次
+    uint32_t born_gen;           // 首次出现的轮次
+    uint64_t rx, tx;             // 上次采样的累计字节（bytes_received / bytes_acked）
+    uint64_t sample_ns;          // 上次采样所在dump的开始时刻
+    float rx_bps, tx_bps;        // 最近一次计算的速率（B/s）
+    uint32_t rqueue, wqueue;
+    uint32_t uid;
+    uint16_t sport, dport;       // 主机字节序
+    uint8_t family, proto, state, has_info;
+    uint8_t saddr[16], daddr[16];
+} SockEntry;
+
+typedef struct {
+    int32_t pid;                 // 0表示空槽
+    uint32_t pass;               // 读取comm时的扫描轮次，pid复用后下一轮扫描会重读
+    uint32_t nsock;              // 本周期汇总的socket数，0表示已无socket
+    float rx_bps, tx_bps;
+    char comm[16];
+} ProcEntry;
+
+typedef struct {
+    SockEntry *slots;
+    size_t cap, max_cap;         // 槽位数（2的幂）及其上限
+    size_t count, max_count;     // 已跟踪的socket数及其上限
+    uint32_t gen;                // 当前轮次
+    uint64_t now_ns;             // 本轮dump的开始时刻
+    uint64_t last_ns;            // 上一次完整dump的开始时刻，0表示还没有
+    uint32_t seq;
+    // 本轮统计
+    uint64_t dumped, fresh, closed, unresolved, orphans, overflow;
+    uint64_t last_overflow;      // 上一次完整dump中因表满未跟踪的socket数
+    uint32_t resolved_upto;      // 已完成扫描覆盖到的轮次：此前出现仍未解析的即为无主
+} SockTable;
+
+typedef struct {
+    ProcEntry *slots;
+    size_t count;
+    uint32_t pass;               // 进行中的扫描轮次，本轮新建的表项尚未汇总，清理时保留
+    uint64_t overflow;
+} ProcTable;
+
+typedef struct {
+    int procfd;                  // /proc
+    DIR *dir;                    // 进行中的扫描，NULL表示空闲
+    uint32_t pass;               // 扫描轮次编号
+    uint32_t start_gen;          // 本轮扫描开始时的socket表轮次
+    uint64_t budget;             // 每周期readlink上限
+    uint64_t readlinks, pids, resolved;
+} PidScan;
+
+typedef struct {
+    double key;
+    const void *item;
+} TopItem;
+
+typedef struct {
+    TopItem *items;
+    int n, max;
+} Top;
+
+static volatile sig_atomic_t running = 1;
+
+static void sigint_handler(int sig) {
+    running = 0;
+}
+
+static inline uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* ---------------- socket表 ---------------- */
+
+static inline size_t sock_hash(uint32_t inode, size_t cap) {
+    return (inode * 2654435761u) & (cap - 1);
+}
+
+// 线性探测查找槽位：命中返回该槽，否则返回可插入的空槽
+static SockEntry *sock_probe(SockEntry *slots, size_t cap, uint32_t inode) {
+    size_t i = sock_hash(inode, cap);
+    while (slots[i].inode != 0 && slots[i].inode != inode)
+        i = (i + 1) & (cap - 1);
+    return &slots[i];
+}
+
+static SockEntry *sock_find(SockTable *tbl, uint32_t inode) {
+    SockEntry *e = sock_probe(tbl->slots, tbl->cap, inode);
+    return e->inode ? e : NULL;
+}
+
+static int sock_grow(SockTable *tbl) {
+    size_t new_cap = tbl->cap * 2;
+    SockEntry *slots = calloc(new_cap, sizeof(*slots));
+    if (!slots)
+        return -1;
+    for (size_t i = 0; i < tbl->cap; i++)
+        if (tbl->slots[i].inode)
+            *sock_probe(slots, new_cap, tbl->slots[i].inode) = tbl->slots[i];
+    free(tbl->slots);
+    tbl->slots = slots;
+    tbl->cap = new_cap;
+    return 0;
+}
+
+// 查找或插入，负载因子超过1/2时扩容；达到上限返回NULL
+static SockEntry *sock_get(SockTable *tbl, uint32_t inode) {
+    SockEntry *e = sock_probe(tbl->slots, tbl->cap, inode);
+    if (e->inode)
+        return e;
+    if (tbl->count >= tbl->max_count)
+        return NULL;
+    if ((tbl->count + 1) * 2 > tbl->cap) {
+        if (tbl->cap >= tbl->max_cap || sock_grow(tbl) == -1)
+            return NULL;
+        e = sock_probe(tbl->slots, tbl->cap, inode);
+    }
+    memset(e, 0, sizeof(*e));
+    e->inode = inode;
+    tbl->count++;
+    return e;
+}
+
+/*
+ * 后移删除（Knuth 6.4 算法R）：把同一探测簇里后面、且起始槽不在(i, j]之间的表项前移补洞，
+ * 不留墓碑，查找永远在遇到空槽时结束
+ */
+static void sock_delete(SockTable *tbl, size_t i) {
+    size_t mask = tbl->cap - 1, j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!tbl->slots[j].inode)
+            break;
+        size_t k = sock_hash(tbl->slots[j].inode, tbl->cap);
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        tbl->slots[i] = tbl->slots[j];
+        i = j;
+    }
+    tbl->slots[i].inode = 0;
+    tbl->count--;
+}
+
+/* ---------------- 进程表 ---------------- */
+
+static inline size_t proc_hash(int32_t pid) {
+    return ((uint32_t)pid * 2654435761u) & (PROC_CAP - 1);
+}
+
+static ProcEntry *proc_probe(ProcEntry *slots, int32_t pid) {
+    size_t i = proc_hash(pid);
+    while (slots[i].pid != 0 && slots[i].pid != pid)
+        i = (i + 1) & (PROC_CAP - 1);
+    return &slots[i];
+}
+
+// 丢弃本周期已没有socket的进程
+static void proc_purge(ProcTable *pt) {
+    ProcEntry *slots = calloc(PROC_CAP, sizeof(*slots));
+    if (!slots)
+        return;
+    pt->count = 0;
+    for (size_t i = 0; i < PROC_CAP; i++) {
+        const ProcEntry *p = &pt->slots[i];
+        if (p->pid && (p->nsock || p->pass == pt->pass)) {
+            *proc_probe(slots, p->pid) = *p;
+            pt->count++;
+        }
+    }
+    free(pt->slots);
+    pt->slots = slots;
+}
+
+// 查找或插入；表满时先清掉已无socket的进程
+static ProcEntry *proc_get(ProcTable *pt, int32_t pid) {
+    ProcEntry *p = proc_probe(pt->slots, pid);
+    if (p->pid)
+        return p;
+    if ((pt->count + 1) * 2 > PROC_CAP) {
+        proc_purge(pt);
+        if ((pt->count + 1) * 2 > PROC_CAP) {
+            pt->overflow++;
+            return NULL;
+        }
+        p = proc_probe(pt->slots, pid);
+    }
+    memset(p, 0, sizeof(*p));
+    p->pid = pid;
+    pt->count++;
+    return p;
+}
+
+/* ---------------- inode->pid 增量扫描 ---------------- */
+
+static void read_comm(int procfd, ProcEntry *p) {
+    char path[32];
+    snprintf(path, sizeof(path), "%d/comm", p->pid);
+    int fd = openat(procfd, path, O_RDONLY | O_CLOEXEC);
+    ssize_t n = fd >= 0 ? read(fd, p->comm, sizeof(p->comm) - 1) : -1;
+    if (fd >= 0)
+        close(fd);
+    if (n <= 0)
+        strcpy(p->comm, "?");
+    else
+        p->comm[p->comm[n - 1] == '\n' ? n - 1 : n] = '\0';
+}
+
+// 遍历一个进程的fd，把表中未解析的socket归到该进程；返回readlink次数
+static uint64_t scan_pid(PidScan *sc, SockTable *tbl, ProcTable *pt, int32_t pid) {
+    char path[32], link[64];
+    snprintf(path, sizeof(path), "%d/fd", pid);
+    int dfd = openat(sc->procfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd == -1)
+        return 0;                 // 内核线程无权限或进程已退出
+    DIR *d = fdopendir(dfd);
+    if (!d) {
+        close(dfd);
+        return 0;
+    }
+    uint64_t n = 0;
+    ProcEntry *p = NULL;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.')
+            continue;
+        ssize_t len = readlinkat(dfd, de->d_name, link, sizeof(link) - 1);
+        n++;
+        if (len < 10 || memcmp(link, "socket:[", 8) != 0)
+            continue;
+        link[len] = '\0';
+        SockEntry *e = sock_find(tbl, (uint32_t)strtoul(link + 8, NULL, 10));
+        if (!e || e->pid > 0)
+            continue;             // 未跟踪，或已归属（fork继承的socket记在先找到的进程上）
+        e->pid = pid;
+        sc->resolved++;
+        if (!p && (p = proc_get(pt, pid)) && p->pass != sc->pass) {
+            read_comm(sc->procfd, p);
+            p->pass = sc->pass;
+        }
+    }
+    closedir(d);
+    return n;
+}
+
+// 有未解析的socket时开始新一轮扫描
+static void scan_start(PidScan *sc, SockTable *tbl, ProcTable *pt) {
+    if (sc->dir || !tbl->unresolved)
+        return;
+    int fd = openat(sc->procfd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1 || !(sc->dir = fdopendir(fd))) {
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    pt->pass = ++sc->pass;
+    sc->start_gen = tbl->gen;
+}
+
+// 按预算继续扫描；一轮结束时，此前出现仍未解析的socket在下次汇总时标记为无主
+static void scan_step(PidScan *sc, SockTable *tbl, ProcTable *pt) {
+    uint64_t used = 0;
+    struct dirent *de;
+    while (sc->dir && used < sc->budget) {
+        if (!(de = readdir(sc->dir))) {
+            closedir(sc->dir);
+            sc->dir = NULL;
+            tbl->resolved_upto = sc->start_gen;
+            break;
+        }
+        if (de->d_name[0] < '1' || de->d_name[0] > '9')
+            continue;
+        used += scan_pid(sc, tbl, pt, (int32_t)atoi(de->d_name));
+        sc->pids++;
+    }
+    sc->readlinks += used;
+}
+
+/* ---------------- sock_diag dump ---------------- */
+
+// 处理dump中的一个socket
+static void sock_update(SockTable *tbl, const struct nlmsghdr *nlh, int proto) {
+    const struct inet_diag_msg *m = NLMSG_DATA(nlh);
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*m)))
+        return;
+    tbl->dumped++;
+    // 进程已close、仍在FIN-WAIT等状态的TCP没有inode，也就没有属主
+    if (m->idiag_inode == 0) {
+        tbl->orphans++;
+        return;
+    }
+    SockEntry *e = sock_get(tbl, m->idiag_inode);
+    if (!e) {
+        tbl->overflow++;
+        return;
+    }
+    uint64_t cookie = m->id.idiag_cookie[0] | (uint64_t)m->id.idiag_cookie[1] << 32;
+    if (e->born_gen == 0 || e->cookie != cookie) {
+        // 新socket，或inode被复用
+        uint32_t inode = e->inode;
+        memset(e, 0, sizeof(*e));
+        e->inode = inode;
+        e->cookie = cookie;
+        e->born_gen = tbl->gen;
+        e->family = m->idiag_family;
+        e->proto = proto;
+        e->sport = ntohs(m->id.idiag_sport);
+        e->dport = ntohs(m->id.idiag_dport);
+        size_t alen = m->idiag_family == AF_INET ? 4 : 16;
+        memcpy(e->saddr, m->id.idiag_src, alen);
+        memcpy(e->daddr, m->id.idiag_dst, alen);
+        e->uid = m->idiag_uid;
+        tbl->fresh++;
+    }
+    e->seen_gen = tbl->gen;
+    e->state = m->idiag_state < ST_MAX ? m->idiag_state : 0;
+    e->rqueue = m->idiag_rqueue;
+    e->wqueue = m->idiag_wqueue;
+    e->rx_bps = e->tx_bps = 0;
+    if (e->pid == 0)
+        tbl->unresolved++;
+
+    // tcp_info可能比头文件定义短（旧内核），只用确实带上的字段
+    const struct rtattr *rta = (const struct rtattr *)(m + 1);
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*m));
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type != INET_DIAG_INFO)
+            continue;
+        size_t have = RTA_PAYLOAD(rta);
+        if (have < offsetof(struct tcp_info, tcpi_bytes_received) + sizeof(uint64_t))
+            break;
+        struct tcp_info ti;
+        memcpy(&ti, RTA_DATA(rta), have < sizeof(ti) ? have : sizeof(ti));
+        uint64_t rx = ti.tcpi_bytes_received, tx = ti.tcpi_bytes_acked;
+        // 速率按各自的上次采样时刻计算：失败的dump中途更新过的与没走到的socket
+        // 间隔不同。上次完整dump之后新建的socket从0起算；首轮没有上次，不算速率。
+        // 上次dump有socket因表满未跟踪时，本轮才出现的也可能是那时就有的老socket，
+        // 其累计字节不能当作一个周期的流量，先取基线
+        uint64_t since = e->has_info ? e->sample_ns :
+                         e->born_gen == tbl->gen && !tbl->last_overflow ? tbl->last_ns : 0;
+        if (since && tbl->now_ns > since) {
+            double dt = (double)(tbl->now_ns - since) / NSEC_PER_SEC;
+            e->rx_bps = (rx >= e->rx ? rx - e->rx : 0) / dt;
+            e->tx_bps = (tx >= e->tx ? tx - e->tx : 0) / dt;
+        }
+        e->rx = rx;
+        e->tx = tx;
+        e->sample_ns = tbl->now_ns;
+        e->has_info = 1;
+        break;
+    }
+}
+
+// 一次流式dump：一个地址族+协议的全部socket
+static int diag_dump(SockTable *tbl, int fd, int family, int proto, char *buf) {
+    struct {
+        struct nlmsghdr nlh;
+        struct inet_diag_req_v2 req;
+    } msg = {
+        .nlh = {
+            .nlmsg_len = sizeof(msg),
+            .nlmsg_type = SOCK_DIAG_BY_FAMILY,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+            .nlmsg_seq = ++tbl->seq,
+        },
+        .req = {
+            .sdiag_family = family,
+            .sdiag_protocol = proto,
+            .idiag_states = proto == IPPROTO_TCP ? TCP_STATES : ~0U,
+            .idiag_ext = proto == IPPROTO_TCP ? 1 << (INET_DIAG_INFO - 1) : 0,
+        },
+    };
+    if (send(fd, &msg, sizeof(msg), 0) == -1)
+        return -1;
+
+    for (;;) {
+        ssize_t n = recv(fd, buf, DIAG_BUF_SIZE, 0);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+        int remain = (int)n;
+        for (; NLMSG_OK(nlh, remain); nlh = NLMSG_NEXT(nlh, remain)) {
+            if (nlh->nlmsg_seq != tbl->seq)
+                continue;
+            if (nlh->nlmsg_type == NLMSG_DONE)
+                return 0;
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *err = NLMSG_DATA(nlh);
+                errno = err->error ? -err->error : EPROTO;
+                return -1;
+            }
+            sock_update(tbl, nlh, proto);
+        }
+    }
+}
+
+/* ---------------- 汇总与输出 ---------------- */
+
+// 保持前max个最大值，降序
+static void top_push(Top *t, double key, const void *item) {
+    if (key <= 0 || (t->n == t->max && key <= t->items[t->n - 1].key))
+        return;
+    int i = t->n < t->max ? t->n++ : t->n - 1;
+    while (i > 0 && t->items[i - 1].key < key) {
+        t->items[i] = t->items[i - 1];
+        i--;
+    }
+    t->items[i].key = key;
+    t->items[i].item = item;
+}
+
+/*
+ * 一次遍历完成：删除本轮dump未出现的socket、标记无主socket、按进程汇总、选出前N
+ * 从一个空槽之后开始，探测簇不会跨过遍历起点，后移删除移来的表项都还没遍历到
+ */
+static void sock_sweep(SockTable *tbl, ProcTable *pt, Top *top_socks, Top *top_procs) {
+    for (size_t i = 0; i < PROC_CAP; i++) {
+        pt->slots[i].nsock = 0;
+        pt->slots[i].rx_bps = pt->slots[i].tx_bps = 0;
+    }
+    size_t mask = tbl->cap - 1, start = 0;
+    while (tbl->slots[start].inode)
+        start++;
+    for (size_t k = 1; k <= tbl->cap; k++) {
+        size_t i = (start + k) & mask;
+        while (tbl->slots[i].inode && tbl->slots[i].seen_gen != tbl->gen) {
+            sock_delete(tbl, i);
+            tbl->closed++;
+        }
+        SockEntry *e = &tbl->slots[i];
+        if (!e->inode)
+            continue;
+        if (e->pid == 0 && e->born_gen <= tbl->resolved_upto)
+            e->pid = -1;
+        if (e->pid > 0) {
+            ProcEntry *p = proc_probe(pt->slots, e->pid);
+            if (p->pid) {
+                p->nsock++;
+                p->rx_bps += e->rx_bps;
+                p->tx_bps += e->tx_bps;
+            }
+        }
+        top_push(top_socks, (double)e->rx_bps + e->tx_bps, e);
+    }
+    for (size_t i = 0; i < PROC_CAP; i++) {
+        ProcEntry *p = &pt->slots[i];
+        if (p->pid && p->nsock)
+            top_push(top_procs, (double)p->rx_bps + p->tx_bps, p);
+    }
+}
+
+static void format_endpoint(char *out, size_t size, int family, const uint8_t *addr,
+                            uint16_t port) {
+    char ip[INET6_ADDRSTRLEN];
+    inet_ntop(family, addr, ip, sizeof(ip));
+    snprintf(out, size, family == AF_INET6 ? "[%s]:%u" : "%s:%u", ip, port);
+}
+
+static void report(const SockTable *tbl, const ProcTable *pt, const Top *top_socks,
+                   const Top *top_procs, double dump_ms, int udp) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    printf("[%ld.%03ld] sockets=%zu dumped=%llu new=%llu closed=%llu unresolved=%llu "
+           "dump=%.1fms\n", (long)now.tv_sec, now.tv_nsec / 1000000, tbl->count,
+           (unsigned long long)tbl->dumped, (unsigned long long)tbl->fresh,
+           (unsigned long long)tbl->closed, (unsigned long long)tbl->unresolved, dump_ms);
+    if (top_procs->n) {
+        printf("  %-8s %-16s %6s %12s %12s\n", "PID", "COMM", "SOCKS", "RX KB/s", "TX KB/s");
+        for (int i = 0; i < top_procs->n; i++) {
+            const ProcEntry *p = top_procs->items[i].item;
+            printf("  %-8d %-16s %6u %12.2f %12.2f\n", p->pid, p->comm, p->nsock,
+                   p->rx_bps / 1024, p->tx_bps / 1024);
+        }
+    }
+    if (top_socks->n) {
+        printf("  %-24s %-10s %12s %12s  %s\n", "PID/COMM", "STATE", "RX KB/s", "TX KB/s",
+               "LOCAL -> REMOTE");
+        for (int i = 0; i < top_socks->n; i++) {
+            const SockEntry *e = top_socks->items[i].item;
+            char owner[32], local[64], remote[64];
+            const ProcEntry *p = e->pid > 0 ? proc_probe(pt->slots, e->pid) : NULL;
+            if (p && p->pid)
+                snprintf(owner, sizeof(owner), "%d/%s", p->pid, p->comm);
+            else
+                snprintf(owner, sizeof(owner), e->pid < 0 ? "-" : "?");
+            format_endpoint(local, sizeof(local), e->family, e->saddr, e->sport);
+            format_endpoint(remote, sizeof(remote), e->family, e->daddr, e->dport);
+            printf("  %-24s %-10s %12.2f %12.2f  %s -> %s\n", owner, state_names[e->state],
+                   e->rx_bps / 1024, e->tx_bps / 1024, local, remote);
+        }
+    }
+    // UDP没有字节计数，按队列积压列出
+    int shown = 0;
+    for (size_t i = 0; udp && i < tbl->cap && shown < top_socks->max; i++) {
+        const SockEntry *e = &tbl->slots[i];
+        if (!e->inode || e->proto != IPPROTO_UDP || (!e->rqueue && !e->wqueue))
+            continue;
+        char local[64];
+        format_endpoint(local, sizeof(local), e->family, e->saddr, e->sport);
+        printf("  udp %-21s rqueue=%u wqueue=%u pid=%d\n", local, e->rqueue, e->wqueue,
+               e->pid);
+        shown++;
+    }
+    printf("--------------------------------\n");
+    fflush(stdout);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-i ms] [-n top] [-m max_sockets] [-b budget] [-u] [-P] [-c count] [-q]\n"
+            "  -i  采样间隔（毫秒，默认%d）\n"
+            "  -n  每次列出速率最高的进程/socket数（默认%d）\n"
+            "  -m  跟踪的socket数上限，超出的新socket只计数（默认%d，每个约%zu字节x2）\n"
+            "  -b  每个周期inode->pid扫描最多readlink的fd数（默认%d）\n"
+            "  -u  同时采集UDP（只有队列积压，没有字节计数）\n"
+            "  -P  不做inode->pid映射\n"
+            "  -c  输出多少次后退出\n"
+            "  -q  不打印每周期的排行，只在退出时打印统计\n",
+            prog, DEFAULT_INTERVAL_MS, DEFAULT_TOP, DEFAULT_MAX_SOCKS, sizeof(SockEntry),
+            DEFAULT_SCAN_BUDGET);
+}
+
+int main(int argc, char **argv) {
+    long interval_ms = DEFAULT_INTERVAL_MS, max_socks = DEFAULT_MAX_SOCKS;
+    int ntop = DEFAULT_TOP, udp = 0, map_pids = 1, quiet = 0;
+    long long budget = DEFAULT_SCAN_BUDGET, count = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:n:m:b:uPc:q")) != -1) {
+        switch (opt) {
+        case 'i': interval_ms = strtol(optarg, NULL, 10); break;
+        case 'n': ntop = atoi(optarg); break;
+        case 'm': max_socks = strtol(optarg, NULL, 10); break;
+        case 'b': budget = strtoll(optarg, NULL, 10); break;
+        case 'u': udp = 1; break;
+        case 'P': map_pids = 0; break;
+        case 'c': count = strtoll(optarg, NULL, 10); break;
+        case 'q': quiet = 1; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (interval_ms <= 0 || ntop <= 0 || max_socks <= 0 || budget <= 0 || count < 0 ||
+        optind != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // 槽位上限取不小于2*max_socks的2的幂，负载因子不超过1/2
+    SockTable tbl = { .cap = SOCK_INIT_CAP, .max_cap = SOCK_INIT_CAP, .max_count = max_socks };
+    while (tbl.max_cap < (size_t)max_socks * 2)
+        tbl.max_cap *= 2;
+    ProcTable pt = {0};
+    PidScan sc = { .procfd = -1, .budget = (uint64_t)budget };
+    TopItem *items = calloc(2 * (size_t)ntop, sizeof(*items));
+    Top top_socks = { .items = items, .max = ntop }, top_procs = { .items = items + ntop, .max = ntop };
+    char *buf = malloc(DIAG_BUF_SIZE);
+    tbl.slots = calloc(tbl.cap, sizeof(*tbl.slots));
+    pt.slots = calloc(PROC_CAP, sizeof(*pt.slots));
+    if (!items || !buf || !tbl.slots || !pt.slots) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    if (map_pids && (sc.procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+        perror("/proc");
+        return EXIT_FAILURE;
+    }
+
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (fd == -1) {
+        perror("socket");
+        return EXIT_FAILURE;
+    }
+    // 按理想时间轴触发的定时器，处理耗时不推迟后续采样点
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    struct itimerspec its = {
+        .it_value    = { 0, 1 },
+        .it_interval = { interval_ms / 1000, (interval_ms % 1000) * 1000000L },
+    };
+    if (tfd == -1 || timerfd_settime(tfd, 0, &its, NULL) == -1) {
+        perror("timerfd");
+        return EXIT_FAILURE;
+    }
+    struct sigaction sa = { .sa_handler = sigint_handler };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    static const struct { int family, proto; } dumps[] = {
+        { AF_INET, IPPROTO_TCP }, { AF_INET6, IPPROTO_TCP },
+        { AF_INET, IPPROTO_UDP }, { AF_INET6, IPPROTO_UDP },
+    };
+    uint64_t ticks = 0, missed = 0, dump_ns_sum = 0, dump_ns_max = 0;
+    uint64_t scan_ns_sum = 0, overflow = 0;
+    while (running && (!count || (long long)ticks < count)) {
+        uint64_t expirations;
+        if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+            continue;                 // 被信号打断
+        missed += expirations - 1;
+
+        uint64_t t0 = mono_ns();
+        tbl.gen++;
+        tbl.now_ns = t0;
+        tbl.dumped = tbl.fresh = tbl.closed = tbl.unresolved = tbl.orphans = tbl.overflow = 0;
+        int failed = 0;
+        for (size_t i = 0; i < sizeof(dumps) / sizeof(dumps[0]); i++) {
+            if (dumps[i].proto == IPPROTO_UDP && !udp)
+                continue;
+            if (diag_dump(&tbl, fd, dumps[i].family, dumps[i].proto, buf) == -1) {
+                // IPv6未启用时忽略该地址族
+                if (dumps[i].family == AF_INET6 && (errno == ENOENT || errno == EAFNOSUPPORT))
+                    continue;
+                perror("sock_diag dump");
+                failed = 1;
+                break;
+            }
+        }
+        if (failed) {
+            // 本轮不完整，不能据此删除socket；回退轮次，下轮重来
+            tbl.gen--;
+            continue;
+        }
+        tbl.last_ns = t0;
+        tbl.last_overflow = tbl.overflow;
+        uint64_t t1 = mono_ns();
+        if (map_pids) {
+            scan_start(&sc, &tbl, &pt);
+            scan_step(&sc, &tbl, &pt);
+        }
+        uint64_t t2 = mono_ns();
+
+        top_socks.n = top_procs.n = 0;
+        sock_sweep(&tbl, &pt, &top_socks, &top_procs);
+        ticks++;
+        overflow += tbl.overflow;
+        dump_ns_sum += t1 - t0;
+        scan_ns_sum += t2 - t1;
+        if (t1 - t0 > dump_ns_max)
+            dump_ns_max = t1 - t0;
+        if (!quiet)
+            report(&tbl, &pt, &top_socks, &top_procs, (t1 - t0) / 1e6, udp);
+    }
+
+    fprintf(stderr, "[STATS] ticks=%llu missed=%llu sockets=%zu table=%zu slots (%.1fMB) "
+            "overflow=%llu procs=%zu proc_overflow=%llu\n",
+            (unsigned long long)ticks, (unsigned long long)missed, tbl.count, tbl.cap,
+            tbl.cap * sizeof(SockEntry) / 1048576.0, (unsigned long long)overflow, pt.count,
+            (unsigned long long)pt.overflow);
+    fprintf(stderr, "[STATS] dump avg=%.1fms max=%.1fms, pid scan avg=%.1fms passes=%u "
+            "pids=%llu readlinks=%llu resolved=%llu\n",
+            ticks ? dump_ns_sum / 1e6 / ticks : 0.0, dump_ns_max / 1e6,
+            ticks ? scan_ns_sum / 1e6 / ticks : 0.0, sc.pass,
+            (unsigned long long)sc.pids, (unsigned long long)sc.readlinks,
+            (unsigned long long)sc.resolved);
+
+    if (sc.dir)
+        closedir(sc.dir);
+    if (sc.procfd >= 0)
+        close(sc.procfd);
+    close(tfd);
+    close(fd);
+    free(tbl.slots);
+    free(pt.slots);
+    free(items);
+    free(buf);
+    return 0;
+}
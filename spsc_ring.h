@@ -0,0 +1,129 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/*
+ * 单生产者单消费者无锁环（元素为指针）
+ * 快路径只有一次原子读写；环空/满时先自旋，再在对端的位置计数上futex等待，
+ * 对端只在有等待者时才调用futex唤醒，正常流量下不产生系统调用。
+ * 容量必须为2的幂；head/tail为32位自由计数，回绕不影响 head - tail 的计算。
+ */
+#define SPSC_SPIN 256                 // 进入futex等待前的自旋次数
+
+#if defined(__x86_64__) || defined(__i386__)
+#define spsc_cpu_relax() __builtin_ia32_pause()
+#else
+#define spsc_cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+typedef struct {
+    void **items;
+    uint32_t mask;
+    uint32_t head __attribute__((aligned(64)));   // 生产者推进
+    uint32_t head_waiters;                        // 等待head变化的消费者
+    uint32_t tail __attribute__((aligned(64)));   // 消费者推进
+    uint32_t tail_waiters;                        // 等待tail变化的生产者
+} spsc_ring;
+
+static inline int spsc_init(spsc_ring *r, uint32_t capacity) {
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+        return -1;
+    r->items = calloc(capacity, sizeof(void *));
+    if (!r->items)
+        return -1;
+    r->mask = capacity - 1;
+    r->head = r->tail = 0;
+    r->head_waiters = r->tail_waiters = 0;
+    return 0;
+}
+
+static inline void spsc_destroy(spsc_ring *r) {
+    free(r->items);
+    r->items = NULL;
+}
+
+static inline uint32_t spsc_count(const spsc_ring *r) {
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+static inline void spsc_futex_wait(uint32_t *addr, uint32_t val, int timeout_ms) {
+    struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout_ms < 0 ? NULL : &ts, NULL, 0);
+}
+
+static inline void spsc_futex_wake(uint32_t *addr, uint32_t *waiters) {
+    if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// 入队（仅生产者线程），环满返回-1
+static inline int spsc_push(spsc_ring *r, void *item) {
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > r->mask)
+        return -1;
+    r->items[head & r->mask] = item;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+    spsc_futex_wake(&r->head, &r->head_waiters);
+    return 0;
+}
+
+// 出队（仅消费者线程），环空返回NULL
+static inline void *spsc_pop(spsc_ring *r) {
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    if (tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+        return NULL;
+    void *item = r->items[tail & r->mask];
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+    spsc_futex_wake(&r->tail, &r->tail_waiters);
+    return item;
+}
+
+/**
+ * 出队，环空时等待
+ * @param timeout_ms  最长等待时间，-1为一直等待；超时或被唤醒后仍为空返回NULL
+ */
+static inline void *spsc_pop_wait(spsc_ring *r, int timeout_ms) {
+    for (int i = 0; i < SPSC_SPIN; i++) {
+        void *item = spsc_pop(r);
+        if (item)
+            return item;
+        spsc_cpu_relax();
+    }
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&r->head_waiters, 1, __ATOMIC_SEQ_CST);
+    // 置等待标志后再确认一次，避免与生产者的唤醒错过
+    if (head == __atomic_load_n(&r->tail, __ATOMIC_RELAXED) &&
+        head == __atomic_load_n(&r->head, __ATOMIC_SEQ_CST))
+        spsc_futex_wait(&r->head, head, timeout_ms);
+    __atomic_store_n(&r->head_waiters, 0, __ATOMIC_RELAXED);
+    return spsc_pop(r);
+}
+
+/**
+ * 入队，环满时等待
+ * @return 成功返回0；超时后仍满返回-1
+ */
+static inline int spsc_push_wait(spsc_ring *r, void *item, int timeout_ms) {
+    for (int i = 0; i < SPSC_SPIN; i++) {
+        if (spsc_push(r, item) == 0)
+            return 0;
+        spsc_cpu_relax();
+    }
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&r->tail_waiters, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->head, __ATOMIC_RELAXED) - tail > r->mask &&
+        tail == __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST))
+        spsc_futex_wait(&r->tail, tail, timeout_ms);
+    __atomic_store_n(&r->tail_waiters, 0, __ATOMIC_RELAXED);
+    return spsc_push(r, item);
+}
+
+#endif // SPSC_RING_H
@@ -0,0 +1,870 @@
+#include "atomic_write.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+/*
+ * sqlite在线备份：直接cp正在写入的库，要么得先停写，要么拷出一个损坏的镜像。
+ * 这里用sqlite3_backup_init/step分步拷贝页，每步之间释放源库的锁：
+ *   - 节奏：每步的耗时就是写者最多被挡住的时间（回滚日志模式下备份持有共享锁，
+ *     写者无法提交；WAL模式下不挡写者，但占用IO）。单步超过预算-L页数减半，
+ *     不到预算一半页数翻倍；步间休息不短于本步耗时，占空比不超过一半。
+ *   - 重启：回滚日志模式下其他连接修改源库后，下一步会从第1页重新开始；
+ *     重启超过-R次说明写入太频繁、分步永远拷不完，改为持锁一次拷完。
+ *     WAL模式下整个备份期间持有一个读事务，快照固定，不会重启也不挡写者。
+ *   - 发布：写同目录临时文件，结束后fdatasync、rename、fsync目录（atomic_write.h）。
+ *
+ * WAL增量归档（-w）：每一代先做一次全量快照，之后只把-wal文件里新增的、已提交的帧
+ * 原样追加为段文件：<archive>/<代>/snapshot.db、00000000.wal、00000001.wal……
+ *   - 开始新一代时先checkpoint(TRUNCATE)把WAL清空，再持有读事务做快照，
+ *     快照正好是库文件内容，之后WAL里出现的帧都要归档。
+ *   - 一直持有读事务：别的连接checkpoint回填不会越过我们的读标记，WAL也就不会在
+ *     两次轮询之间被重置。帧数超过-C时短暂释放读事务，自己做RESTART checkpoint，
+ *     让下一个写者从头重用WAL（PASSIVE在持续写入下几乎等不到重置，WAL会无限增长）。
+ *   - 帧按WAL格式校验（salt与累计校验和），只归档到最后一个提交帧为止。
+ *   - WAL被重置（salt变化）时：新WAL从第0帧起覆盖旧WAL，旧WAL尾部没来得及归档的帧
+ *     还在，按旧salt和校验和读出来补齐；checkpoint轮次不是正好+1，或新帧已经覆盖到
+ *     旧帧校验断开的位置（无法确认旧帧读全），就开始新一代。
+ * 恢复（-r）：快照 + 按顺序把各段里的页写回原位置，截断到最后一次提交时的库大小。
+ */
+
+#define DEFAULT_PAGES 64
+#define MAX_PAGES 65536
+#define DEFAULT_BUDGET_MS 5.0
+#define DEFAULT_RESTARTS 5
+#define DEFAULT_POLL_MS 1000
+#define DEFAULT_CKPT_FRAMES 1000
+#define DEFAULT_FULL_SEC 3600
+
+#define WAL_HDR_SIZE 32
+#define WAL_FRAME_HDR_SIZE 24
+#define WAL_MAGIC 0x377f0682          // 最低位为1时校验和按大端计算
+
+typedef struct {
+    int pages;                        // 每步初始页数，<=0表示一次拷完
+    double budget_ms;                 // 单步耗时预算
+    int max_restarts;
+    int verbose;
+} PaceOpts;
+
+typedef struct {
+    uint64_t steps;
+    uint64_t restarts;
+    uint64_t busy;
+    int pages;                        // 源库总页数
+    int locked_finish;                // 重启太多次后持锁拷完
+    double max_step_ms;
+    double elapsed_ms;
+} BackupStats;
+
+typedef struct {
+    sqlite3 *db;
+    const char *archive;
+    char gen_dir[PATH_MAX];
+    int fd;                           // -wal文件
+    int have_hdr;
+    uint32_t page_size;
+    uint32_t ckpt_seq;
+    uint32_t salt1, salt2;
+    int big_endian;
+    uint8_t hdr[WAL_HDR_SIZE];        // 当前WAL的文件头，写在每个段文件开头
+    uint32_t ck0, ck1;                // 已归档的最后一帧的累计校验和
+    uint32_t next_frame;              // 下一个要归档的帧序号
+    uint32_t final_frames;            // RESTART checkpoint成功时的帧数，此后本WAL不再追加
+    uint32_t seg;
+    // 统计
+    uint64_t generations;
+    uint64_t segments;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t checkpoints;
+    uint64_t wal_restarts;
+} WalShipper;
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void stop_handler(int sig) {
+    keep_running = 0;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms(double ms) {
+    struct timespec ts = { (time_t)(ms / 1000), (long)((ms - (time_t)(ms / 1000) * 1000) * 1e6) };
+    nanosleep(&ts, NULL);
+}
+
+static int open_db(const char *path, sqlite3 **db) {
+    if (sqlite3_open_v2(path, db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", path, sqlite3_errmsg(*db));
+        sqlite3_close(*db);
+        *db = NULL;
+        return -1;
+    }
+    sqlite3_busy_timeout(*db, 5000);
+    return 0;
+}
+
+static int is_wal(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int wal = 0;
+    if (sqlite3_prepare_v2(db, "PRAGMA journal_mode", -1, &stmt, NULL) != SQLITE_OK)
+        return 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        wal = strcmp((const char *)sqlite3_column_text(stmt, 0), "wal") == 0;
+    sqlite3_finalize(stmt);
+    return wal;
+}
+
+// 开始并保持一个读事务（WAL模式下固定快照）
+static int hold_read_txn(sqlite3 *db) {
+    if (sqlite3_exec(db, "BEGIN; SELECT count(*) FROM sqlite_master", NULL, NULL, NULL) == SQLITE_OK)
+        return 0;
+    fprintf(stderr, "read txn: %s\n", sqlite3_errmsg(db));
+    if (!sqlite3_get_autocommit(db))
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    return -1;
+}
+
+static void release_read_txn(sqlite3 *db) {
+    if (!sqlite3_get_autocommit(db))
+        sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+}
+
+/**
+ * 按节奏把src的main库拷到dst
+ * @return 成功返回0；失败或被信号中断返回-1
+ */
+static int paced_backup(sqlite3 *src, sqlite3 *dst, const PaceOpts *o, BackupStats *st) {
+    sqlite3_backup *b = sqlite3_backup_init(dst, "main", src, "main");
+    if (!b) {
+        fprintf(stderr, "backup_init: %s\n", sqlite3_errmsg(dst));
+        return -1;
+    }
+    memset(st, 0, sizeof(*st));
+    double start = now_ms();
+    int pages = o->pages, done_before = -1, remaining_before = 0, restarts = 0, rc;
+    do {
+        int n = pages <= 0 || restarts > o->max_restarts ? -1 : pages;
+        double t0 = now_ms();
+        rc = sqlite3_backup_step(b, n);
+        double dt = now_ms() - t0;
+        st->steps++;
+        if (dt > st->max_step_ms)
+            st->max_step_ms = dt;
+        if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            // 写者正持有锁，等一个预算周期再试
+            st->busy++;
+            sleep_ms(o->budget_ms);
+            continue;
+        }
+        if (rc != SQLITE_OK && rc != SQLITE_DONE)
+            break;
+
+        int total = sqlite3_backup_pagecount(b);
+        int remaining = sqlite3_backup_remaining(b);
+        int done = total - remaining;
+        // 源库被其他连接修改：本步从第1页重新开始，拷完的页数比预期少
+        if (rc == SQLITE_OK && n > 0 && done_before >= 0 &&
+            done < done_before + (n < remaining_before ? n : remaining_before)) {
+            restarts++;
+            st->restarts++;
+            if (restarts > o->max_restarts)
+                st->locked_finish = 1;
+        }
+        done_before = done;
+        remaining_before = remaining;
+        if (o->verbose)
+            fprintf(stderr, "step %llu: n=%d %.2fms %d/%d restarts=%d\n",
+                    (unsigned long long)st->steps, n, dt, done, total, restarts);
+
+        if (n > 0) {
+            if (dt > o->budget_ms && pages > 1)
+                pages /= 2;
+            else if (dt < o->budget_ms / 2 && pages < MAX_PAGES)
+                pages *= 2;
+        }
+        if (rc == SQLITE_OK)
+            sleep_ms(dt > 1 ? dt : 1);
+    } while ((rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) && keep_running);
+
+    st->pages = sqlite3_backup_pagecount(b);
+    st->elapsed_ms = now_ms() - start;
+    int frc = sqlite3_backup_finish(b);
+    if (rc == SQLITE_DONE && frc == SQLITE_OK)
+        return 0;
+    if (rc == SQLITE_DONE || rc == SQLITE_OK)
+        rc = frc;
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "backup: %s\n", sqlite3_errstr(rc));
+    return -1;
+}
+
+// 备份到同目录临时文件，完成后原子替换path
+static int backup_to_file(sqlite3 *src, const char *path, const PaceOpts *o, BackupStats *st) {
+    aw_temp t;
+    if (aw_temp_open_named(&t, path, 0644) == -1) {
+        perror(path);
+        return -1;
+    }
+    // 临时库只在rename前可见，不需要日志；落盘由提交时的fdatasync保证
+    sqlite3 *dst;
+    int ok = sqlite3_open_v2(t.tmp, &dst, SQLITE_OPEN_READWRITE, NULL) == SQLITE_OK &&
+             sqlite3_exec(dst, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF",
+                          NULL, NULL, NULL) == SQLITE_OK;
+    if (!ok)
+        fprintf(stderr, "%s: %s\n", t.tmp, sqlite3_errmsg(dst));
+    else
+        ok = paced_backup(src, dst, o, st) == 0;
+    if (sqlite3_close(dst) != SQLITE_OK)
+        ok = 0;
+    if (!ok) {
+        aw_temp_abort(&t);
+        return -1;
+    }
+    if (aw_temp_commit(&t) == -1) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_backup_stats(const BackupStats *st) {
+    fprintf(stderr, "[STATS] pages=%d steps=%llu restarts=%llu busy=%llu locked_finish=%d "
+            "max_step=%.2fms elapsed=%.0fms\n",
+            st->pages, (unsigned long long)st->steps, (unsigned long long)st->restarts,
+            (unsigned long long)st->busy, st->locked_finish, st->max_step_ms, st->elapsed_ms);
+}
+
+static int run_backup(const char *src_path, const char *dst_path, const PaceOpts *o,
+                      BackupStats *st) {
+    sqlite3 *src;
+    if (open_db(src_path, &src) == -1)
+        return -1;
+    // WAL模式：读事务固定快照，写者照常提交，备份不会重启
+    int ret = is_wal(src) ? hold_read_txn(src) : 0;
+    if (ret == 0)
+        ret = backup_to_file(src, dst_path, o, st);
+    release_read_txn(src);
+    sqlite3_close(src);
+    return ret;
+}
+
+/* ---------------- WAL增量归档 ---------------- */
+
+static uint32_t get_be32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return be32toh(v);
+}
+
+// WAL校验和：按32位字两两累加，字节序由文件头magic决定
+static void wal_checksum(int big_endian, const uint8_t *p, size_t len, uint32_t *s0, uint32_t *s1) {
+    for (size_t i = 0; i + 8 <= len; i += 8) {
+        uint32_t x0, x1;
+        memcpy(&x0, p + i, 4);
+        memcpy(&x1, p + i + 4, 4);
+        x0 = big_endian ? be32toh(x0) : le32toh(x0);
+        x1 = big_endian ? be32toh(x1) : le32toh(x1);
+        *s0 += x0 + *s1;
+        *s1 += x1 + *s0;
+    }
+}
+
+// 读WAL文件头；文件为空或头无效返回-1
+static int wal_read_header(int fd, uint8_t *hdr) {
+    if (pread(fd, hdr, WAL_HDR_SIZE, 0) != WAL_HDR_SIZE)
+        return -1;
+    uint32_t magic = get_be32(hdr);
+    if ((magic & ~1u) != WAL_MAGIC)
+        return -1;
+    uint32_t s0 = 0, s1 = 0;
+    wal_checksum(magic & 1, hdr, 24, &s0, &s1);
+    return s0 == get_be32(hdr + 24) && s1 == get_be32(hdr + 28) ? 0 : -1;
+}
+
+static void wal_adopt_header(WalShipper *ws, const uint8_t *hdr) {
+    ws->have_hdr = 1;
+    memcpy(ws->hdr, hdr, WAL_HDR_SIZE);
+    ws->big_endian = get_be32(hdr) & 1;
+    ws->page_size = get_be32(hdr + 8);
+    ws->ckpt_seq = get_be32(hdr + 12);
+    ws->salt1 = get_be32(hdr + 16);
+    ws->salt2 = get_be32(hdr + 20);
+    ws->ck0 = get_be32(hdr + 24);
+    ws->ck1 = get_be32(hdr + 28);
+    ws->next_frame = 0;
+    ws->final_frames = UINT32_MAX;
+}
+
+// 校验一帧（salt与接续*s0/*s1的累计校验和），通过返回1
+static int wal_frame_ok(const WalShipper *ws, const uint8_t *f, uint32_t *s0, uint32_t *s1) {
+    if (get_be32(f + 8) != ws->salt1 || get_be32(f + 12) != ws->salt2)
+        return 0;
+    wal_checksum(ws->big_endian, f, 8, s0, s1);
+    wal_checksum(ws->big_endian, f + WAL_FRAME_HDR_SIZE, ws->page_size, s0, s1);
+    return *s0 == get_be32(f + 16) && *s1 == get_be32(f + 20);
+}
+
+/**
+ * 从next_frame起读取并校验帧，把到最后一个提交帧为止的部分写成一个段文件
+ * @param valid_end  输出：校验通过的连续帧到第几帧为止
+ * @return 成功返回0（可能没有新帧），出错返回-1
+ */
+static int wal_ship_frames(WalShipper *ws, uint32_t *valid_end) {
+    *valid_end = ws->next_frame;
+    struct stat st;
+    if (fstat(ws->fd, &st) == -1) {
+        perror("fstat wal");
+        return -1;
+    }
+    size_t frame_size = WAL_FRAME_HDR_SIZE + ws->page_size;
+    off_t start = WAL_HDR_SIZE + (off_t)ws->next_frame * frame_size;
+    if (st.st_size < start + (off_t)frame_size)
+        return 0;
+    size_t avail = (st.st_size - start) / frame_size * frame_size;
+
+    // 段文件 = WAL文件头 + 新帧，恢复时凭文件头得到页大小和salt
+    uint8_t *buf = malloc(WAL_HDR_SIZE + avail);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(buf, ws->hdr, WAL_HDR_SIZE);
+    ssize_t got = pread(ws->fd, buf + WAL_HDR_SIZE, avail, start);
+    if (got < 0) {
+        perror("read wal");
+        free(buf);
+        return -1;
+    }
+
+    // 写者还没写完的帧、上一轮WAL的残留帧都校验不过
+    uint32_t s0 = ws->ck0, s1 = ws->ck1, commit_s0 = 0, commit_s1 = 0, nframes = 0, valid = 0;
+    for (size_t off = 0; off + frame_size <= (size_t)got; off += frame_size, valid++) {
+        const uint8_t *f = buf + WAL_HDR_SIZE + off;
+        if (!wal_frame_ok(ws, f, &s0, &s1))
+            break;
+        if (get_be32(f + 4) != 0) {
+            nframes = valid + 1;
+            commit_s0 = s0;
+            commit_s1 = s1;
+        }
+    }
+    *valid_end = ws->next_frame + valid;
+    int ret = 0;
+    if (nframes > 0) {
+        char path[PATH_MAX + 16];
+        size_t len = WAL_HDR_SIZE + (size_t)nframes * frame_size;
+        snprintf(path, sizeof(path), "%s/%08u.wal", ws->gen_dir, ws->seg);
+        if (aw_write_file(NULL, path, buf, len, 0644) == -1) {
+            perror(path);
+            ret = -1;
+        } else {
+            ws->seg++;
+            ws->segments++;
+            ws->frames += nframes;
+            ws->bytes += len;
+            ws->next_frame += nframes;
+            ws->ck0 = commit_s0;
+            ws->ck1 = commit_s1;
+        }
+    }
+    free(buf);
+    return ret;
+}
+
+// 从第0帧起数校验通过的连续帧，最多数到limit
+static uint32_t wal_count_frames(const WalShipper *ws, uint32_t limit) {
+    size_t frame_size = WAL_FRAME_HDR_SIZE + ws->page_size;
+    uint8_t *f = malloc(frame_size);
+    uint32_t s0 = ws->ck0, s1 = ws->ck1, n = 0;
+    while (f && n < limit &&
+           pread(ws->fd, f, frame_size, WAL_HDR_SIZE + (off_t)n * frame_size) == (ssize_t)frame_size &&
+           wal_frame_ok(ws, f, &s0, &s1))
+        n++;
+    free(f);
+    return n;
+}
+
+/**
+ * 把WAL中新增的已提交帧写成段文件
+ * @return 0成功（可能没有新帧）；1可能漏帧，需要开始新一代；-1出错
+ */
+static int wal_ship(WalShipper *ws) {
+    uint8_t hdr[WAL_HDR_SIZE];
+    uint32_t end;
+    if (wal_read_header(ws->fd, hdr) == -1)
+        return 0;                     // 刚截断，还没有写者写入
+    if (!ws->have_hdr) {
+        wal_adopt_header(ws, hdr);
+    } else if (get_be32(hdr + 16) != ws->salt1 || get_be32(hdr + 20) != ws->salt2) {
+        // WAL被重置：中间又重置过一次就无从知道丢了什么
+        ws->wal_restarts++;
+        if (get_be32(hdr + 12) != ws->ckpt_seq + 1)
+            return 1;
+        // 旧WAL尾部还没归档的帧，按旧salt和校验和读出来
+        if (wal_ship_frames(ws, &end) == -1)
+            return -1;
+        // 旧WAL的帧数不确定时：新WAL从第0帧起覆盖旧WAL，新帧还没写到旧帧校验
+        // 断开的位置，说明断开处就是旧WAL的末尾而不是被覆盖了，旧帧已读全
+        if (ws->next_frame != ws->final_frames) {
+            WalShipper next = *ws;
+            wal_adopt_header(&next, hdr);
+            if (wal_count_frames(&next, end + 1) > end)
+                return 1;
+        }
+        wal_adopt_header(ws, hdr);
+    }
+    return wal_ship_frames(ws, &end);
+}
+
+/**
+ * 短暂释放读事务，自己做一次RESTART checkpoint：回填完等读者离开WAL，
+ * 下一个写者就会从头重用WAL。等待期间新写者被挡住，所以只等-L毫秒。
+ * 成功时WAL的帧数就是旧WAL最终的帧数，调用者应立即再归档一次，赶在被覆盖之前
+ */
+static int wal_checkpoint(WalShipper *ws, const PaceOpts *o) {
+    int log = -1, ckpt = -1;
+    release_read_txn(ws->db);
+    sqlite3_busy_timeout(ws->db, (int)o->budget_ms);
+    int rc = sqlite3_wal_checkpoint_v2(ws->db, "main", SQLITE_CHECKPOINT_RESTART, &log, &ckpt);
+    sqlite3_busy_timeout(ws->db, 5000);
+    ws->checkpoints++;
+    if (rc == SQLITE_OK && log >= 0 && log == ckpt)
+        ws->final_frames = log;
+    return hold_read_txn(ws->db);
+}
+
+// 截断WAL、持有读事务、做全量快照，开始新的一代
+static int wal_new_generation(WalShipper *ws, const PaceOpts *o) {
+    release_read_txn(ws->db);
+    for (int i = 0;; i++) {
+        int rc = sqlite3_wal_checkpoint_v2(ws->db, "main", SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
+        if (rc == SQLITE_OK && hold_read_txn(ws->db) == 0) {
+            if (ws->fd == -1) {
+                char wal[PATH_MAX];
+                snprintf(wal, sizeof(wal), "%s-wal", sqlite3_db_filename(ws->db, "main"));
+                if ((ws->fd = open(wal, O_RDONLY | O_CLOEXEC)) == -1) {
+                    perror(wal);
+                    return -1;
+                }
+            }
+            // 读事务开始后WAL仍为空，快照就是库文件本身
+            struct stat st;
+            if (fstat(ws->fd, &st) == 0 && st.st_size == 0)
+                break;
+            release_read_txn(ws->db);
+        }
+        if (i == 50 || !keep_running) {
+            fprintf(stderr, "checkpoint(TRUNCATE) failed: %s\n", sqlite3_errmsg(ws->db));
+            return -1;
+        }
+        sleep_ms(100);
+    }
+
+    for (int i = 0;; i++) {
+        snprintf(ws->gen_dir, sizeof(ws->gen_dir), "%s/%lld-%d", ws->archive,
+                 (long long)time(NULL), i);
+        if (mkdir(ws->gen_dir, 0755) == 0)
+            break;
+        if (errno != EEXIST) {
+            perror(ws->gen_dir);
+            return -1;
+        }
+    }
+    if (aw_fsync_dir(ws->archive) == -1) {
+        perror(ws->archive);
+        return -1;
+    }
+
+    char snap[PATH_MAX + 16];
+    snprintf(snap, sizeof(snap), "%s/snapshot.db", ws->gen_dir);
+    BackupStats st;
+    if (backup_to_file(ws->db, snap, o, &st) == -1)
+        return -1;
+    print_backup_stats(&st);
+    ws->have_hdr = 0;
+    ws->next_frame = 0;
+    ws->seg = 0;
+    ws->generations++;
+    printf("generation %s: %d pages\n", ws->gen_dir, st.pages);
+    return 0;
+}
+
+static int run_wal_ship(const char *src_path, const char *archive, const PaceOpts *o,
+                        int poll_ms, int ckpt_frames, int full_sec) {
+    WalShipper ws = { .archive = archive, .fd = -1 };
+    if (mkdir(archive, 0755) == -1 && errno != EEXIST) {
+        perror(archive);
+        return -1;
+    }
+    if (open_db(src_path, &ws.db) == -1)
+        return -1;
+    if (!is_wal(ws.db)) {
+        fprintf(stderr, "%s: not in WAL mode\n", src_path);
+        sqlite3_close(ws.db);
+        return -1;
+    }
+    // 本连接只在自己选定的时机checkpoint
+    sqlite3_wal_autocheckpoint(ws.db, 0);
+
+    int ret = wal_new_generation(&ws, o);
+    double next_full = now_ms() + full_sec * 1000.0;
+    while (ret == 0 && keep_running) {
+        sleep_ms(poll_ms);
+        int rc = wal_ship(&ws);
+        if (rc == 0 && ws.next_frame >= (uint32_t)ckpt_frames) {
+            rc = wal_checkpoint(&ws, o);
+            if (rc == 0)
+                rc = wal_ship(&ws);
+        }
+        if (rc == 1 || (rc == 0 && now_ms() >= next_full)) {
+            rc = wal_new_generation(&ws, o);
+            next_full = now_ms() + full_sec * 1000.0;
+        }
+        ret = rc;
+    }
+    if (ret == 0)
+        ret = wal_ship(&ws) == 0 ? 0 : -1;
+
+    release_read_txn(ws.db);
+    sqlite3_close(ws.db);
+    if (ws.fd != -1)
+        close(ws.fd);
+    fprintf(stderr, "[STATS] generations=%llu segments=%llu frames=%llu bytes=%llu "
+            "checkpoints=%llu wal_restarts=%llu\n",
+            (unsigned long long)ws.generations, (unsigned long long)ws.segments,
+            (unsigned long long)ws.frames, (unsigned long long)ws.bytes,
+            (unsigned long long)ws.checkpoints, (unsigned long long)ws.wal_restarts);
+    return ret;
+}
+
+// 读整个文件
+static uint8_t *read_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    struct stat st;
+    uint8_t *buf = NULL;
+    if (fstat(fd, &st) == 0 && (buf = malloc(st.st_size ? st.st_size : 1))) {
+        size_t off = 0;
+        while (off < (size_t)st.st_size) {
+            ssize_t n = read(fd, buf + off, st.st_size - off);
+            if (n <= 0) {
+                if (n == -1 && errno == EINTR)
+                    continue;
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            off += n;
+        }
+        *len = off;
+    }
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return buf;
+}
+
+// 快照 + 各段中的页按顺序写回，结果原子替换dst
+static int run_restore(const char *gen_dir, const char *dst_path) {
+    char path[PATH_MAX + 16];
+    size_t len;
+    snprintf(path, sizeof(path), "%s/snapshot.db", gen_dir);
+    uint8_t *buf = read_file(path, &len);
+    if (!buf) {
+        perror(path);
+        return -1;
+    }
+    aw_temp t;
+    if (aw_temp_open(&t, dst_path, 0644) == -1) {
+        perror(dst_path);
+        free(buf);
+        return -1;
+    }
+    int ok = aw_write_all(t.fd, buf, len) == 0;
+    free(buf);
+
+    uint32_t seg, frames = 0, db_pages = 0, page_size = 0;
+    for (seg = 0; ok; seg++) {
+        snprintf(path, sizeof(path), "%s/%08u.wal", gen_dir, seg);
+        if (!(buf = read_file(path, &len))) {
+            if (errno != ENOENT) {
+                perror(path);
+                ok = 0;
+            }
+            break;
+        }
+        uint8_t *hdr = buf;
+        page_size = len >= WAL_HDR_SIZE ? get_be32(hdr + 8) : 0;
+        size_t frame_size = WAL_FRAME_HDR_SIZE + page_size;
+        if (page_size < 512 || (len - WAL_HDR_SIZE) % frame_size != 0) {
+            fprintf(stderr, "%s: bad segment\n", path);
+            ok = 0;
+        }
+        for (size_t off = WAL_HDR_SIZE; ok && off < len; off += frame_size) {
+            const uint8_t *f = buf + off;
+            if (get_be32(f + 8) != get_be32(hdr + 16) || get_be32(f + 12) != get_be32(hdr + 20)) {
+                fprintf(stderr, "%s: salt mismatch\n", path);
+                ok = 0;
+                break;
+            }
+            uint32_t pgno = get_be32(f);
+            if (pwrite(t.fd, f + WAL_FRAME_HDR_SIZE, page_size,
+                       (off_t)(pgno - 1) * page_size) != (ssize_t)page_size) {
+                perror("pwrite");
+                ok = 0;
+            }
+            if (get_be32(f + 4) != 0)
+                db_pages = get_be32(f + 4);
+            frames++;
+        }
+        free(buf);
+    }
+    // 库可能被VACUUM缩小过，截断到最后一次提交时的大小
+    if (ok && db_pages && ftruncate(t.fd, (off_t)db_pages * page_size) == -1) {
+        perror("ftruncate");
+        ok = 0;
+    }
+    if (!ok) {
+        aw_temp_abort(&t);
+        return -1;
+    }
+    if (aw_temp_commit(&t) == -1) {
+        perror(dst_path);
+        return -1;
+    }
+    printf("restored %s: %u segments, %u frames\n", dst_path, seg, frames);
+    return 0;
+}
+
+/* ---------------- 基准测试 ---------------- */
+
+typedef struct {
+    const char *path;
+    double *lat_ms;
+    size_t n, cap;
+    int failed;
+    volatile int stop;
+} BenchWriter;
+
+// 每2ms提交一个单行UPDATE事务，记录提交耗时
+static void *bench_writer(void *arg) {
+    BenchWriter *w = arg;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    if (open_db(w->path, &db) == -1)
+        return NULL;
+    sqlite3_busy_timeout(db, 30000);
+    sqlite3_exec(db, "PRAGMA synchronous=NORMAL", NULL, NULL, NULL);
+    sqlite3_prepare_v2(db, "UPDATE t SET v=randomblob(1000) WHERE id=?", -1, &stmt, NULL);
+    int rows = 0;
+    sqlite3_stmt *cnt;
+    if (sqlite3_prepare_v2(db, "SELECT max(id) FROM t", -1, &cnt, NULL) == SQLITE_OK &&
+        sqlite3_step(cnt) == SQLITE_ROW)
+        rows = sqlite3_column_int(cnt, 0);
+    sqlite3_finalize(cnt);
+
+    while (!w->stop && w->n < w->cap) {
+        double t0 = now_ms();
+        int ok = sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL) == SQLITE_OK;
+        if (ok) {
+            sqlite3_bind_int(stmt, 1, 1 + rand() % (rows ? rows : 1));
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+            ok = sqlite3_exec(db, ok ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL) == SQLITE_OK && ok;
+        }
+        if (!ok)
+            w->failed++;
+        w->lat_ms[w->n++] = now_ms() - t0;
+        sleep_ms(2);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// mode: 0不备份，1按节奏分步，2一次拷完
+static void bench_phase(const char *name, const char *db_path, const char *copy_path,
+                        int mode, const PaceOpts *o, int seconds) {
+    BenchWriter w = { .path = db_path, .cap = (size_t)seconds * 1000 };
+    w.lat_ms = malloc(sizeof(double) * w.cap);
+    if (!w.lat_ms) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    pthread_t tid;
+    pthread_create(&tid, NULL, bench_writer, &w);
+
+    PaceOpts po = *o;
+    if (mode == 2)
+        po.pages = -1;
+    int backups = 0, failed = 0, locked = 0;
+    uint64_t restarts = 0;
+    double max_step = 0, end = now_ms() + seconds * 1000.0;
+    while (now_ms() < end) {
+        if (mode == 0) {
+            sleep_ms(50);
+            continue;
+        }
+        BackupStats st = {0};         // run_backup在开始复制前失败时不填写
+        if (run_backup(db_path, copy_path, &po, &st) == 0)
+            backups++;
+        else
+            failed++;
+        restarts += st.restarts;
+        locked += st.locked_finish;
+        if (st.max_step_ms > max_step)
+            max_step = st.max_step_ms;
+    }
+    w.stop = 1;
+    pthread_join(tid, NULL);
+
+    if (w.n == 0) {
+        printf("%-7s no writes\n", name);
+    } else {
+        qsort(w.lat_ms, w.n, sizeof(double), cmp_double);
+        printf("%-7s writes=%zu failed=%d p50=%.2fms p99=%.2fms max=%.2fms "
+               "backups=%d/%d restarts=%llu locked_finish=%d max_step=%.2fms\n",
+               name, w.n, w.failed, w.lat_ms[w.n / 2], w.lat_ms[(size_t)(w.n * 0.99)],
+               w.lat_ms[w.n - 1], backups, backups + failed, (unsigned long long)restarts,
+               locked, max_step);
+    }
+    free(w.lat_ms);
+}
+
+static int run_bench(const char *dir, const char *journal, int seconds, int rows, const PaceOpts *o) {
+    char db_path[PATH_MAX], copy_path[PATH_MAX], sql[512];
+    snprintf(db_path, sizeof(db_path), "%s/bench.db", dir);
+    snprintf(copy_path, sizeof(copy_path), "%s/bench-copy.db", dir);
+    unlink(db_path);
+    sqlite3 *db;
+    if (sqlite3_open(db_path, &db) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", db_path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    snprintf(sql, sizeof(sql),
+             "PRAGMA journal_mode=%s;"
+             "CREATE TABLE t(id INTEGER PRIMARY KEY, v BLOB);"
+             "WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM c WHERE i<%d) "
+             "INSERT INTO t SELECT i, randomblob(1000) FROM c", journal, rows);
+    int rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "%s: %s\n", db_path, sqlite3_errmsg(db));
+    sqlite3_close(db);
+    if (rc != SQLITE_OK)
+        return -1;
+
+    printf("journal=%s rows=%d pages=%d budget=%.1fms\n", journal, rows, o->pages, o->budget_ms);
+    bench_phase("idle", db_path, copy_path, 0, o, seconds);
+    bench_phase("paced", db_path, copy_path, 1, o, seconds);
+    bench_phase("oneshot", db_path, copy_path, 2, o, seconds);
+    unlink(copy_path);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-p pages] [-L ms] [-R n] [-v] <src.db> <dst.db>  在线备份（原子替换dst）\n"
+            "       %s -w <archive> [-p pages] [-L ms] [-i ms] [-C frames] [-F sec] <src.db>\n"
+            "                                         全量快照 + WAL增量归档\n"
+            "       %s -r <generation-dir> <dst.db>   由快照和WAL段恢复\n"
+            "       %s -B <dir> [-j wal|delete] [-t sec] [-N rows]  基准：有无备份时写者延迟\n"
+            "  -p  每步初始页数（默认%d，按-L自动增减；0为一次拷完）\n"
+            "  -L  单步耗时预算（毫秒，默认%.0f），回滚日志模式下即写者最多被阻塞的时长\n"
+            "  -R  源库被修改导致备份重启超过n次后持锁一次拷完（默认%d）\n"
+            "  -i  WAL轮询间隔（毫秒，默认%d）\n"
+            "  -C  WAL超过多少帧时checkpoint（默认%d）\n"
+            "  -F  每隔多少秒开始新一代全量快照（默认%d）\n"
+            "  -j  基准测试库的日志模式（默认wal）\n"
+            "  -t  基准测试每轮秒数（默认5）\n"
+            "  -N  基准测试库的行数（每行1KB，默认20000）\n"
+            "  -v  打印每一步\n",
+            prog, prog, prog, prog, DEFAULT_PAGES, DEFAULT_BUDGET_MS, DEFAULT_RESTARTS,
+            DEFAULT_POLL_MS, DEFAULT_CKPT_FRAMES, DEFAULT_FULL_SEC);
+}
+
+int main(int argc, char **argv) {
+    PaceOpts o = { .pages = DEFAULT_PAGES, .budget_ms = DEFAULT_BUDGET_MS,
+                   .max_restarts = DEFAULT_RESTARTS };
+    const char *archive = NULL, *restore = NULL, *bench_dir = NULL, *journal = "wal";
+    int poll_ms = DEFAULT_POLL_MS, ckpt_frames = DEFAULT_CKPT_FRAMES, full_sec = DEFAULT_FULL_SEC;
+    int seconds = 5, rows = 20000, opt;
+    while ((opt = getopt(argc, argv, "p:L:R:w:i:C:F:r:B:j:t:N:v")) != -1) {
+        switch (opt) {
+        case 'p': o.pages = atoi(optarg); break;
+        case 'L': o.budget_ms = atof(optarg); break;
+        case 'R': o.max_restarts = atoi(optarg); break;
+        case 'w': archive = optarg; break;
+        case 'i': poll_ms = atoi(optarg); break;
+        case 'C': ckpt_frames = atoi(optarg); break;
+        case 'F': full_sec = atoi(optarg); break;
+        case 'r': restore = optarg; break;
+        case 'B': bench_dir = optarg; break;
+        case 'j': journal = optarg; break;
+        case 't': seconds = atoi(optarg); break;
+        case 'N': rows = atoi(optarg); break;
+        case 'v': o.verbose = 1; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (o.budget_ms <= 0 || poll_ms < 1 || ckpt_frames < 1 || full_sec < 1 || seconds < 1 ||
+        rows < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+
+    int ret;
+    if (bench_dir) {
+        ret = run_bench(bench_dir, journal, seconds, rows, &o);
+    } else if (restore) {
+        if (optind + 1 != argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        ret = run_restore(restore, argv[optind]);
+    } else if (archive) {
+        if (optind + 1 != argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        ret = run_wal_ship(argv[optind], archive, &o, poll_ms, ckpt_frames, full_sec);
+    } else {
+        if (optind + 2 != argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        BackupStats st;
+        ret = run_backup(argv[optind], argv[optind + 1], &o, &st);
+        if (ret == 0)
+            print_backup_stats(&st);
+    }
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,364 @@
+#ifndef TRAFFIC_HISTORY_H
+#define TRAFFIC_HISTORY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <linux/if_link.h>
+
+/*
+ * 网卡流量历史存储：单文件、定长记录、mmap循环写入
+ * 文件 = 头部 + 4个环形区：原始采样 / 1秒 / 1分钟 / 1小时汇总
+ * 写端（netlink_traffic）每次采样追加一条原始记录，并把与上一样本的增量
+ * 累加到各级汇总桶中，跨桶时落盘一条汇总记录；读端（traffic_query）只读映射。
+ * 文件大小在创建时确定，长期运行时内存与磁盘占用均有上界。
+ */
+#define TH_MAGIC      "NLTHIST1"
+#define TH_VERSION    1
+#define TH_BOOT_ID    "/proc/sys/kernel/random/boot_id"
+#define TH_READ_GUARD 64          // 读端起点避开即将被覆盖的最旧记录数（读后仍需th_read校验）
+
+enum { TH_RAW, TH_1S, TH_1M, TH_1H, TH_NRINGS };
+#define TH_NROLLUPS (TH_NRINGS - 1)
+
+static const uint64_t th_bucket_ns[TH_NRINGS] = {
+    0, 1000000000ULL, 60000000000ULL, 3600000000000ULL
+};
+static const char *const th_ring_names[TH_NRINGS] = { "raw", "1s", "1m", "1h" };
+
+typedef struct {
+    uint64_t offset;              // 记录区在文件中的偏移
+    uint64_t capacity;            // 可容纳记录数
+    uint64_t bucket_ns;           // 汇总粒度，原始环为0
+    uint32_t rec_size;            // 单条记录字节数
+    uint32_t reserved;
+    uint64_t head;                // 累计写入条数（单调递增），槽位 = head % capacity
+} th_ring;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t stats_size;          // 写入时 struct rtnl_link_stats64 的大小
+    char boot_id[40];             // 单调时钟只在同一次启动内可比
+    uint64_t created_ns;
+    th_ring rings[TH_NRINGS];
+} th_header;
+
+// 原始采样记录
+typedef struct {
+    uint32_t ifindex;
+    uint32_t reserved;
+    uint64_t ts_ns;               // CLOCK_MONOTONIC
+    struct rtnl_link_stats64 stats;
+} th_sample;
+
+// 汇总记录：桶内各计数器增量之和
+typedef struct {
+    uint32_t ifindex;
+    uint32_t nsamples;            // 参与汇总的增量个数
+    uint64_t start_ns;            // 首个增量的起点（前一样本时间）
+    uint64_t end_ns;              // 最后一个样本时间
+    uint64_t rx_bytes, tx_bytes;
+    uint64_t rx_packets, tx_packets;
+    uint64_t rx_errors, tx_errors;
+    uint64_t rx_dropped, tx_dropped;
+    uint64_t rx_peak_bps, tx_peak_bps;  // 桶内单次采样间隔的最大速率（B/s）
+} th_rollup;
+
+// 写端每网卡每级的汇总累加器，只存在于内存中
+typedef struct {
+    uint64_t bucket;              // 当前桶编号 = ts / bucket_ns
+    th_rollup cur;                // cur.nsamples == 0 表示空桶
+} th_accum;
+
+typedef struct {
+    int fd;
+    int writable;
+    size_t size;
+    th_header *hdr;
+    uint8_t *base;
+} th_store;
+
+static inline uint64_t th_mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void th_read_boot_id(char *buf, size_t len) {
+    memset(buf, 0, len);
+    FILE *fp = fopen(TH_BOOT_ID, "r");
+    if (!fp)
+        return;
+    if (fgets(buf, len, fp))
+        buf[strcspn(buf, "\n")] = '\0';
+    fclose(fp);
+}
+
+static inline void *th_slot(const th_store *st, int ring, uint64_t seq) {
+    const th_ring *r = &st->hdr->rings[ring];
+    return st->base + r->offset + (seq % r->capacity) * r->rec_size;
+}
+
+static inline uint64_t th_head(const th_store *st, int ring) {
+    return __atomic_load_n(&st->hdr->rings[ring].head, __ATOMIC_ACQUIRE);
+}
+
+// 读端的起始序号：留出TH_READ_GUARD条余量，减少读到一半被覆盖而丢弃的记录
+static inline uint64_t th_tail(const th_store *st, int ring, uint64_t head) {
+    uint64_t cap = st->hdr->rings[ring].capacity;
+    uint64_t keep = cap > TH_READ_GUARD * 2 ? cap - TH_READ_GUARD : cap / 2;
+    return head > keep ? head - keep : 0;
+}
+
+static inline int th_map(th_store *st, size_t size) {
+    int prot = PROT_READ | (st->writable ? PROT_WRITE : 0);
+    void *p = mmap(NULL, size, prot, MAP_SHARED, st->fd, 0);
+    if (p == MAP_FAILED)
+        return -1;
+    st->size = size;
+    st->base = p;
+    st->hdr = p;
+    return 0;
+}
+
+static inline int th_header_valid(const th_header *hdr, size_t size) {
+    if (memcmp(hdr->magic, TH_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != TH_VERSION ||
+        hdr->stats_size != sizeof(struct rtnl_link_stats64))
+        return 0;
+    for (int i = 0; i < TH_NRINGS; i++) {
+        const th_ring *r = &hdr->rings[i];
+        if (r->capacity == 0 || r->offset + r->capacity * r->rec_size > size)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * 写端打开历史文件，格式/容量不符或跨越重启时重新初始化
+ * @param path     文件路径
+ * @param raw_cap  原始采样环容量（条），各级汇总环按比例缩小
+ * @return 成功返回0，失败返回-1
+ */
+static inline int th_open_writer(th_store *st, const char *path, uint64_t raw_cap) {
+    memset(st, 0, sizeof(*st));
+    st->writable = 1;
+    st->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (st->fd == -1)
+        return -1;
+
+    // 同一文件只允许一个写端
+    if (flock(st->fd, LOCK_EX | LOCK_NB) == -1)
+        goto fail;
+
+    th_header want = { .version = TH_VERSION,
+                       .stats_size = sizeof(struct rtnl_link_stats64) };
+    memcpy(want.magic, TH_MAGIC, sizeof(want.magic));
+    th_read_boot_id(want.boot_id, sizeof(want.boot_id));
+
+    uint64_t off = (sizeof(th_header) + 4095) & ~4095ULL;
+    for (int i = 0; i < TH_NRINGS; i++) {
+        th_ring *r = &want.rings[i];
+        uint64_t cap = i == TH_RAW ? raw_cap : raw_cap >> (2 * i);
+        r->capacity = cap < 4096 ? 4096 : cap;
+        r->bucket_ns = th_bucket_ns[i];
+        r->rec_size = i == TH_RAW ? sizeof(th_sample) : sizeof(th_rollup);
+        r->offset = off;
+        off += (r->capacity * r->rec_size + 4095) & ~4095ULL;
+    }
+
+    struct stat sb;
+    if (fstat(st->fd, &sb) == -1)
+        goto fail;
+
+    // 复用已有文件：布局一致且同一次启动
+    if ((uint64_t)sb.st_size == off) {
+        if (th_map(st, off) == -1)
+            goto fail;
+        const th_header *h = st->hdr;
+        int same = th_header_valid(h, off) &&
+                   strcmp(h->boot_id, want.boot_id) == 0;
+        for (int i = 0; same && i < TH_NRINGS; i++)
+            same = h->rings[i].offset == want.rings[i].offset &&
+                   h->rings[i].capacity == want.rings[i].capacity;
+        if (same)
+            return 0;
+        munmap(st->base, st->size);
+    }
+
+    // 重新初始化：先截断为0清掉旧数据，再扩展为稀疏文件
+    if (ftruncate(st->fd, 0) == -1 || ftruncate(st->fd, off) == -1 ||
+        th_map(st, off) == -1)
+        goto fail;
+    want.created_ns = th_mono_ns();
+    memcpy(st->hdr, &want, sizeof(want));
+    return 0;
+
+fail:
+    close(st->fd);
+    st->fd = -1;
+    return -1;
+}
+
+// 读端只读打开
+static inline int th_open_reader(th_store *st, const char *path) {
+    memset(st, 0, sizeof(*st));
+    st->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (st->fd == -1)
+        return -1;
+
+    struct stat sb;
+    if (fstat(st->fd, &sb) == -1 || (size_t)sb.st_size < sizeof(th_header) ||
+        th_map(st, sb.st_size) == -1) {
+        close(st->fd);
+        return -1;
+    }
+    if (!th_header_valid(st->hdr, st->size)) {
+        munmap(st->base, st->size);
+        close(st->fd);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+static inline void th_close(th_store *st) {
+    if (st->base)
+        munmap(st->base, st->size);
+    if (st->fd >= 0)
+        close(st->fd);
+    memset(st, 0, sizeof(*st));
+    st->fd = -1;
+}
+
+// 先写记录再发布head，读端按head读取不会看到未写完的新记录
+static inline void *th_reserve(th_store *st, int ring) {
+    // 保证已发布的head先于对该槽位（覆盖最旧记录）的写入对读端可见，th_read据此校验
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return th_slot(st, ring, st->hdr->rings[ring].head);
+}
+
+static inline void th_commit(th_store *st, int ring) {
+    th_ring *r = &st->hdr->rings[ring];
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+static inline void th_append_sample(th_store *st, uint32_t ifindex, uint64_t ts_ns,
+                                    const struct rtnl_link_stats64 *stats) {
+    th_sample *s = th_reserve(st, TH_RAW);
+    s->ifindex = ifindex;
+    s->reserved = 0;
+    s->ts_ns = ts_ns;
+    s->stats = *stats;
+    th_commit(st, TH_RAW);
+}
+
+// 将累加器中的桶写入对应汇总环并清空
+static inline void th_flush_accum(th_store *st, int ring, th_accum *acc) {
+    if (acc->cur.nsamples == 0)
+        return;
+    th_rollup *r = th_reserve(st, ring);
+    *r = acc->cur;
+    th_commit(st, ring);
+    memset(&acc->cur, 0, sizeof(acc->cur));
+}
+
+static inline void th_flush_all(th_store *st, th_accum acc[TH_NROLLUPS]) {
+    for (int i = 0; i < TH_NROLLUPS; i++)
+        th_flush_accum(st, TH_1S + i, &acc[i]);
+}
+
+/**
+ * 把两次采样之间的增量累加到各级汇总桶（增量归属于后一样本所在的桶）
+ * @param acc      该网卡的累加器数组
+ * @param prev_ns  前一样本时间
+ * @param ts_ns    当前样本时间
+ */
+static inline void th_accumulate(th_store *st, th_accum acc[TH_NROLLUPS],
+                                 uint32_t ifindex, uint64_t prev_ns, uint64_t ts_ns,
+                                 const struct rtnl_link_stats64 *prev,
+                                 const struct rtnl_link_stats64 *cur) {
+    if (ts_ns <= prev_ns)
+        return;
+
+    uint64_t dt = ts_ns - prev_ns;
+    uint64_t rx = cur->rx_bytes - prev->rx_bytes;
+    uint64_t tx = cur->tx_bytes - prev->tx_bytes;
+    uint64_t rx_bps = (uint64_t)((double)rx * 1e9 / dt);
+    uint64_t tx_bps = (uint64_t)((double)tx * 1e9 / dt);
+
+    for (int i = 0; i < TH_NROLLUPS; i++) {
+        int ring = TH_1S + i;
+        th_accum *a = &acc[i];
+        uint64_t bucket = ts_ns / th_bucket_ns[ring];
+        if (a->cur.nsamples && bucket != a->bucket)
+            th_flush_accum(st, ring, a);
+
+        th_rollup *r = &a->cur;
+        if (r->nsamples == 0) {
+            a->bucket = bucket;
+            r->ifindex = ifindex;
+            r->start_ns = prev_ns;
+        }
+        r->nsamples++;
+        r->end_ns = ts_ns;
+        r->rx_bytes += rx;
+        r->tx_bytes += tx;
+        r->rx_packets += cur->rx_packets - prev->rx_packets;
+        r->tx_packets += cur->tx_packets - prev->tx_packets;
+        r->rx_errors += cur->rx_errors - prev->rx_errors;
+        r->tx_errors += cur->tx_errors - prev->tx_errors;
+        r->rx_dropped += cur->rx_dropped - prev->rx_dropped;
+        r->tx_dropped += cur->tx_dropped - prev->tx_dropped;
+        if (rx_bps > r->rx_peak_bps) r->rx_peak_bps = rx_bps;
+        if (tx_bps > r->tx_peak_bps) r->tx_peak_bps = tx_bps;
+    }
+}
+
+/**
+ * 读端复制一条记录：复制后重读head，写端只会改写已发布head所指的槽位，
+ * 因此head < seq + capacity 时该槽位在复制期间没有被覆盖
+ * @param out  至少rec_size字节
+ * @return 完整快照返回0，记录已被（或正被）覆盖返回-1
+ */
+static inline int th_read(const th_store *st, int ring, uint64_t seq, void *out) {
+    const th_ring *r = &st->hdr->rings[ring];
+    memcpy(out, th_slot(st, ring, seq), r->rec_size);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return th_head(st, ring) < seq + r->capacity ? 0 : -1;
+}
+
+// 记录时间戳：原始记录为采样时刻，汇总记录为桶内最后样本时刻；已被覆盖的记录返回0
+static inline uint64_t th_record_ts(const th_store *st, int ring, uint64_t seq) {
+    const void *rec = th_slot(st, ring, seq);
+    uint64_t ts = ring == TH_RAW ? __atomic_load_n(&((const th_sample *)rec)->ts_ns, __ATOMIC_RELAXED)
+                                 : __atomic_load_n(&((const th_rollup *)rec)->end_ns, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return th_head(st, ring) < seq + st->hdr->rings[ring].capacity ? ts : 0;
+}
+
+// 二分查找[tail, head)中首条时间戳 >= ts_ns 的记录序号（记录按时间追加，
+// 已被覆盖的记录时间戳视为0，落在窗口之前）
+static inline uint64_t th_seek(const th_store *st, int ring, uint64_t tail,
+                               uint64_t head, uint64_t ts_ns) {
+    uint64_t lo = tail, hi = head;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (th_record_ts(st, ring, mid) < ts_ns)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+#endif // TRAFFIC_HISTORY_H
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <net/if.h>
+
+#include "traffic_history.h"
+
+// 查询netlink_traffic -H 生成的历史文件，如：最近10分钟eth0的速率
+#define DEFAULT_WINDOW_SEC 600
+
+// 查询结果：窗口内各计数器增量
+typedef struct {
+    uint64_t first_ns, last_ns;   // 实际覆盖的时间段
+    uint64_t records;             // 参与计算的记录数
+    uint64_t rx_bytes, tx_bytes;
+    uint64_t rx_packets, tx_packets;
+    uint64_t rx_errors, tx_errors;
+    uint64_t rx_dropped, tx_dropped;
+    uint64_t rx_peak_bps, tx_peak_bps;
+} QueryResult;
+
+// 原始环：取窗口内首尾两个样本做差；读取期间被写端覆盖的记录跳过
+static void query_raw(const th_store *st, uint32_t ifindex, uint64_t from_ns,
+                      QueryResult *res) {
+    uint64_t head = th_head(st, TH_RAW);
+    uint64_t tail = th_tail(st, TH_RAW, head);
+    th_sample s, first, last;
+
+    for (uint64_t seq = th_seek(st, TH_RAW, tail, head, from_ns); seq < head; seq++) {
+        if (th_read(st, TH_RAW, seq, &s) == -1 || s.ifindex != ifindex)
+            continue;
+        if (res->records == 0)
+            first = s;
+        // 相邻样本之间的速率作为峰值候选
+        else if (s.ts_ns > last.ts_ns) {
+            double dt = (double)(s.ts_ns - last.ts_ns) / 1e9;
+            uint64_t rx = (uint64_t)((s.stats.rx_bytes - last.stats.rx_bytes) / dt);
+            uint64_t tx = (uint64_t)((s.stats.tx_bytes - last.stats.tx_bytes) / dt);
+            if (rx > res->rx_peak_bps) res->rx_peak_bps = rx;
+            if (tx > res->tx_peak_bps) res->tx_peak_bps = tx;
+        }
+        last = s;
+        res->records++;
+    }
+
+    if (res->records < 2)
+        return;
+    res->first_ns = first.ts_ns;
+    res->last_ns = last.ts_ns;
+    res->rx_bytes = last.stats.rx_bytes - first.stats.rx_bytes;
+    res->tx_bytes = last.stats.tx_bytes - first.stats.tx_bytes;
+    res->rx_packets = last.stats.rx_packets - first.stats.rx_packets;
+    res->tx_packets = last.stats.tx_packets - first.stats.tx_packets;
+    res->rx_errors = last.stats.rx_errors - first.stats.rx_errors;
+    res->tx_errors = last.stats.tx_errors - first.stats.tx_errors;
+    res->rx_dropped = last.stats.rx_dropped - first.stats.rx_dropped;
+    res->tx_dropped = last.stats.tx_dropped - first.stats.tx_dropped;
+}
+
+// 汇总环：累加窗口内各桶的增量
+static void query_rollup(const th_store *st, int ring, uint32_t ifindex,
+                         uint64_t from_ns, QueryResult *res) {
+    uint64_t head = th_head(st, ring);
+    uint64_t tail = th_tail(st, ring, head);
+    th_rollup r;
+
+    for (uint64_t seq = th_seek(st, ring, tail, head, from_ns); seq < head; seq++) {
+        if (th_read(st, ring, seq, &r) == -1 || r.ifindex != ifindex || r.start_ns < from_ns)
+            continue;
+        if (res->records == 0)
+            res->first_ns = r.start_ns;
+        res->last_ns = r.end_ns;
+        res->records++;
+        res->rx_bytes += r.rx_bytes;
+        res->tx_bytes += r.tx_bytes;
+        res->rx_packets += r.rx_packets;
+        res->tx_packets += r.tx_packets;
+        res->rx_errors += r.rx_errors;
+        res->tx_errors += r.tx_errors;
+        res->rx_dropped += r.rx_dropped;
+        res->tx_dropped += r.tx_dropped;
+        if (r.rx_peak_bps > res->rx_peak_bps) res->rx_peak_bps = r.rx_peak_bps;
+        if (r.tx_peak_bps > res->tx_peak_bps) res->tx_peak_bps = r.tx_peak_bps;
+    }
+}
+
+// 环内最旧可读记录的时间戳，空环返回UINT64_MAX
+static uint64_t ring_oldest_ns(const th_store *st, int ring) {
+    uint64_t head = th_head(st, ring);
+    for (uint64_t seq = th_tail(st, ring, head); seq < head; seq++) {
+        uint64_t ts = th_record_ts(st, ring, seq);
+        if (ts)
+            return ts;
+    }
+    return UINT64_MAX;
+}
+
+// 自动选择环：窗口至少覆盖100个桶的最粗粒度，且该环的数据能覆盖整个窗口
+static int pick_ring(const th_store *st, uint64_t window_ns, uint64_t from_ns) {
+    int best = TH_RAW;
+    for (int i = TH_1S; i < TH_NRINGS; i++) {
+        if (th_bucket_ns[i] * 100 > window_ns)
+            break;
+        best = i;
+    }
+    // 所选环数据不足时退到更粗的环；都覆盖不全时取数据最久远的环
+    int pick = best;
+    uint64_t pick_oldest = ring_oldest_ns(st, best);
+    for (int i = best; i < TH_NRINGS; i++) {
+        uint64_t oldest = ring_oldest_ns(st, i);
+        if (oldest <= from_ns)
+            return i;
+        if (oldest < pick_oldest) {
+            pick = i;
+            pick_oldest = oldest;
+        }
+    }
+    return pick;
+}
+
+static void list_rings(const th_store *st) {
+    uint64_t now = th_mono_ns();
+    printf("boot_id: %s\n", st->hdr->boot_id);
+    printf("%-4s %10s %12s %12s %s\n", "ring", "capacity", "written", "rec_size", "span");
+    for (int i = 0; i < TH_NRINGS; i++) {
+        const th_ring *r = &st->hdr->rings[i];
+        uint64_t oldest = ring_oldest_ns(st, i);
+        printf("%-4s %10llu %12llu %12u ", th_ring_names[i],
+               (unsigned long long)r->capacity, (unsigned long long)th_head(st, i),
+               r->rec_size);
+        if (oldest == UINT64_MAX || oldest > now)
+            printf("-\n");
+        else
+            printf("%.1fs\n", (double)(now - oldest) / 1e9);
+    }
+}
+
+static void print_result(const char *ifname, uint64_t window_sec, int ring,
+                         const QueryResult *res) {
+    double span = (double)(res->last_ns - res->first_ns) / 1e9;
+    if (res->records == 0 || span <= 0) {
+        printf("%s: no data in last %llus\n", ifname, (unsigned long long)window_sec);
+        return;
+    }
+
+    printf("%s last %llus (%s ring, %llu records, covered %.1fs):\n", ifname,
+           (unsigned long long)window_sec, th_ring_names[ring],
+           (unsigned long long)res->records, span);
+    printf("  RX: avg %.2f KB/s  peak %.2f KB/s  %.1f pkt/s  errors %llu  dropped %llu\n",
+           res->rx_bytes / span / 1024, res->rx_peak_bps / 1024.0,
+           res->rx_packets / span, (unsigned long long)res->rx_errors,
+           (unsigned long long)res->rx_dropped);
+    printf("  TX: avg %.2f KB/s  peak %.2f KB/s  %.1f pkt/s  errors %llu  dropped %llu\n",
+           res->tx_bytes / span / 1024, res->tx_peak_bps / 1024.0,
+           res->tx_packets / span, (unsigned long long)res->tx_errors,
+           (unsigned long long)res->tx_dropped);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s -f <file> -i <ifname|ifindex> [-s seconds] [-r raw|1s|1m|1h]\n"
+            "       %s -f <file> -l       列出各环的容量与覆盖时长\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL, *ifname = NULL;
+    uint64_t window_sec = DEFAULT_WINDOW_SEC;
+    int ring = -1, list = 0, opt;
+
+    while ((opt = getopt(argc, argv, "f:i:s:r:l")) != -1) {
+        switch (opt) {
+        case 'f': path = optarg; break;
+        case 'i': ifname = optarg; break;
+        case 's': window_sec = strtoull(optarg, NULL, 10); break;
+        case 'l': list = 1; break;
+        case 'r':
+            for (int i = 0; i < TH_NRINGS; i++)
+                if (strcmp(optarg, th_ring_names[i]) == 0)
+                    ring = i;
+            if (ring < 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!path || (!list && (!ifname || window_sec == 0))) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    th_store st;
+    if (th_open_reader(&st, path) == -1) {
+        perror("Failed to open history file");
+        return EXIT_FAILURE;
+    }
+
+    // 单调时钟跨重启不可比
+    char boot_id[sizeof(st.hdr->boot_id)];
+    th_read_boot_id(boot_id, sizeof(boot_id));
+    if (strcmp(boot_id, st.hdr->boot_id) != 0)
+        fprintf(stderr, "Warning: history file was written before the last reboot\n");
+
+    if (list) {
+        list_rings(&st);
+        th_close(&st);
+        return EXIT_SUCCESS;
+    }
+
+    // 历史文件按ifindex记录，名称在本机解析
+    char *endp;
+    uint32_t ifindex = strtoul(ifname, &endp, 10);
+    if (*endp != '\0' || ifindex == 0)
+        ifindex = if_nametoindex(ifname);
+    if (ifindex == 0) {
+        fprintf(stderr, "Unknown interface: %s\n", ifname);
+        th_close(&st);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t now = th_mono_ns();
+    uint64_t window_ns = window_sec * 1000000000ULL;
+    uint64_t from = now > window_ns ? now - window_ns : 0;
+    if (ring < 0)
+        ring = pick_ring(&st, window_ns, from);
+
+    QueryResult res = {0};
+    if (ring == TH_RAW)
+        query_raw(&st, ifindex, from, &res);
+    else
+        query_rollup(&st, ring, ifindex, from, &res);
+    print_result(ifname, window_sec, ring, &res);
+
+    th_close(&st);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,249 @@
+#ifndef TRAFFIC_SHM_H
+#define TRAFFIC_SHM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <net/if.h>
+#include <linux/if_link.h>
+
+/*
+ * 网卡实时统计的共享内存发布（POSIX shm + 每槽位seqlock）
+ * 写端（netlink_traffic -S）每轮采样后更新各网卡所在槽位；
+ * 读端映射后直接读取，无系统调用、不加锁，也不会阻塞写端：
+ *   seq为奇数表示写入中；读前后两次seq相同且为偶数即为一致快照。
+ */
+#define TS_MAGIC        "NLTSHM01"
+#define TS_VERSION      1
+#define TS_READ_RETRIES 1000      // 读端单槽位最大重试次数
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ts_cpu_relax() __builtin_ia32_pause()
+#else
+#define ts_cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t nslots;              // 槽位总数
+    uint32_t slot_size;           // sizeof(ts_slot)，用于版本兼容检查
+    uint32_t writer_pid;          // 写端进程号，退出时清0
+    uint64_t interval_ns;         // 写端采样间隔
+    uint64_t generation;          // 每轮采样结束后递增
+} __attribute__((aligned(64))) ts_header;
+
+// 每个槽位独占缓存行，避免不同网卡之间的伪共享
+typedef struct {
+    uint32_t seq;                 // seqlock序号
+    uint32_t ifindex;             // 0表示空闲槽位
+    char ifname[IF_NAMESIZE];
+    uint64_t ts_ns;               // 采样时间（CLOCK_MONOTONIC）
+    double rx_bps, tx_bps;        // 速率（B/s）
+    double rx_pps, tx_pps;        // 速率（包/秒）
+    struct rtnl_link_stats64 stats;
+} __attribute__((aligned(64))) ts_slot;
+
+typedef struct {
+    int fd;
+    size_t size;
+    ts_header *hdr;
+    ts_slot *slots;
+    // 以下仅写端使用
+    char name[NAME_MAX];
+    uint32_t *free_list;          // 空闲槽位栈
+    uint32_t nfree;
+} ts_shm;
+
+static inline size_t ts_shm_size(uint32_t nslots) {
+    return sizeof(ts_header) + (size_t)nslots * sizeof(ts_slot);
+}
+
+/**
+ * 写端创建（或重建）共享内存段
+ * @param name    shm名称，如 "/netlink_traffic"
+ * @param nslots  最多发布的网卡数
+ * @return 成功返回0，失败返回-1
+ */
+static inline int ts_create(ts_shm *shm, const char *name, uint32_t nslots,
+                            uint64_t interval_ns) {
+    memset(shm, 0, sizeof(*shm));
+    shm->fd = -1;
+    snprintf(shm->name, sizeof(shm->name), "%s", name);
+    shm->size = ts_shm_size(nslots);
+    shm->free_list = malloc(nslots * sizeof(uint32_t));
+    if (!shm->free_list)
+        return -1;
+
+    // 先删除旧段，已映射旧段的读端不受影响，重新打开即可看到新段
+    shm_unlink(name);
+    shm->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (shm->fd == -1 || ftruncate(shm->fd, shm->size) == -1)
+        goto fail;
+
+    void *p = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (p == MAP_FAILED)
+        goto fail;
+    shm->hdr = p;
+    shm->slots = (ts_slot *)((uint8_t *)p + sizeof(ts_header));
+
+    for (uint32_t i = 0; i < nslots; i++)
+        shm->free_list[i] = nslots - 1 - i;
+    shm->nfree = nslots;
+
+    shm->hdr->version = TS_VERSION;
+    shm->hdr->nslots = nslots;
+    shm->hdr->slot_size = sizeof(ts_slot);
+    shm->hdr->writer_pid = getpid();
+    shm->hdr->interval_ns = interval_ns;
+    // magic最后写入，读端看到magic即可认为头部有效
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(shm->hdr->magic, TS_MAGIC, sizeof(shm->hdr->magic));
+    return 0;
+
+fail:
+    if (shm->fd != -1)
+        close(shm->fd);
+    free(shm->free_list);
+    shm_unlink(name);
+    return -1;
+}
+
+// 写端退出：标记写端已停止并删除段名
+static inline void ts_destroy(ts_shm *shm) {
+    if (shm->hdr) {
+        __atomic_store_n(&shm->hdr->writer_pid, 0, __ATOMIC_RELEASE);
+        munmap(shm->hdr, shm->size);
+    }
+    if (shm->fd != -1)
+        close(shm->fd);
+    shm_unlink(shm->name);
+    free(shm->free_list);
+    memset(shm, 0, sizeof(*shm));
+}
+
+// 为新网卡分配槽位，槽位耗尽返回-1
+static inline int ts_slot_alloc(ts_shm *shm) {
+    return shm->nfree ? (int)shm->free_list[--shm->nfree] : -1;
+}
+
+static inline void ts_write_begin(ts_slot *s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    // 保证seq变为奇数先于后续数据写入对读端可见
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void ts_write_end(ts_slot *s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+// 网卡删除后释放槽位
+static inline void ts_slot_free(ts_shm *shm, int idx) {
+    ts_slot *s = &shm->slots[idx];
+    ts_write_begin(s);
+    s->ifindex = 0;
+    s->ifname[0] = '\0';
+    ts_write_end(s);
+    shm->free_list[shm->nfree++] = idx;
+}
+
+// 一轮采样结束，通知读端有新数据
+static inline void ts_publish_generation(ts_shm *shm) {
+    __atomic_store_n(&shm->hdr->generation, shm->hdr->generation + 1, __ATOMIC_RELEASE);
+}
+
+/* ---------------- 读端接口 ---------------- */
+
+// 读端只读映射共享内存段
+static inline int ts_open(ts_shm *shm, const char *name) {
+    memset(shm, 0, sizeof(*shm));
+    shm->fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (shm->fd == -1)
+        return -1;
+
+    struct stat sb;
+    if (fstat(shm->fd, &sb) == -1 || (size_t)sb.st_size < sizeof(ts_header))
+        goto fail;
+    void *p = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, shm->fd, 0);
+    if (p == MAP_FAILED)
+        goto fail;
+    shm->hdr = p;
+    shm->size = sb.st_size;
+    shm->slots = (ts_slot *)((uint8_t *)p + sizeof(ts_header));
+
+    const ts_header *h = shm->hdr;
+    if (memcmp(h->magic, TS_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != TS_VERSION || h->slot_size != sizeof(ts_slot) ||
+        ts_shm_size(h->nslots) > shm->size) {
+        munmap(p, sb.st_size);
+        errno = EINVAL;
+        goto fail;
+    }
+    return 0;
+
+fail:
+    close(shm->fd);
+    shm->fd = -1;
+    return -1;
+}
+
+static inline void ts_close(ts_shm *shm) {
+    if (shm->hdr)
+        munmap(shm->hdr, shm->size);
+    if (shm->fd != -1)
+        close(shm->fd);
+    memset(shm, 0, sizeof(*shm));
+    shm->fd = -1;
+}
+
+/**
+ * 读取单个槽位的一致快照
+ * @return 1 有效网卡；0 空闲槽位；-1 重试耗尽（写端持续写入或已异常退出）
+ */
+static inline int ts_read_slot(const ts_shm *shm, uint32_t idx, ts_slot *out) {
+    const ts_slot *s = &shm->slots[idx];
+    for (int i = 0; i < TS_READ_RETRIES; i++) {
+        uint32_t seq1 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (seq1 & 1) {
+            ts_cpu_relax();
+            continue;
+        }
+        memcpy(out, s, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t seq2 = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+        if (seq1 == seq2) {
+            out->seq = seq1;
+            return out->ifindex != 0;
+        }
+    }
+    return -1;
+}
+
+// 按名称查找网卡快照，找到返回1
+static inline int ts_find(const ts_shm *shm, const char *ifname, ts_slot *out) {
+    for (uint32_t i = 0; i < shm->hdr->nslots; i++) {
+        if (ts_read_slot(shm, i, out) == 1 &&
+            strncmp(out->ifname, ifname, IF_NAMESIZE) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static inline int ts_writer_alive(const ts_shm *shm) {
+    uint32_t pid = __atomic_load_n(&shm->hdr->writer_pid, __ATOMIC_ACQUIRE);
+    return pid != 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+static inline uint64_t ts_generation(const ts_shm *shm) {
+    return __atomic_load_n(&shm->hdr->generation, __ATOMIC_ACQUIRE);
+}
+
+#endif // TRAFFIC_SHM_H
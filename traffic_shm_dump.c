@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "traffic_shm.h"
+
+// 读取netlink_traffic -S 发布的共享内存，打印各网卡实时速率（不发起任何netlink请求）
+// -T 为seqlock压力测试：一个写进程反复改写私有段，多个读进程校验快照没有撕裂
+#define DEFAULT_SHM_NAME "/netlink_traffic"
+#define STRESS_SLOTS     64
+#define STRESS_READERS   4
+#define STRESS_SECONDS   5
+
+static volatile sig_atomic_t keep_running = 1;
+
+void sigint_handler(int sig) {
+    keep_running = 0;
+}
+
+static void print_slot(const ts_slot *s) {
+    printf("%-16s %8u %14.2f %14.2f %12.1f %12.1f %12llu %12llu\n",
+           s->ifname, s->ifindex, s->rx_bps / 1024, s->tx_bps / 1024,
+           s->rx_pps, s->tx_pps,
+           (unsigned long long)(s->stats.rx_dropped + s->stats.rx_missed_errors),
+           (unsigned long long)s->stats.tx_dropped);
+}
+
+// 打印一次快照；ifname非NULL时只打印该网卡
+static int dump_once(const ts_shm *shm, const char *ifname) {
+    ts_slot snap;
+    int found = 0, torn = 0;
+
+    printf("%-16s %8s %14s %14s %12s %12s %12s %12s\n", "Interface", "Index",
+           "RX KB/s", "TX KB/s", "RX pkt/s", "TX pkt/s", "RX drop", "TX drop");
+    for (uint32_t i = 0; i < shm->hdr->nslots; i++) {
+        int ret = ts_read_slot(shm, i, &snap);
+        if (ret < 0) {
+            torn++;
+            continue;
+        }
+        if (ret == 0 || (ifname && strncmp(snap.ifname, ifname, IF_NAMESIZE) != 0))
+            continue;
+        print_slot(&snap);
+        found++;
+    }
+    if (torn)
+        fprintf(stderr, "%d slots busy, skipped\n", torn);
+    return found;
+}
+
+/* ---------------- 压力测试 ---------------- */
+
+typedef struct {
+    uint64_t reads, live, free, busy, torn;
+} __attribute__((aligned(64))) StressCounters;
+
+// 槽位的每个字段都由同一个代数g推出，读到的快照只要有一个字段对不上就是撕裂
+static void stress_fill(ts_slot *s, uint32_t idx, uint64_t g) {
+    s->ifindex = idx + 1;
+    snprintf(s->ifname, sizeof(s->ifname), "s%x", (unsigned)g);
+    s->ts_ns = g;
+    s->rx_bps = (double)g;
+    s->tx_bps = (double)g + 1;
+    s->rx_pps = (double)g + 2;
+    s->tx_pps = (double)g + 3;
+    uint64_t *c = (uint64_t *)&s->stats;
+    for (size_t i = 0; i < sizeof(s->stats) / sizeof(*c); i++)
+        c[i] = g * 131 + i;
+}
+
+static int stress_valid(const ts_slot *snap, uint32_t idx) {
+    ts_slot want;
+    stress_fill(&want, idx, snap->ts_ns);
+    return snap->ifindex == want.ifindex &&
+           strncmp(snap->ifname, want.ifname, IF_NAMESIZE) == 0 &&
+           snap->rx_bps == want.rx_bps && snap->tx_bps == want.tx_bps &&
+           snap->rx_pps == want.rx_pps && snap->tx_pps == want.tx_pps &&
+           memcmp(&snap->stats, &want.stats, sizeof(want.stats)) == 0;
+}
+
+// 读进程：独立打开并映射段，反复读取全部槽位直到stop置位
+static void stress_reader(const char *name, StressCounters *cnt, const volatile int *stop) {
+    ts_shm shm;
+    if (ts_open(&shm, name) == -1) {
+        perror("ts_open");
+        _exit(EXIT_FAILURE);
+    }
+    ts_slot snap;
+    while (!*stop) {
+        for (uint32_t i = 0; i < shm.hdr->nslots; i++) {
+            int ret = ts_read_slot(&shm, i, &snap);
+            cnt->reads++;
+            if (ret < 0)
+                cnt->busy++;
+            else if (ret == 0 && snap.ifname[0] == '\0')
+                cnt->free++;
+            else if (ret == 1 && stress_valid(&snap, i))
+                cnt->live++;
+            else
+                cnt->torn++;
+        }
+    }
+    ts_close(&shm);
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * 写进程连续改写所有槽位并不时释放/重新分配，读进程校验每个快照
+ * @return 没有撕裂返回0
+ */
+static int stress_test(int nreaders, int seconds) {
+    char name[64];
+    snprintf(name, sizeof(name), "/traffic_shm_stress-%d", (int)getpid());
+    ts_shm shm;
+    if (ts_create(&shm, name, STRESS_SLOTS, 0) == -1) {
+        perror("ts_create");
+        return -1;
+    }
+    // 读进程计数与停止标志放在共享匿名映射中
+    size_t ctl_size = sizeof(StressCounters) * (nreaders + 1);
+    void *ctl = mmap(NULL, ctl_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ctl == MAP_FAILED) {
+        perror("mmap");
+        ts_destroy(&shm);
+        return -1;
+    }
+    volatile int *stop = ctl;
+    StressCounters *cnt = (StressCounters *)ctl + 1;
+
+    int idx[STRESS_SLOTS];
+    for (int i = 0; i < STRESS_SLOTS; i++)
+        idx[i] = ts_slot_alloc(&shm);
+
+    pid_t pids[nreaders];
+    for (int r = 0; r < nreaders; r++) {
+        if ((pids[r] = fork()) == 0)
+            stress_reader(name, &cnt[r], stop);
+        if (pids[r] == -1) {
+            perror("fork");
+            nreaders = r;
+            *stop = 1;
+            break;
+        }
+    }
+
+    struct timespec t0, now;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t g = 0, writes = 0, frees = 0;
+    do {
+        for (int i = 0; i < STRESS_SLOTS; i++) {
+            g++;
+            // 每隔一段时间释放一个槽位，下一轮再分配，覆盖ts_slot_free的清空路径
+            if (idx[i] >= 0 && g % 97 == 0) {
+                ts_slot_free(&shm, idx[i]);
+                idx[i] = -1;
+                frees++;
+                continue;
+            }
+            if (idx[i] < 0 && (idx[i] = ts_slot_alloc(&shm)) < 0)
+                continue;
+            ts_slot *s = &shm.slots[idx[i]];
+            ts_write_begin(s);
+            stress_fill(s, idx[i], g);
+            ts_write_end(s);
+            writes++;
+        }
+        ts_publish_generation(&shm);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (!*stop && now.tv_sec - t0.tv_sec < seconds);
+
+    *stop = 1;
+    int failed = 0;
+    for (int r = 0; r < nreaders; r++) {
+        int status;
+        if (waitpid(pids[r], &status, 0) == -1 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != EXIT_SUCCESS)
+            failed++;
+    }
+
+    StressCounters sum = {0};
+    for (int r = 0; r < nreaders; r++) {
+        sum.reads += cnt[r].reads;
+        sum.live += cnt[r].live;
+        sum.free += cnt[r].free;
+        sum.busy += cnt[r].busy;
+        sum.torn += cnt[r].torn;
+    }
+    printf("writes=%llu frees=%llu readers=%d reads=%llu live=%llu free=%llu busy=%llu torn=%llu\n",
+           (unsigned long long)writes, (unsigned long long)frees, nreaders,
+           (unsigned long long)sum.reads, (unsigned long long)sum.live,
+           (unsigned long long)sum.free, (unsigned long long)sum.busy,
+           (unsigned long long)sum.torn);
+    munmap(ctl, ctl_size);
+    ts_destroy(&shm);
+    if (failed)
+        fprintf(stderr, "%d readers failed\n", failed);
+    return sum.torn || failed || nreaders == 0 ? -1 : 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n shm_name] [-w] [ifname]\n"
+            "       %s -T [-t readers] [-s seconds]\n"
+            "  -n name  共享内存名称（默认%s）\n"
+            "  -w       每轮采样后刷新输出\n"
+            "  -T       seqlock压力测试：发现撕裂的快照时以非0退出\n"
+            "  -t       读进程数（默认%d）\n"
+            "  -s       测试时长（秒，默认%d）\n",
+            prog, prog, DEFAULT_SHM_NAME, STRESS_READERS, STRESS_SECONDS);
+}
+
+int main(int argc, char **argv) {
+    const char *name = DEFAULT_SHM_NAME;
+    int watch = 0, stress = 0, nreaders = STRESS_READERS, seconds = STRESS_SECONDS, opt;
+
+    while ((opt = getopt(argc, argv, "n:wTt:s:")) != -1) {
+        switch (opt) {
+        case 'n': name = optarg; break;
+        case 'w': watch = 1; break;
+        case 'T': stress = 1; break;
+        case 't': nreaders = atoi(optarg); break;
+        case 's': seconds = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (stress) {
+        if (nreaders < 1 || seconds < 1) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return stress_test(nreaders, seconds) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    const char *ifname = optind < argc ? argv[optind] : NULL;
+
+    ts_shm shm;
+    if (ts_open(&shm, name) == -1) {
+        perror("Failed to open shared memory");
+        return EXIT_FAILURE;
+    }
+    if (!ts_writer_alive(&shm))
+        fprintf(stderr, "Warning: writer is not running, data may be stale\n");
+
+    signal(SIGINT, sigint_handler);
+
+    int found = dump_once(&shm, ifname);
+    if (watch) {
+        // 写端每轮结束递增generation，按采样间隔轮询即可
+        useconds_t poll_us = shm.hdr->interval_ns / 1000 / 4;
+        uint64_t gen = ts_generation(&shm);
+        while (keep_running && ts_writer_alive(&shm)) {
+            usleep(poll_us ? poll_us : 1000);
+            uint64_t cur = ts_generation(&shm);
+            if (cur == gen)
+                continue;
+            gen = cur;
+            printf("\n");
+            found = dump_once(&shm, ifname);
+        }
+    }
+
+    ts_close(&shm);
+    if (ifname && !found) {
+        fprintf(stderr, "Interface %s not published\n", ifname);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+#ifndef UEVENT_FILTER_H
+#define UEVENT_FILTER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+/*
+ * uevent订阅过滤：把子系统/动作白名单编译成经典BPF，挂到NETLINK_KOBJECT_UEVENT socket上，
+ * 不匹配的事件在内核中直接丢弃，不拷贝也不唤醒进程。
+ * 只适用于内核消息（多播组1），其格式固定为：
+ *   "action@devpath\0" "ACTION=action\0" "DEVPATH=devpath\0" "SUBSYSTEM=subsys\0" ...
+ * 设首行长度（含'\0'）为H，则action长A、devpath长D满足 H = A + D + 2，
+ * SUBSYSTEM=位于 H + (A+8) + (D+9) = 2H + 15 处。
+ * cBPF没有循环，H由展开的按字扫描求出（has-zero-byte技巧：(v - 0x01010101) & ~v & 0x80808080）。
+ * 格式与预期不符（首行超出扫描范围、字段顺序不同）时放行，由用户态过滤兜底。
+ */
+#define UF_MAX_INSNS    BPF_MAXINSNS
+#define UF_SCAN_BYTES   512             // 首行'\0'的最大扫描范围
+#define UF_MAX_ITEMS    16              // 每类白名单的最大条目数
+#define UF_MAX_NAME     32              // 子系统/动作名最大长度（不含'\0'）
+#define UF_ACCEPT       0xffffffff
+#define UF_DROP         0
+
+typedef struct {
+    const char *subsystems[UF_MAX_ITEMS];
+    int nsubsystems;
+    const char *actions[UF_MAX_ITEMS];
+    int nactions;
+} uf_spec;
+
+typedef struct {
+    struct sock_filter insns[UF_MAX_INSNS];
+    unsigned n;
+    int overflow;
+} uf_prog;
+
+static inline void uf_emit(uf_prog *p, uint16_t code, uint8_t jt, uint8_t jf, uint32_t k) {
+    if (p->n >= UF_MAX_INSNS) {
+        p->overflow = 1;
+        return;
+    }
+    p->insns[p->n++] = (struct sock_filter)BPF_JUMP(code, k, jt, jf);
+}
+
+// 比较len字节所需的加载次数（按4/2/1字节分段）
+static inline unsigned uf_chunks(size_t len) {
+    return len / 4 + (len % 4) / 2 + (len % 2);
+}
+
+/*
+ * 比较 [base+off, base+off+len) 是否等于 s；mode为BPF_ABS（绝对偏移）或BPF_IND（相对X）
+ * 不相等时跳过本段之后的skip条指令
+ */
+static inline void uf_emit_cmp(uf_prog *p, int mode, uint32_t off, const char *s,
+                               size_t len, unsigned skip) {
+    unsigned left = uf_chunks(len);
+    size_t i = 0;
+    while (i < len) {
+        uint16_t size;
+        uint32_t v;
+        size_t step;
+        // cBPF按网络字节序加载，即缓冲区中第一个字节为最高位
+        if (len - i >= 4) {
+            size = BPF_W;
+            step = 4;
+            v = (uint8_t)s[i] << 24 | (uint8_t)s[i + 1] << 16 |
+                (uint8_t)s[i + 2] << 8 | (uint8_t)s[i + 3];
+        } else if (len - i >= 2) {
+            size = BPF_H;
+            step = 2;
+            v = (uint8_t)s[i] << 8 | (uint8_t)s[i + 1];
+        } else {
+            size = BPF_B;
+            step = 1;
+            v = (uint8_t)s[i];
+        }
+        left--;
+        uf_emit(p, BPF_LD | size | mode, 0, 0, off + i);
+        uf_emit(p, BPF_JMP | BPF_JEQ | BPF_K, 0, left * 2 + skip, v);
+        i += step;
+    }
+}
+
+/*
+ * 候选值比较：值紧跟终止符term（动作为'@'，子系统为'\0'）
+ * 任一命中则继续执行后续指令，全不命中则返回UF_DROP
+ */
+static inline void uf_emit_alternatives(uf_prog *p, int mode, uint32_t off,
+                                        const char *const *vals, int n, char term) {
+    char buf[UF_MAX_NAME + 1];
+    unsigned sizes[UF_MAX_ITEMS], total = 1;   // 末尾的ret DROP
+
+    for (int i = 0; i < n; i++) {
+        sizes[i] = uf_chunks(strlen(vals[i]) + 1) * 2 + 1;  // 比较 + 命中跳转
+        total += sizes[i];
+    }
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(vals[i]);
+        memcpy(buf, vals[i], len);
+        buf[len] = term;
+        total -= sizes[i];
+        // 不匹配时跳过本候选的"ja"，落到下一候选
+        uf_emit_cmp(p, mode, off, buf, len + 1, 1);
+        uf_emit(p, BPF_JMP | BPF_JA, 0, 0, total);
+    }
+    uf_emit(p, BPF_RET | BPF_K, 0, 0, UF_DROP);
+}
+
+// 校验X处的固定字段名，不符时放行（交给用户态）
+static inline void uf_emit_expect(uf_prog *p, const char *name) {
+    size_t len = strlen(name);
+    uf_emit_cmp(p, BPF_IND, 0, name, len, 1);
+    uf_emit(p, BPF_JMP | BPF_JA, 0, 0, 1);
+    uf_emit(p, BPF_RET | BPF_K, 0, 0, UF_ACCEPT);
+}
+
+/**
+ * 编译过滤程序
+ * @return 成功返回0；名称过长或条目过多返回-1
+ */
+static inline int uf_compile(const uf_spec *spec, uf_prog *p) {
+    p->n = 0;
+    p->overflow = 0;
+    if (spec->nactions > UF_MAX_ITEMS || spec->nsubsystems > UF_MAX_ITEMS)
+        return -1;
+    for (int i = 0; i < spec->nactions; i++)
+        if (strlen(spec->actions[i]) > UF_MAX_NAME)
+            return -1;
+    for (int i = 0; i < spec->nsubsystems; i++)
+        if (strlen(spec->subsystems[i]) > UF_MAX_NAME)
+            return -1;
+
+    // 动作在首行开头，直接按绝对偏移比较 "action@"
+    if (spec->nactions)
+        uf_emit_alternatives(p, BPF_ABS, 0, spec->actions, spec->nactions, '@');
+
+    if (spec->nsubsystems) {
+        // 1. 按字扫描首行的'\0'，命中后X = 该字偏移，跳到逐字节定位
+        unsigned nwords = UF_SCAN_BYTES / 4;
+        unsigned resolve = p->n + nwords * 10 + 1;
+        for (unsigned w = 0; w < nwords; w++) {
+            uint32_t k = w * 4;
+            uf_emit(p, BPF_LD | BPF_W | BPF_ABS, 0, 0, k);
+            uf_emit(p, BPF_ALU | BPF_XOR | BPF_K, 0, 0, 0xffffffff);
+            uf_emit(p, BPF_MISC | BPF_TAX, 0, 0, 0);
+            uf_emit(p, BPF_LD | BPF_W | BPF_ABS, 0, 0, k);
+            uf_emit(p, BPF_ALU | BPF_SUB | BPF_K, 0, 0, 0x01010101);
+            uf_emit(p, BPF_ALU | BPF_AND | BPF_X, 0, 0, 0);
+            uf_emit(p, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x80808080);
+            uf_emit(p, BPF_JMP | BPF_JEQ | BPF_K, 2, 0, 0);
+            uf_emit(p, BPF_LDX | BPF_W | BPF_IMM, 0, 0, k);
+            uf_emit(p, BPF_JMP | BPF_JA, 0, 0, resolve - p->n - 1);
+        }
+        // 扫描范围内没有'\0'：首行过长，放行
+        uf_emit(p, BPF_RET | BPF_K, 0, 0, UF_ACCEPT);
+
+        // 2. 在该字内逐字节定位，A = H（'\0'偏移+1）
+        unsigned have_h = p->n + 4 * 5 + 1;
+        for (unsigned i = 0; i < 4; i++) {
+            uf_emit(p, BPF_LD | BPF_B | BPF_IND, 0, 0, i);
+            uf_emit(p, BPF_JMP | BPF_JEQ | BPF_K, 0, 3, 0);
+            uf_emit(p, BPF_MISC | BPF_TXA, 0, 0, 0);
+            uf_emit(p, BPF_ALU | BPF_ADD | BPF_K, 0, 0, i + 1);
+            uf_emit(p, BPF_JMP | BPF_JA, 0, 0, have_h - p->n - 1);
+        }
+        uf_emit(p, BPF_RET | BPF_K, 0, 0, UF_ACCEPT);
+
+        // 3. 确认字段顺序，X = 2H + 15 指向SUBSYSTEM=
+        uf_emit(p, BPF_MISC | BPF_TAX, 0, 0, 0);
+        uf_emit_expect(p, "ACTION=");
+        uf_emit(p, BPF_MISC | BPF_TXA, 0, 0, 0);
+        uf_emit(p, BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0);
+        uf_emit(p, BPF_ALU | BPF_ADD | BPF_K, 0, 0, 15);
+        uf_emit(p, BPF_MISC | BPF_TAX, 0, 0, 0);
+        uf_emit_expect(p, "SUBSYSTEM=");
+
+        // 4. 比较子系统取值
+        uf_emit_alternatives(p, BPF_IND, strlen("SUBSYSTEM="),
+                             spec->subsystems, spec->nsubsystems, '\0');
+    }
+
+    uf_emit(p, BPF_RET | BPF_K, 0, 0, UF_ACCEPT);
+    return p->overflow ? -1 : 0;
+}
+
+// 编译并挂载到socket；没有任何条件时不挂载
+static inline int uf_attach(int sock, const uf_spec *spec) {
+    if (!spec->nactions && !spec->nsubsystems)
+        return 0;
+
+    static uf_prog prog;
+    if (uf_compile(spec, &prog) == -1)
+        return -1;
+    struct sock_fprog fprog = { .len = prog.n, .filter = prog.insns };
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+}
+
+// 用户态过滤：用于重扫合成的事件及BPF放行的非常规消息
+static inline int uf_match(const uf_spec *spec, const char *action, size_t alen,
+                           const char *subsystem, size_t slen) {
+    int ok = spec->nactions == 0;
+    for (int i = 0; i < spec->nactions && !ok; i++)
+        ok = strlen(spec->actions[i]) == alen && memcmp(spec->actions[i], action, alen) == 0;
+    if (!ok)
+        return 0;
+    ok = spec->nsubsystems == 0;
+    for (int i = 0; i < spec->nsubsystems && !ok; i++)
+        ok = strlen(spec->subsystems[i]) == slen &&
+             memcmp(spec->subsystems[i], subsystem, slen) == 0;
+    return ok;
+}
+
+#endif // UEVENT_FILTER_H
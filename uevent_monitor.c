@@ -1,56 +1,813 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <limits.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <spawn.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include <linux/netlink.h>
 
-#define UEVENT_BUFFER_SIZE 2048  // 足够大的缓冲区存储uevent消息
+#include "uevent_parser.h"
+#include "uevent_filter.h"
+#include "uevent_rules.h"
+#include "mpmc_queue.h"
+
+#define UEVENT_BUFFER_SIZE 8192  // 单条uevent缓冲区（内核uevent上限2048，libudev消息上限8K）
+#define UEVENT_BATCH       64    // 单次recvmmsg最多接收的消息数
+#define DEFAULT_RCVBUF     (16 * 1024 * 1024)  // 默认socket接收缓冲区，扛住大批量热插拔
+#define SYSFS_DEVICES      "/sys/devices"
+#define DEFAULT_WORKERS    4     // 规则动作的工作线程数
+#define DEFAULT_WINDOW_MS  200   // 同一DEVPATH的事件合并窗口
+#define MAX_HOLD_WINDOWS   4     // 持续抖动的设备最多推迟的窗口数，防止永不触发
+#define JOB_QUEUE_SIZE     1024  // 待执行任务队列容量（2的幂）
+#define COALESCE_SLOTS     4096  // 合并表槽位数（2的幂），最多使用3/4
 static volatile sig_atomic_t running = 1;
 
+extern char **environ;
+
+// 接收统计
+static struct {
+    unsigned long received;      // 成功接收的消息
+    unsigned long truncated;     // 超过缓冲区被截断的消息（MSG_TRUNC）
+    unsigned long overflows;     // socket缓冲区溢出次数（ENOBUFS），期间事件已丢失
+    unsigned long resyncs;       // 因丢失事件触发的/sys重扫次数
+    unsigned long resynced;      // 重扫时补发的设备事件数
+    unsigned long foreign;       // 非内核发送者的消息（已忽略）
+    unsigned long malformed;     // 格式无效的消息
+    unsigned long filtered;      // BPF放行但被用户态过滤掉的消息
+    unsigned long coalesced;     // 被同一设备后续事件合并掉的事件
+    unsigned long dispatched;    // 提交给工作线程的任务
+    unsigned long deferred;      // 任务队列满而推迟提交的次数
+    unsigned long dropped;       // 合并表满而丢弃的事件
+    unsigned long failed;        // 执行失败的RUN命令（工作线程原子累加）
+} stats;
+static int verbose;
+static int quiet;                // -q：不打印事件（只执行规则）
+static uf_spec filter;           // --subsystem/--action 白名单
+
 // 利用Netlink处理linux下的硬件设备热插拔等
 // 信号处理：优雅退出
-void sigint_handler(int sig) {
+static void sigint_handler(int sig) {
     running = 0;
 }
 
+// 交给工作线程的事件副本
+typedef struct {
+    uint64_t rules;              // 命中规则掩码
+    uint64_t hash;               // DEVPATH哈希
+    uint32_t coalesced;          // 本次处理合并的事件数（含自身）
+    uint32_t devpath_off, devpath_len;
+    uint32_t len;
+    char buf[];                  // 消息副本，末尾补'\0'，值都以'\0'结尾可直接作环境变量
+} Job;
+
+// 按DEVPATH合并的待处理事件，只由主线程访问
+typedef struct {
+    uint64_t hash;               // 0表示空槽
+    Job *latest;                 // 窗口内最新的事件，NULL表示无待处理
+    uint64_t first_ns, last_ns;
+    uint32_t count;
+    int busy;                    // 该设备的任务在执行中，期间的事件继续合并，完成后再提交
+} Pending;
+
+static struct {
+    ur_ruleset rules;
+    uint64_t window_ns;
+    int nworkers;
+    pthread_t *threads;
+    mpmc_queue jobs;             // 主线程 -> 工作线程
+    mpmc_queue done;             // 工作线程 -> 主线程，归还已执行的任务
+    sem_t jobs_sem;
+    int done_fd;                 // eventfd，工作线程完成任务时唤醒主线程
+    volatile int stop;
+    uint32_t used;
+    uint64_t next_due;           // 最早到期时间，可能偏早（到期时重新扫描）
+    Pending slots[COALESCE_SLOTS];
+} disp = { .done_fd = -1 };
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// FNV-1a，结果不为0（0表示空槽）
+static uint64_t devpath_hash(const char *s, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+/*
+ * 查找设备所在槽位；不存在时返回可插入的空槽，表满返回-1
+ * 按哈希比较即可：DEVPATH不同而64位哈希相同的概率可以忽略
+ */
+static int pending_lookup(uint64_t hash) {
+    uint32_t mask = COALESCE_SLOTS - 1;
+    for (uint32_t i = hash & mask, n = 0; n < COALESCE_SLOTS; i = (i + 1) & mask, n++) {
+        if (disp.slots[i].hash == hash || disp.slots[i].hash == 0)
+            return i;
+    }
+    return -1;
+}
+
+// 删除槽位，后移删除法保持探测链连续
+static void pending_remove(uint32_t i) {
+    uint32_t mask = COALESCE_SLOTS - 1;
+    memset(&disp.slots[i], 0, sizeof(Pending));
+    disp.used--;
+    for (uint32_t j = (i + 1) & mask; disp.slots[j].hash; j = (j + 1) & mask) {
+        uint32_t home = disp.slots[j].hash & mask;
+        // home不在(i, j]之间时，j处的元素可以前移到i
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            disp.slots[i] = disp.slots[j];
+            memset(&disp.slots[j], 0, sizeof(Pending));
+            i = j;
+        }
+    }
+}
+
+// 去抖：最后一次事件后静默一个窗口再触发，但距第一次事件不超过MAX_HOLD_WINDOWS个窗口
+static uint64_t pending_deadline(const Pending *p) {
+    uint64_t quiet_at = p->last_ns + disp.window_ns;
+    uint64_t hold_at = p->first_ns + disp.window_ns * MAX_HOLD_WINDOWS;
+    return quiet_at < hold_at ? quiet_at : hold_at;
+}
+
+// 命中规则的事件按DEVPATH合并，只保留最新的一条（反映设备的最终状态）
+static void coalesce_event(const char *buf, size_t len, const ue_event *ev) {
+    uint64_t rules = ur_match(&disp.rules, ev);
+    if (!rules)
+        return;
+
+    ue_str devpath = ue_devpath(ev);
+    uint64_t hash = devpath_hash(devpath.ptr, devpath.len);
+    int idx = pending_lookup(hash);
+    if (idx == -1 || (disp.slots[idx].hash == 0 && disp.used >= COALESCE_SLOTS / 4 * 3)) {
+        stats.dropped++;
+        return;
+    }
+
+    Job *job = malloc(sizeof(Job) + len + 1);
+    if (!job) {
+        stats.dropped++;
+        return;
+    }
+    memcpy(job->buf, buf, len);
+    job->buf[len] = '\0';
+    job->len = len;
+    job->rules = rules;
+    job->hash = hash;
+    job->devpath_off = devpath.ptr - buf;
+    job->devpath_len = devpath.len;
+
+    uint64_t now = mono_ns();
+    Pending *p = &disp.slots[idx];
+    if (p->hash == 0) {
+        p->hash = hash;
+        disp.used++;
+    }
+    if (p->latest) {
+        free(p->latest);
+        stats.coalesced++;
+    }
+    if (p->count == 0)
+        p->first_ns = now;
+    p->latest = job;
+    p->last_ns = now;
+    p->count++;
+
+    uint64_t due = pending_deadline(p);
+    if (due < disp.next_due)
+        disp.next_due = due;
+}
+
+// 提交到期的合并事件
+static void flush_due(void) {
+    uint64_t now = mono_ns();
+    if (now < disp.next_due)
+        return;
+
+    uint64_t next = UINT64_MAX;
+    for (uint32_t i = 0; i < COALESCE_SLOTS; i++) {
+        Pending *p = &disp.slots[i];
+        if (!p->latest || p->busy)
+            continue;
+        uint64_t due = pending_deadline(p);
+        if (due > now) {
+            if (due < next)
+                next = due;
+            continue;
+        }
+        p->latest->coalesced = p->count;
+        if (mpmc_push(&disp.jobs, p->latest) == -1) {
+            // 工作线程跟不上：留在表中继续合并，稍后重试
+            stats.deferred++;
+            if (now + disp.window_ns / 10 < next)
+                next = now + disp.window_ns / 10;
+            continue;
+        }
+        sem_post(&disp.jobs_sem);
+        stats.dispatched++;
+        p->latest = NULL;
+        p->count = 0;
+        p->busy = 1;
+    }
+    disp.next_due = next;
+}
+
+// 回收已执行的任务，解除设备的执行中标记
+static void reap_done(void) {
+    uint64_t n;
+    if (read(disp.done_fd, &n, sizeof(n)) == -1 && errno != EAGAIN)
+        perror("read eventfd");
+
+    Job *job;
+    while ((job = mpmc_pop(&disp.done))) {
+        int idx = pending_lookup(job->hash);
+        if (idx >= 0 && disp.slots[idx].hash == job->hash) {
+            Pending *p = &disp.slots[idx];
+            p->busy = 0;
+            if (!p->latest) {
+                pending_remove(idx);
+            } else {
+                uint64_t due = pending_deadline(p);
+                if (due < disp.next_due)
+                    disp.next_due = due;
+            }
+        }
+        free(job);
+    }
+}
+
+// 到最早到期事件的毫秒数，没有待处理事件时返回-1（无限等待）
+static int next_timeout_ms(void) {
+    if (disp.next_due == UINT64_MAX)
+        return -1;
+    uint64_t now = mono_ns();
+    if (disp.next_due <= now)
+        return 0;
+    return (disp.next_due - now + 999999) / 1000000;
+}
+
+// 执行RUN命令：/bin/sh -c cmd，环境变量为事件的全部键值
+static void run_command(const char *cmd, const ue_event *ev, uint32_t coalesced) {
+    char *envp[UE_MAX_KV + 3];
+    char coalesced_env[32], path_env[PATH_MAX];
+    int n = 0;
+
+    for (uint32_t i = 0; i < ev->nkv; i++)
+        envp[n++] = (char *)ev->kv[i].key.ptr;   // 副本中的 "KEY=VALUE\0"
+    snprintf(coalesced_env, sizeof(coalesced_env), "UEVENT_COALESCED=%u", coalesced);
+    envp[n++] = coalesced_env;
+    const char *path = getenv("PATH");
+    snprintf(path_env, sizeof(path_env), "PATH=%s", path ? path : "/usr/sbin:/usr/bin:/sbin:/bin");
+    envp[n++] = path_env;
+    envp[n] = NULL;
+
+    char *argv[] = { "/bin/sh", "-c", (char *)cmd, NULL };
+    pid_t pid;
+    int err = posix_spawn(&pid, "/bin/sh", NULL, NULL, argv, envp);
+    if (err) {
+        fprintf(stderr, "[RULE] spawn '%s': %s\n", cmd, strerror(err));
+        __atomic_add_fetch(&stats.failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+        ;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "[RULE] '%s' failed (status %d)\n", cmd, status);
+        __atomic_add_fetch(&stats.failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void run_job(Job *job) {
+    ue_event ev;
+    if (ue_parse(&ev, job->buf, job->len) == -1)
+        return;
+    for (int i = 0; i < disp.rules.nrules; i++) {
+        if (!(job->rules & (1ULL << i)))
+            continue;
+        const ur_rule *r = &disp.rules.rules[i];
+        for (int j = 0; j < r->nacts; j++) {
+            if (r->acts[j].type == UR_RUN)
+                run_command(r->acts[j].cmd, &ev, job->coalesced);
+            else
+                r->acts[j].fn(&ev, job->coalesced);
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    for (;;) {
+        while (sem_wait(&disp.jobs_sem) == -1 && errno == EINTR)
+            ;
+        Job *job = mpmc_pop(&disp.jobs);
+        if (!job) {
+            if (disp.stop)
+                break;
+            continue;
+        }
+        run_job(job);
+        // done队列容量与合并表相同，而每个设备同时最多一个任务在途，不会满
+        while (mpmc_push(&disp.done, job) == -1)
+            sched_yield();
+        uint64_t one = 1;
+        if (write(disp.done_fd, &one, sizeof(one)) == -1)
+            perror("write eventfd");
+    }
+    return NULL;
+}
+
+// CALL="print"：内置回调示例
+static void builtin_print(const ue_event *ev, uint32_t coalesced) {
+    ue_str action = ue_action(ev), devpath = ue_devpath(ev);
+    printf("[RULE] %.*s %.*s (%u events)\n", (int)action.len, action.ptr,
+           (int)devpath.len, devpath.ptr, coalesced);
+    fflush(stdout);
+}
+
+static const ur_builtin builtins[] = {
+    { "print", builtin_print },
+};
+
+static int dispatcher_start(const char *rules_path) {
+    if (ur_load(&disp.rules, rules_path, builtins,
+                sizeof(builtins) / sizeof(builtins[0])) == -1)
+        return -1;
+    if (mpmc_init(&disp.jobs, JOB_QUEUE_SIZE) == -1 ||
+        mpmc_init(&disp.done, COALESCE_SLOTS) == -1 ||
+        sem_init(&disp.jobs_sem, 0, 0) == -1)
+        return -1;
+    disp.done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (disp.done_fd == -1)
+        return -1;
+    disp.next_due = UINT64_MAX;
+
+    // 信号只由主线程处理，工作线程屏蔽，避免waitpid被打断
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    disp.threads = calloc(disp.nworkers, sizeof(pthread_t));
+    for (int i = 0; i < disp.nworkers; i++) {
+        if (pthread_create(&disp.threads[i], NULL, worker_main, NULL) != 0) {
+            disp.nworkers = i;
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    printf("Loaded %d rules, %d workers, coalescing window %llums\n",
+           disp.rules.nrules, disp.nworkers,
+           (unsigned long long)(disp.window_ns / 1000000));
+    return disp.nworkers > 0 ? 0 : -1;
+}
+
+// 退出：等待已提交的任务执行完，未到期的合并事件丢弃
+static void dispatcher_stop(void) {
+    disp.stop = 1;
+    for (int i = 0; i < disp.nworkers; i++)
+        sem_post(&disp.jobs_sem);
+    for (int i = 0; i < disp.nworkers; i++)
+        pthread_join(disp.threads[i], NULL);
+
+    Job *job;
+    while ((job = mpmc_pop(&disp.done)))
+        free(job);
+    unsigned long discarded = 0;
+    for (uint32_t i = 0; i < COALESCE_SLOTS; i++) {
+        if (disp.slots[i].latest) {
+            free(disp.slots[i].latest);
+            discarded++;
+        }
+    }
+    if (discarded)
+        fprintf(stderr, "[RULE] %lu pending events discarded\n", discarded);
+
+    free(disp.threads);
+    close(disp.done_fd);
+    sem_destroy(&disp.jobs_sem);
+    mpmc_destroy(&disp.jobs);
+    mpmc_destroy(&disp.done);
+    ur_free(&disp.rules);
+}
+
 // 解析uevent消息并打印关键信息
 void parse_uevent(const char *buf, ssize_t len) {
-    const char *p = buf;
-    const char *end = buf + len;
+    ue_event ev;
+    if (ue_parse(&ev, buf, len) == -1) {
+        stats.malformed++;
+        return;
+    }
+
+    ue_str action = ue_action(&ev);       // 设备动作：add/remove/bind/unbind等
+    ue_str subsystem = ue_get(&ev, UE_SUBSYSTEM);  // 设备子系统：usb/block/platform等
+    ue_str devpath = ue_devpath(&ev);     // 设备路径
+    ue_str seqnum = ue_get(&ev, UE_SEQNUM);
+    ue_str devname = ue_get(&ev, UE_DEVNAME);
 
-    char action[32] = {0};   // 设备动作：add/remove/bind/unbind等
-    char subsystem[32] = {0};// 设备子系统：usb/block/platform等
-    char devpath[256] = {0}; // 设备路径
+    // 只打印有效事件
+    if (!action.len || !subsystem.len)
+        return;
+    // 内核BPF只过滤标准格式的消息，这里再确认一次（重扫合成的事件也走这里）
+    if (!uf_match(&filter, action.ptr, action.len, subsystem.ptr, subsystem.len)) {
+        stats.filtered++;
+        return;
+    }
+    if (disp.rules.nrules)
+        coalesce_event(buf, len, &ev);
+    if (quiet)
+        return;
+    printf("[EVENT] Action: %-8.*s Subsystem: %-12.*s Path: %.*s",
+           (int)action.len, action.ptr, (int)subsystem.len, subsystem.ptr,
+           (int)devpath.len, devpath.ptr);
+    if (seqnum.len)
+        printf(" Seq: %.*s", (int)seqnum.len, seqnum.ptr);
+    if (devname.len)
+        printf(" Dev: %.*s", (int)devname.len, devname.ptr);
+    ue_str major = ue_get(&ev, UE_MAJOR), minor = ue_get(&ev, UE_MINOR);
+    if (major.len && minor.len)
+        printf(" (%.*s:%.*s)", (int)major.len, major.ptr, (int)minor.len, minor.ptr);
+    printf("\n");
+
+    // -v：列出全部键值对
+    if (verbose) {
+        for (uint32_t i = 0; i < ev.nkv; i++)
+            printf("    %.*s=%.*s\n", (int)ev.kv[i].key.len, ev.kv[i].key.ptr,
+                   (int)ev.kv[i].value.len, ev.kv[i].value.ptr);
+        if (ev.dropped)
+            printf("    ... %u more\n", ev.dropped);
+    }
+}
+
+// 为/sys下的一个设备合成add事件，格式与内核uevent一致
+static int resync_device(const char *fpath, const struct stat *sb, int type,
+                         struct FTW *ftw) {
+    if (type != FTW_F || strcmp(fpath + ftw->base, "uevent") != 0)
+        return 0;
+
+    // 没有subsystem链接的目录不是设备（与udevadm trigger的枚举范围一致）
+    char link[PATH_MAX], target[PATH_MAX];
+    snprintf(link, sizeof(link), "%.*ssubsystem", ftw->base, fpath);
+    ssize_t n = readlink(link, target, sizeof(target) - 1);
+    if (n <= 0)
+        return 0;
+    target[n] = '\0';
+
+    // DEVPATH为设备目录去掉"/sys"前缀
+    const char *devpath = fpath + strlen("/sys");
+    int devpath_len = ftw->base - 1 - (int)strlen("/sys");
+
+    char buf[UEVENT_BUFFER_SIZE];
+    int len = snprintf(buf, sizeof(buf), "add@%.*s%cACTION=add%cDEVPATH=%.*s%cSUBSYSTEM=%s%c",
+                       devpath_len, devpath, 0, 0, devpath_len, devpath, 0,
+                       basename(target), 0);
+    if (len >= (int)sizeof(buf))
+        return 0;
 
-    // 逐行解析键值对（以'\0'分隔）
-    while (p < end) {
-        if (strncmp(p, "ACTION=", 7) == 0) {
-            sscanf(p + 7, "%31[^ ]", action);
-        } else if (strncmp(p, "SUBSYSTEM=", 10) == 0) {
-            sscanf(p + 10, "%31[^ ]", subsystem);
-        } else if (strncmp(p, "DEVPATH=", 8) == 0) {
-            sscanf(p + 8, "%255[^ ]", devpath);
+    // 追加uevent文件中的其余属性，换行转为'\0'分隔
+    int fd = open(fpath, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ssize_t r = read(fd, buf + len, sizeof(buf) - len);
+        close(fd);
+        for (ssize_t i = 0; i < r; i++) {
+            if (buf[len + i] == '\n')
+                buf[len + i] = '\0';
         }
-        p += strlen(p) + 1; // 移动到下一个字段
+        if (r > 0)
+            len += r;
     }
 
-    // 只打印有效事件
-    if (action[0] && subsystem[0]) {
-        printf("[EVENT] Action: %-8s Subsystem: %-12s Path: %s\n",
-               action, subsystem, devpath);
+    parse_uevent(buf, len);
+    stats.resynced++;
+    return running ? 0 : 1;
+}
+
+// 丢失事件后重扫/sys，为当前存在的设备补发add事件，使下游状态收敛
+static void resync_sysfs(void) {
+    unsigned long before = stats.resynced;
+    stats.resyncs++;
+    nftw(SYSFS_DEVICES, resync_device, 32, FTW_PHYS);
+    fprintf(stderr, "[RESYNC] replayed %lu devices from %s\n",
+            stats.resynced - before, SYSFS_DEVICES);
+}
+
+static void print_stats(void) {
+    fprintf(stderr, "[STATS] received=%lu truncated=%lu overflows=%lu "
+            "resyncs=%lu resynced=%lu foreign=%lu malformed=%lu filtered=%lu\n",
+            stats.received, stats.truncated, stats.overflows,
+            stats.resyncs, stats.resynced, stats.foreign, stats.malformed,
+            stats.filtered);
+    if (disp.threads)
+        fprintf(stderr, "[STATS] coalesced=%lu dispatched=%lu deferred=%lu dropped=%lu "
+                "failed=%lu\n", stats.coalesced, stats.dispatched, stats.deferred,
+                stats.dropped, __atomic_load_n(&stats.failed, __ATOMIC_RELAXED));
+}
+
+// 设置接收缓冲区：特权进程用SO_RCVBUFFORCE突破rmem_max，否则退回SO_RCVBUF
+static void set_rcvbuf(int sock, int bytes) {
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) == -1)
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+
+    int actual = 0;
+    socklen_t optlen = sizeof(actual);
+    getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &actual, &optlen);
+    // 内核返回值为设置值的2倍（含管理开销）
+    if (actual / 2 < bytes)
+        fprintf(stderr, "Warning: receive buffer limited to %d bytes "
+                "(raise net.core.rmem_max or run as root)\n", actual / 2);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-b rcvbuf_bytes] [-v] [-q] [-s|--subsystem a,b] [-a|--action a,b] [-u]\n"
+            "          [-R|--rules file] [-w|--workers n] [-W|--window ms]\n"
+            "       %s -B|--bench events [-s a,b] [-a a,b]\n"
+            "  -s, --subsystem  只接收指定子系统的事件（可多次指定，逗号分隔）\n"
+            "  -a, --action     只接收指定动作的事件，如 add,remove\n"
+            "  -u, --no-bpf     不挂载内核BPF过滤，只在用户态过滤（用于对比）\n"
+            "  -R, --rules      规则文件，命中的事件交给工作线程执行RUN/CALL\n"
+            "  -w, --workers    工作线程数（默认%d）\n"
+            "  -W, --window     同一DEVPATH的事件合并窗口，毫秒（默认%d）\n"
+            "  -q               不打印事件\n"
+            "  -B, --bench      合成事件风暴基准：对比用户态过滤与内核BPF过滤时接收进程的CPU时间\n"
+            "                   （未指定-s/-a时按 --subsystem block 过滤）\n",
+            prog, prog, DEFAULT_WORKERS, DEFAULT_WINDOW_MS);
+}
+
+// 逗号分隔的列表追加到白名单
+static int add_names(const char **list, int *n, char *arg) {
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        if (*n >= UF_MAX_ITEMS || strlen(tok) > UF_MAX_NAME)
+            return -1;
+        list[(*n)++] = tok;
+    }
+    return 0;
+}
+
+/* ---------------- 事件风暴基准（-B） ---------------- */
+
+static const char *const bench_subsystems[] = {
+    "net", "usb", "platform", "input", "tty", "pci", "scsi", "power_supply",
+    "thermal", "block", "queues", "bdi", "mem", "cpu", "drm", "sound",
+};
+static const char *const bench_actions[] = { "add", "change", "remove", "bind", "unbind" };
+
+// 第i条合成事件，格式与内核一致（首行 + ACTION/DEVPATH/SUBSYSTEM + 其余属性）
+static int bench_event(char *buf, size_t size, unsigned long i) {
+    const char *sub = bench_subsystems[i % (sizeof(bench_subsystems) / sizeof(*bench_subsystems))];
+    const char *act = bench_actions[(i / 7) % (sizeof(bench_actions) / sizeof(*bench_actions))];
+    return snprintf(buf, size,
+                    "%s@/devices/virtual/%s/dev%lu%cACTION=%s%cDEVPATH=/devices/virtual/%s/dev%lu%c"
+                    "SUBSYSTEM=%s%cMAJOR=%lu%cMINOR=%lu%cDEVNAME=dev%lu%cSEQNUM=%lu%c",
+                    act, sub, i, 0, act, 0, sub, i, 0, sub, 0, i % 256, 0, i % 1024, 0, i, 0, i, 0);
+}
+
+typedef struct {
+    double user_ms, sys_ms, wall_ms;
+    unsigned long delivered, matched, wakeups;
+} BenchResult;
+
+static double tv_ms(struct timeval tv) {
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+/*
+ * 一轮风暴：子进程通过AF_UNIX数据报socketpair发送nevents条事件，本进程按主循环的方式
+ * poll + recvmmsg + parse_uevent接收，直到收齐所有应通过过滤的事件。
+ * SO_ATTACH_FILTER挂在接收端，与netlink一样在发送路径上执行，被丢弃的事件不入队也不唤醒接收者。
+ * 只统计接收进程自身的CPU时间（子进程不计入RUSAGE_SELF）
+ */
+static int bench_round(unsigned long nevents, int use_bpf, BenchResult *res) {
+    unsigned long expected = 0;
+    char ev[UEVENT_BUFFER_SIZE];
+    for (unsigned long i = 0; i < nevents; i++) {
+        int len = bench_event(ev, sizeof(ev), i);
+        ue_event parsed;
+        if (ue_parse(&parsed, ev, len) == 0) {
+            ue_str a = ue_action(&parsed), s = ue_get(&parsed, UE_SUBSYSTEM);
+            expected += uf_match(&filter, a.ptr, a.len, s.ptr, s.len);
+        }
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sv) == -1) {
+        perror("socketpair");
+        return -1;
+    }
+    if (use_bpf && uf_attach(sv[0], &filter) == -1) {
+        perror("Failed to attach BPF filter");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    set_rcvbuf(sv[0], DEFAULT_RCVBUF);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        for (unsigned long i = 0; i < nevents; i++) {
+            int len = bench_event(ev, sizeof(ev), i);
+            // 接收队列满时send阻塞，不会丢事件
+            if (send(sv[1], ev, len, 0) == -1 && errno != EINTR)
+                _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+    close(sv[1]);
+
+    static char bufs[UEVENT_BATCH][UEVENT_BUFFER_SIZE];
+    static struct iovec iov[UEVENT_BATCH];
+    static struct mmsghdr msgs[UEVENT_BATCH];
+    unsigned long filtered_before = stats.filtered;
+    struct rusage ru0, ru1;
+    struct timespec t0, t1;
+    memset(res, 0, sizeof(*res));
+    getrusage(RUSAGE_SELF, &ru0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (running && res->delivered - (stats.filtered - filtered_before) < expected) {
+        struct pollfd pfd = { .fd = sv[0], .events = POLLIN };
+        if (poll(&pfd, 1, 1000) <= 0)
+            continue;
+        res->wakeups++;
+        for (int i = 0; i < UEVENT_BATCH; i++) {
+            iov[i] = (struct iovec){ bufs[i], UEVENT_BUFFER_SIZE };
+            msgs[i].msg_hdr = (struct msghdr){ .msg_iov = &iov[i], .msg_iovlen = 1 };
+        }
+        int n = recvmmsg(sv[0], msgs, UEVENT_BATCH, MSG_DONTWAIT, NULL);
+        for (int i = 0; i < n; i++) {
+            res->delivered++;
+            parse_uevent(bufs[i], msgs[i].msg_len);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    getrusage(RUSAGE_SELF, &ru1);
+    res->matched = res->delivered - (stats.filtered - filtered_before);
+    res->user_ms = tv_ms(ru1.ru_utime) - tv_ms(ru0.ru_utime);
+    res->sys_ms = tv_ms(ru1.ru_stime) - tv_ms(ru0.ru_stime);
+    res->wall_ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+
+    int status;
+    waitpid(pid, &status, 0);
+    close(sv[0]);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS || res->matched != expected) {
+        fprintf(stderr, "bench: sender failed or events lost (matched %lu of %lu)\n",
+                res->matched, expected);
+        return -1;
     }
+    return 0;
+}
+
+static void bench_print(const char *name, unsigned long nevents, const BenchResult *r) {
+    double cpu = r->user_ms + r->sys_ms;
+    printf("%-10s events=%lu delivered=%lu matched=%lu wakeups=%lu "
+           "cpu=%.0fms (user %.0f sys %.0f) %.0f ns/event wall=%.0fms\n",
+           name, nevents, r->delivered, r->matched, r->wakeups, cpu, r->user_ms, r->sys_ms,
+           cpu * 1e6 / nevents, r->wall_ms);
 }
 
-int main() {
+// 同一风暴先只用用户态过滤、再挂内核BPF各跑一遍，对比接收进程的CPU时间
+static int run_bench(unsigned long nevents) {
+    quiet = 1;
+    if (!filter.nsubsystems && !filter.nactions)
+        filter.subsystems[filter.nsubsystems++] = "block";
+    BenchResult user, bpf;
+    if (bench_round(nevents, 0, &user) == -1 || bench_round(nevents, 1, &bpf) == -1)
+        return -1;
+    bench_print("userspace", nevents, &user);
+    bench_print("bpf", nevents, &bpf);
+    double cu = user.user_ms + user.sys_ms, cb = bpf.user_ms + bpf.sys_ms;
+    if (cu > 0)
+        printf("receiver CPU reduced by %.1f%% (%.1fx)\n", (1 - cb / cu) * 100, cb > 0 ? cu / cb : 0);
+    return 0;
+}
+
+#ifdef NL_REPLAY
+// 回放入口（见nl_replay.c）：不打印、不过滤、不加载规则，只走parse_uevent的解析路径
+int uevent_replay_init(void) {
+    quiet = 1;
+    return 0;
+}
+
+int uevent_replay_feed(const void *buf, size_t len, uint64_t now_ns) {
+    parse_uevent(buf, (ssize_t)len);
+    return 1;
+}
+
+void uevent_replay_fini(void) {
+}
+
+#define main uevent_monitor_main
+#endif
+
+int main(int argc, char **argv) {
+    static const struct option long_opts[] = {
+        { "subsystem", required_argument, NULL, 's' },
+        { "action",    required_argument, NULL, 'a' },
+        { "no-bpf",    no_argument,       NULL, 'u' },
+        { "rules",     required_argument, NULL, 'R' },
+        { "workers",   required_argument, NULL, 'w' },
+        { "window",    required_argument, NULL, 'W' },
+        { "bench",     required_argument, NULL, 'B' },
+        { NULL, 0, NULL, 0 },
+    };
+    int rcvbuf = DEFAULT_RCVBUF;
+    int use_bpf = 1;
+    const char *rules_path = NULL;
+    int window_ms = DEFAULT_WINDOW_MS;
+    disp.nworkers = DEFAULT_WORKERS;
+    long bench_events = 0;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:vqs:a:uR:w:W:B:", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'b':
+            rcvbuf = atoi(optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 's':
+            if (add_names(filter.subsystems, &filter.nsubsystems, optarg) == -1) {
+                fprintf(stderr, "Too many or too long subsystem names\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'a':
+            if (add_names(filter.actions, &filter.nactions, optarg) == -1) {
+                fprintf(stderr, "Too many or too long action names\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'u':
+            use_bpf = 0;
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        case 'R':
+            rules_path = optarg;
+            break;
+        case 'w':
+            disp.nworkers = atoi(optarg);
+            break;
+        case 'W':
+            window_ms = atoi(optarg);
+            break;
+        case 'B':
+            bench_events = strtol(optarg, NULL, 10);
+            if (bench_events <= 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (bench_events)
+        return run_bench(bench_events) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
     // 创建Netlink Socket
-    int sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+    int sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
     if (sock == -1) {
         perror("Failed to create socket");
         return EXIT_FAILURE;
     }
 
+    // 在bind之前挂载过滤器，避免加入多播组后先收到未过滤的事件
+    if (use_bpf && uf_attach(sock, &filter) == -1) {
+        perror("Failed to attach BPF filter");
+        close(sock);
+        return EXIT_FAILURE;
+    }
+
     // 绑定到内核的uevent组
     struct sockaddr_nl addr;
     memset(&addr, 0, sizeof(addr));
@@ -63,24 +820,108 @@ int main() {
         close(sock);
         return EXIT_FAILURE;
     }
+    if (rcvbuf > 0)
+        set_rcvbuf(sock, rcvbuf);
 
-    // 设置信号处理
-    signal(SIGINT, sigint_handler);
+    // 设置信号处理（不带SA_RESTART，使阻塞的poll能被Ctrl+C打断）
+    struct sigaction sa = { .sa_handler = sigint_handler };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
     printf("Monitoring uevents. Press Ctrl+C to exit...\n");
 
+    disp.next_due = UINT64_MAX;
+    if (rules_path) {
+        disp.window_ns = (uint64_t)(window_ms > 0 ? window_ms : 0) * 1000000ULL;
+        if (disp.nworkers <= 0)
+            disp.nworkers = DEFAULT_WORKERS;
+        if (dispatcher_start(rules_path) == -1) {
+            fprintf(stderr, "Failed to start rule dispatcher\n");
+            close(sock);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // 批量接收缓冲区
+    static char bufs[UEVENT_BATCH][UEVENT_BUFFER_SIZE];
+    static struct iovec iov[UEVENT_BATCH];
+    static struct sockaddr_nl senders[UEVENT_BATCH];
+    static struct mmsghdr msgs[UEVENT_BATCH];
+    for (int i = 0; i < UEVENT_BATCH; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = UEVENT_BUFFER_SIZE;
+    }
+
     // 接收消息循环
-    char buf[UEVENT_BUFFER_SIZE];
+    int resync_pending = 0;
     while (running) {
-        ssize_t len = recv(sock, buf, sizeof(buf), 0);
-        if (len == -1) {
-            if (running) perror("Error receiving message");
-            continue;
+        for (int i = 0; i < UEVENT_BATCH; i++) {
+            msgs[i].msg_hdr = (struct msghdr) {
+                .msg_name = &senders[i],
+                .msg_namelen = sizeof(senders[i]),
+                .msg_iov = &iov[i],
+                .msg_iovlen = 1,
+            };
+        }
+
+        // 等待新消息、任务完成通知或最早的合并窗口到期（没有规则时done_fd为-1，被poll忽略）
+        struct pollfd pfd[2] = {
+            { .fd = sock, .events = POLLIN },
+            { .fd = disp.done_fd, .events = POLLIN },
+        };
+        if (poll(pfd, 2, next_timeout_ms()) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
         }
+        if (pfd[1].revents & POLLIN)
+            reap_done();
 
-        parse_uevent(buf, len);  // 解析并打印事件
+        // 把已到达的消息一次取完
+        int n = 0;
+        if (pfd[0].revents & (POLLIN | POLLERR))
+            n = recvmmsg(sock, msgs, UEVENT_BATCH, MSG_DONTWAIT, NULL);
+        if (n == -1) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            if (errno == ENOBUFS) {
+                // 内核缓冲区溢出，已有事件丢失：待积压消息取完后重扫/sys补齐状态
+                stats.overflows++;
+                fprintf(stderr, "[OVERFLOW] uevent socket buffer overrun, events lost\n");
+                resync_pending = 1;
+                continue;
+            }
+            perror("Error receiving message");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            const struct msghdr *mh = &msgs[i].msg_hdr;
+            // 只接受内核发出的消息，防止本地进程伪造uevent
+            if (mh->msg_namelen != sizeof(struct sockaddr_nl) || senders[i].nl_pid != 0) {
+                stats.foreign++;
+                continue;
+            }
+            if (mh->msg_flags & MSG_TRUNC) {
+                stats.truncated++;
+                resync_pending = 1;
+                continue;
+            }
+            stats.received++;
+            parse_uevent(bufs[i], msgs[i].msg_len);  // 解析并打印事件
+        }
+        // 风暴期间只在队列取空（本批未满）时重扫一次，避免反复遍历/sys加剧溢出
+        if (resync_pending && n < UEVENT_BATCH) {
+            resync_sysfs();
+            resync_pending = 0;
+        }
+        flush_due();
     }
 
+    if (disp.threads)
+        dispatcher_stop();
     close(sock);
+    print_stats();
     printf("\nExiting...\n");
     return EXIT_SUCCESS;
 }
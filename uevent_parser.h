@@ -0,0 +1,230 @@
+#ifndef UEVENT_PARSER_H
+#define UEVENT_PARSER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+/*
+ * uevent零拷贝解析器
+ * 一次memchr驱动的扫描把消息切分为(key, value)视图数组，全部指向接收缓冲区，不做拷贝；
+ * 常用键在解析时归类，ue_get()为O(1)查找，其余键（ID_*等）用ue_find()线性查找。
+ * 支持两种来源：
+ *   内核（多播组1）："action@devpath\0KEY=VALUE\0..."
+ *   libudev（多播组2，udevd处理后转发）："libudev\0" + 固定头部 + 属性区
+ * 解析结果的生命周期与接收缓冲区相同。
+ */
+#define UE_MAX_KV         128         // 单条消息最多保留的键值对
+#define UE_LIBUDEV_PREFIX "libudev"
+#define UE_LIBUDEV_MAGIC  0xfeedcafe  // libudev头部魔数（网络字节序存储）
+
+// 视图：不以'\0'结尾，打印时用 "%.*s", (int)s.len, s.ptr
+typedef struct {
+    const char *ptr;
+    uint32_t len;
+} ue_str;
+
+typedef struct {
+    ue_str key;
+    ue_str value;
+} ue_kv;
+
+// 常用键，解析时直接记录其位置
+enum ue_key {
+    UE_ACTION, UE_DEVPATH, UE_SUBSYSTEM, UE_SEQNUM, UE_DEVNAME, UE_DEVTYPE,
+    UE_DRIVER, UE_MAJOR, UE_MINOR, UE_IFINDEX, UE_INTERFACE, UE_MODALIAS,
+    UE_PRODUCT, UE_DEVLINKS, UE_TAGS, UE_SYNTH_UUID, UE_USEC_INITIALIZED,
+    UE_ID_BUS, UE_ID_MODEL, UE_ID_VENDOR, UE_ID_SERIAL, UE_ID_PATH,
+    UE_ID_FS_TYPE, UE_ID_FS_UUID, UE_ID_FS_LABEL,
+    UE_NKEYS
+};
+
+static const char *const ue_key_names[UE_NKEYS] = {
+    "ACTION", "DEVPATH", "SUBSYSTEM", "SEQNUM", "DEVNAME", "DEVTYPE",
+    "DRIVER", "MAJOR", "MINOR", "IFINDEX", "INTERFACE", "MODALIAS",
+    "PRODUCT", "DEVLINKS", "TAGS", "SYNTH_UUID", "USEC_INITIALIZED",
+    "ID_BUS", "ID_MODEL", "ID_VENDOR", "ID_SERIAL", "ID_PATH",
+    "ID_FS_TYPE", "ID_FS_UUID", "ID_FS_LABEL",
+};
+
+enum ue_source {
+    UE_SRC_KERNEL,
+    UE_SRC_LIBUDEV,
+};
+
+typedef struct {
+    enum ue_source source;
+    ue_str hdr_action;            // 内核消息首行 "action@devpath" 中的两部分
+    ue_str hdr_devpath;
+    uint32_t nkv;
+    uint32_t dropped;             // 超出UE_MAX_KV而未保留的键值对数
+    int16_t known[UE_NKEYS];      // 常用键在kv[]中的下标，-1表示不存在
+    ue_kv kv[UE_MAX_KV];
+} ue_event;
+
+// libudev消息头（与systemd/libudev的udev_monitor_netlink_header一致）
+typedef struct {
+    char prefix[8];               // "libudev\0"
+    uint32_t magic;               // htonl(UE_LIBUDEV_MAGIC)
+    uint32_t header_size;
+    uint32_t properties_off;
+    uint32_t properties_len;
+    uint32_t filter_subsystem_hash;
+    uint32_t filter_devtype_hash;
+    uint32_t filter_tag_bloom_hi;
+    uint32_t filter_tag_bloom_lo;
+} ue_libudev_header;
+
+/* ---- 常用键分类：按(长度, 首字符, 尾字符)哈希的64槽开放寻址表 ---- */
+
+#define UE_KEYTAB_SIZE 64
+
+static int8_t ue_keytab[UE_KEYTAB_SIZE];
+static uint8_t ue_key_lens[UE_NKEYS];
+static pthread_once_t ue_keytab_once = PTHREAD_ONCE_INIT;
+
+static inline uint32_t ue_key_hash(const char *k, uint32_t len) {
+    return (len * 31u + (uint8_t)k[0] * 7u + (uint8_t)k[len - 1] * 13u) & (UE_KEYTAB_SIZE - 1);
+}
+
+static void ue_keytab_build(void) {
+    memset(ue_keytab, -1, sizeof(ue_keytab));
+    for (int i = 0; i < UE_NKEYS; i++) {
+        const char *name = ue_key_names[i];
+        ue_key_lens[i] = strlen(name);
+        uint32_t h = ue_key_hash(name, ue_key_lens[i]);
+        while (ue_keytab[h] != -1)
+            h = (h + 1) & (UE_KEYTAB_SIZE - 1);
+        ue_keytab[h] = i;
+    }
+}
+
+// 构建分类表；重建期间表是半清空的，工作线程并发解析时必须只构建一次
+static inline void ue_keytab_init(void) {
+    pthread_once(&ue_keytab_once, ue_keytab_build);
+}
+
+// 返回常用键编号，非常用键返回-1
+static inline int ue_classify(const char *k, uint32_t len) {
+    if (len == 0)
+        return -1;
+    for (uint32_t h = ue_key_hash(k, len);; h = (h + 1) & (UE_KEYTAB_SIZE - 1)) {
+        int idx = ue_keytab[h];
+        if (idx < 0)
+            return -1;
+        if (ue_key_lens[idx] == len && memcmp(ue_key_names[idx], k, len) == 0)
+            return idx;
+    }
+}
+
+/* ---- 解析 ---- */
+
+// 扫描以'\0'分隔的KEY=VALUE区域
+static inline void ue_parse_props(ue_event *ev, const char *p, const char *end) {
+    while (p < end) {
+        const char *nul = memchr(p, '\0', end - p);
+        const char *tok_end = nul ? nul : end;
+        const char *eq = memchr(p, '=', tok_end - p);
+
+        if (eq && eq > p) {
+            if (ev->nkv < UE_MAX_KV) {
+                ue_kv *kv = &ev->kv[ev->nkv];
+                kv->key = (ue_str){ p, (uint32_t)(eq - p) };
+                kv->value = (ue_str){ eq + 1, (uint32_t)(tok_end - eq - 1) };
+                int id = ue_classify(kv->key.ptr, kv->key.len);
+                if (id >= 0 && ev->known[id] < 0)
+                    ev->known[id] = ev->nkv;
+                ev->nkv++;
+            } else {
+                ev->dropped++;
+            }
+        }
+        p = tok_end + 1;
+    }
+}
+
+/**
+ * 解析一条uevent消息
+ * @param buf  接收缓冲区（解析结果直接引用其中内容）
+ * @param len  消息长度
+ * @return 成功返回0；格式无效返回-1
+ */
+static inline int ue_parse(ue_event *ev, const char *buf, size_t len) {
+    ue_keytab_init();
+
+    ev->nkv = 0;
+    ev->dropped = 0;
+    ev->hdr_action = ev->hdr_devpath = (ue_str){ NULL, 0 };
+    memset(ev->known, -1, sizeof(ev->known));
+
+    if (len >= sizeof(ue_libudev_header) &&
+        memcmp(buf, UE_LIBUDEV_PREFIX, sizeof(UE_LIBUDEV_PREFIX)) == 0) {
+        ue_libudev_header hdr;
+        memcpy(&hdr, buf, sizeof(hdr));
+        if (hdr.magic != htonl(UE_LIBUDEV_MAGIC) ||
+            hdr.properties_off < sizeof(hdr) ||
+            hdr.properties_off > len ||
+            hdr.properties_len > len - hdr.properties_off)
+            return -1;
+        ev->source = UE_SRC_LIBUDEV;
+        ue_parse_props(ev, buf + hdr.properties_off,
+                       buf + hdr.properties_off + hdr.properties_len);
+        return 0;
+    }
+
+    // 内核消息：首行为 "action@devpath"
+    const char *end = buf + len;
+    const char *nul = memchr(buf, '\0', len);
+    const char *tok_end = nul ? nul : end;
+    const char *at = memchr(buf, '@', tok_end - buf);
+    if (!at || memchr(buf, '=', tok_end - buf))
+        return -1;
+
+    ev->source = UE_SRC_KERNEL;
+    ev->hdr_action = (ue_str){ buf, (uint32_t)(at - buf) };
+    ev->hdr_devpath = (ue_str){ at + 1, (uint32_t)(tok_end - at - 1) };
+    ue_parse_props(ev, tok_end + 1, end);
+    return 0;
+}
+
+/* ---- 访问 ---- */
+
+// O(1)获取常用键的值，不存在时返回 {NULL, 0}
+static inline ue_str ue_get(const ue_event *ev, enum ue_key key) {
+    int idx = ev->known[key];
+    return idx < 0 ? (ue_str){ NULL, 0 } : ev->kv[idx].value;
+}
+
+// 按任意键名查找（线性），用于ID_*等不常用键
+static inline ue_str ue_find(const ue_event *ev, const char *key) {
+    ue_keytab_init();
+    uint32_t klen = strlen(key);
+    int id = ue_classify(key, klen);
+    if (id >= 0)
+        return ue_get(ev, id);
+    for (uint32_t i = 0; i < ev->nkv; i++) {
+        const ue_kv *kv = &ev->kv[i];
+        if (kv->key.len == klen && memcmp(kv->key.ptr, key, klen) == 0)
+            return kv->value;
+    }
+    return (ue_str){ NULL, 0 };
+}
+
+static inline int ue_str_eq(ue_str s, const char *lit) {
+    size_t n = strlen(lit);
+    return s.ptr && s.len == n && memcmp(s.ptr, lit, n) == 0;
+}
+
+// 内核消息的ACTION/DEVPATH缺失时回退到首行
+static inline ue_str ue_action(const ue_event *ev) {
+    ue_str s = ue_get(ev, UE_ACTION);
+    return s.ptr ? s : ev->hdr_action;
+}
+
+static inline ue_str ue_devpath(const ue_event *ev) {
+    ue_str s = ue_get(ev, UE_DEVPATH);
+    return s.ptr ? s : ev->hdr_devpath;
+}
+
+#endif // UEVENT_PARSER_H
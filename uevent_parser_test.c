@@ -0,0 +1,323 @@
+#include "uevent_parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+// uevent_parser.h 的模糊测试与基准测试
+//   -f  对种子消息做随机变异后解析，逐条检查视图边界与键索引的一致性，发现问题以非0退出
+//       （建议用 -fsanitize=address,undefined 编译，缓冲区按消息长度精确分配以捕获越界读）
+//   -b  与原先的 strlen+sscanf 解析对比每条消息耗时
+#define DEFAULT_FUZZ_ITERS 1000000
+#define DEFAULT_BENCH_MSGS 200000
+#define BENCH_ROUNDS       5
+#define MSG_MAX            4096
+
+typedef struct {
+    const char *data;
+    size_t len;
+} Seed;
+
+// 种子：内核格式的几类常见事件，字段顺序与内核一致
+#define KMSG(s) { s, sizeof(s) - 1 }
+static const Seed kernel_seeds[] = {
+    KMSG("add@/devices/pci0000:00/0000:00:1f.2/ata1/host0/target0:0:0/0:0:0:0/block/sda\0"
+         "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:1f.2/ata1/host0/target0:0:0/0:0:0:0/block/sda\0"
+         "SUBSYSTEM=block\0MAJOR=8\0MINOR=0\0DEVNAME=sda\0DEVTYPE=disk\0DISKSEQ=9\0SEQNUM=4711\0"),
+    KMSG("change@/devices/virtual/net/veth0\0ACTION=change\0DEVPATH=/devices/virtual/net/veth0\0"
+         "SUBSYSTEM=net\0INTERFACE=veth0\0IFINDEX=12\0SEQNUM=4712\0"),
+    KMSG("bind@/devices/pci0000:00/0000:00:14.0/usb1/1-2/1-2:1.0\0ACTION=bind\0"
+         "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-2/1-2:1.0\0SUBSYSTEM=usb\0"
+         "DEVTYPE=usb_interface\0DRIVER=usbhid\0PRODUCT=46d/c52b/1211\0TYPE=0/0/0\0"
+         "INTERFACE=3/1/2\0MODALIAS=usb:v046DpC52Bd1211dc00dsc00dp00ic03isc01ip02in00\0SEQNUM=4713\0"),
+    KMSG("remove@/devices/virtual/block/loop3\0ACTION=remove\0DEVPATH=/devices/virtual/block/loop3\0"
+         "SUBSYSTEM=block\0MAJOR=7\0MINOR=3\0DEVNAME=loop3\0DEVTYPE=disk\0SEQNUM=4714\0"
+         "SYNTH_UUID=0\0"),
+};
+
+static const char libudev_props[] =
+    "ACTION=add\0DEVPATH=/devices/virtual/block/dm-0\0SUBSYSTEM=block\0DEVNAME=/dev/dm-0\0"
+    "DEVTYPE=disk\0MAJOR=253\0MINOR=0\0SEQNUM=4715\0USEC_INITIALIZED=123456789\0"
+    "ID_FS_TYPE=ext4\0ID_FS_UUID=2f0c1d9a-5d6b-4c0e-9a57-0cf1b4a8e7d2\0ID_FS_LABEL=root\0"
+    "DEVLINKS=/dev/mapper/root /dev/disk/by-uuid/2f0c1d9a-5d6b-4c0e-9a57-0cf1b4a8e7d2\0"
+    "TAGS=:systemd:\0";
+
+// 按libudev格式封装一条消息，返回长度
+static size_t build_libudev(char *out, size_t size) {
+    ue_libudev_header hdr = {
+        .prefix = UE_LIBUDEV_PREFIX,
+        .magic = htonl(UE_LIBUDEV_MAGIC),
+        .header_size = sizeof(hdr),
+        .properties_off = sizeof(hdr),
+        .properties_len = sizeof(libudev_props) - 1,
+    };
+    size_t len = sizeof(hdr) + hdr.properties_len;
+    if (len > size)
+        return 0;
+    memcpy(out, &hdr, sizeof(hdr));
+    memcpy(out + sizeof(hdr), libudev_props, hdr.properties_len);
+    return len;
+}
+
+static inline uint64_t xorshift(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+static inline double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ---------------- 模糊测试 ---------------- */
+
+static int view_inside(ue_str s, const char *buf, size_t len) {
+    return s.ptr >= buf && s.ptr + s.len <= buf + len;
+}
+
+// 检查一次成功解析的结果；返回NULL表示通过，否则返回违反的规则
+static const char *check_event(const ue_event *ev, const char *buf, size_t len) {
+    if (ev->nkv > UE_MAX_KV)
+        return "nkv > UE_MAX_KV";
+    if (ev->source == UE_SRC_KERNEL &&
+        (!view_inside(ev->hdr_action, buf, len) || !view_inside(ev->hdr_devpath, buf, len)))
+        return "header view outside buffer";
+    for (uint32_t i = 0; i < ev->nkv; i++) {
+        const ue_kv *kv = &ev->kv[i];
+        if (!view_inside(kv->key, buf, len) || !view_inside(kv->value, buf, len))
+            return "kv view outside buffer";
+        if (kv->key.len == 0 || memchr(kv->key.ptr, '=', kv->key.len) ||
+            memchr(kv->key.ptr, '\0', kv->key.len))
+            return "bad key";
+        if (memchr(kv->value.ptr, '\0', kv->value.len))
+            return "value spans a field separator";
+        // 任意键都能通过ue_find找到首次出现的值
+        char key[MSG_MAX];
+        memcpy(key, kv->key.ptr, kv->key.len);
+        key[kv->key.len] = '\0';
+        ue_str v = ue_find(ev, key);
+        int first = 1;
+        for (uint32_t j = 0; j < i && first; j++)
+            first = !(ev->kv[j].key.len == kv->key.len &&
+                      memcmp(ev->kv[j].key.ptr, kv->key.ptr, kv->key.len) == 0);
+        if (first && (v.ptr != kv->value.ptr || v.len != kv->value.len))
+            return "ue_find does not return the first occurrence";
+    }
+    for (int k = 0; k < UE_NKEYS; k++) {
+        int idx = ev->known[k];
+        if (idx < 0) {
+            for (uint32_t i = 0; i < ev->nkv; i++)
+                if (ev->kv[i].key.len == strlen(ue_key_names[k]) &&
+                    memcmp(ev->kv[i].key.ptr, ue_key_names[k], ev->kv[i].key.len) == 0)
+                    return "known key not indexed";
+            continue;
+        }
+        if ((uint32_t)idx >= ev->nkv || !ue_str_eq(ev->kv[idx].key, ue_key_names[k]))
+            return "known[] points to the wrong kv";
+    }
+    return NULL;
+}
+
+// 对msg做1~8次随机变异：翻转字节、插入分隔符、截断、复制片段、改写libudev头部
+static size_t mutate(char *msg, size_t len, uint64_t *rng) {
+    static const char specials[] = { '\0', '=', '@', '\n', ' ', '\xff' };
+    int n = 1 + xorshift(rng) % 8;
+    for (int i = 0; i < n && len; i++) {
+        uint64_t r = xorshift(rng);
+        size_t pos = (r >> 8) % len;
+        switch (r % 6) {
+        case 0:
+            msg[pos] ^= (char)(1u << ((r >> 40) % 8));
+            break;
+        case 1:
+            msg[pos] = specials[(r >> 40) % sizeof(specials)];
+            break;
+        case 2:
+            len = pos;
+            break;
+        case 3: {
+            size_t span = 1 + (r >> 32) % 64;
+            if (pos + span <= len && len + span <= MSG_MAX) {
+                memmove(msg + pos + span, msg + pos, len - pos);
+                len += span;
+            }
+            break;
+        }
+        case 4:
+            if (len >= sizeof(ue_libudev_header)) {
+                uint32_t v = (uint32_t)(r >> 32);
+                size_t field = offsetof(ue_libudev_header, header_size) + 4 * ((r >> 16) % 4);
+                memcpy(msg + field, &v, sizeof(v));
+            }
+            break;
+        case 5:
+            len = pos + 1;
+            memset(msg + pos, 0, 1);
+            break;
+        }
+    }
+    return len;
+}
+
+static int fuzz(long iters, uint64_t seed) {
+    char libudev[MSG_MAX], work[MSG_MAX];
+    size_t libudev_len = build_libudev(libudev, sizeof(libudev));
+    int nseeds = sizeof(kernel_seeds) / sizeof(kernel_seeds[0]);
+    uint64_t rng = seed ? seed : 0x9e3779b97f4a7c15ULL;
+    long ok = 0, rejected = 0;
+    ue_event ev;
+
+    for (long it = 0; it < iters; it++) {
+        int which = xorshift(&rng) % (nseeds + 1);
+        size_t len = which < nseeds ? kernel_seeds[which].len : libudev_len;
+        memcpy(work, which < nseeds ? kernel_seeds[which].data : libudev, len);
+        len = mutate(work, len, &rng);
+
+        // 精确分配，越界读由ASan报告
+        char *buf = malloc(len ? len : 1);
+        if (!buf) {
+            perror("malloc");
+            return -1;
+        }
+        memcpy(buf, work, len);
+        if (ue_parse(&ev, buf, len) == -1) {
+            rejected++;
+        } else {
+            const char *err = check_event(&ev, buf, len);
+            if (err) {
+                fprintf(stderr, "iteration %ld (seed %llu): %s\n", it,
+                        (unsigned long long)seed, err);
+                for (size_t i = 0; i < len; i++)
+                    fprintf(stderr, "%02x%s", (uint8_t)buf[i], i % 32 == 31 ? "\n" : " ");
+                fprintf(stderr, "\n");
+                free(buf);
+                return -1;
+            }
+            ok++;
+        }
+        free(buf);
+    }
+    printf("fuzz: iterations=%ld parsed=%ld rejected=%ld violations=0\n", iters, ok, rejected);
+    return 0;
+}
+
+/* ---------------- 基准测试 ---------------- */
+
+// 原先uevent_monitor中的解析方式：逐字段strlen，sscanf截取三个键
+static int legacy_parse(const char *buf, size_t len, char *action, char *subsystem,
+                        char *devpath) {
+    const char *p = buf, *end = buf + len;
+    action[0] = subsystem[0] = devpath[0] = '\0';
+    while (p < end) {
+        if (strncmp(p, "ACTION=", 7) == 0)
+            sscanf(p + 7, "%31[^ ]", action);
+        else if (strncmp(p, "SUBSYSTEM=", 10) == 0)
+            sscanf(p + 10, "%31[^ ]", subsystem);
+        else if (strncmp(p, "DEVPATH=", 8) == 0)
+            sscanf(p + 8, "%255[^ ]", devpath);
+        p += strlen(p) + 1;
+    }
+    return action[0] && subsystem[0];
+}
+
+static int bench(long nmsgs) {
+    char libudev[MSG_MAX];
+    size_t libudev_len = build_libudev(libudev, sizeof(libudev));
+    int nseeds = sizeof(kernel_seeds) / sizeof(kernel_seeds[0]);
+    // 语料：各类内核消息轮流排列，每条独立缓冲区，模拟逐条recv
+    char **msgs = malloc(nmsgs * sizeof(*msgs));
+    size_t *lens = malloc(nmsgs * sizeof(*lens));
+    if (!msgs || !lens) {
+        perror("malloc");
+        return -1;
+    }
+    size_t bytes = 0;
+    for (long i = 0; i < nmsgs; i++) {
+        lens[i] = kernel_seeds[i % nseeds].len;
+        msgs[i] = malloc(lens[i]);
+        memcpy(msgs[i], kernel_seeds[i % nseeds].data, lens[i]);
+        bytes += lens[i];
+    }
+
+    double best_new = 1e30, best_old = 1e30, best_udev = 1e30;
+    volatile uint64_t sink = 0;
+    ue_event ev;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        double t0 = now_sec();
+        for (long i = 0; i < nmsgs; i++) {
+            if (ue_parse(&ev, msgs[i], lens[i]) == 0)
+                sink += ue_action(&ev).len + ue_get(&ev, UE_SUBSYSTEM).len + ue_devpath(&ev).len;
+        }
+        double t1 = now_sec();
+        for (long i = 0; i < nmsgs; i++) {
+            char action[32], subsystem[32], devpath[256];
+            sink += legacy_parse(msgs[i], lens[i], action, subsystem, devpath);
+        }
+        double t2 = now_sec();
+        for (long i = 0; i < nmsgs; i++) {
+            if (ue_parse(&ev, libudev, libudev_len) == 0)
+                sink += ue_get(&ev, UE_ID_FS_UUID).len;
+        }
+        double t3 = now_sec();
+        if (t1 - t0 < best_new) best_new = t1 - t0;
+        if (t2 - t1 < best_old) best_old = t2 - t1;
+        if (t3 - t2 < best_udev) best_udev = t3 - t2;
+    }
+
+    printf("messages=%ld avg_len=%zu rounds=%d (best of)\n", nmsgs, bytes / nmsgs, BENCH_ROUNDS);
+    printf("%-22s %8.1f ns/msg %8.1f MB/s  (all keys, no copies)\n", "ue_parse kernel",
+           best_new * 1e9 / nmsgs, bytes / best_new / 1e6);
+    printf("%-22s %8.1f ns/msg %8.1f MB/s  (3 keys, truncating copies)\n", "strlen+sscanf kernel",
+           best_old * 1e9 / nmsgs, bytes / best_old / 1e6);
+    printf("%-22s %8.1f ns/msg %8.1f MB/s\n", "ue_parse libudev",
+           best_udev * 1e9 / nmsgs, (double)libudev_len * nmsgs / best_udev / 1e6);
+
+    for (long i = 0; i < nmsgs; i++)
+        free(msgs[i]);
+    free(msgs);
+    free(lens);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s -f [-n iterations] [-s seed]\n"
+            "       %s -b [-n messages]\n"
+            "  -f  模糊测试（默认%d次变异），违反不变量时打印消息并以非0退出\n"
+            "  -b  基准测试：ue_parse 与原 strlen+sscanf 解析对比（默认%d条消息）\n"
+            "  -n  迭代次数/消息条数\n"
+            "  -s  随机种子，用于复现\n",
+            prog, prog, DEFAULT_FUZZ_ITERS, DEFAULT_BENCH_MSGS);
+}
+
+int main(int argc, char **argv) {
+    int mode = 0, opt;
+    long n = 0;
+    uint64_t seed = 0;
+    while ((opt = getopt(argc, argv, "fbn:s:")) != -1) {
+        switch (opt) {
+        case 'f': mode = 'f'; break;
+        case 'b': mode = 'b'; break;
+        case 'n': n = strtol(optarg, NULL, 10); break;
+        case 's': seed = strtoull(optarg, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!mode || n < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    int ret = mode == 'f' ? fuzz(n ? n : DEFAULT_FUZZ_ITERS, seed)
+                          : bench(n ? n : DEFAULT_BENCH_MSGS);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
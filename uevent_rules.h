@@ -0,0 +1,254 @@
+#ifndef UEVENT_RULES_H
+#define UEVENT_RULES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <fnmatch.h>
+
+#include "uevent_parser.h"
+
+/*
+ * uevent规则文件（语法取udev规则的子集）
+ * 每行一条规则，条件与动作以逗号分隔，# 开头为注释：
+ *   SUBSYSTEM=="block", ACTION=="add", DEVTYPE=="partition", RUN+="/usr/local/bin/automount $DEVNAME"
+ *   SUBSYSTEM=="net", ACTION=="add|move", INTERFACE=="eth*", RUN="ip link set $INTERFACE up"
+ *   SUBSYSTEM=="usb", CALL="print"
+ * 条件：KEY==pattern / KEY!=pattern，pattern为shell通配符，| 分隔多个候选；键不存在按空串处理。
+ * 动作：RUN= / RUN+= 经 /bin/sh -c 执行，事件的全部键值作为环境变量；
+ *       CALL= 调用程序注册的内置回调。
+ */
+#define UR_MAX_RULES    64          // 匹配结果用64位掩码表示
+#define UR_MAX_CONDS    8
+#define UR_MAX_ACTIONS  4
+#define UR_VALUE_MAX    512         // 参与匹配的值最大长度
+
+enum ur_op { UR_EQ, UR_NE };
+enum ur_act { UR_RUN, UR_CALL };
+
+typedef void (*ur_callback)(const ue_event *ev, uint32_t coalesced);
+
+typedef struct {
+    const char *name;
+    ur_callback fn;
+} ur_builtin;
+
+typedef struct {
+    char *key;
+    int known;                    // 常用键编号，-1表示需按名称查找
+    enum ur_op op;
+    char *patterns;               // 以'\0'分隔的候选模式
+    int npatterns;
+} ur_cond;
+
+typedef struct {
+    enum ur_act type;
+    char *cmd;                    // RUN命令
+    ur_callback fn;               // CALL回调
+} ur_action;
+
+typedef struct {
+    int line;
+    int nconds, nacts;
+    ur_cond conds[UR_MAX_CONDS];
+    ur_action acts[UR_MAX_ACTIONS];
+} ur_rule;
+
+typedef struct {
+    int nrules;
+    ur_rule rules[UR_MAX_RULES];
+} ur_ruleset;
+
+static inline void ur_free(ur_ruleset *set) {
+    for (int i = 0; i < set->nrules; i++) {
+        ur_rule *r = &set->rules[i];
+        for (int j = 0; j < r->nconds; j++) {
+            free(r->conds[j].key);
+            free(r->conds[j].patterns);
+        }
+        for (int j = 0; j < r->nacts; j++)
+            free(r->acts[j].cmd);
+    }
+    set->nrules = 0;
+}
+
+// 读取一个值：带引号时取到下一个引号，否则取到逗号或空白；返回值之后的位置
+static inline char *ur_read_value(char *p, char **out) {
+    if (*p == '"') {
+        char *end = strchr(p + 1, '"');
+        if (!end)
+            return NULL;
+        *end = '\0';
+        *out = p + 1;
+        return end + 1;
+    }
+    *out = p;
+    while (*p && *p != ',' && !isspace((unsigned char)*p))
+        p++;
+    if (*p)
+        *p++ = '\0';
+    return p;
+}
+
+static inline int ur_parse_line(ur_rule *r, char *p, const ur_builtin *builtins,
+                                int nbuiltins, const char *path) {
+    for (;;) {
+        while (*p == ',' || isspace((unsigned char)*p))
+            p++;
+        if (*p == '\0' || *p == '#')
+            break;
+
+        char *key = p;
+        while (isalnum((unsigned char)*p) || *p == '_')
+            p++;
+        size_t klen = p - key;
+        char op[3] = {0};
+        if ((p[0] == '=' || p[0] == '!' || p[0] == '+') && p[1] == '=') {
+            op[0] = p[0];
+            op[1] = '=';
+            p += 2;
+        } else if (p[0] == '=') {
+            op[0] = '=';
+            p++;
+        }
+        char *value;
+        if (klen == 0 || op[0] == '\0' || !(p = ur_read_value(p, &value))) {
+            fprintf(stderr, "%s:%d: syntax error\n", path, r->line);
+            return -1;
+        }
+        key[klen] = '\0';
+
+        if (strcmp(key, "RUN") == 0 || strcmp(key, "CALL") == 0) {
+            if (strcmp(op, "=") != 0 && strcmp(op, "+=") != 0) {
+                fprintf(stderr, "%s:%d: %s needs = or +=\n", path, r->line, key);
+                return -1;
+            }
+            if (r->nacts >= UR_MAX_ACTIONS) {
+                fprintf(stderr, "%s:%d: too many actions\n", path, r->line);
+                return -1;
+            }
+            ur_action *a = &r->acts[r->nacts];
+            if (key[0] == 'R') {
+                a->type = UR_RUN;
+                a->cmd = strdup(value);
+            } else {
+                a->type = UR_CALL;
+                a->fn = NULL;
+                for (int i = 0; i < nbuiltins; i++)
+                    if (strcmp(builtins[i].name, value) == 0)
+                        a->fn = builtins[i].fn;
+                if (!a->fn) {
+                    fprintf(stderr, "%s:%d: unknown callback %s\n", path, r->line, value);
+                    return -1;
+                }
+            }
+            r->nacts++;
+            continue;
+        }
+
+        if (strcmp(op, "==") != 0 && strcmp(op, "!=") != 0) {
+            fprintf(stderr, "%s:%d: %s needs == or !=\n", path, r->line, key);
+            return -1;
+        }
+        if (r->nconds >= UR_MAX_CONDS) {
+            fprintf(stderr, "%s:%d: too many conditions\n", path, r->line);
+            return -1;
+        }
+        ur_cond *c = &r->conds[r->nconds++];
+        c->key = strdup(key);
+        c->known = ue_classify(key, klen);
+        c->op = op[0] == '=' ? UR_EQ : UR_NE;
+        c->patterns = strdup(value);
+        c->npatterns = 1;
+        for (char *q = c->patterns; *q; q++) {
+            if (*q == '|') {
+                *q = '\0';
+                c->npatterns++;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * 加载规则文件
+ * @param builtins   CALL=可引用的内置回调
+ * @return 成功返回0，失败返回-1（已打印出错行）
+ */
+static inline int ur_load(ur_ruleset *set, const char *path,
+                          const ur_builtin *builtins, int nbuiltins) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    ue_keytab_init();
+
+    set->nrules = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    int lineno = 0, ret = 0;
+    while (getline(&line, &cap, fp) != -1) {
+        lineno++;
+        if (set->nrules >= UR_MAX_RULES) {
+            fprintf(stderr, "%s:%d: more than %d rules\n", path, lineno, UR_MAX_RULES);
+            ret = -1;
+            break;
+        }
+        ur_rule *r = &set->rules[set->nrules];
+        memset(r, 0, sizeof(*r));
+        r->line = lineno;
+        // 先计入规则数，出错时由ur_free统一释放已分配的字段
+        set->nrules++;
+        if (ur_parse_line(r, line, builtins, nbuiltins, path) == -1) {
+            ret = -1;
+            break;
+        }
+        // 空行/注释不算规则；没有动作的规则没有意义
+        if (r->nconds == 0 && r->nacts == 0) {
+            set->nrules--;
+        } else if (r->nacts == 0) {
+            fprintf(stderr, "%s:%d: rule has no RUN or CALL\n", path, lineno);
+            ret = -1;
+            break;
+        }
+    }
+    free(line);
+    fclose(fp);
+    if (ret == -1)
+        ur_free(set);
+    return ret;
+}
+
+static inline int ur_cond_match(const ur_cond *c, const ue_event *ev) {
+    ue_str v = c->known >= 0 ? ue_get(ev, c->known) : ue_find(ev, c->key);
+    char buf[UR_VALUE_MAX];
+    if (v.len >= sizeof(buf))
+        return c->op == UR_NE;
+    memcpy(buf, v.ptr ? v.ptr : "", v.len);
+    buf[v.len] = '\0';
+
+    int hit = 0;
+    const char *pat = c->patterns;
+    for (int i = 0; i < c->npatterns && !hit; i++, pat += strlen(pat) + 1)
+        hit = fnmatch(pat, buf, 0) == 0;
+    return c->op == UR_EQ ? hit : !hit;
+}
+
+// 返回命中规则的位掩码（第i位对应第i条规则）
+static inline uint64_t ur_match(const ur_ruleset *set, const ue_event *ev) {
+    uint64_t mask = 0;
+    for (int i = 0; i < set->nrules; i++) {
+        const ur_rule *r = &set->rules[i];
+        int ok = 1;
+        for (int j = 0; j < r->nconds && ok; j++)
+            ok = ur_cond_match(&r->conds[j], ev);
+        if (ok)
+            mask |= 1ULL << i;
+    }
+    return mask;
+}
+
+#endif // UEVENT_RULES_H
@@ -0,0 +1,620 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
+#include <netinet/icmp6.h>
+#include <netinet/if_ether.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <linux/if_packet.h>
+#include <linux/rtnetlink.h>
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+#include <netlink/attr.h>
+#include <netlink/route/addr.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
+
+// 依赖第三方工具 apt install -y libnl-3-dev libnl-route-3-dev
+
+/*
+ * 由载波驱动的VIP快速切换
+ * 订阅RTNLGRP_LINK（与netlink_traffic相同的NETLINK_ROUTE套接字），接口的载波
+ * （IFF_LOWER_UP）或运行状态（IFLA_OPERSTATE）一变化就重新选主：按命令行顺序
+ * 取第一个可用的接口。切换时先在新接口上加VIP并广播免费ARP（IPv6为非请求NA），
+ * 再从旧接口删除，整个过程在收到通知的同一轮事件处理中完成，不等待任何定时器。
+ * keepalived靠周期性通告探测对端，是秒级的；这里只处理本机链路故障，二者可叠加。
+ * -n 不抢占：当前接口仍可用时，优先级更高的接口恢复也不切回。
+ */
+#define MAX_CANDIDATES      8
+#define DEFAULT_GARP_COUNT  3     // 每次切换发送的免费ARP/NA个数
+#define DEFAULT_GARP_MS     200   // 重复发送间隔（毫秒）
+#define NL_RCVBUF           (1024 * 1024)
+
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP 0x10000          // linux/if.h，与net/if.h不能同时包含
+#endif
+#ifndef IF_OPER_UP
+#define IF_OPER_UNKNOWN 0             // RFC 2863运行状态，同上
+#define IF_OPER_UP      6
+#endif
+
+typedef struct {
+    char name[IF_NAMESIZE];
+    int ifindex;                 // 0表示接口不存在
+    int up;                      // 管理UP、有载波且operstate为UP/UNKNOWN
+    int has_mac;
+    unsigned char mac[ETH_ALEN];
+    int seen;                    // 本次dump中出现过
+} Candidate;
+
+typedef struct {
+    struct arphdr h;
+    unsigned char sha[ETH_ALEN], spa[4], tha[ETH_ALEN], tpa[4];
+} __attribute__((packed)) ArpPacket;
+
+static struct {
+    Candidate cand[MAX_CANDIDATES];
+    int ncand;
+    int owner;                   // 当前持有VIP的候选下标，-1为无
+    int preempt;
+    struct nl_addr *vip;
+    int family;
+    struct nl_sock *req;         // 地址增删请求（同步等ACK）
+    int pkt_fd;                  // 发送免费ARP的AF_PACKET套接字
+    int icmp6_fd;                // 发送NA的ICMPv6原始套接字
+    int garp_count;
+    uint64_t garp_interval_ns;
+    int garp_left;               // 本次切换还需重复发送的个数
+    uint64_t garp_next_ns;
+    int changed;                 // 本轮通知中有候选接口状态变化
+    int dumping;                 // dump进行中：其间未出现的候选接口视为已不存在
+    int dump_done;               // 收到链路dump的NLMSG_DONE
+    // 统计
+    uint64_t events, failovers;
+    double last_ms, max_ms;
+} vf = { .owner = -1, .preempt = 1, .pkt_fd = -1, .icmp6_fd = -1 };
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void sigint_handler(int sig) {
+    keep_running = 0;
+}
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char *owner_name(int i) {
+    return i >= 0 ? vf.cand[i].name : "(none)";
+}
+
+/* ---------------- 链路通知 ---------------- */
+
+static int link_event(struct nl_msg *msg, void *arg) {
+    struct nlmsghdr *nlh = nlmsg_hdr(msg);
+    struct nlattr *attrs[IFLA_MAX + 1];
+    if (nlh->nlmsg_type != RTM_NEWLINK && nlh->nlmsg_type != RTM_DELLINK)
+        return NL_SKIP;
+    struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    if (nlmsg_parse(nlh, sizeof(*ifi), attrs, IFLA_MAX, NULL) < 0 || !attrs[IFLA_IFNAME])
+        return NL_SKIP;
+    const char *name = nla_get_string(attrs[IFLA_IFNAME]);
+    vf.events++;
+
+    for (int i = 0; i < vf.ncand; i++) {
+        Candidate *c = &vf.cand[i];
+        int same_name = strcmp(c->name, name) == 0;
+        if (c->ifindex != ifi->ifi_index && !same_name)
+            continue;
+        int was_up = c->up, was_index = c->ifindex;
+        if (nlh->nlmsg_type == RTM_DELLINK || !same_name) {
+            // 删除或改名走：按名字配置的候选视为不存在
+            if (c->ifindex == ifi->ifi_index) {
+                c->ifindex = 0;
+                c->up = 0;
+            }
+        } else {
+            int oper = attrs[IFLA_OPERSTATE] ? nla_get_u8(attrs[IFLA_OPERSTATE]) : IF_OPER_UNKNOWN;
+            c->seen = 1;
+            c->ifindex = ifi->ifi_index;
+            c->up = (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_LOWER_UP) &&
+                    (oper == IF_OPER_UP || oper == IF_OPER_UNKNOWN);
+            if (attrs[IFLA_ADDRESS] && nla_len(attrs[IFLA_ADDRESS]) == ETH_ALEN) {
+                memcpy(c->mac, nla_data(attrs[IFLA_ADDRESS]), ETH_ALEN);
+                c->has_mac = 1;
+            }
+        }
+        if (c->up != was_up || c->ifindex != was_index)
+            vf.changed = 1;
+    }
+    return NL_OK;
+}
+
+// dump结束：溢出期间被删除的接口收不到RTM_DELLINK，没在dump中出现即视为不存在
+static int dump_finished(struct nl_msg *msg, void *arg) {
+    for (int i = 0; vf.dumping && i < vf.ncand; i++) {
+        Candidate *c = &vf.cand[i];
+        if (!c->seen && c->ifindex) {
+            c->ifindex = 0;
+            c->up = 0;
+            vf.changed = 1;
+        }
+    }
+    vf.dumping = 0;
+    vf.dump_done = 1;
+    return NL_OK;
+}
+
+/* ---------------- VIP增删与通告 ---------------- */
+
+// 与netcfg的add_ip_address/del_ip_address相同，按ifindex操作
+static int vip_change(const Candidate *c, int add) {
+    struct rtnl_addr *addr = rtnl_addr_alloc();
+    rtnl_addr_set_local(addr, vf.vip);
+    rtnl_addr_set_prefixlen(addr, nl_addr_get_prefixlen(vf.vip));
+    rtnl_addr_set_ifindex(addr, c->ifindex);
+    int ret;
+    if (add) {
+        // IPv6跳过DAD，否则地址在tentative期间无法使用
+        if (vf.family == AF_INET6)
+            rtnl_addr_set_flags(addr, IFA_F_NODAD);
+        ret = rtnl_addr_add(vf.req, addr, NLM_F_REPLACE);
+        if (ret == -NLE_EXIST)
+            ret = 0;
+    } else {
+        ret = rtnl_addr_delete(vf.req, addr, 0);
+        if (ret == -NLE_NOADDR || ret == -NLE_OBJ_NOTFOUND || ret == -NLE_NODEV)
+            ret = 0;
+    }
+    rtnl_addr_put(addr);
+    if (ret < 0)
+        fprintf(stderr, "%s VIP on %s: %s\n", add ? "add" : "del", c->name, nl_geterror(ret));
+    return ret;
+}
+
+// 免费ARP：发送方与目标IP都是VIP的广播ARP请求
+static int send_garp(const Candidate *c) {
+    ArpPacket pkt = {
+        .h = { .ar_hrd = htons(ARPHRD_ETHER), .ar_pro = htons(ETH_P_IP),
+               .ar_hln = ETH_ALEN, .ar_pln = 4, .ar_op = htons(ARPOP_REQUEST) },
+    };
+    memcpy(pkt.sha, c->mac, ETH_ALEN);
+    memcpy(pkt.spa, nl_addr_get_binary_addr(vf.vip), 4);
+    memcpy(pkt.tpa, nl_addr_get_binary_addr(vf.vip), 4);
+
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_ARP),
+        .sll_ifindex = c->ifindex,
+        .sll_halen = ETH_ALEN,
+        .sll_addr = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+    };
+    return sendto(vf.pkt_fd, &pkt, sizeof(pkt), 0, (struct sockaddr *)&sll, sizeof(sll));
+}
+
+// 非请求NA：发往ff02::1，置Override位，携带目标链路层地址选项
+static int send_unsolicited_na(const Candidate *c) {
+    struct {
+        struct nd_neighbor_advert na;
+        struct nd_opt_hdr opt;
+        unsigned char mac[ETH_ALEN];
+    } __attribute__((packed)) pkt = {
+        .na = { .nd_na_type = ND_NEIGHBOR_ADVERT, .nd_na_flags_reserved = ND_NA_FLAG_OVERRIDE },
+        .opt = { .nd_opt_type = ND_OPT_TARGET_LINKADDR, .nd_opt_len = 1 },
+    };
+    memcpy(&pkt.na.nd_na_target, nl_addr_get_binary_addr(vf.vip), sizeof(struct in6_addr));
+    memcpy(pkt.mac, c->mac, ETH_ALEN);
+
+    struct sockaddr_in6 dst = { .sin6_family = AF_INET6, .sin6_scope_id = c->ifindex };
+    inet_pton(AF_INET6, "ff02::1", &dst.sin6_addr);
+    setsockopt(vf.icmp6_fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &c->ifindex, sizeof(c->ifindex));
+    return sendto(vf.icmp6_fd, &pkt, sizeof(pkt), 0, (struct sockaddr *)&dst, sizeof(dst));
+}
+
+static void announce(const Candidate *c) {
+    if (!c->has_mac)
+        return;
+    int ret = vf.family == AF_INET6 ? send_unsolicited_na(c) : send_garp(c);
+    if (ret == -1)
+        fprintf(stderr, "announce on %s: %s\n", c->name, strerror(errno));
+}
+
+/* ---------------- 选主与切换 ---------------- */
+
+static int choose_owner(void) {
+    if (!vf.preempt && vf.owner >= 0 && vf.cand[vf.owner].up)
+        return vf.owner;
+    for (int i = 0; i < vf.ncand; i++)
+        if (vf.cand[i].up)
+            return i;
+    return -1;
+}
+
+/**
+ * 切换VIP：先加到新接口并通告，再从旧接口删除
+ * @param t0  收到触发通知的时刻，用于统计切换耗时
+ */
+static void failover(int next, uint64_t t0) {
+    int prev = vf.owner;
+    if (next >= 0) {
+        if (vip_change(&vf.cand[next], 1) < 0)
+            return;                   // 下次通知时重试
+        announce(&vf.cand[next]);
+        vf.garp_left = vf.garp_count - 1;
+        vf.garp_next_ns = mono_ns() + vf.garp_interval_ns;
+    }
+    double ms = (mono_ns() - t0) / 1e6;
+    if (prev >= 0 && vf.cand[prev].ifindex)
+        vip_change(&vf.cand[prev], 0);
+    vf.owner = next;
+    vf.failovers++;
+    vf.last_ms = ms;
+    if (ms > vf.max_ms)
+        vf.max_ms = ms;
+
+    char buf[INET6_ADDRSTRLEN + 8];
+    fprintf(stderr, "[FAILOVER] %s: %s -> %s in %.3fms\n", nl_addr2str(vf.vip, buf, sizeof(buf)),
+            owner_name(prev), owner_name(next), ms);
+}
+
+// 启动时：VIP只保留在选中的接口上
+static void claim_initial(uint64_t t0) {
+    int next = choose_owner();
+    for (int i = 0; i < vf.ncand; i++)
+        if (i != next && vf.cand[i].ifindex)
+            vip_change(&vf.cand[i], 0);
+    if (next >= 0)
+        failover(next, t0);
+}
+
+// 请求一次全量链路dump（启动及通知溢出后重新同步）
+static int request_dump(struct nl_sock *mon) {
+    struct rtgenmsg gen = { .rtgen_family = AF_UNSPEC };
+    for (int i = 0; i < vf.ncand; i++)
+        vf.cand[i].seen = 0;
+    vf.dumping = 1;
+    return nl_send_simple(mon, RTM_GETLINK, NLM_F_DUMP, &gen, sizeof(gen));
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s -a <vip/cidr> [-n] [-c count] [-i ms] <ifname> [ifname ...]\n"
+            "       %s -T <rounds>\n"
+            "  -a  虚拟IP（IPv4或IPv6）\n"
+            "  -n  不抢占：当前接口可用时不切回优先级更高的接口\n"
+            "  -c  每次切换发送的免费ARP/NA个数（默认%d）\n"
+            "  -i  重复发送间隔（毫秒，默认%d）\n"
+            "  -T  切换延迟测试：在临时网络命名空间中用veth对反复断开/恢复载波\n"
+            "  接口按优先级从高到低排列，最多%d个\n",
+            prog, prog, DEFAULT_GARP_COUNT, DEFAULT_GARP_MS, MAX_CANDIDATES);
+}
+
+// 守护进程主循环，vf中的VIP与候选接口已设置好
+static int run_daemon(void) {
+    // 通告用套接字
+    if (vf.family == AF_INET) {
+        vf.pkt_fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    } else {
+        int hops = 255;           // NA的跳数限制必须为255，否则接收方丢弃
+        vf.icmp6_fd = socket(AF_INET6, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_ICMPV6);
+        if (vf.icmp6_fd != -1)
+            setsockopt(vf.icmp6_fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops, sizeof(hops));
+    }
+    if (vf.pkt_fd == -1 && vf.icmp6_fd == -1) {
+        perror("Failed to create announce socket (need CAP_NET_RAW)");
+        return EXIT_FAILURE;
+    }
+
+    // 请求套接字与订阅RTNLGRP_LINK的通知套接字
+    vf.req = nl_socket_alloc();
+    struct nl_sock *mon = nl_socket_alloc();
+    if (!vf.req || !mon || nl_connect(vf.req, NETLINK_ROUTE) < 0 ||
+        nl_connect(mon, NETLINK_ROUTE) < 0 || nl_socket_add_membership(mon, RTNLGRP_LINK) < 0) {
+        fprintf(stderr, "Failed to initialize netlink socket\n");
+        return EXIT_FAILURE;
+    }
+    nl_socket_disable_seq_check(mon);
+    nl_socket_modify_cb(mon, NL_CB_VALID, NL_CB_CUSTOM, link_event, NULL);
+    nl_socket_modify_cb(mon, NL_CB_FINISH, NL_CB_CUSTOM, dump_finished, NULL);
+    nl_socket_set_buffer_size(mon, NL_RCVBUF, 0);
+    nl_socket_set_nonblocking(mon);
+
+    signal(SIGINT, sigint_handler);
+    signal(SIGTERM, sigint_handler);
+
+    int synced = 0;
+    request_dump(mon);
+    while (keep_running) {
+        int timeout = -1;
+        if (vf.garp_left > 0) {
+            uint64_t now = mono_ns();
+            timeout = vf.garp_next_ns > now ? (vf.garp_next_ns - now + 999999) / 1000000 : 0;
+        }
+        struct pollfd pfd = { .fd = nl_socket_get_fd(mon), .events = POLLIN };
+        int n = poll(&pfd, 1, timeout);
+        if (n == -1 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        uint64_t t0 = mono_ns();
+
+        if (n > 0) {
+            // 读空套接字；通知溢出时丢失的状态靠重新dump补齐
+            int ret;
+            while ((ret = nl_recvmsgs_default(mon)) >= 0)
+                ;
+            if (ret == -NLE_NOMEM) {
+                fprintf(stderr, "netlink notification overrun, resyncing\n");
+                request_dump(mon);
+            }
+        }
+        if (!synced && vf.dump_done) {
+            synced = 1;               // 启动dump已处理完
+            vf.changed = 0;
+            claim_initial(t0);
+        }
+
+        if (synced && vf.changed) {
+            vf.changed = 0;
+            int next = choose_owner();
+            if (next != vf.owner)
+                failover(next, t0);
+        }
+
+        if (vf.garp_left > 0 && mono_ns() >= vf.garp_next_ns) {
+            if (vf.owner >= 0)
+                announce(&vf.cand[vf.owner]);
+            vf.garp_left--;
+            vf.garp_next_ns += vf.garp_interval_ns;
+        }
+    }
+
+    fprintf(stderr, "[STATS] link_events=%llu failovers=%llu last=%.3fms max=%.3fms owner=%s\n",
+            (unsigned long long)vf.events, (unsigned long long)vf.failovers, vf.last_ms,
+            vf.max_ms, owner_name(vf.owner));
+    nl_socket_free(mon);
+    nl_socket_free(vf.req);
+    nl_addr_put(vf.vip);
+    if (vf.pkt_fd != -1)
+        close(vf.pkt_fd);
+    if (vf.icmp6_fd != -1)
+        close(vf.icmp6_fd);
+    return EXIT_SUCCESS;
+}
+
+/* ---------------- 切换延迟测试（-T） ---------------- */
+
+/*
+ * 在unshare出的网络命名空间里建两对veth：vfa0/vfb0、vfa1/vfb1，守护进程
+ * （子进程，-c 1）管理vfa0、vfa1上的测试VIP，父进程在对端vfb0/vfb1上用
+ * AF_PACKET收免费ARP。每一轮：
+ *   把vfb0置DOWN（vfa0失去载波），计时到vfb1收到免费ARP —— 载波丢失切换
+ *   把vfb0置UP（vfa0恢复载波），计时到vfb0收到免费ARP —— 抢占切回
+ * 延迟从改变对端状态的ioctl之前算到报文到达对端，含内核的载波事件投递。
+ */
+#define TEST_VIP            "192.0.2.100/24"
+#define TEST_TIMEOUT_MS     5000
+
+static const char *const test_links[2][2] = { { "vfa0", "vfb0" }, { "vfa1", "vfb1" } };
+
+static int test_set_up(int fd, const char *name, int up) {
+    struct ifreq ifr = {0};
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", name);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == -1)
+        return -1;
+    ifr.ifr_flags = up ? ifr.ifr_flags | IFF_UP : ifr.ifr_flags & ~IFF_UP;
+    return ioctl(fd, SIOCSIFFLAGS, &ifr);
+}
+
+static int test_listen(const char *name) {
+    int fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, htons(ETH_P_ARP));
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_ARP),
+        .sll_ifindex = if_nametoindex(name),
+    };
+    if (fd != -1 && bind(fd, (struct sockaddr *)&sll, sizeof(sll)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void test_drain(const int fds[2]) {
+    char buf[256];
+    for (int i = 0; i < 2; i++)
+        while (recv(fds[i], buf, sizeof(buf), 0) > 0)
+            ;
+}
+
+/**
+ * 等待fds[want]上出现VIP的免费ARP
+ * @param t  收到的时刻
+ * @return 收到返回0，超时返回-1
+ */
+static int test_wait_garp(const int fds[2], int want, uint64_t *t) {
+    uint64_t deadline = mono_ns() + TEST_TIMEOUT_MS * 1000000ULL;
+    struct pollfd pfd[2] = { { .fd = fds[0], .events = POLLIN }, { .fd = fds[1], .events = POLLIN } };
+    for (uint64_t now = mono_ns(); now < deadline; now = mono_ns()) {
+        if (poll(pfd, 2, (deadline - now + 999999) / 1000000) <= 0)
+            continue;
+        for (int i = 0; i < 2; i++) {
+            ArpPacket pkt;
+            ssize_t n;
+            while ((n = recv(fds[i], &pkt, sizeof(pkt), 0)) > 0) {
+                if (i == want && n == (ssize_t)sizeof(pkt) &&
+                    memcmp(pkt.spa, nl_addr_get_binary_addr(vf.vip), 4) == 0) {
+                    *t = mono_ns();
+                    return 0;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void test_report(const char *what, double *ms, int n) {
+    if (n == 0)
+        return;
+    qsort(ms, n, sizeof(double), cmp_double);
+    printf("[TEST] %-24s rounds=%d p50=%.2fms p99=%.2fms min=%.2fms max=%.2fms\n", what, n,
+           ms[n / 2], ms[(n * 99 - 1) / 100], ms[0], ms[n - 1]);
+}
+
+static int test_create_links(void) {
+    struct nl_sock *sk = nl_socket_alloc();
+    int err = sk ? nl_connect(sk, NETLINK_ROUTE) : -NLE_NOMEM;
+    for (int i = 0; i < 2 && err >= 0; i++) {
+        struct rtnl_link *link = rtnl_link_veth_alloc();
+        if (!link) {
+            err = -NLE_NOMEM;
+            break;
+        }
+        struct rtnl_link *peer = rtnl_link_veth_get_peer(link);
+        rtnl_link_set_name(link, test_links[i][0]);
+        rtnl_link_set_name(peer, test_links[i][1]);
+        rtnl_link_put(peer);
+        err = rtnl_link_add(sk, link, NLM_F_CREATE | NLM_F_EXCL);
+        rtnl_link_veth_release(link);
+    }
+    if (err < 0)
+        fprintf(stderr, "Failed to create veth pair: %s\n", nl_geterror(err));
+    nl_socket_free(sk);
+    return err < 0 ? -1 : 0;
+}
+
+static int run_test(int rounds) {
+    if (unshare(CLONE_NEWNET) == -1) {
+        perror("unshare(CLONE_NEWNET) (need root)");
+        return EXIT_FAILURE;
+    }
+    int ctl = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (ctl == -1 || test_create_links() == -1)
+        return EXIT_FAILURE;
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 2; j++)
+            if (test_set_up(ctl, test_links[i][j], 1) == -1) {
+                perror(test_links[i][j]);
+                return EXIT_FAILURE;
+            }
+    int fds[2] = { test_listen(test_links[0][1]), test_listen(test_links[1][1]) };
+    if (fds[0] == -1 || fds[1] == -1) {
+        perror("AF_PACKET");
+        return EXIT_FAILURE;
+    }
+
+    nl_addr_parse(TEST_VIP, AF_INET, &vf.vip);
+    vf.family = AF_INET;
+    vf.garp_count = 1;                // 只要每次切换的第一个通告
+    vf.garp_interval_ns = DEFAULT_GARP_MS * 1000000ULL;
+    for (int i = 0; i < 2; i++)
+        snprintf(vf.cand[vf.ncand++].name, IF_NAMESIZE, "%s", test_links[i][0]);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0)
+        _exit(run_daemon());
+
+    double *loss = calloc(rounds, sizeof(double)), *back = calloc(rounds, sizeof(double));
+    int done = 0, ret = EXIT_FAILURE;
+    uint64_t t0, t1;
+    if (!loss || !back) {
+        perror("calloc");
+        goto out;
+    }
+    // 守护进程启动后把VIP放在vfa0上
+    if (test_wait_garp(fds, 0, &t1) == -1) {
+        fprintf(stderr, "No initial GARP on %s\n", test_links[0][1]);
+        goto out;
+    }
+    for (; done < rounds; done++) {
+        test_drain(fds);
+        t0 = mono_ns();
+        test_set_up(ctl, test_links[0][1], 0);
+        if (test_wait_garp(fds, 1, &t1) == -1) {
+            fprintf(stderr, "Round %d: no GARP on %s after carrier loss\n", done, test_links[1][1]);
+            goto out;
+        }
+        loss[done] = (t1 - t0) / 1e6;
+        test_drain(fds);
+        t0 = mono_ns();
+        test_set_up(ctl, test_links[0][1], 1);
+        if (test_wait_garp(fds, 0, &t1) == -1) {
+            fprintf(stderr, "Round %d: no GARP on %s after carrier restore\n", done,
+                    test_links[0][1]);
+            goto out;
+        }
+        back[done] = (t1 - t0) / 1e6;
+    }
+    ret = EXIT_SUCCESS;
+out:
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    test_report("carrier loss -> GARP", loss, done);
+    test_report("carrier restore -> GARP", back, done);
+    free(loss);
+    free(back);
+    close(fds[0]);
+    close(fds[1]);
+    close(ctl);
+    nl_addr_put(vf.vip);
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    const char *vip = NULL;
+    int garp_ms = DEFAULT_GARP_MS, test_rounds = 0, opt;
+    vf.garp_count = DEFAULT_GARP_COUNT;
+    while ((opt = getopt(argc, argv, "a:nc:i:T:")) != -1) {
+        switch (opt) {
+        case 'T': test_rounds = atoi(optarg); break;
+        case 'a': vip = optarg; break;
+        case 'n': vf.preempt = 0; break;
+        case 'c': vf.garp_count = atoi(optarg); break;
+        case 'i': garp_ms = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (test_rounds > 0 && !vip && optind == argc)
+        return run_test(test_rounds);
+    if (!vip || optind == argc || argc - optind > MAX_CANDIDATES || garp_ms <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (nl_addr_parse(vip, AF_UNSPEC, &vf.vip) < 0 ||
+        (nl_addr_get_family(vf.vip) != AF_INET && nl_addr_get_family(vf.vip) != AF_INET6)) {
+        fprintf(stderr, "Invalid VIP: %s\n", vip);
+        return EXIT_FAILURE;
+    }
+    vf.family = nl_addr_get_family(vf.vip);
+    vf.garp_interval_ns = (uint64_t)garp_ms * 1000000ULL;
+    for (int i = optind; i < argc; i++)
+        snprintf(vf.cand[vf.ncand++].name, IF_NAMESIZE, "%s", argv[i]);
+    return run_daemon();
+}